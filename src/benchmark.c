@@ -0,0 +1,3303 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <drm_fourcc.h>
+#include <linux/dma-buf.h>
+
+#include "bufmgr.h"
+#include "common.h"
+#include "compositor.h"
+#include "convert.h"
+#include "damage.h"
+#include "dmabuf.h"
+#include "event_loop.h"
+#include "fb_pool.h"
+#include "fill.h"
+#include "format.h"
+#include "frame_hash.h"
+#include "frame_sched.h"
+#include "raster.h"
+#include "region.h"
+#include "render_pool.h"
+#include "scene_cache.h"
+#include "swapchain.h"
+#include "tiling.h"
+#include "gem_submission/lib.h"
+
+/*
+ * Headless benchmarks, everything runs on buffers allocated with malloc so
+ * no DRM device or display is needed. The few numbers that need a GPU are
+ * reported as n/a when DEFAULT_DRM_DEVICE can't be opened.
+ */
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+
+#define BOX_SIZE 100
+
+struct resolution {
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+};
+
+static const struct resolution resolutions[] = {
+	{ "1080p", 1920, 1080 },
+	{ "4K", 3840, 2160 },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int buf_alloc_format(struct modeset_buf *buf, uint32_t width, uint32_t height,
+			    uint32_t format, uint64_t modifier)
+{
+	memset(buf, 0, sizeof(*buf));
+	if (format_layout(format, modifier, width, height, buf->pitches, buf->offsets, &buf->size))
+		return -EINVAL;
+
+	buf->width = width;
+	buf->height = height;
+	buf->stride = buf->pitches[0];
+	buf->format = format;
+	buf->modifier = modifier;
+	buf->map_tiled = modifier != DRM_FORMAT_MOD_LINEAR;
+	buf->map = aligned_alloc(TILE_SIZE, buf->size);
+	if (!buf->map)
+		return -ENOMEM;
+
+	memset(buf->map, 0, buf->size);
+	return 0;
+}
+
+static int buf_alloc_tiled(struct modeset_buf *buf, uint32_t width, uint32_t height,
+			   uint64_t modifier)
+{
+	return buf_alloc_format(buf, width, height, DRM_FORMAT_XRGB8888, modifier);
+}
+
+static int buf_alloc(struct modeset_buf *buf, uint32_t width, uint32_t height)
+{
+	return buf_alloc_tiled(buf, width, height, DRM_FORMAT_MOD_LINEAR);
+}
+
+static void buf_free(struct modeset_buf *buf)
+{
+	free(buf->map);
+	buf->map = NULL;
+}
+
+static double gbps(uint64_t bytes, uint64_t ns)
+{
+	return ns ? (double)bytes / ns : 0;
+}
+
+static int bench_fill(void)
+{
+	const char *names[] = { "scalar", "sse2", "avx2", "avx512" };
+	const unsigned iterations = 20;
+	unsigned r, k, i;
+
+	printf("fill: fill_buffer() per kernel\n");
+	printf("%-8s %-8s %10s %10s\n", "size", "kernel", "ms/frame", "GB/s");
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		struct modeset_buf buf;
+
+		if (buf_alloc(&buf, resolutions[r].width, resolutions[r].height))
+			return -ENOMEM;
+
+		for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+			uint64_t start, elapsed;
+
+			if (fill_kernel_set(names[k])) {
+				printf("%-8s %-8s %10s\n", resolutions[r].name, names[k], "n/a");
+				continue;
+			}
+
+			start = now_ns();
+			for (i = 0; i < iterations; i++)
+				fill_buffer(&buf, fill_color(0, 0, 255, 0));
+			elapsed = now_ns() - start;
+
+			printf("%-8s %-8s %10.3f %10.2f\n", resolutions[r].name, names[k],
+			       (double)elapsed / iterations / NSEC_PER_MSEC,
+			       gbps((uint64_t)buf.size * iterations, elapsed));
+		}
+
+		buf_free(&buf);
+	}
+
+	/* back to the CPUID pick for the other benchmarks */
+	fill_kernel_set(NULL);
+	return 0;
+}
+
+/* The per-pixel loop move_box() used before the rasterizer */
+static void legacy_box(struct modeset_buf *buf, uint32_t box_x_start, uint32_t box_y_start)
+{
+	uint32_t y, box_y_end, box_x_end;
+
+	box_y_end = box_y_start + BOX_SIZE;
+	box_x_end = box_x_start + BOX_SIZE;
+
+	for (y = 0; y < buf->height; y++) {
+		uint32_t x;
+		uint32_t line_offset = buf->stride * y;
+
+		for (x = 0; x < buf->width; x++) {
+			// 32bpp = 4bytes
+			uint32_t pixel_offset = line_offset + (x * 4);
+			struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
+			p->red = 0;
+			p->green = 0;
+
+			if (y >= box_y_start && y < box_y_end && x >= box_x_start
+				&& x < box_x_end)
+				p->blue = 0;
+			else
+				p->blue = 255;
+		}
+	}
+}
+
+/* legacy_box() never writes the X byte, only the color bytes can match */
+static bool rgb_equal(const struct modeset_buf *a, const struct modeset_buf *b)
+{
+	uint32_t x, y;
+
+	for (y = 0; y < a->height; y++) {
+		const uint32_t *pa = (const uint32_t *)&a->map[a->stride * y];
+		const uint32_t *pb = (const uint32_t *)&b->map[b->stride * y];
+
+		for (x = 0; x < a->width; x++) {
+			if ((pa[x] ^ pb[x]) & 0x00ffffff)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static int bench_raster(void)
+{
+	const unsigned iterations = 10;
+	unsigned r, i;
+
+	printf("raster: moving %ux%u box, per-pixel loop vs raster_draw()\n", BOX_SIZE, BOX_SIZE);
+	printf("%-8s %12s %12s %8s %s\n", "size", "legacy ms", "raster ms", "speedup", "output");
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		struct modeset_buf legacy, raster;
+		uint64_t start, legacy_ns, raster_ns;
+		bool identical = true;
+
+		if (buf_alloc(&legacy, resolutions[r].width, resolutions[r].height))
+			return -ENOMEM;
+		if (buf_alloc(&raster, resolutions[r].width, resolutions[r].height)) {
+			buf_free(&legacy);
+			return -ENOMEM;
+		}
+		/* as cleared by _create_buffer(), the X byte differs from the start */
+		memset(legacy.map, 0x77, legacy.size);
+		memset(raster.map, 0x77, raster.size);
+
+		start = now_ns();
+		for (i = 0; i < iterations; i++)
+			legacy_box(&legacy, i * 33, i * 11);
+		legacy_ns = now_ns() - start;
+
+		start = now_ns();
+		for (i = 0; i < iterations; i++) {
+			struct raster_rect box = {
+				.x = i * 33,
+				.y = i * 11,
+				.w = BOX_SIZE,
+				.h = BOX_SIZE,
+				.color = fill_color(0, 0, 0, 0),
+			};
+
+			raster_draw(&raster, fill_color(0, 0, 255, 0), &box, 1);
+		}
+		raster_ns = now_ns() - start;
+
+		/* last frame of both must match, including a box clipped at the edge */
+		identical = rgb_equal(&legacy, &raster);
+		if (identical) {
+			struct raster_rect box = {
+				.x = legacy.width - BOX_SIZE / 2,
+				.y = legacy.height - BOX_SIZE / 2,
+				.w = BOX_SIZE,
+				.h = BOX_SIZE,
+				.color = fill_color(0, 0, 0, 0),
+			};
+
+			legacy_box(&legacy, box.x, box.y);
+			raster_draw(&raster, fill_color(0, 0, 255, 0), &box, 1);
+			identical = rgb_equal(&legacy, &raster);
+		}
+
+		printf("%-8s %12.3f %12.3f %7.1fx %s\n", resolutions[r].name,
+		       (double)legacy_ns / iterations / NSEC_PER_MSEC,
+		       (double)raster_ns / iterations / NSEC_PER_MSEC,
+		       raster_ns ? (double)legacy_ns / raster_ns : 0,
+		       identical ? "identical" : "MISMATCH");
+
+		buf_free(&legacy);
+		buf_free(&raster);
+
+		if (!identical)
+			return -1;
+	}
+
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	uint64_t modifier;
+	uint32_t gem_tiling;
+} tilings[] = {
+	{ "X", I915_FORMAT_MOD_X_TILED, I915_TILING_X },
+	{ "Y", I915_FORMAT_MOD_Y_TILED, I915_TILING_Y },
+};
+
+static bool rows_equal(struct modeset_buf *a, struct modeset_buf *b)
+{
+	uint32_t y;
+
+	for (y = 0; y < a->height; y++) {
+		if (memcmp(&a->map[a->stride * y], &b->map[b->stride * y], a->width * 4))
+			return false;
+	}
+
+	return true;
+}
+
+/* Check the converters and the tiled fill against tiling_offset() */
+static int tiling_validate(uint64_t modifier)
+{
+	const uint32_t width = 1000, height = 101;
+	struct modeset_buf linear, tiled, back;
+	uint32_t x, y, i;
+	int ret = -1;
+
+	if (buf_alloc(&linear, width, height))
+		return -ENOMEM;
+	if (buf_alloc_tiled(&tiled, width, height, modifier))
+		goto err_tiled;
+	if (buf_alloc(&back, width, height))
+		goto err_back;
+
+	for (i = 0; i < linear.size; i++)
+		linear.map[i] = rand();
+
+	tiling_linear_to_tiled(modifier, tiled.map, tiled.stride, linear.map, linear.stride,
+			       width * 4, height);
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width * 4; x++) {
+			uint32_t offset = tiling_offset(modifier, tiled.stride, x, y);
+
+			if (tiled.map[offset] != linear.map[y * linear.stride + x])
+				goto err;
+		}
+	}
+
+	tiling_tiled_to_linear(modifier, back.map, back.stride, tiled.map, tiled.stride,
+			       width * 4, height);
+	if (!rows_equal(&back, &linear))
+		goto err;
+
+	for (i = 0; i < 64; i++) {
+		uint32_t rx = rand() % width, ry = rand() % height;
+		uint32_t rw = rand() % 300 + 1, rh = rand() % 70 + 1, color = rand();
+
+		fill_rect(&linear, rx, ry, rw, rh, color);
+		fill_rect(&tiled, rx, ry, rw, rh, color);
+	}
+	tiling_tiled_to_linear(modifier, back.map, back.stride, tiled.map, tiled.stride,
+			       width * 4, height);
+	if (!rows_equal(&back, &linear))
+		goto err;
+
+	ret = 0;
+err:
+	buf_free(&back);
+err_back:
+	buf_free(&tiled);
+err_tiled:
+	buf_free(&linear);
+	return ret;
+}
+
+/* BO mapped through the GTT, write-combined and detiled by the fence */
+static int gtt_buf_alloc(int drm_fd, struct modeset_buf *buf, uint32_t width, uint32_t height,
+			 uint32_t gem_tiling, uint64_t modifier)
+{
+	uint32_t tile_width, tile_height, handle;
+
+	if (tiling_tile_size(modifier, &tile_width, &tile_height)) {
+		tile_width = 64;
+		tile_height = 1;
+	}
+
+	memset(buf, 0, sizeof(*buf));
+	buf->width = width;
+	buf->height = height;
+	buf->stride = (width * 4 + tile_width - 1) / tile_width * tile_width;
+	buf->format = DRM_FORMAT_XRGB8888;
+	buf->size = buf->stride * ((height + tile_height - 1) / tile_height * tile_height);
+	buf->modifier = modifier;
+	buf->map_wc = true;
+
+	if (gem_buffer_create(drm_fd, buf->size, &handle))
+		return -1;
+	if (gem_tiling != I915_TILING_NONE &&
+	    gem_set_tiling(drm_fd, handle, gem_tiling, buf->stride))
+		goto err;
+	buf->map = gem_buffer_mmap(drm_fd, handle, buf->size);
+	if (!buf->map)
+		goto err;
+	gem_set_domain(drm_fd, handle, I915_GEM_DOMAIN_GTT, I915_GEM_DOMAIN_GTT);
+	buf->handle = handle;
+
+	return 0;
+
+err:
+	gem_buffer_destroy(drm_fd, handle);
+	return -1;
+}
+
+static void gtt_buf_free(int drm_fd, struct modeset_buf *buf)
+{
+	gem_buffer_unmap(drm_fd, buf->map, buf->size);
+	gem_buffer_destroy(drm_fd, buf->handle);
+	buf->map = NULL;
+}
+
+/* Linear writes through a fenced GTT mapping of a tiled BO */
+static double tiling_gtt_gbps(int drm_fd, uint32_t gem_tiling, uint64_t modifier,
+			      uint32_t width, uint32_t height, unsigned iterations)
+{
+	struct modeset_buf buf;
+	uint64_t start, elapsed;
+	unsigned i;
+
+	if (gtt_buf_alloc(drm_fd, &buf, width, height, gem_tiling, modifier))
+		return 0;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		fill_buffer(&buf, fill_color(0, 0, 255, 0));
+	elapsed = now_ns() - start;
+
+	gtt_buf_free(drm_fd, &buf);
+	return gbps((uint64_t)width * height * 4 * iterations, elapsed);
+}
+
+static int bench_tiling(void)
+{
+	const unsigned iterations = 10;
+	unsigned r, t, i;
+	int drm_fd;
+
+	printf("tiling: CPU tiling vs linear writes through a GTT fence\n");
+
+	for (t = 0; t < sizeof(tilings) / sizeof(tilings[0]); t++) {
+		int ret = tiling_validate(tilings[t].modifier);
+
+		printf("%s tiled swizzle vs reference: %s\n", tilings[t].name, ret ? "MISMATCH" : "ok");
+		if (ret)
+			return -1;
+	}
+
+	drm_fd = open(DEFAULT_DRM_DEVICE, O_RDWR | O_CLOEXEC);
+
+	printf("%-8s %-6s %12s %12s %12s %12s\n", "size", "tiling", "to tiled", "to linear",
+	       "tiled fill", "GTT fill");
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		for (t = 0; t < sizeof(tilings) / sizeof(tilings[0]); t++) {
+			uint32_t width = resolutions[r].width, height = resolutions[r].height;
+			uint64_t bytes = (uint64_t)width * height * 4 * iterations;
+			uint64_t start, to_tiled, to_linear, tiled_fill;
+			struct modeset_buf linear, tiled;
+			double gtt = 0;
+
+			if (buf_alloc(&linear, width, height))
+				return -ENOMEM;
+			if (buf_alloc_tiled(&tiled, width, height, tilings[t].modifier)) {
+				buf_free(&linear);
+				return -ENOMEM;
+			}
+
+			start = now_ns();
+			for (i = 0; i < iterations; i++)
+				tiling_linear_to_tiled(tiled.modifier, tiled.map, tiled.stride,
+						       linear.map, linear.stride, width * 4, height);
+			to_tiled = now_ns() - start;
+
+			start = now_ns();
+			for (i = 0; i < iterations; i++)
+				tiling_tiled_to_linear(tiled.modifier, linear.map, linear.stride,
+						       tiled.map, tiled.stride, width * 4, height);
+			to_linear = now_ns() - start;
+
+			start = now_ns();
+			for (i = 0; i < iterations; i++)
+				fill_buffer(&tiled, fill_color(0, 0, 255, 0));
+			tiled_fill = now_ns() - start;
+
+			if (drm_fd >= 0)
+				gtt = tiling_gtt_gbps(drm_fd, tilings[t].gem_tiling, tilings[t].modifier,
+						      width, height, iterations);
+
+			printf("%-8s %-6s %9.2fGB/s %9.2fGB/s %9.2fGB/s ", resolutions[r].name,
+			       tilings[t].name, gbps(bytes, to_tiled), gbps(bytes, to_linear),
+			       gbps(bytes, tiled_fill));
+			if (gtt)
+				printf("%9.2fGB/s\n", gtt);
+			else
+				printf("%12s\n", "n/a");
+
+			buf_free(&linear);
+			buf_free(&tiled);
+		}
+	}
+
+	if (drm_fd >= 0)
+		close(drm_fd);
+
+	return 0;
+}
+
+/* Uneven frame: the top quarter is overdrawn 8 times, like busy content */
+static void pool_band(struct modeset_buf *buf, uint32_t y_start, uint32_t y_end, void *data)
+{
+	const struct raster_rect *box = data;
+	unsigned i, passes = y_start < buf->height / 4 ? 8 : 1;
+
+	for (i = 0; i < passes; i++)
+		raster_draw_rows(buf, fill_color(0, 0, 255, 0), box, 1, y_start, y_end);
+}
+
+static int bench_pool(void)
+{
+	const unsigned iterations = 20;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned max_threads = cpus > 4 ? cpus * 2 : 8;
+	struct raster_rect box = {
+		.x = 500,
+		.y = 300,
+		.w = BOX_SIZE,
+		.h = BOX_SIZE,
+		.color = fill_color(0, 0, 0, 0),
+	};
+	struct modeset_buf buf;
+	double single = 0;
+	unsigned threads, i;
+
+	printf("pool: row band rendering of an uneven 4K frame, %ld CPUs online\n", cpus);
+	printf("%-8s %12s %8s %10s\n", "threads", "ms/frame", "speedup", "GB/s");
+
+	if (buf_alloc(&buf, 3840, 2160))
+		return -ENOMEM;
+
+	for (threads = 1; threads <= max_threads; threads *= 2) {
+		struct render_pool *pool = render_pool_create(threads);
+		uint64_t start, elapsed;
+		double ms;
+
+		if (!pool) {
+			buf_free(&buf);
+			return -ENOMEM;
+		}
+
+		/* warm up the threads and the buffer pages */
+		render_pool_frame(pool, &buf, pool_band, &box);
+
+		start = now_ns();
+		for (i = 0; i < iterations; i++)
+			render_pool_frame(pool, &buf, pool_band, &box);
+		elapsed = now_ns() - start;
+		render_pool_destroy(pool);
+
+		ms = (double)elapsed / iterations / NSEC_PER_MSEC;
+		if (threads == 1)
+			single = ms;
+		printf("%-8u %12.3f %7.2fx %10.2f\n", threads, ms, single / ms,
+		       gbps((uint64_t)buf.size * 11 / 4 * iterations, elapsed));
+	}
+
+	buf_free(&buf);
+	return 0;
+}
+
+#define RING_SIZE 3
+
+/* One frame of the box moving like move_box() does, repainting only the damage */
+static void damage_frame(struct modeset_buf *ring, unsigned frame, struct raster_rect *box,
+			 uint64_t *pixels)
+{
+	struct modeset_buf *back = &ring[frame % RING_SIZE];
+	struct damage damage, repaint;
+
+	damage_clear(&damage);
+	damage_add_rect(&damage, box->x, box->y, box->w, box->h);
+
+	box->x += BOX_SIZE / 3;
+	if (box->x + BOX_SIZE > back->width) {
+		box->x = 0;
+		box->y = (box->y + BOX_SIZE / 3) % (back->height - BOX_SIZE);
+	}
+	damage_add_rect(&damage, box->x, box->y, box->w, box->h);
+
+	damage_buffer_repaint(back, &damage, &repaint);
+	raster_draw_damage(back, fill_color(0, 0, 255, 0), box, 1, &repaint);
+	damage_buffers_swap(ring, RING_SIZE, back, &damage);
+
+	/* the first pass over the ring repaints everything, not counted */
+	if (frame >= RING_SIZE)
+		*pixels += damage_area(&repaint);
+}
+
+static int bench_damage(void)
+{
+	const unsigned frames = 300 + RING_SIZE;
+	unsigned r, i;
+
+	printf("damage: moving %ux%u box on a %u buffers ring, full vs damage repaint\n",
+	       BOX_SIZE, BOX_SIZE, RING_SIZE);
+	printf("%-8s %12s %12s %12s %12s %s\n", "size", "full ms", "damage ms", "full px",
+	       "damage px", "output");
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		uint32_t width = resolutions[r].width, height = resolutions[r].height;
+		struct modeset_buf full[RING_SIZE], ring[RING_SIZE];
+		struct raster_rect full_box = { 0, 0, BOX_SIZE, BOX_SIZE, fill_color(0, 0, 0, 0) };
+		struct raster_rect box = full_box;
+		uint64_t start, full_ns = 0, damage_ns = 0, pixels = 0;
+		bool identical = true;
+		unsigned allocated = 0;
+		int ret = 0;
+
+		for (i = 0; i < RING_SIZE; i++, allocated++) {
+			if (buf_alloc(&full[i], width, height))
+				break;
+			if (buf_alloc(&ring[i], width, height)) {
+				buf_free(&full[i]);
+				break;
+			}
+		}
+		if (allocated < RING_SIZE) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		for (i = 0; i < frames; i++) {
+			struct modeset_buf *back = &full[i % RING_SIZE];
+
+			uint64_t full_frame_ns, damage_frame_ns;
+
+			start = now_ns();
+			full_box.x += BOX_SIZE / 3;
+			if (full_box.x + BOX_SIZE > width) {
+				full_box.x = 0;
+				full_box.y = (full_box.y + BOX_SIZE / 3) % (height - BOX_SIZE);
+			}
+			raster_draw(back, fill_color(0, 0, 255, 0), &full_box, 1);
+			full_frame_ns = now_ns() - start;
+
+			start = now_ns();
+			damage_frame(ring, i, &box, &pixels);
+			damage_frame_ns = now_ns() - start;
+
+			if (i >= RING_SIZE) {
+				full_ns += full_frame_ns;
+				damage_ns += damage_frame_ns;
+			}
+
+			if (identical && !rows_equal(back, &ring[i % RING_SIZE]))
+				identical = false;
+		}
+
+		printf("%-8s %12.3f %12.3f %12u %12" PRIu64 " %s, %.0fx fewer writes\n",
+		       resolutions[r].name, (double)full_ns / (frames - RING_SIZE) / NSEC_PER_MSEC,
+		       (double)damage_ns / (frames - RING_SIZE) / NSEC_PER_MSEC, width * height,
+		       pixels / (frames - RING_SIZE), identical ? "identical" : "MISMATCH",
+		       pixels ? (double)width * height * (frames - RING_SIZE) / pixels : 0);
+		if (!identical)
+			ret = -1;
+
+out:
+		for (i = 0; i < allocated; i++) {
+			buf_free(&full[i]);
+			buf_free(&ring[i]);
+		}
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Fake drmModeDirtyFB(), records the last clip list */
+static struct {
+	unsigned calls;
+	unsigned count;
+	struct drm_clip_rect clips[DAMAGE_MAX_RECTS];
+} fake_dirty;
+
+static int fake_dirty_fb(int fd UNUSED, uint32_t fb UNUSED, drmModeClipPtr clips,
+			 uint32_t num_clips)
+{
+	fake_dirty.calls++;
+	fake_dirty.count = num_clips;
+	if (num_clips > DAMAGE_MAX_RECTS)
+		return -EINVAL;
+	memcpy(fake_dirty.clips, clips, num_clips * sizeof(*clips));
+	return 0;
+}
+
+static void mask_rect(uint8_t *mask, uint32_t width, uint32_t height,
+		      uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2)
+{
+	uint32_t y;
+
+	if (x2 > width)
+		x2 = width;
+	if (y2 > height)
+		y2 = height;
+	for (y = y1; y < y2 && x1 < x2; y++)
+		memset(&mask[y * width + x1], 1, x2 - x1);
+}
+
+static const struct {
+	const char *name;
+	unsigned max_clips;
+	uint64_t slack;
+} dirty_configs[] = {
+	{ "1 clip", 1, 0 },
+	{ "4 exact", 4, 0 },
+	{ "default", DAMAGE_FLUSH_MAX_CLIPS, DAMAGE_FLUSH_SLACK },
+	{ "16 exact", 16, 0 },
+};
+
+/*
+ * Draw the scene with fill_rect() and flush it, the clip list must cover
+ * every drawn pixel and respect the clip cap.
+ */
+static int dirty_scene(const char *scene, const struct raster_rect *rects, unsigned count)
+{
+	const uint32_t width = 1920, height = 1080;
+	uint8_t *drawn, *refreshed;
+	struct modeset_buf buf;
+	unsigned c, i;
+	int ret = 0;
+
+	if (buf_alloc(&buf, width, height))
+		return -ENOMEM;
+	drawn = calloc(width, height);
+	refreshed = calloc(width, height);
+	if (!drawn || !refreshed) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (c = 0; c < sizeof(dirty_configs) / sizeof(dirty_configs[0]); c++) {
+		uint64_t drawn_px = 0, refreshed_px = 0;
+		bool covered = true;
+		unsigned p;
+
+		memset(drawn, 0, width * height);
+		memset(refreshed, 0, width * height);
+		damage_flush_config(dirty_configs[c].max_clips, dirty_configs[c].slack);
+		fake_dirty.calls = 0;
+
+		/* nothing drawn, nothing sent */
+		damage_flush(-1, &buf);
+
+		for (i = 0; i < count; i++) {
+			const struct raster_rect *r = &rects[i];
+
+			fill_rect(&buf, r->x, r->y, r->w, r->h, r->color);
+			mask_rect(drawn, width, height, r->x, r->y, r->x + r->w, r->y + r->h);
+		}
+		damage_flush(-1, &buf);
+
+		for (i = 0; i < fake_dirty.count; i++) {
+			const struct drm_clip_rect *clip = &fake_dirty.clips[i];
+
+			mask_rect(refreshed, width, height, clip->x1, clip->y1, clip->x2, clip->y2);
+		}
+		for (p = 0; p < width * height; p++) {
+			drawn_px += drawn[p];
+			refreshed_px += refreshed[p];
+			if (drawn[p] && !refreshed[p])
+				covered = false;
+		}
+
+		if (fake_dirty.calls != 1 || fake_dirty.count > dirty_configs[c].max_clips)
+			covered = false;
+
+		printf("%-8s %-9s %6u %12" PRIu64 " %12" PRIu64 " %7.2f%% %s\n", scene,
+		       dirty_configs[c].name, fake_dirty.count, refreshed_px,
+		       refreshed_px - drawn_px, 100.0 * refreshed_px / (width * height),
+		       covered ? "ok" : "MISMATCH");
+		if (!covered)
+			ret = -1;
+	}
+
+out:
+	free(drawn);
+	free(refreshed);
+	buf_free(&buf);
+	return ret;
+}
+
+static int bench_dirty(void)
+{
+	struct raster_rect box[2] = {
+		{ 900, 500, BOX_SIZE, BOX_SIZE, fill_color(0, 0, 255, 0) },
+		{ 933, 500, BOX_SIZE, BOX_SIZE, fill_color(0, 0, 0, 0) },
+	};
+	struct raster_rect scattered[12];
+	unsigned i;
+	int ret;
+
+	printf("dirty: drmModeDirtyFB() clip lists against a fake ioctl, 1080p\n");
+	printf("%-8s %-9s %6s %12s %12s %8s %s\n", "scene", "merge", "clips", "refresh px",
+	       "overdraw px", "screen", "coverage");
+
+	damage_flush_backend_set(fake_dirty_fb);
+
+	srand(1);
+	for (i = 0; i < sizeof(scattered) / sizeof(scattered[0]); i++) {
+		scattered[i] = (struct raster_rect){
+			.x = rand() % 1800,
+			.y = rand() % 1000,
+			.w = 16 + rand() % 100,
+			.h = 16 + rand() % 60,
+			.color = rand(),
+		};
+	}
+
+	ret = dirty_scene("box", box, 2);
+	if (!ret)
+		ret = dirty_scene("scatter", scattered, sizeof(scattered) / sizeof(scattered[0]));
+
+	damage_flush_config(DAMAGE_FLUSH_MAX_CLIPS, DAMAGE_FLUSH_SLACK);
+	damage_flush_backend_set(NULL);
+	return ret;
+}
+
+#define REGION_GRID 256
+
+static bool region_valid(const struct region *region)
+{
+	uint32_t i;
+
+	for (i = 0; i < region->count; i++) {
+		const struct region_box *box = &region->boxes[i];
+
+		if (box->x1 >= box->x2 || box->y1 >= box->y2)
+			return false;
+		if (!i)
+			continue;
+
+		/* same band: sorted and not touching, next band: below */
+		if (box->y1 == box[-1].y1) {
+			if (box->y2 != box[-1].y2 || box->x1 <= box[-1].x2)
+				return false;
+		} else if (box->y1 < box[-1].y2) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void region_mask(const struct region *region, uint8_t *mask)
+{
+	uint32_t i;
+
+	memset(mask, 0, REGION_GRID * REGION_GRID);
+	for (i = 0; i < region->count; i++) {
+		const struct region_box *box = &region->boxes[i];
+		int32_t y;
+
+		for (y = box->y1; y < box->y2; y++)
+			memset(&mask[y * REGION_GRID + box->x1], 1, box->x2 - box->x1);
+	}
+}
+
+static int region_random(struct region *region, struct region_arena *arena, unsigned rects,
+			 uint32_t size, uint32_t max_rect)
+{
+	unsigned i;
+
+	region_init(region, arena);
+	for (i = 0; i < rects; i++) {
+		uint32_t w = 1 + rand() % max_rect, h = 1 + rand() % max_rect;
+
+		if (region_union_rect(region, region, rand() % (size - w), rand() % (size - h), w, h))
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/* Random operations checked pixel by pixel against a bitmap */
+static int region_validate(void)
+{
+	static uint8_t ma[REGION_GRID * REGION_GRID], mb[REGION_GRID * REGION_GRID];
+	static uint8_t mr[REGION_GRID * REGION_GRID];
+	struct region_arena arena;
+	unsigned iter, p;
+	int ret = 0;
+
+	if (region_arena_init(&arena, 0))
+		return -ENOMEM;
+
+	for (iter = 0; iter < 500 && !ret; iter++) {
+		struct region a, b, r, copy;
+		unsigned op = iter % 4;
+
+		region_arena_reset(&arena);
+		if (region_random(&a, &arena, 1 + rand() % 20, REGION_GRID / 2, 60) ||
+		    region_random(&b, &arena, 1 + rand() % 20, REGION_GRID / 2, 60)) {
+			ret = -ENOMEM;
+			break;
+		}
+		region_mask(&a, ma);
+		region_mask(&b, mb);
+		region_init(&r, &arena);
+
+		switch (op) {
+		case 0:
+			ret = region_union(&r, &a, &b);
+			break;
+		case 1:
+			ret = region_intersect(&r, &a, &b);
+			break;
+		case 2:
+			ret = region_subtract(&r, &a, &b);
+			break;
+		case 3:
+			region_init(&copy, &arena);
+			ret = region_copy(&copy, &a);
+			region_translate(&copy, 100, 70);
+			ret |= region_union(&r, &copy, &b);
+			for (p = REGION_GRID * REGION_GRID; p-- > 0;)
+				ma[p] = (p % REGION_GRID >= 100 && p / REGION_GRID >= 70) ?
+					ma[p - 70 * REGION_GRID - 100] : 0;
+			break;
+		}
+		if (ret || !region_valid(&r)) {
+			ret = -1;
+			break;
+		}
+
+		region_mask(&r, mr);
+		for (p = 0; p < REGION_GRID * REGION_GRID; p++) {
+			uint8_t expected;
+
+			if (op == 1)
+				expected = ma[p] && mb[p];
+			else if (op == 2)
+				expected = ma[p] && !mb[p];
+			else
+				expected = ma[p] || mb[p];
+
+			if (mr[p] != expected ||
+			    region_contains_point(&r, p % REGION_GRID, p / REGION_GRID) != expected) {
+				ret = -1;
+				break;
+			}
+		}
+
+		/* simplify keeps covering the region with at most n boxes */
+		if (!ret) {
+			uint32_t max_rects = 1 + rand() % 8;
+
+			region_init(&copy, &arena);
+			if (region_copy(&copy, &r) || region_simplify(&copy, max_rects) ||
+			    !region_valid(&copy) || copy.count > max_rects) {
+				ret = -1;
+				break;
+			}
+			region_mask(&copy, ma);
+			for (p = 0; p < REGION_GRID * REGION_GRID; p++) {
+				if (mr[p] && !ma[p])
+					ret = -1;
+			}
+		}
+	}
+
+	region_arena_fini(&arena);
+	return ret;
+}
+
+static int bench_region(void)
+{
+	const unsigned sizes[] = { 1000, 4000 }, iterations = 20;
+	struct region_box *rects;
+	struct region_arena arena;
+	unsigned s, i, j;
+	int ret;
+
+	printf("region: banded region ops, validation against a bitmap: ");
+	ret = region_validate();
+	printf("%s\n", ret ? "MISMATCH" : "ok");
+	if (ret)
+		return ret;
+
+	printf("%-6s %8s %10s %10s %10s %10s %10s %10s %s\n", "rects", "boxes", "build ms",
+	       "union us", "inter us", "sub us", "transl us", "simpl us", "arena");
+
+	rects = malloc(2 * sizes[1] * sizeof(*rects));
+	if (!rects || region_arena_init(&arena, 0)) {
+		free(rects);
+		return -ENOMEM;
+	}
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		uint64_t start, build = 0, ops[5] = { 0 };
+		size_t arena_size = 0;
+		uint32_t boxes = 0;
+
+		for (i = 0; i < iterations; i++) {
+			struct region a, b, r;
+
+			/* a frame: everything is dropped at once */
+			region_arena_reset(&arena);
+			if (i == 1)
+				arena_size = arena.size;
+
+			srand(s);
+			for (j = 0; j < 2 * sizes[s]; j++) {
+				int32_t x = rand() % 3640, y = rand() % 1960;
+
+				rects[j] = (struct region_box){
+					x, y, x + 1 + rand() % 200, y + 1 + rand() % 200
+				};
+			}
+
+			start = now_ns();
+			if (region_init_boxes(&a, &arena, rects, sizes[s]) ||
+			    region_init_boxes(&b, &arena, rects + sizes[s], sizes[s])) {
+				region_arena_fini(&arena);
+				free(rects);
+				return -ENOMEM;
+			}
+			build += now_ns() - start;
+			boxes = a.count;
+			region_init(&r, &arena);
+
+			start = now_ns();
+			region_union(&r, &a, &b);
+			ops[0] += now_ns() - start;
+
+			start = now_ns();
+			region_intersect(&r, &a, &b);
+			ops[1] += now_ns() - start;
+
+			start = now_ns();
+			region_subtract(&r, &a, &b);
+			ops[2] += now_ns() - start;
+
+			start = now_ns();
+			region_translate(&a, 10, -10);
+			ops[3] += now_ns() - start;
+
+			start = now_ns();
+			region_simplify(&r, 16);
+			ops[4] += now_ns() - start;
+		}
+
+		printf("%-6u %8u %10.3f %10.1f %10.1f %10.1f %10.1f %10.1f %zuKiB%s\n", sizes[s],
+		       boxes, (double)build / iterations / NSEC_PER_MSEC,
+		       (double)ops[0] / iterations / 1000, (double)ops[1] / iterations / 1000,
+		       (double)ops[2] / iterations / 1000, (double)ops[3] / iterations / 1000,
+		       (double)ops[4] / iterations / 1000, arena.size / 1024,
+		       arena.size == arena_size ? "" : " (grew after the first frame)");
+	}
+
+	region_arena_fini(&arena);
+	free(rects);
+	return 0;
+}
+
+static int scene_buffer_alloc(void *data UNUSED, struct modeset_buf *buf, uint32_t width,
+			      uint32_t height, uint32_t format UNUSED, uint64_t modifier)
+{
+	return buf_alloc_tiled(buf, width, height, modifier);
+}
+
+static void scene_buffer_free(void *data UNUSED, struct modeset_buf *buf)
+{
+	buf_free(buf);
+}
+
+static const struct scene_buffer_ops scene_buffer_ops = {
+	.alloc = scene_buffer_alloc,
+	.free = scene_buffer_free,
+};
+
+static void scene_half(struct scene *scene, uint32_t width, uint32_t height, uint32_t right)
+{
+	scene_init(scene, width, height, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR,
+		   fill_color(0, 0, 255, 0));
+	scene_add_rect(scene, width / 2, 0, width - width / 2, height, right);
+}
+
+static int scene_lru(void)
+{
+	const uint32_t width = 1920, height = 1080;
+	struct scene_cache_stats stats;
+	struct scene_cache *cache;
+	struct modeset_buf *pinned, *buf;
+	struct scene scenes[3];
+	unsigned i, round;
+	int ret = 0;
+
+	/* room for two of the three scenes */
+	cache = scene_cache_create((size_t)width * height * 4 * 2, &scene_buffer_ops, NULL);
+	if (!cache)
+		return -ENOMEM;
+
+	for (i = 0; i < 3; i++)
+		scene_half(&scenes[i], width, height, fill_color(i * 100, 255, 0, 0));
+
+	/* scene 0 stays on screen the whole time, 1 and 2 take turns in the other slot */
+	pinned = scene_cache_get(cache, &scenes[0]);
+	for (round = 0; round < 4 && pinned; round++) {
+		buf = scene_cache_get(cache, &scenes[1 + round % 2]);
+		scene_cache_put(cache, buf);
+		buf = scene_cache_get(cache, &scenes[0]);
+		if (buf != pinned)
+			ret = -1;
+		scene_cache_put(cache, buf);
+	}
+	scene_cache_put(cache, pinned);
+
+	scene_cache_stats_get(cache, &stats);
+	printf("LRU, budget 2 frames, 3 scenes, scene 0 pinned: %" PRIu64 " hits %" PRIu64
+	       " misses %" PRIu64 " evictions, %u entries: %s\n", stats.hits, stats.misses,
+	       stats.evictions, stats.entries,
+	       !ret && pinned && stats.entries == 2 && stats.evictions == 3 ? "ok" : "MISMATCH");
+	if (!pinned || stats.entries != 2 || stats.evictions != 3)
+		ret = -1;
+
+	scene_cache_destroy(cache);
+	return ret;
+}
+
+/* The system memory copy is XRGB8888, other layouts must be refused */
+static int scene_copy_formats(void)
+{
+	const struct {
+		uint32_t format;
+		int ret;
+	} formats[] = {
+		{ DRM_FORMAT_XRGB8888, 0 },
+		{ DRM_FORMAT_ARGB8888, 0 },
+		{ DRM_FORMAT_ABGR8888, -EINVAL },
+		{ DRM_FORMAT_XRGB2101010, -EINVAL },
+	};
+	const uint32_t width = 64, height = 64;
+	struct scene_cache *cache;
+	struct scene scene;
+	unsigned i;
+	int ret = 0;
+
+	cache = scene_cache_create(SIZE_MAX, &scene_buffer_ops, NULL);
+	if (!cache)
+		return -ENOMEM;
+	scene_half(&scene, width, height, fill_color(0, 255, 0, 0));
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		struct modeset_buf dst;
+		int copied;
+
+		if (buf_alloc_format(&dst, width, height, formats[i].format, DRM_FORMAT_MOD_LINEAR)) {
+			ret = -ENOMEM;
+			break;
+		}
+		copied = scene_cache_copy(cache, &scene, &dst);
+		buf_free(&dst);
+
+		printf("copy of an XRGB8888 scene into %s: %s\n",
+		       format_info_get(formats[i].format)->name,
+		       copied == formats[i].ret ? (copied ? "refused" : "ok") : "MISMATCH");
+		if (copied != formats[i].ret)
+			ret = -1;
+	}
+
+	scene_cache_destroy(cache);
+	return ret;
+}
+
+static int bench_scene(void)
+{
+	const unsigned iterations = 20;
+	unsigned r, i;
+
+	printf("scene: static frame cache, half blue half green frame\n");
+	printf("%-8s %10s %10s %10s %10s %10s %s\n", "size", "render ms", "miss ms", "flip us",
+	       "copy ms", "copy GB/s", "output");
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		uint32_t width = resolutions[r].width, height = resolutions[r].height;
+		uint64_t start, render, miss, hit, copy;
+		struct modeset_buf direct, dst, *buf;
+		struct scene_cache *cache;
+		struct scene scene;
+		bool identical;
+
+		cache = scene_cache_create(SIZE_MAX, &scene_buffer_ops, NULL);
+		if (!cache || buf_alloc(&direct, width, height))
+			return -ENOMEM;
+		if (buf_alloc(&dst, width, height)) {
+			buf_free(&direct);
+			return -ENOMEM;
+		}
+		scene_half(&scene, width, height, fill_color(0, 255, 0, 0));
+
+		start = now_ns();
+		for (i = 0; i < iterations; i++)
+			raster_draw(&direct, scene.background, scene.rects, scene.count);
+		render = now_ns() - start;
+
+		start = now_ns();
+		buf = scene_cache_get(cache, &scene);
+		miss = now_ns() - start;
+		scene_cache_put(cache, buf);
+
+		/* a hit only hands out the framebuffer, the caller flips to it */
+		start = now_ns();
+		for (i = 0; i < iterations; i++)
+			scene_cache_put(cache, scene_cache_get(cache, &scene));
+		hit = now_ns() - start;
+
+		/* first copy renders the system memory copy */
+		scene_cache_copy(cache, &scene, &dst);
+		start = now_ns();
+		for (i = 0; i < iterations; i++)
+			scene_cache_copy(cache, &scene, &dst);
+		copy = now_ns() - start;
+
+		identical = buf && rows_equal(&direct, buf) && rows_equal(&direct, &dst);
+		printf("%-8s %10.3f %10.3f %10.3f %10.3f %10.2f %s\n", resolutions[r].name,
+		       (double)render / iterations / NSEC_PER_MSEC, (double)miss / NSEC_PER_MSEC,
+		       (double)hit / iterations / 1000, (double)copy / iterations / NSEC_PER_MSEC,
+		       gbps((uint64_t)width * height * 4 * iterations, copy),
+		       identical ? "identical" : "MISMATCH");
+
+		buf_free(&dst);
+		buf_free(&direct);
+		scene_cache_destroy(cache);
+		if (!identical)
+			return -1;
+	}
+
+	if (scene_copy_formats())
+		return -1;
+
+	return scene_lru();
+}
+
+#define COMPOSITOR_WINDOWS 8
+#define CURSOR_SIZE 64
+
+struct compositor_scene {
+	struct compositor *compositor;
+	struct layer *background;
+	struct layer *windows[COMPOSITOR_WINDOWS];
+	struct layer *image;
+	struct layer *cursor;
+	struct modeset_buf image_buf, cursor_buf;
+};
+
+static void compositor_scene_fini(struct compositor_scene *cs)
+{
+	compositor_destroy(cs->compositor);
+	buf_free(&cs->cursor_buf);
+	buf_free(&cs->image_buf);
+}
+
+/* Gradient image and a round cursor with soft edges */
+static int compositor_scene_init(struct compositor_scene *cs, uint32_t width, uint32_t height)
+{
+	uint32_t x, y, i;
+
+	memset(cs, 0, sizeof(*cs));
+	if (buf_alloc(&cs->image_buf, width / 4, height / 4) ||
+	    buf_alloc(&cs->cursor_buf, CURSOR_SIZE, CURSOR_SIZE))
+		goto err;
+
+	for (y = 0; y < cs->image_buf.height; y++) {
+		uint32_t *row = (uint32_t *)&cs->image_buf.map[cs->image_buf.stride * y];
+
+		for (x = 0; x < cs->image_buf.width; x++)
+			row[x] = fill_color(x * 255 / cs->image_buf.width,
+					    y * 255 / cs->image_buf.height, 128, 0);
+	}
+
+	for (y = 0; y < CURSOR_SIZE; y++) {
+		uint32_t *row = (uint32_t *)&cs->cursor_buf.map[cs->cursor_buf.stride * y];
+
+		for (x = 0; x < CURSOR_SIZE; x++) {
+			int32_t dx = 2 * x - CURSOR_SIZE + 1, dy = 2 * y - CURSOR_SIZE + 1;
+			int32_t d = CURSOR_SIZE * CURSOR_SIZE - (dx * dx + dy * dy) / 2;
+
+			row[x] = fill_color(255, 255, 255,
+					    d <= 0 ? 0 : d >= CURSOR_SIZE * 8 ? 255 : d / 8);
+		}
+	}
+
+	cs->compositor = compositor_create(fill_color(0, 0, 0, 0));
+	if (!cs->compositor)
+		goto err;
+
+	cs->background = compositor_layer_add(cs->compositor, LAYER_SOLID, 0);
+	if (!cs->background)
+		goto err;
+	layer_set_color(cs->background, fill_color(0, 0, 255, 0));
+
+	for (i = 0; i < COMPOSITOR_WINDOWS; i++) {
+		cs->windows[i] = compositor_layer_add(cs->compositor, LAYER_RECT, 1 + i);
+		if (!cs->windows[i])
+			goto err;
+		layer_set_position(cs->windows[i], i * width / 12, i * height / 12);
+		layer_set_size(cs->windows[i], width / 3, height / 3);
+		layer_set_color(cs->windows[i], fill_color(32 * i, 255 - 32 * i, 64, 0));
+	}
+
+	cs->image = compositor_layer_add(cs->compositor, LAYER_IMAGE, COMPOSITOR_WINDOWS + 1);
+	cs->cursor = compositor_layer_add(cs->compositor, LAYER_CURSOR, COMPOSITOR_WINDOWS + 2);
+	if (!cs->image || !cs->cursor)
+		goto err;
+	layer_set_image(cs->image, &cs->image_buf);
+	layer_set_position(cs->image, width / 2, height / 2);
+	layer_set_image(cs->cursor, &cs->cursor_buf);
+
+	return 0;
+
+err:
+	compositor_scene_fini(cs);
+	return -ENOMEM;
+}
+
+/* Painter's algorithm, every layer fully drawn bottom to top */
+static uint64_t compositor_naive(struct compositor_scene *cs, struct modeset_buf *buf,
+				 int32_t cursor_x, int32_t cursor_y)
+{
+	uint64_t pixels = (uint64_t)buf->width * buf->height;
+	struct raster_rect rects[COMPOSITOR_WINDOWS];
+	uint32_t x, y, i;
+
+	for (i = 0; i < COMPOSITOR_WINDOWS; i++) {
+		uint32_t w = buf->width / 3, h = buf->height / 3;
+
+		rects[i] = (struct raster_rect){ i * buf->width / 12, i * buf->height / 12, w, h,
+						 fill_color(32 * i, 255 - 32 * i, 64, 0) };
+		if (i == COMPOSITOR_WINDOWS - 1)
+			rects[i].x = cursor_y % (buf->width - w);
+		pixels += (uint64_t)w * h;
+	}
+	raster_draw(buf, fill_color(0, 0, 255, 0), rects, COMPOSITOR_WINDOWS);
+
+	for (y = 0; y < cs->image_buf.height; y++)
+		memcpy(&buf->map[buf->stride * (buf->height / 2 + y) + buf->width / 2 * 4],
+		       &cs->image_buf.map[cs->image_buf.stride * y], cs->image_buf.width * 4);
+	pixels += (uint64_t)cs->image_buf.width * cs->image_buf.height;
+
+	for (y = 0; y < CURSOR_SIZE; y++) {
+		const struct pixel *src = (const struct pixel *)&cs->cursor_buf.map[cs->cursor_buf.stride * y];
+		struct pixel *dst = (struct pixel *)&buf->map[buf->stride * (cursor_y + y) + cursor_x * 4];
+
+		for (x = 0; x < CURSOR_SIZE; x++) {
+			uint32_t a = src[x].pad_or_alpha, v;
+
+			v = src[x].blue * a + dst[x].blue * (255 - a) + 128;
+			dst[x].blue = (v + (v >> 8)) >> 8;
+			v = src[x].green * a + dst[x].green * (255 - a) + 128;
+			dst[x].green = (v + (v >> 8)) >> 8;
+			v = src[x].red * a + dst[x].red * (255 - a) + 128;
+			dst[x].red = (v + (v >> 8)) >> 8;
+		}
+	}
+	pixels += CURSOR_SIZE * CURSOR_SIZE;
+
+	return pixels;
+}
+
+/*
+ * The cursor moves every frame, the top window every 8 frames. The naive
+ * painter redraws everything, the compositor only the damage and never
+ * writes pixels hidden by opaque layers.
+ */
+static int bench_compositor(void)
+{
+	const unsigned frames = 200 + RING_SIZE;
+	unsigned r, i;
+
+	printf("compositor: background, %u windows, image and cursor on a %u buffers ring\n",
+	       COMPOSITOR_WINDOWS, RING_SIZE);
+	printf("%-8s %10s %10s %10s %12s %12s %12s %s\n", "size", "naive ms", "full ms",
+	       "frame ms", "naive px", "full px", "frame px", "output");
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		uint32_t width = resolutions[r].width, height = resolutions[r].height;
+		struct modeset_buf full[RING_SIZE], ring[RING_SIZE];
+		uint64_t start, naive_ns = 0, frame_ns = 0, naive_px = 0, frame_px = 0;
+		uint64_t full_ns, full_px;
+		struct compositor_stats stats;
+		struct compositor_scene cs;
+		unsigned allocated = 0;
+		bool identical = true;
+		int ret;
+
+		for (i = 0; i < RING_SIZE; i++, allocated++) {
+			if (buf_alloc(&full[i], width, height))
+				break;
+			if (buf_alloc(&ring[i], width, height)) {
+				buf_free(&full[i]);
+				break;
+			}
+		}
+		ret = allocated < RING_SIZE ? -ENOMEM : compositor_scene_init(&cs, width, height);
+		if (ret)
+			goto out;
+
+		for (i = 0; i < frames; i++) {
+			struct modeset_buf *back = &ring[i % RING_SIZE];
+			int32_t cursor_x = (i * 7) % (width - CURSOR_SIZE);
+			int32_t cursor_y = (i * 5) % (height - CURSOR_SIZE);
+			uint64_t elapsed, pixels;
+			struct damage damage;
+
+			start = now_ns();
+			pixels = compositor_naive(&cs, &full[i % RING_SIZE], cursor_x, cursor_y);
+			elapsed = now_ns() - start;
+			if (i >= RING_SIZE) {
+				naive_ns += elapsed;
+				naive_px += pixels;
+			}
+
+			compositor_stats_get(cs.compositor, &stats);
+			pixels = stats.pixels;
+			start = now_ns();
+			layer_set_position(cs.cursor, cursor_x, cursor_y);
+			if (!(i % 8))
+				layer_set_position(cs.windows[COMPOSITOR_WINDOWS - 1],
+						   cursor_y % (width - width / 3),
+						   (COMPOSITOR_WINDOWS - 1) * height / 12);
+			ret = compositor_render(cs.compositor, back, &damage);
+			damage_buffers_swap(ring, RING_SIZE, back, &damage);
+			elapsed = now_ns() - start;
+			if (ret)
+				goto out_scene;
+
+			/* the first pass over the ring repaints everything, not counted */
+			compositor_stats_get(cs.compositor, &stats);
+			if (i >= RING_SIZE) {
+				frame_ns += elapsed;
+				frame_px += stats.pixels - pixels;
+			}
+
+			/* the window only moves every 8 frames, the naive painter follows the same state */
+			if (i % 8)
+				continue;
+			if (identical && !rows_equal(&full[i % RING_SIZE], back))
+				identical = false;
+		}
+
+		/* full frames, into a buffer of age 0 */
+		compositor_stats_get(cs.compositor, &stats);
+		full_px = stats.pixels;
+		start = now_ns();
+		for (i = 0; i < RING_SIZE * 4 && !ret; i++) {
+			struct damage damage;
+
+			ring[0].age = 0;
+			ret = compositor_render(cs.compositor, &ring[0], &damage);
+		}
+		full_ns = (now_ns() - start) / (RING_SIZE * 4);
+		if (ret)
+			goto out_scene;
+		compositor_stats_get(cs.compositor, &stats);
+		full_px = (stats.pixels - full_px) / (RING_SIZE * 4);
+
+		printf("%-8s %10.3f %10.3f %10.3f %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %s\n",
+		       resolutions[r].name, (double)naive_ns / (frames - RING_SIZE) / NSEC_PER_MSEC,
+		       (double)full_ns / NSEC_PER_MSEC,
+		       (double)frame_ns / (frames - RING_SIZE) / NSEC_PER_MSEC,
+		       naive_px / (frames - RING_SIZE), full_px, frame_px / (frames - RING_SIZE),
+		       identical ? "identical" : "MISMATCH");
+		if (!identical)
+			ret = -1;
+
+out_scene:
+		compositor_scene_fini(&cs);
+out:
+		for (i = 0; i < allocated; i++) {
+			buf_free(&full[i]);
+			buf_free(&ring[i]);
+		}
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Bytes of pixel data in buf, without the pitch and tile padding */
+static uint64_t image_bytes(const struct modeset_buf *buf)
+{
+	const struct format_info *info = format_info_get(buf->format);
+	uint64_t bytes = 0;
+	unsigned plane;
+
+	for (plane = 0; plane < info->planes; plane++) {
+		uint32_t width, height;
+
+		format_plane_size(info, plane, buf->width, buf->height, &width, &height);
+		bytes += (uint64_t)width * height * info->cpp[plane];
+	}
+
+	return bytes;
+}
+
+static const uint32_t bench_formats[] = {
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_XRGB2101010,
+	DRM_FORMAT_RGB565,
+	DRM_FORMAT_NV12,
+};
+
+/*
+ * Fill a rectangle at odd coordinates over a background, every sample of
+ * every plane must have the converted color of the pixels it covers, and
+ * the rasterizer must write the same bytes.
+ */
+static int format_validate(uint32_t format, uint64_t modifier)
+{
+	const struct format_info *info = format_info_get(format);
+	const struct raster_rect rect = { 11, 7, 33, 17, fill_color(255, 128, 0, 0) };
+	uint32_t bg[FORMAT_MAX_PLANES], fg[FORMAT_MAX_PLANES];
+	struct modeset_buf buf, raster;
+	uint32_t x, y;
+	unsigned plane;
+	int ret = 0;
+
+	if (buf_alloc_format(&buf, 256, 64, format, modifier))
+		return -ENOMEM;
+	if (buf_alloc_format(&raster, 256, 64, format, modifier)) {
+		buf_free(&buf);
+		return -ENOMEM;
+	}
+
+	format_pack(format, fill_color(0, 0, 255, 0), bg);
+	format_pack(format, rect.color, fg);
+	fill_buffer(&buf, fill_color(0, 0, 255, 0));
+	fill_rect(&buf, rect.x, rect.y, rect.w, rect.h, rect.color);
+	raster_draw(&raster, fill_color(0, 0, 255, 0), &rect, 1);
+
+	for (plane = 0; plane < info->planes && !ret; plane++) {
+		uint32_t width, height, x0 = rect.x, y0 = rect.y, x1 = rect.x + rect.w;
+		uint32_t y1 = rect.y + rect.h, cpp = info->cpp[plane];
+
+		format_plane_size(info, plane, buf.width, buf.height, &width, &height);
+		if (plane) {
+			x0 /= info->hsub;
+			y0 /= info->vsub;
+			x1 = (x1 + info->hsub - 1) / info->hsub;
+			y1 = (y1 + info->vsub - 1) / info->vsub;
+		}
+
+		for (y = 0; y < height && !ret; y++) {
+			for (x = 0; x < width; x++) {
+				bool inside = x >= x0 && x < x1 && y >= y0 && y < y1;
+				uint32_t offset = buf.offsets[plane] +
+					(buf.map_tiled ? tiling_offset(modifier, buf.pitches[plane], x * cpp, y) :
+							 buf.pitches[plane] * y + x * cpp);
+
+				if (memcmp(&buf.map[offset], inside ? &fg[plane] : &bg[plane], cpp)) {
+					ret = -1;
+					break;
+				}
+			}
+		}
+	}
+
+	if (!ret && memcmp(buf.map, raster.map, buf.size))
+		ret = -1;
+
+	buf_free(&raster);
+	buf_free(&buf);
+	return ret;
+}
+
+/* Memory and fill_buffer() throughput per format, bytes are what the planes hold */
+static int bench_format(void)
+{
+	const unsigned iterations = 20;
+	unsigned r, f, i;
+
+	printf("format: buffer size and fill_buffer() per pixel format\n");
+	printf("%-8s %-12s %10s %10s %10s %10s %10s %s\n", "size", "format", "linear MB",
+	       "Y MB", "ms/frame", "Mpix/s", "GB/s", "check");
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		uint32_t width = resolutions[r].width, height = resolutions[r].height;
+
+		for (f = 0; f < sizeof(bench_formats) / sizeof(bench_formats[0]); f++) {
+			const struct format_info *info = format_info_get(bench_formats[f]);
+			uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], tiled_size;
+			uint64_t start, elapsed, bytes;
+			struct modeset_buf buf;
+			bool valid;
+
+			if (buf_alloc_format(&buf, width, height, bench_formats[f],
+					     DRM_FORMAT_MOD_LINEAR) ||
+			    format_layout(bench_formats[f], I915_FORMAT_MOD_Y_TILED, width, height,
+					  pitches, offsets, &tiled_size))
+				return -ENOMEM;
+
+			bytes = image_bytes(&buf);
+
+			/* warm up the pages */
+			fill_buffer(&buf, 0);
+			start = now_ns();
+			for (i = 0; i < iterations; i++)
+				fill_buffer(&buf, fill_color(0, 0, 255, 0));
+			elapsed = now_ns() - start;
+
+			valid = !format_validate(bench_formats[f], DRM_FORMAT_MOD_LINEAR) &&
+				!format_validate(bench_formats[f], I915_FORMAT_MOD_X_TILED) &&
+				!format_validate(bench_formats[f], I915_FORMAT_MOD_Y_TILED);
+
+			printf("%-8s %-12s %10.2f %10.2f %10.3f %10.0f %10.2f %s\n",
+			       resolutions[r].name, info->name, (double)buf.size / (1024 * 1024),
+			       (double)tiled_size / (1024 * 1024),
+			       (double)elapsed / iterations / NSEC_PER_MSEC,
+			       elapsed ? (double)width * height * iterations * 1000 / elapsed : 0,
+			       gbps(bytes * iterations, elapsed), valid ? "ok" : "FAILED");
+
+			buf_free(&buf);
+			if (!valid)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Known layouts, pitches are the smallest the display takes */
+static const struct {
+	uint32_t format;
+	uint64_t modifier;
+	uint32_t width, height;
+	uint32_t pitches[2];
+	uint32_t offset;
+	uint32_t size;
+} layout_cases[] = {
+	{ DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, 1920, 1080, { 7680 }, 0, 7680 * 1080 },
+	{ DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, 1366, 768, { 5504 }, 0, 5504 * 768 },
+	{ DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_X_TILED, 1366, 767, { 5632 }, 0, 5632 * 768 },
+	{ DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_Y_TILED, 1366, 767, { 5504 }, 0, 5504 * 768 },
+	{ DRM_FORMAT_RGB565, DRM_FORMAT_MOD_LINEAR, 1366, 768, { 2752 }, 0, 2752 * 768 },
+	{ DRM_FORMAT_XRGB2101010, DRM_FORMAT_MOD_LINEAR, 1, 1, { 64 }, 0, 64 },
+	{ DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR, 1920, 1080, { 1920, 1920 }, 1920 * 1080,
+	  1920 * 1620 },
+	{ DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR, 1366, 767, { 1408, 1408 }, 1408 * 767,
+	  1408 * (767 + 384) },
+	{ DRM_FORMAT_NV12, I915_FORMAT_MOD_Y_TILED, 1920, 1080, { 1920, 1920 }, 1920 * 1088,
+	  1920 * (1088 + 544) },
+};
+
+/* Every pitch is aligned and less than one alignment step above the row */
+static int layout_minimal(uint32_t format, uint64_t modifier, uint32_t width, uint32_t height)
+{
+	const struct format_info *info = format_info_get(format);
+	uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], size;
+	uint32_t align = 64, tile_height = 1;
+	uint64_t end = 0;
+	unsigned i;
+
+	if (modifier != DRM_FORMAT_MOD_LINEAR && tiling_tile_size(modifier, &align, &tile_height))
+		return -1;
+	if (format_layout(format, modifier, width, height, pitches, offsets, &size))
+		return -1;
+
+	for (i = 0; i < info->planes; i++) {
+		uint32_t plane_width, plane_height, row;
+
+		format_plane_size(info, i, width, height, &plane_width, &plane_height);
+		row = plane_width * info->cpp[i];
+		if (pitches[i] % align || pitches[i] < row || pitches[i] - row >= align ||
+		    offsets[i] != end || offsets[i] % (pitches[i] * tile_height))
+			return -1;
+		end += (uint64_t)pitches[i] * ((plane_height + tile_height - 1) / tile_height *
+					       tile_height);
+	}
+
+	return end == size ? 0 : -1;
+}
+
+static int bench_layout(void)
+{
+	const uint64_t modifiers[] = { DRM_FORMAT_MOD_LINEAR, I915_FORMAT_MOD_X_TILED,
+				       I915_FORMAT_MOD_Y_TILED };
+	uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], size;
+	unsigned c, f, m, checked = 0;
+	uint32_t width;
+
+	printf("layout: pitch and size of format_layout()\n");
+	printf("%-12s %-7s %10s %8s %8s %10s %s\n", "format", "tiling", "size", "pitch", "pitch 1",
+	       "MB", "check");
+
+	for (c = 0; c < sizeof(layout_cases) / sizeof(layout_cases[0]); c++) {
+		const struct format_info *info = format_info_get(layout_cases[c].format);
+		const char *tiling = layout_cases[c].modifier == DRM_FORMAT_MOD_LINEAR ? "linear" :
+				     layout_cases[c].modifier == I915_FORMAT_MOD_X_TILED ? "X" : "Y";
+		char name[24];
+		bool valid;
+
+		valid = !format_layout(layout_cases[c].format, layout_cases[c].modifier,
+				       layout_cases[c].width, layout_cases[c].height, pitches,
+				       offsets, &size) &&
+			pitches[0] == layout_cases[c].pitches[0] &&
+			pitches[1] == layout_cases[c].pitches[1] &&
+			offsets[1] == layout_cases[c].offset && size == layout_cases[c].size;
+
+		snprintf(name, sizeof(name), "%ux%u", layout_cases[c].width, layout_cases[c].height);
+		printf("%-12s %-7s %10s %8u %8u %10.2f %s\n", info->name, tiling, name, pitches[0],
+		       pitches[1], (double)size / (1024 * 1024), valid ? "ok" : "FAILED");
+		if (!valid)
+			return -1;
+	}
+
+	/* every width up to 4K and odd heights, for each format and tiling */
+	for (f = 0; f < sizeof(bench_formats) / sizeof(bench_formats[0]); f++) {
+		for (m = 0; m < sizeof(modifiers) / sizeof(modifiers[0]); m++) {
+			for (width = 1; width <= 4096; width++, checked++) {
+				if (layout_minimal(bench_formats[f], modifiers[m], width,
+						   width % 2161 + 1)) {
+					printf("%.4s 0x%llx width %u: not minimal\n",
+					       (const char *)&bench_formats[f],
+					       (unsigned long long)modifiers[m], width);
+					return -1;
+				}
+			}
+		}
+	}
+
+	/* more than 4GB doesn't fit the 32 bits sizes of modeset_buf */
+	if (!format_layout(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, 65535, 65535, pitches,
+			   offsets, &size))
+		return -1;
+
+	printf("%u layouts minimal and aligned: ok\n", checked);
+	return 0;
+}
+
+static const uint32_t convert_sources[] = {
+	DRM_FORMAT_ABGR8888,
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_YUV420,
+};
+
+static const uint32_t convert_destinations[] = {
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_RGB565,
+	DRM_FORMAT_NV12,
+};
+
+static const char *const convert_levels[] = { "scalar", "ssse3", "avx2" };
+
+static int channel_diff(uint32_t a, uint32_t b, unsigned shift, uint32_t mask)
+{
+	return abs((int)(a >> shift & mask) - (int)(b >> shift & mask));
+}
+
+/*
+ * Compare the RGB channels of every pixel, tolerance in units of the
+ * channel. NV12 and tolerance 0 compare the bytes.
+ */
+static bool convert_close(const struct modeset_buf *a, const struct modeset_buf *b, int tolerance)
+{
+	uint32_t x, y;
+
+	if (!tolerance || a->format == DRM_FORMAT_NV12)
+		return !memcmp(a->map, b->map, a->size);
+
+	for (y = 0; y < a->height; y++) {
+		for (x = 0; x < a->width; x++) {
+			uint32_t va = 0, vb = 0;
+			bool close;
+
+			if (a->format == DRM_FORMAT_RGB565) {
+				memcpy(&va, &a->map[a->stride * y + x * 2], 2);
+				memcpy(&vb, &b->map[b->stride * y + x * 2], 2);
+				close = channel_diff(va, vb, 11, 0x1f) <= tolerance &&
+					channel_diff(va, vb, 5, 0x3f) <= tolerance &&
+					channel_diff(va, vb, 0, 0x1f) <= tolerance;
+			} else {
+				memcpy(&va, &a->map[a->stride * y + x * 4], 4);
+				memcpy(&vb, &b->map[b->stride * y + x * 4], 4);
+				close = channel_diff(va, vb, 16, 0xff) <= tolerance &&
+					channel_diff(va, vb, 8, 0xff) <= tolerance &&
+					channel_diff(va, vb, 0, 0xff) <= tolerance;
+			}
+			if (!close)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Random content: every kernel level gives the scalar bytes. Solid
+ * colors: the result is what fill_buffer() writes in the destination
+ * format, exactly from RGB and within 2 units from YUV, whose 8 bits
+ * round trip is lossy.
+ */
+static int convert_validate(uint32_t src_format, uint32_t dst_format)
+{
+	const uint32_t colors[] = {
+		fill_color(255, 0, 0, 0), fill_color(0, 255, 0, 0), fill_color(0, 0, 255, 0),
+		fill_color(255, 255, 255, 0), fill_color(128, 128, 128, 0), fill_color(20, 200, 90, 0),
+	};
+	struct modeset_buf src, ref, dst;
+	unsigned i, l;
+	int ret = -1;
+
+	/* odd sizes for the vector tails and the chroma edges */
+	if (buf_alloc_format(&src, 317, 123, src_format, DRM_FORMAT_MOD_LINEAR))
+		return -ENOMEM;
+	if (buf_alloc_format(&ref, 317, 123, dst_format, DRM_FORMAT_MOD_LINEAR))
+		goto out_src;
+	if (buf_alloc_format(&dst, 317, 123, dst_format, DRM_FORMAT_MOD_LINEAR))
+		goto out_ref;
+
+	srand(src_format ^ dst_format);
+	for (i = 0; i < src.size; i++)
+		src.map[i] = rand();
+
+	convert_kernel_set("scalar");
+	convert(&ref, &src);
+
+	/* two even bands give the whole frame, an odd start splits the chroma blocks */
+	memset(dst.map, 0, dst.size);
+	if (convert_rows(&dst, &src, 0, 62) || convert_rows(&dst, &src, 62, dst.height) ||
+	    memcmp(dst.map, ref.map, dst.size))
+		goto out;
+	if (!convert_rows(&dst, &src, 61, dst.height) !=
+	    (format_info_get(src_format)->vsub == 1 && format_info_get(dst_format)->vsub == 1))
+		goto out;
+
+	for (l = 1; l < sizeof(convert_levels) / sizeof(convert_levels[0]); l++) {
+		if (convert_kernel_set(convert_levels[l]))
+			continue;
+		memset(dst.map, 0, dst.size);
+		convert(&dst, &src);
+		if (memcmp(dst.map, ref.map, dst.size))
+			goto out;
+	}
+	convert_kernel_set(NULL);
+
+	for (i = 0; i < sizeof(colors) / sizeof(colors[0]); i++) {
+		fill_buffer(&src, colors[i]);
+		fill_buffer(&ref, colors[i]);
+		convert(&dst, &src);
+		if (!convert_close(&dst, &ref, src_format == DRM_FORMAT_YUV420 ? 2 : 0))
+			goto out;
+	}
+	ret = 0;
+
+out:
+	convert_kernel_set(NULL);
+	buf_free(&dst);
+out_ref:
+	buf_free(&ref);
+out_src:
+	buf_free(&src);
+	return ret;
+}
+
+static int bench_convert(void)
+{
+	const unsigned iterations = 10;
+	unsigned r, s, d, l;
+
+	printf("convert: pixel format conversion per kernel, GB/s of source plus destination\n");
+	printf("%-8s %-10s %-10s %-8s %10s %10s %s\n", "size", "source", "dest", "kernel",
+	       "ms/frame", "GB/s", "check");
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		uint32_t width = resolutions[r].width, height = resolutions[r].height;
+
+		for (s = 0; s < sizeof(convert_sources) / sizeof(convert_sources[0]); s++) {
+			for (d = 0; d < sizeof(convert_destinations) / sizeof(convert_destinations[0]); d++) {
+				uint32_t src_format = convert_sources[s], dst_format = convert_destinations[d];
+				struct modeset_buf src, dst;
+				const char *check;
+
+				if (!convert_supported(src_format, dst_format))
+					continue;
+
+				check = convert_validate(src_format, dst_format) ? "FAILED" : "ok";
+				if (buf_alloc_format(&src, width, height, src_format, DRM_FORMAT_MOD_LINEAR))
+					return -ENOMEM;
+				if (buf_alloc_format(&dst, width, height, dst_format, DRM_FORMAT_MOD_LINEAR)) {
+					buf_free(&src);
+					return -ENOMEM;
+				}
+				fill_buffer(&src, fill_color(20, 200, 90, 0));
+
+				for (l = 0; l < sizeof(convert_levels) / sizeof(convert_levels[0]); l++) {
+					uint64_t start, elapsed;
+					unsigned i;
+
+					/* only the levels the pair has a kernel for */
+					if (convert_kernel_set(convert_levels[l]) ||
+					    strcmp(convert_kernel_name(src_format, dst_format), convert_levels[l]))
+						continue;
+
+					convert(&dst, &src);
+					start = now_ns();
+					for (i = 0; i < iterations; i++)
+						convert(&dst, &src);
+					elapsed = now_ns() - start;
+
+					printf("%-8s %-10s %-10s %-8s %10.3f %10.2f %s\n", resolutions[r].name,
+					       format_info_get(src_format)->name,
+					       format_info_get(dst_format)->name, convert_levels[l],
+					       (double)elapsed / iterations / NSEC_PER_MSEC,
+					       gbps((image_bytes(&src) + image_bytes(&dst)) * iterations, elapsed),
+					       check);
+				}
+				convert_kernel_set(NULL);
+
+				buf_free(&dst);
+				buf_free(&src);
+				if (strcmp(check, "ok"))
+					return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* GB/s of a full clear and a fill_buffer(), regular stores or streaming */
+static void stream_run(struct modeset_buf *buf, bool stream, unsigned iterations,
+		       double *clear, double *fill)
+{
+	bool map_wc = buf->map_wc;
+	uint64_t start;
+	unsigned i;
+
+	buf->map_wc = stream;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		fill_clear(buf, 0x77);
+	*clear = gbps((uint64_t)buf->size * iterations, now_ns() - start);
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		fill_buffer(buf, fill_color(0, 0, 255, 0));
+	*fill = gbps((uint64_t)buf->width * buf->height * 4 * iterations, now_ns() - start);
+
+	buf->map_wc = map_wc;
+}
+
+static void stream_print(const char *size, const char *memory, struct modeset_buf *buf,
+			 unsigned iterations)
+{
+	double clear, fill, clear_stream, fill_stream;
+
+	/* warm up the pages */
+	fill_clear(buf, 0);
+
+	stream_run(buf, false, iterations, &clear, &fill);
+	stream_run(buf, true, iterations, &clear_stream, &fill_stream);
+
+	printf("%-8s %-7s %9.2fGB/s %9.2fGB/s %9.2fGB/s %9.2fGB/s\n", size, memory,
+	       clear, clear_stream, fill, fill_stream);
+}
+
+static int bench_stream(void)
+{
+	const unsigned iterations = 20;
+	unsigned r;
+	int drm_fd;
+
+	printf("stream: regular vs non-temporal stores, clear and fill_buffer()\n");
+	printf("%-8s %-7s %12s %12s %12s %12s\n", "size", "memory", "clear", "clear nt",
+	       "fill", "fill nt");
+
+	drm_fd = open(DEFAULT_DRM_DEVICE, O_RDWR | O_CLOEXEC);
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		uint32_t width = resolutions[r].width, height = resolutions[r].height;
+		struct modeset_buf buf;
+
+		if (buf_alloc(&buf, width, height))
+			return -ENOMEM;
+		stream_print(resolutions[r].name, "malloc", &buf, iterations);
+		buf_free(&buf);
+
+		if (drm_fd < 0 ||
+		    gtt_buf_alloc(drm_fd, &buf, width, height, I915_TILING_NONE,
+				  DRM_FORMAT_MOD_LINEAR)) {
+			printf("%-8s %-7s %12s\n", resolutions[r].name, "GTT", "n/a");
+			continue;
+		}
+		stream_print(resolutions[r].name, "GTT", &buf, iterations);
+		gtt_buf_free(drm_fd, &buf);
+	}
+
+	if (drm_fd >= 0)
+		close(drm_fd);
+
+	return 0;
+}
+
+static const char *const crc32c_kernels[] = { "table", "sse4.2" };
+
+/*
+ * NV12 with an odd width, its chroma rows are a byte wider than the luma
+ * ones. The tiled frames must hash as the linear one.
+ */
+static int hash_odd_nv12_validate(void)
+{
+	const uint64_t modifiers[] = {
+		DRM_FORMAT_MOD_LINEAR, I915_FORMAT_MOD_X_TILED, I915_FORMAT_MOD_Y_TILED,
+	};
+	const uint32_t width = 1365, height = 767;
+	uint32_t hashes[3];
+	unsigned m;
+	bool valid = true;
+
+	for (m = 0; m < sizeof(modifiers) / sizeof(modifiers[0]); m++) {
+		struct modeset_buf buf;
+		int ret;
+
+		if (buf_alloc_format(&buf, width, height, DRM_FORMAT_NV12, modifiers[m]))
+			return -ENOMEM;
+
+		fill_buffer(&buf, fill_color(255, 0, 0, 0));
+		fill_rect(&buf, width / 3, height / 3, width / 3, height / 3, fill_color(0, 0, 255, 0));
+		fill_rect(&buf, width - 7, 0, 7, height, fill_color(0, 255, 0, 0));
+		ret = frame_hash(&buf, &hashes[m]);
+		buf_free(&buf);
+
+		valid &= !ret && hashes[m] == hashes[0];
+	}
+
+	printf("NV12 %ux%u, linear X Y: 0x%08x 0x%08x 0x%08x %s\n", width, height, hashes[0],
+	       hashes[1], hashes[2], valid ? "ok" : "FAILED");
+	return valid ? 0 : -1;
+}
+
+/* CRC32C of every frame, is there room for it at 4K60? */
+static int bench_hash(void)
+{
+	const uint64_t modifiers[] = { DRM_FORMAT_MOD_LINEAR, I915_FORMAT_MOD_Y_TILED };
+	const char *const layouts[] = { "linear", "Y" };
+	const unsigned iterations = 10;
+	unsigned r, m, k, i;
+
+	printf("hash: CRC32C of a frame per kernel and layout, 60Hz is the share of a vblank\n");
+
+	/* the check value of the Castagnoli polynomial, in one go and continued */
+	for (k = 0; k < sizeof(crc32c_kernels) / sizeof(crc32c_kernels[0]); k++) {
+		if (crc32c_kernel_set(crc32c_kernels[k]))
+			continue;
+		if (crc32c(0, "123456789", 9) != 0xe3069283 ||
+		    crc32c(crc32c(0, "1234", 4), "56789", 5) != 0xe3069283) {
+			printf("%s: wrong check value\n", crc32c_kernels[k]);
+			crc32c_kernel_set(NULL);
+			return -1;
+		}
+	}
+	crc32c_kernel_set(NULL);
+
+	if (hash_odd_nv12_validate())
+		return -1;
+
+	printf("%-8s %-7s %-8s %10s %10s %10s %10s %s\n", "size", "layout", "kernel", "ms/frame",
+	       "GB/s", "fps", "60Hz %", "check");
+
+	for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+		uint32_t width = resolutions[r].width, height = resolutions[r].height;
+		struct modeset_buf bufs[2];
+		uint32_t reference = 0;
+		bool first = true;
+		int ret = 0;
+
+		if (buf_alloc(&bufs[0], width, height))
+			return -ENOMEM;
+		if (buf_alloc_tiled(&bufs[1], width, height, modifiers[1])) {
+			buf_free(&bufs[0]);
+			return -ENOMEM;
+		}
+
+		srand(width);
+		for (i = 0; i < bufs[0].size; i++)
+			bufs[0].map[i] = rand();
+		tiling_linear_to_tiled(modifiers[1], bufs[1].map, bufs[1].stride, bufs[0].map,
+				       bufs[0].stride, width * 4, height);
+
+		for (m = 0; m < sizeof(modifiers) / sizeof(modifiers[0]) && !ret; m++) {
+			for (k = 0; k < sizeof(crc32c_kernels) / sizeof(crc32c_kernels[0]); k++) {
+				uint64_t start, elapsed;
+				uint32_t hash;
+				bool valid;
+
+				if (crc32c_kernel_set(crc32c_kernels[k]))
+					continue;
+
+				/* warm up the caches and the tables */
+				frame_hash(&bufs[m], &hash);
+				start = now_ns();
+				for (i = 0; i < iterations && !ret; i++)
+					ret = frame_hash(&bufs[m], &hash);
+				elapsed = now_ns() - start;
+
+				if (first)
+					reference = hash;
+				first = false;
+				valid = !ret && hash == reference;
+
+				printf("%-8s %-7s %-8s %10.3f %10.2f %10.0f %10.1f %s\n", resolutions[r].name,
+				       layouts[m], crc32c_kernels[k],
+				       (double)elapsed / iterations / NSEC_PER_MSEC,
+				       gbps((uint64_t)width * height * 4 * iterations, elapsed),
+				       elapsed ? (double)iterations * NSEC_PER_SEC / elapsed : 0,
+				       (double)elapsed / iterations * 60 * 100 / NSEC_PER_SEC,
+				       valid ? "ok" : "MISMATCH");
+				if (!valid)
+					ret = -1;
+			}
+		}
+		crc32c_kernel_set(NULL);
+
+		buf_free(&bufs[1]);
+		buf_free(&bufs[0]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+#define GOLDEN_WIDTH 1024
+#define GOLDEN_HEIGHT 768
+#define GOLDEN_FRAMES 40
+
+static int golden_red(struct modeset_buf *buf)
+{
+	fill_buffer(buf, fill_color(255, 0, 0, 0));
+	return 0;
+}
+
+/* frontbuffer_drawing and cursor background */
+static int golden_halves(struct modeset_buf *buf)
+{
+	uint32_t half = buf->width / 2;
+
+	fill_rect(buf, 0, 0, half, buf->height, fill_color(0, 0, 255, 0));
+	fill_rect(buf, half, 0, buf->width - half, buf->height, fill_color(0, 255, 0, 0));
+	return 0;
+}
+
+/* page_flip2 pink box, its borders are exclusive */
+static int golden_box(struct modeset_buf *buf)
+{
+	const uint32_t size = 50;
+
+	fill_buffer(buf, fill_color(255, 0, 0, 0));
+	fill_rect(buf, (buf->width - size) / 2 + 1, (buf->height - size) / 2 + 1, size - 1,
+		  size - 1, fill_color(255, 0, 255, 0));
+	return 0;
+}
+
+/* page_flip3 moving box, repainted from the damage on a ring */
+static int golden_moving_box(struct modeset_buf *buf)
+{
+	struct raster_rect box = { 0, 0, BOX_SIZE, BOX_SIZE, fill_color(0, 0, 0, 0) };
+	struct modeset_buf ring[RING_SIZE];
+	unsigned allocated, i;
+	uint64_t pixels = 0;
+	int ret = 0;
+
+	for (allocated = 0; allocated < RING_SIZE; allocated++) {
+		if (buf_alloc_format(&ring[allocated], buf->width, buf->height, buf->format,
+				     buf->modifier)) {
+			ret = -ENOMEM;
+			break;
+		}
+	}
+
+	if (!ret) {
+		for (i = 0; i < GOLDEN_FRAMES; i++)
+			damage_frame(ring, i, &box, &pixels);
+		memcpy(buf->map, ring[(GOLDEN_FRAMES - 1) % RING_SIZE].map, buf->size);
+	}
+
+	for (i = 0; i < allocated; i++)
+		buf_free(&ring[i]);
+	return ret;
+}
+
+static int golden_compositor(struct modeset_buf *buf)
+{
+	struct compositor_scene cs;
+	struct damage damage;
+	int ret;
+
+	ret = compositor_scene_init(&cs, buf->width, buf->height);
+	if (ret)
+		return ret;
+
+	layer_set_position(cs.cursor, buf->width / 3, buf->height / 3);
+	ret = compositor_render(cs.compositor, buf, &damage);
+	compositor_scene_fini(&cs);
+	return ret;
+}
+
+/* I420 gradients converted for scanout */
+static int golden_convert(struct modeset_buf *buf)
+{
+	const struct format_info *info = format_info_get(DRM_FORMAT_YUV420);
+	struct modeset_buf src;
+	uint32_t x, y;
+	unsigned plane;
+	int ret;
+
+	if (buf_alloc_format(&src, buf->width, buf->height, DRM_FORMAT_YUV420,
+			     DRM_FORMAT_MOD_LINEAR))
+		return -ENOMEM;
+
+	for (plane = 0; plane < info->planes; plane++) {
+		uint32_t width, height;
+
+		format_plane_size(info, plane, src.width, src.height, &width, &height);
+		for (y = 0; y < height; y++) {
+			uint8_t *row = &src.map[src.offsets[plane] + src.pitches[plane] * y];
+
+			for (x = 0; x < width; x++)
+				row[x] = x * (plane + 1) + y * (3 - plane);
+		}
+	}
+
+	ret = convert(buf, &src);
+	buf_free(&src);
+	return ret;
+}
+
+/*
+ * Hash of each scene, the same in every layout. Update golden when a
+ * rendering change is intended, the mode prints the new values.
+ */
+static const struct {
+	const char *name;
+	uint32_t format;
+	/* written with plain CPU loops, no tiled path */
+	bool linear_only;
+	int (*draw)(struct modeset_buf *buf);
+	uint32_t golden;
+	uint32_t width;
+} golden_scenes[] = {
+	{ "red", DRM_FORMAT_XRGB8888, false, golden_red, 0x954b0590, GOLDEN_WIDTH },
+	{ "halves", DRM_FORMAT_XRGB8888, false, golden_halves, 0x4fa37305, GOLDEN_WIDTH },
+	{ "halves", DRM_FORMAT_XRGB2101010, false, golden_halves, 0xf4ab97ce, GOLDEN_WIDTH },
+	{ "box", DRM_FORMAT_XRGB8888, false, golden_box, 0x45e3c695, GOLDEN_WIDTH },
+	{ "box", DRM_FORMAT_RGB565, false, golden_box, 0xfa673115, GOLDEN_WIDTH },
+	{ "box", DRM_FORMAT_NV12, false, golden_box, 0x834f6f2b, GOLDEN_WIDTH },
+	/* the chroma rows are wider than the luma ones */
+	{ "box odd", DRM_FORMAT_NV12, false, golden_box, 0x3c844bc5, 1365 },
+	{ "moving box", DRM_FORMAT_XRGB8888, false, golden_moving_box, 0x0e694044, GOLDEN_WIDTH },
+	{ "compositor", DRM_FORMAT_XRGB8888, true, golden_compositor, 0x984fe63b, GOLDEN_WIDTH },
+	{ "convert", DRM_FORMAT_XRGB8888, true, golden_convert, 0x08beac8a, GOLDEN_WIDTH },
+};
+
+/* The example scenes rendered headless and checked against known hashes */
+static int bench_golden(void)
+{
+	const uint64_t modifiers[] = {
+		DRM_FORMAT_MOD_LINEAR, I915_FORMAT_MOD_X_TILED, I915_FORMAT_MOD_Y_TILED,
+	};
+	const char *const layouts[] = { "linear", "X", "Y" };
+	unsigned s, m;
+	int ret = 0;
+
+	printf("golden: CRC32C of the example scenes at %ux%u, box odd at 1365 wide, against the "
+	       "known hashes\n", GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	printf("%-12s %-12s %-7s %10s %10s %s\n", "scene", "format", "layout", "hash", "golden",
+	       "check");
+
+	for (s = 0; s < sizeof(golden_scenes) / sizeof(golden_scenes[0]); s++) {
+		for (m = 0; m < sizeof(modifiers) / sizeof(modifiers[0]); m++) {
+			uint32_t width = golden_scenes[s].width;
+			struct modeset_buf buf;
+			uint32_t hash = 0;
+			bool valid;
+
+			if (m && golden_scenes[s].linear_only)
+				continue;
+			if (buf_alloc_format(&buf, width, GOLDEN_HEIGHT, golden_scenes[s].format,
+					     modifiers[m]))
+				return -ENOMEM;
+
+			valid = !golden_scenes[s].draw(&buf) && !frame_hash(&buf, &hash) &&
+				hash == golden_scenes[s].golden;
+			printf("%-12s %-12s %-7s 0x%08x 0x%08x %s\n", golden_scenes[s].name,
+			       format_info_get(golden_scenes[s].format)->name, layouts[m], hash,
+			       golden_scenes[s].golden, valid ? "ok" : "FAILED");
+
+			buf_free(&buf);
+			if (!valid)
+				ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Frames through a swapchain the way page_flip3 runs it: the buffers must
+ * come in ring order and, once every buffer was presented, be depth
+ * frames old when acquired.
+ */
+static int swapchain_validate(struct swapchain *swapchain, unsigned frames)
+{
+	unsigned depth = swapchain_depth(swapchain), i;
+	struct damage damage;
+
+	damage_clear(&damage);
+	damage_add_rect(&damage, 0, 0, BOX_SIZE, BOX_SIZE);
+
+	if (depth == 1)
+		return swapchain_acquire(swapchain) ? -1 : 0;
+
+	for (i = 0; i < frames; i++) {
+		struct modeset_buf *buf = swapchain_acquire(swapchain), *previous;
+
+		if (buf != swapchain_buffer(swapchain, (i + 1) % depth) ||
+		    (i >= depth && buf->age != depth))
+			return -1;
+
+		/* the front buffer is only released once replaced */
+		previous = swapchain_front(swapchain);
+		if (!swapchain_release(swapchain, previous) ||
+		    swapchain_present(swapchain, buf, &damage) != previous ||
+		    swapchain_present(swapchain, buf, &damage) ||
+		    swapchain_release(swapchain, previous) ||
+		    !swapchain_release(swapchain, previous) ||
+		    swapchain_state_get(swapchain, buf) != SWAPCHAIN_PRESENTED)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int bench_swapchain(void)
+{
+	const unsigned frames = 100000;
+	const struct resolution *res = &resolutions[1];
+	unsigned depth, i;
+
+	printf("swapchain: %s framebuffers per depth, acquire + present + release per frame\n",
+	       res->name);
+	printf("%-6s %10s %10s %s\n", "depth", "MB", "ns/frame", "check");
+
+	for (depth = 1; depth <= SWAPCHAIN_MAX_DEPTH; depth++) {
+		struct swapchain *swapchain;
+		uint64_t start, elapsed, bytes = 0;
+		bool valid;
+
+		swapchain = swapchain_create(depth, res->width, res->height, DRM_FORMAT_XRGB8888,
+					     DRM_FORMAT_MOD_LINEAR, SWAPCHAIN_INIT_NONE,
+					     &scene_buffer_ops, NULL);
+		if (!swapchain)
+			return -ENOMEM;
+		for (i = 0; i < depth; i++)
+			bytes += swapchain_buffer(swapchain, i)->size;
+
+		valid = !swapchain_validate(swapchain, depth * 4);
+
+		start = now_ns();
+		for (i = 0; i < frames && depth > 1; i++) {
+			struct modeset_buf *buf = swapchain_acquire(swapchain);
+
+			swapchain_release(swapchain, swapchain_present(swapchain, buf, NULL));
+		}
+		elapsed = now_ns() - start;
+
+		/* nothing to acquire in front buffer rendering */
+		if (depth == 1)
+			printf("%-6u %10.1f %10s %s\n", depth, (double)bytes / (1024 * 1024), "n/a",
+			       valid ? "ok" : "FAILED");
+		else
+			printf("%-6u %10.1f %10.1f %s\n", depth, (double)bytes / (1024 * 1024),
+			       (double)elapsed / frames, valid ? "ok" : "FAILED");
+
+		swapchain_destroy(swapchain);
+		if (!valid)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Swapchains recreated at every switch between two resolutions, the way
+ * page_flip_force_resolution switches modes. Returns the mean time of a
+ * switch.
+ */
+static uint64_t fbpool_switches(const struct scene_buffer_ops *ops, void *data, unsigned switches)
+{
+	struct swapchain *swapchain = NULL;
+	uint64_t start = now_ns();
+	unsigned i;
+
+	for (i = 0; i < switches; i++) {
+		const struct resolution *res = &resolutions[i % 2];
+
+		swapchain_destroy(swapchain);
+		swapchain = swapchain_create(RING_SIZE, res->width, res->height, DRM_FORMAT_XRGB8888,
+					     DRM_FORMAT_MOD_LINEAR, SWAPCHAIN_INIT_NONE, ops, data);
+		if (!swapchain)
+			return 0;
+	}
+	swapchain_destroy(swapchain);
+
+	return (now_ns() - start) / switches;
+}
+
+static int bench_fbpool(void)
+{
+	const unsigned switches = 20;
+	const size_t budgets[] = { 192 * 1024 * 1024, 64 * 1024 * 1024 };
+	uint64_t direct;
+	unsigned b;
+
+	printf("fbpool: depth %u swapchains recreated at each %s <-> %s switch, %u switches\n",
+	       RING_SIZE, resolutions[0].name, resolutions[1].name, switches);
+	printf("%-12s %10s %10s %10s %10s %10s %s\n", "pool", "ms/switch", "allocs", "reused",
+	       "trimmed", "kept MB", "check");
+
+	direct = fbpool_switches(&scene_buffer_ops, NULL, switches);
+	printf("%-12s %10.3f %10u %10s %10s %10s\n", "none", (double)direct / NSEC_PER_MSEC,
+	       switches * RING_SIZE, "-", "-", "-");
+
+	for (b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+		struct fb_pool *pool = fb_pool_create(budgets[b], &scene_buffer_ops, NULL);
+		struct fb_pool_stats stats;
+		uint64_t elapsed;
+		char name[24];
+		bool valid;
+
+		if (!pool)
+			return -ENOMEM;
+
+		elapsed = fbpool_switches(&fb_pool_buffer_ops, pool, switches);
+		fb_pool_stats_get(pool, &stats);
+
+		/* both swapchains fit in the large budget, only the first two allocate */
+		valid = elapsed && stats.bytes <= budgets[b] &&
+			stats.hits + stats.misses == switches * RING_SIZE &&
+			(b || stats.misses == 2 * RING_SIZE);
+
+		snprintf(name, sizeof(name), "%zu MB", budgets[b] / (1024 * 1024));
+		printf("%-12s %10.3f %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10.1f %s\n", name,
+		       (double)elapsed / NSEC_PER_MSEC, stats.misses, stats.hits, stats.trims,
+		       (double)stats.bytes / (1024 * 1024), valid ? "ok" : "FAILED");
+
+		fb_pool_destroy(pool);
+		if (!valid)
+			return -1;
+	}
+
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	enum swapchain_init init;
+} startup_inits[] = {
+	{ "eager", SWAPCHAIN_INIT_EAGER },
+	{ "acquire", SWAPCHAIN_INIT_ACQUIRE },
+	{ "background", SWAPCHAIN_INIT_BACKGROUND },
+	{ "none", SWAPCHAIN_INIT_NONE },
+};
+
+static bool buf_cleared(const struct modeset_buf *buf)
+{
+	uint32_t i;
+
+	for (i = 0; i < buf->size; i++) {
+		if (buf->map[i] != SWAPCHAIN_CLEAR)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * The swapchain of a modeset and its first frames, each one drawing all of
+ * a back buffer. The first pixel is on screen once swapchain_create()
+ * returns, the renderer then gets every back buffer once.
+ */
+static int bench_startup(void)
+{
+	const struct resolution *res = &resolutions[1];
+	unsigned i, f;
+
+	printf("startup: %s swapchain of depth %u, first pixel then one full frame per back buffer\n",
+	       res->name, RING_SIZE);
+	printf("%-12s %10s %10s %12s %10s %12s %8s %s\n", "init", "alloc ms", "clear ms",
+	       "first px ms", "frames ms", "acquire ms", "cleared", "check");
+
+	for (i = 0; i < sizeof(startup_inits) / sizeof(startup_inits[0]); i++) {
+		enum swapchain_init init = startup_inits[i].init;
+		struct swapchain_stats stats;
+		struct swapchain *swapchain;
+		uint64_t start, first_pixel, frames;
+		bool valid;
+
+		start = now_ns();
+		swapchain = swapchain_create(RING_SIZE, res->width, res->height, DRM_FORMAT_XRGB8888,
+					     DRM_FORMAT_MOD_LINEAR, init, &scene_buffer_ops, NULL);
+		if (!swapchain)
+			return -ENOMEM;
+		first_pixel = now_ns() - start;
+
+		valid = buf_cleared(swapchain_front(swapchain));
+
+		start = now_ns();
+		for (f = 1; f < RING_SIZE; f++) {
+			struct modeset_buf *buf = swapchain_acquire(swapchain);
+
+			/* what a renderer would find, not timed */
+			if (init != SWAPCHAIN_INIT_NONE) {
+				uint64_t check = now_ns();
+
+				valid &= buf_cleared(buf);
+				start += now_ns() - check;
+			}
+
+			fill_buffer(buf, fill_color(0, 0, 255, 0));
+			swapchain_release(swapchain, swapchain_present(swapchain, buf, NULL));
+		}
+		frames = now_ns() - start;
+
+		swapchain_stats_get(swapchain, &stats);
+		valid &= stats.cleared == (init == SWAPCHAIN_INIT_NONE ? 1 : RING_SIZE);
+
+		printf("%-12s %10.3f %10.3f %12.3f %10.3f %12.3f %8u %s\n", startup_inits[i].name,
+		       (double)stats.alloc_ns / NSEC_PER_MSEC, (double)stats.clear_ns / NSEC_PER_MSEC,
+		       (double)first_pixel / NSEC_PER_MSEC, (double)frames / NSEC_PER_MSEC,
+		       (double)stats.acquire_ns / NSEC_PER_MSEC, stats.cleared, valid ? "ok" : "FAILED");
+
+		swapchain_destroy(swapchain);
+		if (!valid)
+			return -1;
+	}
+
+	return 0;
+}
+
+#ifdef I915_GEM_DOMAIN_WC
+#define MAP_DOMAIN_WC I915_GEM_DOMAIN_WC
+#else
+#define MAP_DOMAIN_WC I915_GEM_DOMAIN_GTT
+#endif
+
+static const struct {
+	const char *name;
+	enum gem_mmap_type type;
+	uint32_t domain;
+} map_modes[] = {
+	{ "GTT", GEM_MMAP_GTT, I915_GEM_DOMAIN_GTT },
+	{ "WC", GEM_MMAP_WC, MAP_DOMAIN_WC },
+	{ "CPU", GEM_MMAP_CPU, I915_GEM_DOMAIN_CPU },
+};
+
+/* Linear XRGB8888 BO mapped the map_modes[mode] way */
+static int map_buf_alloc(int drm_fd, struct modeset_buf *buf, uint32_t width, uint32_t height,
+			 unsigned mode)
+{
+	uint32_t handle;
+
+	memset(buf, 0, sizeof(*buf));
+	if (format_layout(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, width, height, buf->pitches,
+			  buf->offsets, &buf->size))
+		return -EINVAL;
+	buf->width = width;
+	buf->height = height;
+	buf->stride = buf->pitches[0];
+	buf->format = DRM_FORMAT_XRGB8888;
+	buf->modifier = DRM_FORMAT_MOD_LINEAR;
+	buf->map_wc = map_modes[mode].type != GEM_MMAP_CPU;
+	buf->map_cached = map_modes[mode].type == GEM_MMAP_CPU;
+
+	if (gem_buffer_create(drm_fd, buf->size, &handle))
+		return -1;
+	buf->map = gem_buffer_mmap_type(drm_fd, handle, buf->size, map_modes[mode].type);
+	if (!buf->map) {
+		gem_buffer_destroy(drm_fd, handle);
+		return -1;
+	}
+	gem_set_domain(drm_fd, handle, map_modes[mode].domain, map_modes[mode].domain);
+	buf->handle = handle;
+
+	return 0;
+}
+
+static void map_buf_free(int drm_fd, struct modeset_buf *buf)
+{
+	gem_buffer_unmap(drm_fd, buf->map, buf->size);
+	gem_buffer_destroy(drm_fd, buf->handle);
+	buf->map = NULL;
+}
+
+struct map_result {
+	double write;
+	double random;
+	double read;
+	bool valid;
+};
+
+/*
+ * Sequential fills, random single pixel writes and a sequential read of
+ * buf. Cached maps are written back after each pass, like a frame before
+ * it is scanned out.
+ */
+static void map_run(struct modeset_buf *buf, unsigned iterations, unsigned random_writes,
+		    struct map_result *result)
+{
+	uint32_t color = fill_color(0, 0, 255, 0), pixels = buf->stride / 4 * buf->height;
+	volatile uint64_t sink;
+	uint64_t start, elapsed, sum = 0, state = 0x9e3779b97f4a7c15ULL;
+	const uint64_t *words = (const uint64_t *)buf->map;
+	uint32_t *map = (uint32_t *)buf->map;
+	unsigned i;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		fill_buffer(buf, color);
+		fill_writeback(buf, NULL);
+	}
+	elapsed = now_ns() - start;
+	result->write = gbps((uint64_t)buf->width * buf->height * 4 * iterations, elapsed);
+	result->valid = map[0] == color &&
+			map[(buf->height - 1) * buf->stride / 4 + buf->width - 1] == color;
+	damage_clear(&buf->dirty);
+
+	start = now_ns();
+	for (i = 0; i < random_writes; i++) {
+		/* xorshift64 */
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		map[state % pixels] = color;
+	}
+	fill_writeback(buf, NULL);
+	elapsed = now_ns() - start;
+	result->random = gbps((uint64_t)random_writes * 4, elapsed);
+
+	start = now_ns();
+	for (i = 0; i < buf->size / 8; i++)
+		sum += words[i];
+	elapsed = now_ns() - start;
+	sink = sum;
+	(void)sink;
+	result->read = gbps(buf->size, elapsed);
+}
+
+static void map_print(const char *name, const struct map_result *result)
+{
+	printf("%-8s %9.2fGB/s %9.3fGB/s %9.3fGB/s %s\n", name, result->write, result->random,
+	       result->read, result->valid ? "ok" : "FAILED");
+}
+
+static int bench_map(void)
+{
+	const struct resolution *res = &resolutions[1];
+	const unsigned iterations = 10, random_writes = 1 << 20;
+	struct map_result result;
+	struct modeset_buf buf;
+	unsigned m;
+	int drm_fd, ret = 0;
+
+	printf("map: %s linear buffer, sequential fill, %u random pixel writes, sequential read\n",
+	       res->name, random_writes);
+	printf("%-8s %13s %13s %13s %s\n", "map", "write", "random", "read", "check");
+
+	/* system memory, what the mappings are up against */
+	if (buf_alloc(&buf, res->width, res->height))
+		return -ENOMEM;
+	map_run(&buf, iterations, random_writes, &result);
+	map_print("malloc", &result);
+	buf_free(&buf);
+	if (!result.valid)
+		return -1;
+
+	drm_fd = open(DEFAULT_DRM_DEVICE, O_RDWR | O_CLOEXEC);
+
+	for (m = 0; m < sizeof(map_modes) / sizeof(map_modes[0]); m++) {
+		if (drm_fd < 0 || map_buf_alloc(drm_fd, &buf, res->width, res->height, m)) {
+			printf("%-8s %13s %13s %13s\n", map_modes[m].name, "n/a", "n/a", "n/a");
+			continue;
+		}
+
+		map_run(&buf, iterations, random_writes, &result);
+		map_print(map_modes[m].name, &result);
+		map_buf_free(drm_fd, &buf);
+		if (!result.valid)
+			ret = -1;
+	}
+
+	if (drm_fd >= 0)
+		close(drm_fd);
+
+	return ret;
+}
+
+/* Bucket rounding of every page count up to past BUFMGR_BUCKET_MAX */
+static int bufmgr_buckets_validate(void)
+{
+	const uint64_t page = GEM_PAGE_SIZE;
+	uint64_t pages, previous = 0;
+
+	for (pages = 1; pages <= BUFMGR_BUCKET_MAX / page + 1024; pages++) {
+		uint64_t size = pages * page, bucket = bufmgr_bucket_size(size);
+
+		/* a byte less rounds to the same bucket */
+		if (bucket < size || bucket % page || bucket < previous ||
+		    bufmgr_bucket_size(size - 1) != bucket)
+			return -1;
+		/* a quarter at most is lost, nothing above the largest bucket */
+		if (size > BUFMGR_BUCKET_MAX ? bucket != size : pages > 4 && (bucket - size) * 4 > size)
+			return -1;
+		previous = bucket;
+	}
+
+	return 0;
+}
+
+/* Mean time of an allocation and free of a buffer object, sizes alternating like mode switches */
+static uint64_t bufmgr_cycles(int drm_fd, struct bufmgr *bufmgr, const uint64_t sizes[2],
+			      unsigned cycles)
+{
+	uint64_t start = now_ns();
+	unsigned i;
+
+	for (i = 0; i < cycles; i++) {
+		uint64_t size = sizes[i % 2];
+
+		if (bufmgr) {
+			struct bufmgr_bo *bo = bufmgr_bo_alloc(bufmgr, size, I915_TILING_NONE, 0);
+
+			if (!bo || !bufmgr_bo_map(bo, GEM_MMAP_WC))
+				return 0;
+			bufmgr_bo_free(bo);
+		} else {
+			uint32_t handle;
+			void *map;
+
+			if (gem_buffer_create(drm_fd, size, &handle))
+				return 0;
+			map = gem_buffer_mmap_type(drm_fd, handle, size, GEM_MMAP_WC);
+			if (map)
+				gem_buffer_unmap(drm_fd, map, size);
+			gem_buffer_destroy(drm_fd, handle);
+			if (!map)
+				return 0;
+		}
+	}
+
+	return (now_ns() - start) / cycles;
+}
+
+static int bench_bufmgr(void)
+{
+	const unsigned cycles = 100;
+	uint64_t sizes[2], direct, cached;
+	struct bufmgr_stats stats;
+	struct bufmgr *bufmgr;
+	unsigned r;
+	int drm_fd, ret;
+	bool valid;
+
+	printf("bufmgr: buffer objects allocated, WC mapped and freed, %s <-> %s, %u cycles\n",
+	       resolutions[0].name, resolutions[1].name, cycles);
+
+	ret = bufmgr_buckets_validate();
+	printf("bucket rounding up to %u MB: %s\n", BUFMGR_BUCKET_MAX / (1024 * 1024),
+	       ret ? "FAILED" : "ok");
+	if (ret)
+		return -1;
+
+	for (r = 0; r < 2; r++) {
+		uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], size;
+
+		format_layout(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, resolutions[r].width,
+			      resolutions[r].height, pitches, offsets, &size);
+		sizes[r] = size;
+		printf("%-8s %10.2f MB in a %.2f MB bucket\n", resolutions[r].name,
+		       (double)size / (1024 * 1024), (double)bufmgr_bucket_size(size) / (1024 * 1024));
+	}
+
+	printf("%-8s %10s %10s %10s %s\n", "bufmgr", "us/cycle", "creates", "reused", "check");
+
+	drm_fd = open(DEFAULT_DRM_DEVICE, O_RDWR | O_CLOEXEC);
+	bufmgr = drm_fd >= 0 ? bufmgr_create(drm_fd) : NULL;
+	direct = drm_fd >= 0 ? bufmgr_cycles(drm_fd, NULL, sizes, cycles) : 0;
+	cached = bufmgr ? bufmgr_cycles(drm_fd, bufmgr, sizes, cycles) : 0;
+	if (!direct || !cached) {
+		printf("%-8s %10s %10s %10s\n", "none", "n/a", "n/a", "n/a");
+		printf("%-8s %10s %10s %10s\n", "cached", "n/a", "n/a", "n/a");
+		bufmgr_destroy(bufmgr);
+		if (drm_fd >= 0)
+			close(drm_fd);
+		return 0;
+	}
+
+	bufmgr_stats_get(bufmgr, &stats);
+	/* one object per size, unless the kernel purged one meanwhile */
+	valid = stats.creates - stats.purged == 2 && stats.hits + stats.creates == cycles &&
+		stats.cached == 2;
+
+	printf("%-8s %10.1f %10u %10s\n", "none", (double)direct / 1000, cycles, "-");
+	printf("%-8s %10.1f %10" PRIu64 " %10" PRIu64 " %s\n", "cached", (double)cached / 1000,
+	       stats.creates, stats.hits, valid ? "ok" : "FAILED");
+
+	bufmgr_destroy(bufmgr);
+	close(drm_fd);
+	return valid ? 0 : -1;
+}
+
+/* Producer layouts the import must take or refuse, size is relative to the format_layout() one */
+static const struct {
+	const char *name;
+	uint32_t format;
+	uint64_t modifier;
+	int32_t size;
+	int32_t pitch;
+	bool valid;
+} dmabuf_layouts[] = {
+	{ "XRGB8888 linear", DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, 0, 0, true },
+	{ "XRGB8888 short", DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, -1, 0, false },
+	{ "XRGB8888 pitch", DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, 0, -64, false },
+	{ "NV12 linear", DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR, 0, 0, true },
+	{ "NV12 short", DRM_FORMAT_NV12, DRM_FORMAT_MOD_LINEAR, -1, 0, false },
+	{ "XRGB8888 X", DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_X_TILED, 0, 0, true },
+	{ "XRGB8888 X pitch", DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_X_TILED, 0, 64, false },
+	{ "XRGB8888 Y", DRM_FORMAT_XRGB8888, I915_FORMAT_MOD_Y_TILED, 0, 0, true },
+};
+
+static int dmabuf_layouts_validate(const struct resolution *res)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(dmabuf_layouts) / sizeof(dmabuf_layouts[0]); i++) {
+		uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], size;
+		bool valid;
+
+		if (format_layout(dmabuf_layouts[i].format, dmabuf_layouts[i].modifier, res->width,
+				  res->height, pitches, offsets, &size))
+			return -1;
+		pitches[0] += dmabuf_layouts[i].pitch;
+
+		valid = !dmabuf_layout_check(size + dmabuf_layouts[i].size, dmabuf_layouts[i].format,
+					     dmabuf_layouts[i].modifier, res->width, res->height,
+					     pitches, offsets);
+		printf("%-18s %-8s %s\n", dmabuf_layouts[i].name, valid ? "taken" : "refused",
+		       valid == dmabuf_layouts[i].valid ? "ok" : "FAILED");
+		if (valid != dmabuf_layouts[i].valid)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The producer writes its frame in the memfd, the importer view, the
+ * dma-buf or without udmabuf another mapping of the memfd, must show it
+ * without any copy. Returns the mean handoff time, sync ioctls included.
+ */
+static uint64_t dmabuf_shm_frames(struct dmabuf_shm *shm, unsigned frames, bool *valid)
+{
+	int fd = shm->dmabuf_fd >= 0 ? shm->dmabuf_fd : shm->memfd;
+	uint64_t start, elapsed = 0;
+	uint32_t *view;
+	unsigned i;
+
+	view = mmap(NULL, shm->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (view == MAP_FAILED) {
+		*valid = false;
+		return 0;
+	}
+
+	*valid = true;
+	for (i = 0; i < frames; i++) {
+		uint32_t *frame = (uint32_t *)shm->map;
+		size_t last = shm->size / 4 - 1;
+
+		frame[0] = frame[last] = i;
+		start = now_ns();
+		if (shm->dmabuf_fd >= 0) {
+			dmabuf_sync_begin(shm->dmabuf_fd, DMA_BUF_SYNC_READ);
+			dmabuf_sync_end(shm->dmabuf_fd, DMA_BUF_SYNC_READ);
+		}
+		elapsed += now_ns() - start;
+		if (view[0] != i || view[last] != i)
+			*valid = false;
+	}
+
+	munmap(view, shm->size);
+	return elapsed / frames;
+}
+
+/* Export from one file of the device, import in another one twice, and back in the exporter */
+static int dmabuf_prime_validate(int drm_fd, uint64_t size)
+{
+	struct bufmgr *exporter = bufmgr_create(drm_fd), *importer;
+	struct bufmgr_bo *bo, *imported, *again, *back;
+	int import_fd, dmabuf_fd, back_err, ret = -1;
+
+	import_fd = open(DEFAULT_DRM_DEVICE, O_RDWR | O_CLOEXEC);
+	importer = import_fd >= 0 ? bufmgr_create(import_fd) : NULL;
+	bo = exporter ? bufmgr_bo_alloc(exporter, size, I915_TILING_NONE, 0) : NULL;
+	if (!importer || !bo || bufmgr_bo_export(bo, &dmabuf_fd))
+		goto out;
+
+	imported = bufmgr_bo_import(importer, dmabuf_fd);
+	again = bufmgr_bo_import(importer, dmabuf_fd);
+	back = bufmgr_bo_import(exporter, dmabuf_fd);
+	back_err = errno;
+	close(dmabuf_fd);
+	if (imported && again && !back && back_err == EINVAL)
+		ret = imported == again && imported->size == bo->size && imported->imports == 2 ? 0 : -1;
+	if (back)
+		bufmgr_bo_free(back);
+	if (again)
+		bufmgr_bo_free(again);
+	if (imported)
+		bufmgr_bo_free(imported);
+
+out:
+	if (bo)
+		bufmgr_bo_free(bo);
+	bufmgr_destroy(importer);
+	bufmgr_destroy(exporter);
+	if (import_fd >= 0)
+		close(import_fd);
+	return ret;
+}
+
+static int bench_dmabuf(void)
+{
+	const struct resolution *res = &resolutions[1];
+	const unsigned frames = 100;
+	uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], size;
+	struct dmabuf_shm shm;
+	struct modeset_buf copy;
+	uint64_t start, copied, handoff;
+	unsigned i;
+	int drm_fd;
+	bool valid;
+
+	printf("dmabuf: %s XRGB8888 frames of a shared memory producer, %u frames\n", res->name,
+	       frames);
+
+	if (dmabuf_layouts_validate(res))
+		return -1;
+
+	format_layout(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, res->width, res->height, pitches,
+		      offsets, &size);
+	if (dmabuf_shm_create(&shm, size))
+		return -ENOMEM;
+	if (buf_alloc(&copy, res->width, res->height)) {
+		dmabuf_shm_destroy(&shm);
+		return -ENOMEM;
+	}
+
+	/* what producers did before, a copy into the mapped framebuffer */
+	start = now_ns();
+	for (i = 0; i < frames; i++)
+		memcpy(copy.map, shm.map, size);
+	copied = (now_ns() - start) / frames;
+	buf_free(&copy);
+
+	handoff = dmabuf_shm_frames(&shm, frames, &valid);
+	printf("%-10s %12s %s\n", "handoff", "us/frame", "check");
+	printf("%-10s %12.1f\n", "memcpy", (double)copied / 1000);
+	printf("%-10s %12.1f %s\n", shm.dmabuf_fd >= 0 ? "udmabuf" : "memfd", (double)handoff / 1000,
+	       valid ? "ok" : "FAILED");
+	dmabuf_shm_destroy(&shm);
+	if (!valid)
+		return -1;
+
+	drm_fd = open(DEFAULT_DRM_DEVICE, O_RDWR | O_CLOEXEC);
+	if (drm_fd < 0) {
+		printf("%-10s %12s\n", "prime", "n/a");
+		return 0;
+	}
+
+	valid = !dmabuf_prime_validate(drm_fd, size);
+	printf("%-10s %12s %s\n", "prime", "-", valid ? "ok" : "FAILED");
+	close(drm_fd);
+	return valid ? 0 : -1;
+}
+
+#define EVENTS_HEADS 3
+#define EVENTS_TICKS 100
+#define EVENTS_UNKNOWN_CRTC 99
+
+/*
+ * A pipe stands in for the DRM fd and the timer for the display: every
+ * tick flips the first two heads, asks a vblank of the third and writes
+ * the kernel events back, with strays drm_handle_events() has to drop.
+ */
+struct events_sim {
+	int pipe[2];
+	struct event_loop *loop;
+	struct modeset_dev heads[EVENTS_HEADS];
+	uint64_t period_ns, next_ns;
+	uint64_t late_ns, max_late_ns;
+	unsigned ticks;
+	/* handler calls per head, the addresses are the cookies */
+	unsigned flips[EVENTS_HEADS];
+	unsigned vblanks;
+	/* handler calls of a wrong head, cookie, sequence or time */
+	unsigned wrong;
+};
+
+static void events_sim_write(struct events_sim *sim, uint32_t type, uint32_t crtc,
+			     uint64_t user_data, uint64_t time_ns)
+{
+	struct drm_event_vblank event = {
+		.base = {
+			.type = type,
+			.length = sizeof(event),
+		},
+		.user_data = user_data,
+		.tv_sec = time_ns / NSEC_PER_SEC,
+		.tv_usec = time_ns % NSEC_PER_SEC / 1000,
+		.sequence = sim->ticks,
+		.crtc_id = crtc,
+	};
+
+	if (write(sim->pipe[1], &event, sizeof(event)) != sizeof(event))
+		sim->wrong++;
+}
+
+static void events_sim_tick(uint64_t expirations, void *data)
+{
+	struct events_sim *sim = data;
+	uint64_t now = event_loop_now_ns(), late = now - sim->next_ns;
+	struct modeset_dev *heads = sim->heads;
+	unsigned i;
+
+	sim->late_ns += late;
+	if (late > sim->max_late_ns)
+		sim->max_late_ns = late;
+	sim->next_ns += expirations * sim->period_ns;
+	sim->ticks++;
+
+	/* what drm_flip() and drm_vblank_request() leave behind */
+	for (i = 0; i < 2; i++) {
+		heads[i].flip_pending = true;
+		heads[i].flip_cookie = &sim->flips[i];
+	}
+	heads[2].vblank_pending = true;
+	heads[2].vblank_cookie = &sim->vblanks;
+
+	events_sim_write(sim, DRM_EVENT_FLIP_COMPLETE, heads[0].crtc, 0, now);
+	events_sim_write(sim, DRM_EVENT_FLIP_COMPLETE, heads[1].crtc, 0, now);
+	/* a second completion, no flip of head 2 and an unknown CRTC */
+	events_sim_write(sim, DRM_EVENT_FLIP_COMPLETE, heads[0].crtc, 0, now);
+	events_sim_write(sim, DRM_EVENT_FLIP_COMPLETE, heads[2].crtc, 0, now);
+	events_sim_write(sim, DRM_EVENT_FLIP_COMPLETE, EVENTS_UNKNOWN_CRTC, 0, now);
+	/* vblank events carry the CRTC as their user data */
+	events_sim_write(sim, DRM_EVENT_VBLANK, 0, heads[2].crtc, now);
+	events_sim_write(sim, DRM_EVENT_VBLANK, 0, heads[2].crtc, now);
+	events_sim_write(sim, DRM_EVENT_VBLANK, 0, EVENTS_UNKNOWN_CRTC, now);
+}
+
+static bool events_sim_event_valid(struct events_sim *sim, uint64_t time_ns, unsigned sequence)
+{
+	uint64_t now = event_loop_now_ns();
+
+	return sequence == sim->ticks && time_ns <= now && now - time_ns < NSEC_PER_SEC;
+}
+
+static void events_sim_flip_done(struct modeset_dev *dev, void *cookie, uint64_t time_ns,
+				 unsigned sequence, void *data)
+{
+	struct events_sim *sim = data;
+	unsigned head = dev - sim->heads;
+
+	if (head >= EVENTS_HEADS || cookie != &sim->flips[head] ||
+	    !events_sim_event_valid(sim, time_ns, sequence)) {
+		sim->wrong++;
+		return;
+	}
+
+	sim->flips[head]++;
+}
+
+static void events_sim_vblank(struct modeset_dev *dev, void *cookie, uint64_t time_ns,
+			      unsigned sequence, void *data)
+{
+	struct events_sim *sim = data;
+
+	if (dev != &sim->heads[2] || cookie != &sim->vblanks ||
+	    !events_sim_event_valid(sim, time_ns, sequence)) {
+		sim->wrong++;
+		return;
+	}
+
+	sim->vblanks++;
+}
+
+static void events_sim_read(int fd, void *data)
+{
+	struct events_sim *sim = data;
+	const struct drm_event_handlers handlers = {
+		.flip_done = events_sim_flip_done,
+		.vblank = events_sim_vblank,
+		.data = sim,
+	};
+
+	(void)fd;
+	if (drm_handle_events(sim->heads, &handlers))
+		sim->wrong++;
+	if (sim->ticks >= EVENTS_TICKS)
+		event_loop_quit(sim->loop);
+}
+
+static int bench_events(void)
+{
+	struct events_sim sim = {
+		.period_ns = 4 * NSEC_PER_MSEC,
+	};
+	unsigned i;
+	int timer;
+	bool valid;
+
+	printf("events: flip and vblank events through drm_handle_events(), %u ticks of a pipe\n",
+	       EVENTS_TICKS);
+
+	if (pipe(sim.pipe))
+		return -errno;
+	for (i = 0; i < EVENTS_HEADS; i++) {
+		sim.heads[i].drm_fd = sim.pipe[0];
+		sim.heads[i].crtc = 31 + i;
+		sim.heads[i].next = i + 1 < EVENTS_HEADS ? &sim.heads[i + 1] : NULL;
+	}
+
+	sim.loop = event_loop_create();
+	if (!sim.loop || event_loop_fd_add(sim.loop, sim.pipe[0], events_sim_read, &sim)) {
+		event_loop_destroy(sim.loop);
+		close(sim.pipe[0]);
+		close(sim.pipe[1]);
+		return -ENOMEM;
+	}
+
+	timer = event_loop_timer_add(sim.loop, events_sim_tick, &sim);
+	sim.next_ns = event_loop_now_ns() + sim.period_ns;
+	if (timer < 0 || event_loop_timer_arm(sim.loop, timer, sim.next_ns, sim.period_ns) ||
+	    event_loop_run(sim.loop))
+		sim.wrong++;
+
+	/* every cookie came back once, the strays were dropped and nothing is left pending */
+	valid = !sim.wrong && sim.flips[0] == sim.ticks && sim.flips[1] == sim.ticks &&
+		!sim.flips[2] && sim.vblanks == sim.ticks;
+	for (i = 0; i < EVENTS_HEADS; i++)
+		valid &= !sim.heads[i].flip_pending && !sim.heads[i].vblank_pending;
+
+	printf("%-10s %8s %8s %8s %8s %10s %10s %s\n", "period", "ticks", "flips", "vblanks",
+	       "wrong", "late us", "max us", "check");
+	printf("%-10s %8u %8u %8u %8u %10.1f %10.1f %s\n", "4 ms", sim.ticks,
+	       sim.flips[0] + sim.flips[1] + sim.flips[2], sim.vblanks, sim.wrong,
+	       (double)sim.late_ns / sim.ticks / 1000, (double)sim.max_late_ns / 1000,
+	       valid ? "ok" : "FAILED");
+
+	event_loop_destroy(sim.loop);
+	close(sim.pipe[0]);
+	close(sim.pipe[1]);
+	return valid ? 0 : -1;
+}
+
+/* Render cost of a simulated frame: base, up to 1 ms of jitter and a spike every 50 frames */
+static uint64_t sched_sim_cost(uint32_t *seed, unsigned frame, uint64_t base_ns)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return base_ns + *seed % NSEC_PER_MSEC + (frame % 50 == 49 ? 3 * NSEC_PER_MSEC : 0);
+}
+
+/* First vblank of the simulated clock at or after time_ns */
+static uint64_t sched_sim_vblank(uint64_t time_ns, uint64_t period_ns, unsigned *sequence)
+{
+	*sequence = (time_ns + period_ns - 1) / period_ns;
+	return (uint64_t)*sequence * period_ns;
+}
+
+/*
+ * Frames paced by flip events against a simulated vblank clock, rendered
+ * right after the previous flip or when the scheduler says. The clock runs
+ * 0.1% slower than the mode timings, the scheduler has to catch up.
+ */
+static int bench_sched(void)
+{
+	const drmModeModeInfo mode = {
+		.clock = 148500,
+		.hdisplay = 1920,
+		.htotal = 2200,
+		.vdisplay = 1080,
+		.vtotal = 1125,
+		.vrefresh = 60,
+	};
+	const uint64_t base_ns = 4 * NSEC_PER_MSEC, margin_ns = NSEC_PER_MSEC;
+	const unsigned frames = 600;
+	uint64_t mode_period = frame_sched_mode_period(&mode), period = mode_period * 1001 / 1000;
+	uint64_t now = 0, asap_latency = 0;
+	unsigned asap_misses = 0, i, sequence;
+	struct frame_sched_stats stats;
+	struct frame_sched *sched;
+	uint32_t seed = 1;
+	double period_err;
+	bool valid;
+
+	printf("sched: %ux%u@%u, %u frames of %.0f-%.0f ms, +3 ms every 50th\n", mode.hdisplay,
+	       mode.vdisplay, mode.vrefresh, frames, (double)base_ns / NSEC_PER_MSEC,
+	       (double)base_ns / NSEC_PER_MSEC + 1);
+
+	for (i = 0; i < frames; i++) {
+		uint64_t next = sched_sim_vblank(now + 1, period, &sequence);
+		uint64_t end = now + sched_sim_cost(&seed, i, base_ns);
+		uint64_t shown = sched_sim_vblank(end + margin_ns, period, &sequence);
+
+		asap_latency += shown - now;
+		asap_misses += shown > next;
+		now = shown;
+	}
+
+	sched = frame_sched_create(mode_period, margin_ns);
+	if (!sched)
+		return -ENOMEM;
+
+	seed = 1;
+	now = 0;
+	frame_sched_vblank(sched, 0, 0);
+	for (i = 0; i < frames; i++) {
+		uint64_t start = frame_sched_start(sched, now);
+		uint64_t end = start + sched_sim_cost(&seed, i, base_ns);
+
+		frame_sched_rendered(sched, start, end);
+		now = sched_sim_vblank(end + margin_ns, period, &sequence);
+		frame_sched_flip_done(sched, now, sequence);
+	}
+	frame_sched_stats_get(sched, &stats);
+	frame_sched_destroy(sched);
+
+	period_err = ((double)stats.period_ns - period) / period;
+	/* the spikes are beyond any prediction, the rest has to make it */
+	valid = stats.latency_ns < asap_latency && stats.misses <= frames / 50 &&
+		period_err < 0.0001 && period_err > -0.0001;
+
+	printf("%-10s %12s %12s %12s %s\n", "start", "latency ms", "saved ms", "misses", "check");
+	printf("%-10s %12.2f %12s %12u\n", "asap", (double)asap_latency / frames / NSEC_PER_MSEC, "-",
+	       asap_misses);
+	printf("%-10s %12.2f %12.2f %12" PRIu64 " %s\n", "jit",
+	       (double)stats.latency_ns / frames / NSEC_PER_MSEC,
+	       (double)stats.saved_ns / frames / NSEC_PER_MSEC, stats.misses, valid ? "ok" : "FAILED");
+	printf("period %.4f ms predicted, %.4f ms simulated, cost %.2f ms predicted\n",
+	       (double)stats.period_ns / NSEC_PER_MSEC, (double)period / NSEC_PER_MSEC,
+	       (double)stats.cost_ns / NSEC_PER_MSEC);
+
+	return valid ? 0 : -1;
+}
+
+struct benchmark {
+	const char *name;
+	int (*run)(void);
+};
+
+static const struct benchmark benchmarks[] = {
+	{ "fill", bench_fill },
+	{ "raster", bench_raster },
+	{ "tiling", bench_tiling },
+	{ "pool", bench_pool },
+	{ "damage", bench_damage },
+	{ "dirty", bench_dirty },
+	{ "region", bench_region },
+	{ "scene", bench_scene },
+	{ "compositor", bench_compositor },
+	{ "format", bench_format },
+	{ "convert", bench_convert },
+	{ "stream", bench_stream },
+	{ "hash", bench_hash },
+	{ "golden", bench_golden },
+	{ "swapchain", bench_swapchain },
+	{ "fbpool", bench_fbpool },
+	{ "startup", bench_startup },
+	{ "map", bench_map },
+	{ "layout", bench_layout },
+	{ "bufmgr", bench_bufmgr },
+	{ "dmabuf", bench_dmabuf },
+	{ "events", bench_events },
+	{ "sched", bench_sched },
+};
+
+int main(int argc, char *argv[])
+{
+	bool found = false;
+	unsigned i;
+	int ret = 0;
+
+	printf("fill kernel: %s\n\n", fill_kernel_name());
+
+	for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+		if (argc > 1 && strcmp(argv[1], benchmarks[i].name))
+			continue;
+
+		found = true;
+		ret |= benchmarks[i].run();
+		printf("\n");
+	}
+
+	if (!found) {
+		fprintf(stderr, "unknown benchmark '%s'\n", argv[1]);
+		return -1;
+	}
+
+	return ret ? -1 : 0;
+}
@@ -0,0 +1,395 @@
+#include "bufmgr.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <i915_drm.h>
+#include <xf86drm.h>
+
+#include "dmabuf.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/* 1 to 4 pages, then 4 per power of two from 4 to 65536 pages */
+#define BUCKETS (4 + 4 * 14)
+
+/* most recently freed first */
+struct bufmgr_bucket {
+	struct bufmgr_bo *head, *tail;
+};
+
+struct bufmgr {
+	int fd;
+	struct bufmgr_bucket buckets[BUCKETS];
+	/* looked up by handle, the kernel has one per dma-buf and file */
+	struct bufmgr_bo *imports;
+	/* exported objects allocated here, their handle comes back from an import */
+	struct bufmgr_bo *exports;
+	struct bufmgr_stats stats;
+};
+
+static uint64_t _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Bucket of size, -1 if it is not cached */
+static int _bucket(uint64_t size, uint64_t *bucket_size)
+{
+	uint64_t pages = (size + GEM_PAGE_SIZE - 1) / GEM_PAGE_SIZE, base, step, steps;
+	unsigned order;
+
+	if (!pages)
+		pages = 1;
+	if (pages <= 4) {
+		*bucket_size = pages * GEM_PAGE_SIZE;
+		return pages - 1;
+	}
+
+	/* base < pages <= 2 * base, in quarters of base */
+	order = 63 - __builtin_clzll(pages - 1);
+	base = 1ULL << order;
+	step = base / 4;
+	steps = (pages - base + step - 1) / step;
+	*bucket_size = (base + steps * step) * GEM_PAGE_SIZE;
+	if (*bucket_size > BUFMGR_BUCKET_MAX) {
+		*bucket_size = pages * GEM_PAGE_SIZE;
+		return -1;
+	}
+
+	return 4 + (order - 2) * 4 + steps - 1;
+}
+
+uint64_t bufmgr_bucket_size(uint64_t size)
+{
+	uint64_t bucket_size;
+
+	_bucket(size, &bucket_size);
+	return bucket_size;
+}
+
+static void _list_unlink(struct bufmgr *bufmgr, struct bufmgr_bo *bo)
+{
+	struct bufmgr_bucket *bucket = &bufmgr->buckets[bo->bucket];
+
+	if (bo->prev)
+		bo->prev->next = bo->next;
+	else
+		bucket->head = bo->next;
+	if (bo->next)
+		bo->next->prev = bo->prev;
+	else
+		bucket->tail = bo->prev;
+	bufmgr->stats.cached_bytes -= bo->size;
+	bufmgr->stats.cached--;
+}
+
+static void _list_push_front(struct bufmgr *bufmgr, struct bufmgr_bo *bo)
+{
+	struct bufmgr_bucket *bucket = &bufmgr->buckets[bo->bucket];
+
+	bo->prev = NULL;
+	bo->next = bucket->head;
+	if (bucket->head)
+		bucket->head->prev = bo;
+	else
+		bucket->tail = bo;
+	bucket->head = bo;
+	bufmgr->stats.cached_bytes += bo->size;
+	bufmgr->stats.cached++;
+}
+
+/* The imports and exports, linked the same way as the buckets */
+static void _set_add(struct bufmgr_bo **head, struct bufmgr_bo *bo)
+{
+	bo->prev = NULL;
+	bo->next = *head;
+	if (*head)
+		(*head)->prev = bo;
+	*head = bo;
+}
+
+static void _set_remove(struct bufmgr_bo **head, struct bufmgr_bo *bo)
+{
+	if (bo->prev)
+		bo->prev->next = bo->next;
+	else
+		*head = bo->next;
+	if (bo->next)
+		bo->next->prev = bo->prev;
+}
+
+static struct bufmgr_bo *_set_find(struct bufmgr_bo *head, uint32_t handle)
+{
+	for (; head; head = head->next) {
+		if (head->handle == handle)
+			return head;
+	}
+
+	return NULL;
+}
+
+static void _bo_close(struct bufmgr_bo *bo)
+{
+	int fd = bo->bufmgr->fd;
+	unsigned i;
+
+	for (i = 0; i < sizeof(bo->maps) / sizeof(bo->maps[0]); i++) {
+		if (bo->maps[i])
+			gem_buffer_unmap(fd, bo->maps[i], bo->size);
+	}
+	gem_buffer_destroy(fd, bo->handle);
+	free(bo);
+}
+
+/* The oldest are at the tails */
+static void _cache_expire(struct bufmgr *bufmgr, uint64_t now)
+{
+	unsigned i;
+
+	for (i = 0; i < BUCKETS; i++) {
+		struct bufmgr_bo *bo;
+
+		while ((bo = bufmgr->buckets[i].tail) && now - bo->free_ns > BUFMGR_CACHE_NS) {
+			_list_unlink(bufmgr, bo);
+			_bo_close(bo);
+			bufmgr->stats.expired++;
+		}
+	}
+}
+
+/* The oldest idle object of bucket still holding its pages */
+static struct bufmgr_bo *_cache_take(struct bufmgr *bufmgr, int bucket)
+{
+	struct bufmgr_bo *bo;
+
+	while ((bo = bufmgr->buckets[bucket].tail)) {
+		uint32_t busy = 0, retained = 0;
+
+		/* the younger ones are even less likely to be idle */
+		if (!gem_busy(bufmgr->fd, bo->handle, &busy) && busy)
+			return NULL;
+
+		_list_unlink(bufmgr, bo);
+		if (!gem_madvise(bufmgr->fd, bo->handle, I915_MADV_WILLNEED, &retained) && retained)
+			return bo;
+
+		_bo_close(bo);
+		bufmgr->stats.purged++;
+	}
+
+	return NULL;
+}
+
+struct bufmgr *bufmgr_create(int drm_fd)
+{
+	struct bufmgr *bufmgr = calloc(1, sizeof(*bufmgr));
+
+	if (!bufmgr)
+		return NULL;
+
+	bufmgr->fd = drm_fd;
+	return bufmgr;
+}
+
+void bufmgr_destroy(struct bufmgr *bufmgr)
+{
+	if (!bufmgr)
+		return;
+
+	bufmgr_cache_purge(bufmgr);
+	free(bufmgr);
+}
+
+int bufmgr_fd(const struct bufmgr *bufmgr)
+{
+	return bufmgr->fd;
+}
+
+void bufmgr_cache_purge(struct bufmgr *bufmgr)
+{
+	unsigned i;
+
+	for (i = 0; i < BUCKETS; i++) {
+		struct bufmgr_bo *bo;
+
+		while ((bo = bufmgr->buckets[i].tail)) {
+			_list_unlink(bufmgr, bo);
+			_bo_close(bo);
+		}
+	}
+}
+
+static struct bufmgr_bo *_bo_create(struct bufmgr *bufmgr, uint64_t size, int bucket)
+{
+	struct bufmgr_bo *bo = calloc(1, sizeof(*bo));
+
+	if (!bo) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (gem_buffer_create(bufmgr->fd, size, &bo->handle)) {
+		free(bo);
+		return NULL;
+	}
+
+	bo->bufmgr = bufmgr;
+	bo->size = size;
+	bo->tiling = I915_TILING_NONE;
+	bo->bucket = bucket;
+	bufmgr->stats.creates++;
+	return bo;
+}
+
+struct bufmgr_bo *bufmgr_bo_alloc(struct bufmgr *bufmgr, uint64_t size, uint32_t tiling,
+				  uint32_t stride)
+{
+	struct bufmgr_bo *bo = NULL;
+	uint64_t bucket_size;
+	int bucket;
+
+	_cache_expire(bufmgr, _now_ns());
+
+	bucket = _bucket(size, &bucket_size);
+	if (bucket >= 0 && (bo = _cache_take(bufmgr, bucket)))
+		bufmgr->stats.hits++;
+
+	if (!bo) {
+		bo = _bo_create(bufmgr, bucket_size, bucket);
+		/* the cached objects may be what the memory is short of */
+		if (!bo && bufmgr->stats.cached) {
+			bufmgr_cache_purge(bufmgr);
+			bo = _bo_create(bufmgr, bucket_size, bucket);
+		}
+		if (!bo)
+			return NULL;
+	}
+
+	if (tiling == I915_TILING_NONE)
+		stride = 0;
+	if (bo->tiling != tiling || bo->stride != stride) {
+		if (gem_set_tiling(bufmgr->fd, bo->handle, tiling, stride)) {
+			int err = errno;
+
+			_bo_close(bo);
+			errno = err;
+			return NULL;
+		}
+		bo->tiling = tiling;
+		bo->stride = stride;
+	}
+
+	return bo;
+}
+
+void bufmgr_bo_free(struct bufmgr_bo *bo)
+{
+	struct bufmgr *bufmgr = bo->bufmgr;
+	uint32_t retained = 0;
+	uint64_t now = _now_ns();
+
+	if (bo->imports) {
+		if (--bo->imports)
+			return;
+
+		_set_remove(&bufmgr->imports, bo);
+		_bo_close(bo);
+		return;
+	}
+
+	if (bo->exported) {
+		_set_remove(&bufmgr->exports, bo);
+		_bo_close(bo);
+		return;
+	}
+
+	if (bo->bucket < 0 ||
+	    gem_madvise(bufmgr->fd, bo->handle, I915_MADV_DONTNEED, &retained)) {
+		_bo_close(bo);
+		return;
+	}
+
+	bo->free_ns = now;
+	_list_push_front(bufmgr, bo);
+	_cache_expire(bufmgr, now);
+}
+
+int bufmgr_bo_export(struct bufmgr_bo *bo, int *dmabuf_fd)
+{
+	if (drmPrimeHandleToFD(bo->bufmgr->fd, bo->handle, DRM_CLOEXEC | DRM_RDWR, dmabuf_fd))
+		return -errno;
+
+	/* imports are found in their own set already */
+	if (!bo->exported && !bo->imports)
+		_set_add(&bo->bufmgr->exports, bo);
+	bo->exported = true;
+	return 0;
+}
+
+struct bufmgr_bo *bufmgr_bo_import(struct bufmgr *bufmgr, int dmabuf_fd)
+{
+	uint64_t size = dmabuf_size(dmabuf_fd);
+	struct bufmgr_bo *bo;
+	uint32_t handle;
+
+	if (!size) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (drmPrimeFDToHandle(bufmgr->fd, dmabuf_fd, &handle))
+		return NULL;
+
+	bo = _set_find(bufmgr->imports, handle);
+	if (bo) {
+		bo->imports++;
+		return bo;
+	}
+	/* the handle is the exporter's, a second bo would close it under it */
+	if (_set_find(bufmgr->exports, handle)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	bo = calloc(1, sizeof(*bo));
+	if (!bo) {
+		gem_buffer_destroy(bufmgr->fd, handle);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	bo->bufmgr = bufmgr;
+	bo->handle = handle;
+	bo->size = size;
+	bo->tiling = I915_TILING_NONE;
+	bo->bucket = -1;
+	bo->imports = 1;
+	_set_add(&bufmgr->imports, bo);
+	return bo;
+}
+
+void *bufmgr_bo_map(struct bufmgr_bo *bo, enum gem_mmap_type type)
+{
+	/* older kernels have no WC domain, the GTT one flushes the same way */
+	uint32_t domain = type == GEM_MMAP_CPU ? I915_GEM_DOMAIN_CPU : I915_GEM_DOMAIN_GTT;
+	int fd = bo->bufmgr->fd;
+
+	if (!bo->maps[type]) {
+		bo->maps[type] = gem_buffer_mmap_type(fd, bo->handle, bo->size, type);
+		if (!bo->maps[type])
+			return NULL;
+	}
+
+	/* only waits for the GPU and flushes its caches, a failure isn't fatal */
+	gem_set_domain(fd, bo->handle, domain, domain);
+	return bo->maps[type];
+}
+
+void bufmgr_stats_get(const struct bufmgr *bufmgr, struct bufmgr_stats *stats)
+{
+	*stats = bufmgr->stats;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gem_submission/lib.h"
+
+/*
+ * GEM buffer objects of one DRM device, with a cache of the released ones.
+ *
+ * Sizes are rounded up to a bucket: single pages up to 4 pages, then 4
+ * buckets per power of two, so at most a quarter is lost to the rounding.
+ * bufmgr_bo_free() keeps a bucket sized object with its mappings, marked
+ * I915_MADV_DONTNEED so the kernel may take its pages under memory
+ * pressure. bufmgr_bo_alloc() reuses the oldest idle object of the bucket
+ * if the kernel didn't, its content is undefined. Objects cached for more
+ * than BUFMGR_CACHE_NS are closed at the next alloc or free.
+ *
+ * Objects above BUFMGR_BUCKET_MAX are only page rounded and never cached,
+ * nor are imported and exported ones, other users may still access their
+ * pages. Not thread safe, one bufmgr per device and thread.
+ */
+
+#define BUFMGR_BUCKET_MAX (256 * 1024 * 1024)
+#define BUFMGR_CACHE_NS (2 * 1000000000ULL)
+
+struct bufmgr;
+
+struct bufmgr_bo {
+	struct bufmgr *bufmgr;
+	uint32_t handle;
+	/* what the kernel allocated, the bucket size */
+	uint64_t size;
+	/* I915_TILING_* and the pitch of the fence */
+	uint32_t tiling;
+	uint32_t stride;
+
+	/* private, kept until the object is closed */
+	void *maps[GEM_MMAP_CPU + 1];
+	/* -1 if not cached */
+	int bucket;
+	bool exported;
+	/* imports of the same dma-buf share the object */
+	unsigned imports;
+	struct bufmgr_bo *prev, *next;
+	uint64_t free_ns;
+};
+
+struct bufmgr_stats {
+	/* objects created by the kernel */
+	uint64_t creates;
+	/* objects taken back from the cache */
+	uint64_t hits;
+	/* cached objects closed because the kernel purged them */
+	uint64_t purged;
+	/* cached objects closed after BUFMGR_CACHE_NS */
+	uint64_t expired;
+	uint64_t cached_bytes;
+	unsigned cached;
+};
+
+struct bufmgr *bufmgr_create(int drm_fd);
+/* Closes the cached objects, the ones still allocated must be freed before */
+void bufmgr_destroy(struct bufmgr *bufmgr);
+int bufmgr_fd(const struct bufmgr *bufmgr);
+
+/* stride is ignored for I915_TILING_NONE */
+struct bufmgr_bo *bufmgr_bo_alloc(struct bufmgr *bufmgr, uint64_t size, uint32_t tiling,
+				  uint32_t stride);
+void bufmgr_bo_free(struct bufmgr_bo *bo);
+
+/*
+ * PRIME. The dma-buf of an export is the caller's to close. An import
+ * takes its own reference to the pages, the dma-buf fd can be closed right
+ * after. Importing a dma-buf exported by this same bufmgr fails with
+ * EINVAL, the handle is the exported object's own.
+ */
+int bufmgr_bo_export(struct bufmgr_bo *bo, int *dmabuf_fd);
+struct bufmgr_bo *bufmgr_bo_import(struct bufmgr *bufmgr, int dmabuf_fd);
+
+/*
+ * CPU pointer to bo, mapped once per type and moved to the matching
+ * domain at every call. Valid until bufmgr_bo_free().
+ */
+void *bufmgr_bo_map(struct bufmgr_bo *bo, enum gem_mmap_type type);
+
+/* Closes the cached objects */
+void bufmgr_cache_purge(struct bufmgr *bufmgr);
+
+void bufmgr_stats_get(const struct bufmgr *bufmgr, struct bufmgr_stats *stats);
+
+/* Bytes bufmgr_bo_alloc() allocates for size */
+uint64_t bufmgr_bucket_size(uint64_t size);
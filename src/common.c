@@ -5,18 +5,88 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/mman.h>
 
 #include <drm_fourcc.h>
+#include <i915_drm.h>
 
-#include "intel_bufmgr.h"
+#include "bufmgr.h"
+#include "dmabuf.h"
+#include "fb_pool.h"
+#include "kms_atomic.h"
+#include "scene_cache.h"
+#include "swapchain.h"
 
-static drm_intel_bufmgr *bufmgr;
+/* released framebuffers kept for the next modesets, two 4K swapchains of 3 */
+#define FB_POOL_BUDGET (192 * 1024 * 1024)
 
-//#define TILING DRM_FORMAT_MOD_LINEAR
-//#define TILING I915_FORMAT_MOD_X_TILED
-#define TILING I915_FORMAT_MOD_Y_TILED
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+
+/* devices with a modeset, until drm_close() */
+#define DRM_DEVICES_MAX 4
+
+/*
+ * Framebuffers released by the scene caches and swapchains go to the
+ * fb_pool, the buffer objects the fb_pool trims go to the bufmgr cache.
+ */
+static struct drm_device {
+	int fd;
+	struct bufmgr *bufmgr;
+	struct fb_pool *fb_pool;
+	/* DRM_CLIENT_CAP_ATOMIC is set */
+	bool atomic;
+} devices[DRM_DEVICES_MAX];
+
+static bool atomic_enabled = true;
+
+static enum swapchain_init swapchain_init = SWAPCHAIN_INIT_BACKGROUND;
+static enum drm_map map_default = DRM_MAP_GTT;
+
+/* connectors with buffers accounted to them, more are only in the totals */
+#define MEMORY_CONNECTORS_MAX 8
+
+/* buffers are only created and destroyed from the main thread */
+static struct {
+	struct drm_memory_stats stats;
+	struct {
+		uint32_t conn;
+		uint64_t bytes;
+	} connectors[MEMORY_CONNECTORS_MAX];
+} memory;
+
+static const char *const role_names[] = {
+	[DRM_ROLE_SCANOUT] = "scanout",
+	[DRM_ROLE_SCENE] = "scene",
+	[DRM_ROLE_CURSOR] = "cursor",
+	[DRM_ROLE_POOL] = "pool",
+};
+static struct drm_startup_stats startup_stats;
+
+static uint64_t _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * Modifiers of the scanout buffers, best first: render compression saves
+ * the most memory bandwidth, then Y tiles, X tiles and linear. Only the
+ * ones the primary plane lists in IN_FORMATS and format_layout() can lay
+ * out are tried, in this order until AddFB2 takes one.
+ */
+static const uint64_t modifier_preference[] = {
+	I915_FORMAT_MOD_Y_TILED_CCS,
+	I915_FORMAT_MOD_Y_TILED,
+	I915_FORMAT_MOD_X_TILED,
+	DRM_FORMAT_MOD_LINEAR,
+};
+
+#define MODIFIERS_MAX (sizeof(modifier_preference) / sizeof(modifier_preference[0]))
 
 int drm_open(const char *drm_device)
 {
@@ -40,38 +110,188 @@ int drm_open(const char *drm_device)
 	return fd;
 }
 
+static struct drm_device *_device_get(int fd)
+{
+	unsigned i;
+
+	for (i = 0; i < DRM_DEVICES_MAX; i++) {
+		if (devices[i].bufmgr && devices[i].fd == fd)
+			return &devices[i];
+	}
+
+	return NULL;
+}
+
 void drm_close(int fd)
 {
-	drm_intel_bufmgr_destroy(bufmgr);
+	struct drm_device *device = _device_get(fd);
+
+	if (device) {
+		fb_pool_destroy(device->fb_pool);
+		bufmgr_destroy(device->bufmgr);
+		memset(device, 0, sizeof(*device));
+	}
 	close(fd);
 }
 
+static const char *const map_names[] = {
+	[DRM_MAP_GTT] = "GTT",
+	[DRM_MAP_WC] = "WC",
+	[DRM_MAP_CPU] = "CPU",
+};
+
+static const enum gem_mmap_type map_types[] = {
+	[DRM_MAP_GTT] = GEM_MMAP_GTT,
+	[DRM_MAP_WC] = GEM_MMAP_WC,
+	[DRM_MAP_CPU] = GEM_MMAP_CPU,
+};
+
+static int _map_buffer(struct modeset_buf *buf, enum drm_map map)
+{
+	uint8_t *ptr;
+
+	if (map > DRM_MAP_CPU)
+		return -EINVAL;
+
+	ptr = bufmgr_bo_map(buf->bo, map_types[map]);
+	if (!ptr) {
+		fprintf(stderr, "cannot %s map buffer (%d): %m\n", map_names[map], errno);
+		return -errno;
+	}
+
+	buf->map = ptr;
+	buf->map_mode = map;
+	/* only the GTT aperture has a fence detiling the buffer */
+	buf->map_tiled = map != DRM_MAP_GTT && buf->modifier != DRM_FORMAT_MOD_LINEAR;
+	buf->map_wc = map != DRM_MAP_CPU;
+	buf->map_cached = map == DRM_MAP_CPU;
+	return 0;
+}
+
+/* the mappings stay with the buffer object, remapping back is free */
+static void _unmap_buffer(struct modeset_buf *buf)
+{
+	buf->map = NULL;
+}
+
+static uint64_t *_memory_connector(uint32_t conn, bool add)
+{
+	unsigned i;
+
+	for (i = 0; i < MEMORY_CONNECTORS_MAX; i++) {
+		if (memory.connectors[i].conn == conn)
+			return &memory.connectors[i].bytes;
+	}
+
+	for (i = 0; add && i < MEMORY_CONNECTORS_MAX; i++) {
+		if (!memory.connectors[i].bytes) {
+			memory.connectors[i].conn = conn;
+			return &memory.connectors[i].bytes;
+		}
+	}
+
+	return NULL;
+}
+
+/* sign is 1 when buf is accounted, -1 when it goes away */
+static void _memory_account(const struct modeset_buf *buf, int sign)
+{
+	struct drm_memory_stats *stats = &memory.stats;
+	uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], layout = buf->size;
+	uint64_t *connector;
+
+	format_layout(buf->format, buf->modifier, buf->width, buf->height, pitches, offsets,
+		      &layout);
+
+	stats->bytes += sign * (int64_t)buf->size;
+	stats->layout_bytes += sign * (int64_t)layout;
+	stats->roles[buf->role] += sign * (int64_t)buf->size;
+	stats->buffers += sign;
+	if (stats->bytes > stats->peak)
+		stats->peak = stats->bytes;
+
+	if (buf->owner && (connector = _memory_connector(buf->owner, sign > 0)))
+		*connector += sign * (int64_t)buf->size;
+}
+
+/* buf changes hands, the pool keeps it or takes it out */
+static void _memory_move(struct modeset_buf *buf, enum drm_buffer_role role, uint32_t owner)
+{
+	_memory_account(buf, -1);
+	buf->role = role;
+	buf->owner = owner;
+	_memory_account(buf, 1);
+}
+
+void drm_memory_stats_get(struct drm_memory_stats *stats)
+{
+	*stats = memory.stats;
+}
+
+uint64_t drm_memory_connector_bytes(uint32_t conn)
+{
+	uint64_t *connector = _memory_connector(conn, false);
+
+	return connector ? *connector : 0;
+}
+
+void drm_memory_stats_print(void)
+{
+	const struct drm_memory_stats *stats = &memory.stats;
+	unsigned i;
+
+	printf("memory: %.1f MB in %u buffers, peak %.1f MB, layouts need %.1f MB\n",
+	       (double)stats->bytes / (1024 * 1024), stats->buffers,
+	       (double)stats->peak / (1024 * 1024), (double)stats->layout_bytes / (1024 * 1024));
+	for (i = 0; i < DRM_ROLE_COUNT; i++)
+		printf("\t%-8s %8.1f MB\n", role_names[i], (double)stats->roles[i] / (1024 * 1024));
+	for (i = 0; i < MEMORY_CONNECTORS_MAX; i++) {
+		if (memory.connectors[i].bytes)
+			printf("\tconnector %u %8.1f MB\n", memory.connectors[i].conn,
+			       (double)memory.connectors[i].bytes / (1024 * 1024));
+	}
+}
+
 static void _delete_buffer(int drm_fd, struct modeset_buf *buf)
 {
-	drm_intel_gem_bo_unmap_gtt(buf->bo);
-	drm_intel_bo_unreference(buf->bo);
+	_memory_account(buf, -1);
+	_unmap_buffer(buf);
+	bufmgr_bo_free(buf->bo);
+}
+
+/* restore previous CRTC state, of all heads at once if they were set up that way */
+static void _restore_crtcs(struct modeset_dev *list)
+{
+	struct modeset_dev *it;
+
+	if (list && list->atomic && !kms_atomic_restore(list))
+		return;
+
+	for (it = list; it; it = it->next) {
+		if (!it->saved_crtc)
+			continue;
+
+		drmModeSetCrtc(it->drm_fd, it->saved_crtc->crtc_id,
+					   it->saved_crtc->buffer_id, it->saved_crtc->x,
+					   it->saved_crtc->y, &it->conn, 1, &it->saved_crtc->mode);
+	}
 }
 
 void drm_cleanup(struct modeset_dev *list)
 {
+	_restore_crtcs(list);
+
 	while (list) {
 		struct modeset_dev *it = list;
-		unsigned i;
 
 		list = it->next;
 
-		/* restore previous CRTC state */
-		drmModeSetCrtc(it->drm_fd, it->saved_crtc->crtc_id,
-					   it->saved_crtc->buffer_id, it->saved_crtc->x,
-					   it->saved_crtc->y, &it->conn, 1, &it->saved_crtc->mode);
 		drmModeFreeCrtc(it->saved_crtc);
+		kms_atomic_fini(it);
 
-		for (i = 0; i < (sizeof(list->buffers) / sizeof(list->buffers[0])); i++) {
-			drmModeRmFB(it->drm_fd, it->buffers[i].fb);
-			_delete_buffer(it->drm_fd, &it->buffers[i]);
-		}
-
-		_delete_buffer(it->drm_fd, &it->cursor);
+		swapchain_destroy(it->swapchain);
+		if (it->cursor.bo)
+			_delete_buffer(it->drm_fd, &it->cursor);
 
 		free(it);
 	}
@@ -90,6 +310,18 @@ static bool check_crtc_is_unused(struct modeset_dev *list, uint32_t crtc)
 	return true;
 }
 
+static unsigned _crtc_pipe(const drmModeRes *res, uint32_t crtc)
+{
+	int i;
+
+	for (i = 0; i < res->count_crtcs; i++) {
+		if (res->crtcs[i] == crtc)
+			return i;
+	}
+
+	return 0;
+}
+
 static int _find_crtc(struct modeset_dev *list, drmModeRes *res, drmModeConnector *conn, struct modeset_dev *dev)
 {
 	drmModeEncoder *enc;
@@ -139,62 +371,76 @@ static int _find_crtc(struct modeset_dev *list, drmModeRes *res, drmModeConnecto
 	return -ENOENT;
 }
 
-static int _create_buffer(struct modeset_dev *dev, struct modeset_buf *buf,
-			  uint32_t w, uint32_t h, bool change_buffer_to_fb, uint64_t tiling)
+static int _create_buffer(int drm_fd, struct modeset_buf *buf, uint32_t w, uint32_t h,
+			  bool change_buffer_to_fb, uint32_t format, uint64_t tiling, enum drm_map map)
 {
 	uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
 	uint64_t modifiers[4] = {0};
-	unsigned long stride, size;
-	drm_intel_bo *bo;
+	const struct format_info *info = format_info_get(format);
+	struct drm_device *device = _device_get(drm_fd);
+	struct bufmgr_bo *bo;
+	uint32_t size, t;
+	unsigned i;
 	int ret;
 
-	stride = w * 32;
-	size = stride * h;
-
-	if (tiling == DRM_FORMAT_MOD_LINEAR) {
-		printf("DRM_FORMAT_MOD_LINEAR\n");
-		bo = drm_intel_bo_alloc(bufmgr, "buffer", size, 0);
-	} else {
-		uint32_t t;
-
-		stride = 0;
+	if (!device) {
+		fprintf(stderr, "no modeset on fd %d yet\n", drm_fd);
+		return -ENODEV;
+	}
 
-		switch (tiling) {
-		case I915_FORMAT_MOD_X_TILED:
-			printf("I915_FORMAT_MOD_X_TILED\n");
-			t = 1;
-			break;
-		case I915_FORMAT_MOD_Y_TILED:
-			printf("I915_FORMAT_MOD_Y_TILED\n");
-			t = 2;
-			break;
-		default:
-			fprintf(stderr, "tiling not handled yet\n");
-			t = 0;
-		}
+	if (!info || format_layout(format, tiling, w, h, pitches, offsets, &size)) {
+		fprintf(stderr, "format %.4s with modifier 0x%llx not handled yet\n",
+			(const char *)&format, (unsigned long long)tiling);
+		return -EINVAL;
+	}
 
-		bo = drm_intel_bo_alloc_tiled(bufmgr, "buffer tiled", w, h, 4, &t, &stride, 0);
-		printf("tiled buffer stride=%lu\n", stride);
+	switch (tiling) {
+	case DRM_FORMAT_MOD_LINEAR:
+		printf("DRM_FORMAT_MOD_LINEAR %s\n", info->name);
+		t = I915_TILING_NONE;
+		break;
+	case I915_FORMAT_MOD_X_TILED:
+		printf("I915_FORMAT_MOD_X_TILED %s\n", info->name);
+		t = I915_TILING_X;
+		break;
+	case I915_FORMAT_MOD_Y_TILED:
+		printf("I915_FORMAT_MOD_Y_TILED %s\n", info->name);
+		t = I915_TILING_Y;
+		break;
+	default:
+		fprintf(stderr, "tiling not handled yet\n");
+		return -EINVAL;
 	}
 
+	/* the planes share the pitch, so one fence detiles all of them */
+	bo = bufmgr_bo_alloc(device->bufmgr, size, t, pitches[0]);
 	if (!bo) {
 		fprintf(stderr, "cannot create buffer (%d): %m\n", errno);
 		return -errno;
 	}
-	buf->stride = stride;
+	if (t != I915_TILING_NONE)
+		printf("tiled buffer stride=%u\n", pitches[0]);
+	buf->stride = pitches[0];
+	buf->format = format;
+	for (i = 0; i < info->planes; i++) {
+		buf->pitches[i] = pitches[i];
+		buf->offsets[i] = offsets[i];
+	}
 	buf->size = bo->size;
 	buf->handle = bo->handle;
 	buf->width = w;
 	buf->height = h;
+	buf->modifier = tiling;
 	buf->bo = bo;
 
 	if (change_buffer_to_fb) {
-		handles[0] = buf->handle;
-		pitches[0] = buf->stride;
-		modifiers[0] = TILING;
+		for (i = 0; i < info->planes; i++) {
+			handles[i] = buf->handle;
+			modifiers[i] = tiling;
+		}
 
-		ret = drmModeAddFB2WithModifiers(dev->drm_fd, buf->width, buf->height,
-						 DRM_FORMAT_XRGB8888, handles, pitches, offsets,
+		ret = drmModeAddFB2WithModifiers(drm_fd, buf->width, buf->height,
+						 format, handles, pitches, offsets,
 						 modifiers, &buf->fb, DRM_MODE_FB_MODIFIERS);
 		if (ret) {
 			fprintf(stderr, "cannot create framebuffer (%d): %m\n", errno);
@@ -203,43 +449,408 @@ static int _create_buffer(struct modeset_dev *dev, struct modeset_buf *buf,
 		}
 	}
 
-	ret = drm_intel_gem_bo_map_gtt(bo);
-	if (ret) {
-		fprintf(stderr, "cannot map buffer (%d): %m\n", errno);
-		ret = -errno;
+	ret = _map_buffer(buf, map);
+	if (ret)
 		goto err_mmap;
-	}
-	buf->map = bo->virtual;
+	_memory_account(buf, 1);
 
-	memset(buf->map, 0x77, buf->size);
+	/* cleared by the swapchain if needed, everything else draws all of it */
+	/* nothing of the scene rendered yet */
+	buf->age = 0;
+	damage_clear(&buf->damage);
+	damage_clear(&buf->dirty);
 	return 0;
 
 err_mmap:
 	if (change_buffer_to_fb)
-		drmModeRmFB(dev->drm_fd, buf->fb);
+		drmModeRmFB(drm_fd, buf->fb);
 err_map_to_fb:
-	drm_intel_bo_unreference(bo);
+	bufmgr_bo_free(bo);
 	return ret;
 }
 
-static int _create_fbs(struct modeset_dev *dev)
+int drm_buffer_create(int drm_fd, struct modeset_buf *buf, uint32_t width, uint32_t height,
+		      uint32_t format, uint64_t modifier)
+{
+	memset(buf, 0, sizeof(*buf));
+	buf->role = DRM_ROLE_SCENE;
+	return _create_buffer(drm_fd, buf, width, height, true, format, modifier, map_default);
+}
+
+void drm_buffer_destroy(int drm_fd, struct modeset_buf *buf)
 {
+	drmModeRmFB(drm_fd, buf->fb);
+	_delete_buffer(drm_fd, buf);
+}
+
+int drm_buffer_import(int drm_fd, struct modeset_buf *buf, int dmabuf_fd, uint32_t width,
+		      uint32_t height, uint32_t format, uint64_t modifier,
+		      const uint32_t pitches[FORMAT_MAX_PLANES],
+		      const uint32_t offsets[FORMAT_MAX_PLANES])
+{
+	uint32_t handles[FORMAT_MAX_PLANES] = { 0 };
+	uint64_t modifiers[FORMAT_MAX_PLANES] = { 0 };
+	const struct format_info *info = format_info_get(format);
+	struct drm_device *device = _device_get(drm_fd);
+	struct bufmgr_bo *bo;
 	unsigned i;
 
-	for (i = 0; i < (sizeof(dev->buffers) / sizeof(dev->buffers[0])); i++) {
-		if (_create_buffer(dev, &dev->buffers[i], dev->mode.hdisplay, dev->mode.vdisplay, true, TILING))
-			return -1;
+	if (!device)
+		return -ENODEV;
+
+	bo = bufmgr_bo_import(device->bufmgr, dmabuf_fd);
+	if (!bo) {
+		fprintf(stderr, "cannot import dma-buf (%d): %m\n", errno);
+		return -errno;
 	}
 
-	if (_create_buffer(dev, &dev->cursor, 64, 64, false, DRM_FORMAT_MOD_LINEAR))
-		return -1;
+	if (dmabuf_layout_check(bo->size, format, modifier, width, height, pitches, offsets)) {
+		fprintf(stderr, "%ux%u %.4s doesn't fit in a %llu bytes dma-buf\n", width, height,
+			(const char *)&format, (unsigned long long)bo->size);
+		bufmgr_bo_free(bo);
+		return -EINVAL;
+	}
+
+	memset(buf, 0, sizeof(*buf));
+	for (i = 0; i < info->planes; i++) {
+		handles[i] = bo->handle;
+		modifiers[i] = modifier;
+		buf->pitches[i] = pitches[i];
+		buf->offsets[i] = offsets[i];
+	}
 
+	if (drmModeAddFB2WithModifiers(drm_fd, width, height, format, handles, pitches, offsets,
+				       modifiers, &buf->fb, DRM_MODE_FB_MODIFIERS)) {
+		fprintf(stderr, "cannot create framebuffer of dma-buf (%d): %m\n", errno);
+		bufmgr_bo_free(bo);
+		return -errno;
+	}
+
+	buf->bo = bo;
+	buf->handle = bo->handle;
+	buf->size = bo->size;
+	buf->width = width;
+	buf->height = height;
+	buf->stride = pitches[0];
+	buf->format = format;
+	buf->modifier = modifier;
+	buf->role = DRM_ROLE_SCENE;
+	_memory_account(buf, 1);
 	return 0;
 }
 
+int drm_buffer_export(const struct modeset_buf *buf, int *dmabuf_fd)
+{
+	int ret = bufmgr_bo_export(buf->bo, dmabuf_fd);
+
+	if (ret)
+		fprintf(stderr, "cannot export buffer (%d): %m\n", errno);
+	return ret;
+}
+
+void drm_map_default_set(enum drm_map map)
+{
+	map_default = map;
+}
+
+int drm_buffer_remap(struct modeset_buf *buf, enum drm_map map)
+{
+	if (buf->map && buf->map_mode == map)
+		return 0;
+
+	_unmap_buffer(buf);
+	return _map_buffer(buf, map);
+}
+
+/* data is the drm_device */
+static int _pool_buffer_alloc(void *data, struct modeset_buf *buf, uint32_t width,
+			      uint32_t height, uint32_t format, uint64_t modifier)
+{
+	struct drm_device *device = data;
+
+	return drm_buffer_create(device->fd, buf, width, height, format, modifier);
+}
+
+static void _pool_buffer_free(void *data, struct modeset_buf *buf)
+{
+	struct drm_device *device = data;
+
+	drm_buffer_destroy(device->fd, buf);
+}
+
+static const struct scene_buffer_ops pool_buffer_ops = {
+	.alloc = _pool_buffer_alloc,
+	.free = _pool_buffer_free,
+};
+
+struct fb_pool *drm_fb_pool(int fd)
+{
+	struct drm_device *device = _device_get(fd);
+
+	return device ? device->fb_pool : NULL;
+}
+
+struct bufmgr *drm_bufmgr(int fd)
+{
+	struct drm_device *device = _device_get(fd);
+
+	return device ? device->bufmgr : NULL;
+}
+
+/* The framebuffers are shared by every user of the device */
+static int _pool_take(int fd, struct modeset_buf *buf, uint32_t width, uint32_t height,
+		      uint32_t format, uint64_t modifier, enum drm_buffer_role role, uint32_t owner)
+{
+	struct drm_device *device = _device_get(fd);
+	int ret;
+
+	if (!device)
+		return -ENODEV;
+
+	ret = fb_pool_get(device->fb_pool, buf, width, height, format, modifier);
+	if (ret)
+		return ret;
+
+	/* kept by the pool from before the default changed */
+	if (drm_buffer_remap(buf, map_default)) {
+		drm_buffer_destroy(fd, buf);
+		return -EINVAL;
+	}
+
+	_memory_move(buf, role, owner);
+	return 0;
+}
+
+static void _pool_give(int fd, struct modeset_buf *buf)
+{
+	_memory_move(buf, DRM_ROLE_POOL, 0);
+	fb_pool_put(_device_get(fd)->fb_pool, buf);
+}
+
+/* data is a pointer to the DRM fd */
+static int _scene_buffer_alloc(void *data, struct modeset_buf *buf, uint32_t width,
+			       uint32_t height, uint32_t format, uint64_t modifier)
+{
+	return _pool_take(*(int *)data, buf, width, height, format, modifier, DRM_ROLE_SCENE, 0);
+}
+
+static void _scene_buffer_free(void *data, struct modeset_buf *buf)
+{
+	_pool_give(*(int *)data, buf);
+}
+
+const struct scene_buffer_ops drm_scene_buffer_ops = {
+	.alloc = _scene_buffer_alloc,
+	.free = _scene_buffer_free,
+};
+
+int drm_scene_flip(struct scene_cache *cache, struct modeset_dev *dev, const struct scene *scene)
+{
+	struct modeset_buf *buf = scene_cache_get(cache, scene);
+
+	if (!buf)
+		return -ENOMEM;
+
+	if (drmModePageFlip(dev->drm_fd, dev->crtc, buf->fb, 0, NULL)) {
+		int ret = -errno;
+
+		fprintf(stderr, "cannot flip CRTC %u (%d): %m\n", dev->crtc, errno);
+		scene_cache_put(cache, buf);
+		return ret;
+	}
+
+	/* a flip is refused while the previous one is pending, so that one landed */
+	scene_cache_put(cache, dev->prev_scene);
+	dev->prev_scene = dev->scene;
+	dev->scene = buf;
+	return 0;
+}
+
+/* data is the modeset_dev of the swapchain */
+static int _swapchain_buffer_alloc(void *data, struct modeset_buf *buf, uint32_t width,
+				   uint32_t height, uint32_t format, uint64_t modifier)
+{
+	struct modeset_dev *dev = data;
+
+	return _pool_take(dev->drm_fd, buf, width, height, format, modifier, DRM_ROLE_SCANOUT,
+			  dev->conn);
+}
+
+static void _swapchain_buffer_free(void *data, struct modeset_buf *buf)
+{
+	struct modeset_dev *dev = data;
+
+	_pool_give(dev->drm_fd, buf);
+}
+
+static const struct scene_buffer_ops swapchain_buffer_ops = {
+	.alloc = _swapchain_buffer_alloc,
+	.free = _swapchain_buffer_free,
+};
+
+/* Does the IN_FORMATS blob list format with modifier */
+static bool _in_formats_has(const drmModePropertyBlobRes *blob, uint32_t format,
+			    uint64_t modifier)
+{
+	const struct drm_format_modifier_blob *header = blob->data;
+	const uint32_t *formats = (const uint32_t *)((const uint8_t *)header +
+						     header->formats_offset);
+	const struct drm_format_modifier *modifiers =
+		(const struct drm_format_modifier *)((const uint8_t *)header +
+						     header->modifiers_offset);
+	uint32_t i, index;
+
+	for (index = 0; index < header->count_formats; index++) {
+		if (formats[index] == format)
+			break;
+	}
+	if (index == header->count_formats)
+		return false;
+
+	/* each modifier has a 64 formats mask starting at its offset */
+	for (i = 0; i < header->count_modifiers; i++) {
+		if (modifiers[i].modifier != modifier || index < modifiers[i].offset ||
+		    index >= modifiers[i].offset + 64)
+			continue;
+
+		if (modifiers[i].formats & (1ULL << (index - modifiers[i].offset)))
+			return true;
+	}
+
+	return false;
+}
+
+/* Primary plane of the CRTC at crtc_index and its IN_FORMATS blob id, 0 if there is none */
+static uint32_t _primary_plane(int fd, int crtc_index, uint64_t *in_formats)
+{
+	drmModePlaneResPtr planes;
+	uint32_t i, j, primary = 0;
+
+	*in_formats = 0;
+	planes = drmModeGetPlaneResources(fd);
+	if (!planes)
+		return 0;
+
+	for (i = 0; i < planes->count_planes && !primary; i++) {
+		drmModePlanePtr plane = drmModeGetPlane(fd, planes->planes[i]);
+		drmModeObjectPropertiesPtr props;
+		uint64_t type = DRM_PLANE_TYPE_OVERLAY, blob_id = 0;
+
+		if (!plane)
+			continue;
+		if (!(plane->possible_crtcs & (1u << crtc_index))) {
+			drmModeFreePlane(plane);
+			continue;
+		}
+
+		props = drmModeObjectGetProperties(fd, plane->plane_id, DRM_MODE_OBJECT_PLANE);
+		for (j = 0; props && j < props->count_props; j++) {
+			drmModePropertyPtr prop = drmModeGetProperty(fd, props->props[j]);
+
+			if (!prop)
+				continue;
+			if (!strcmp(prop->name, "type"))
+				type = props->prop_values[j];
+			else if (!strcmp(prop->name, "IN_FORMATS"))
+				blob_id = props->prop_values[j];
+			drmModeFreeProperty(prop);
+		}
+		drmModeFreeObjectProperties(props);
+
+		if (type == DRM_PLANE_TYPE_PRIMARY) {
+			primary = plane->plane_id;
+			*in_formats = blob_id;
+		}
+		drmModeFreePlane(plane);
+	}
+
+	drmModeFreePlaneResources(planes);
+	return primary;
+}
+
+/*
+ * Modifiers for format on dev->crtc, best first, dev->plane is looked up
+ * on the way. Without IN_FORMATS, on older kernels, every modifier is tried
+ * and AddFB2 sorts them out.
+ */
+static unsigned _negotiate_modifiers(struct modeset_dev *dev, drmModeRes *res, uint32_t format,
+				     uint64_t modifiers[MODIFIERS_MAX])
+{
+	drmModePropertyBlobPtr blob = NULL;
+	unsigned count = 0, i;
+	int crtc_index;
+
+	for (crtc_index = 0; crtc_index < res->count_crtcs; crtc_index++) {
+		if (res->crtcs[crtc_index] == dev->crtc) {
+			uint64_t in_formats;
+
+			dev->plane = _primary_plane(dev->drm_fd, crtc_index, &in_formats);
+			if (in_formats)
+				blob = drmModeGetPropertyBlob(dev->drm_fd, in_formats);
+			break;
+		}
+	}
+	if (!blob)
+		printf("no IN_FORMATS for CRTC %u, trying every modifier\n", dev->crtc);
+
+	for (i = 0; i < MODIFIERS_MAX; i++) {
+		uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], size;
+
+		if (format_layout(format, modifier_preference[i], dev->mode.hdisplay,
+				  dev->mode.vdisplay, pitches, offsets, &size))
+			continue;
+		if (blob && !_in_formats_has(blob, format, modifier_preference[i]))
+			continue;
+
+		modifiers[count++] = modifier_preference[i];
+	}
+
+	drmModeFreePropertyBlob(blob);
+	return count;
+}
+
+static int _create_fbs(struct modeset_dev *dev, drmModeRes *res, unsigned depth)
+{
+	uint64_t modifiers[MODIFIERS_MAX];
+	unsigned count, i;
+
+	count = _negotiate_modifiers(dev, res, DRM_FORMAT_XRGB8888, modifiers);
+	for (i = 0; i < count; i++) {
+		dev->swapchain = swapchain_create(depth, dev->mode.hdisplay, dev->mode.vdisplay,
+						  DRM_FORMAT_XRGB8888, modifiers[i], swapchain_init,
+						  &swapchain_buffer_ops, dev);
+		if (dev->swapchain)
+			return 0;
+
+		printf("modifier 0x%llx rejected for CRTC %u\n", (unsigned long long)modifiers[i],
+		       dev->crtc);
+	}
+
+	return -1;
+}
+
+int drm_cursor_create(struct modeset_dev *dev)
+{
+	if (dev->cursor.bo)
+		return 0;
+
+	dev->cursor.role = DRM_ROLE_CURSOR;
+	dev->cursor.owner = dev->conn;
+	/* the cursor is drawn without any fill_writeback(), keep it uncached */
+	return _create_buffer(dev->drm_fd, &dev->cursor, 64, 64, false, DRM_FORMAT_ARGB8888,
+			      DRM_FORMAT_MOD_LINEAR,
+			      map_default == DRM_MAP_CPU ? DRM_MAP_WC : map_default);
+}
+
 #define WIDTH 1024
 
-static int _setup_conn(struct modeset_dev *list, drmModeRes *res, drmModeConnector *conn, struct modeset_dev *dev)
+const drmModeModeInfo drm_mode_preferred = {
+	.type = DRM_MODE_TYPE_PREFERRED,
+	.name = "preferred",
+};
+
+static int _setup_conn(struct modeset_dev *list, drmModeRes *res, drmModeConnector *conn, struct modeset_dev *dev,
+		       unsigned depth)
 {
 	int i;
 	drmModeModeInfoPtr found;
@@ -261,11 +872,16 @@ static int _setup_conn(struct modeset_dev *list, drmModeRes *res, drmModeConnect
 	printf("Modes found: %d\n", conn->count_modes);
 	for (i = 0; i < conn->count_modes; i++) {
 		printf("\t%ux%ux@%d\n", conn->modes[i].hdisplay, conn->modes[i].vdisplay, conn->modes[i].vrefresh);
-		if (conn->modes[i].hdisplay == WIDTH) {
-			found = &conn->modes[i];
-			printf("\tpicking this mode\n");
-			break;
+		/* drm_mode_preferred, the first mode if the connector marks none */
+		if (dev->mode.type & DRM_MODE_TYPE_PREFERRED) {
+			if (!(conn->modes[i].type & DRM_MODE_TYPE_PREFERRED))
+				continue;
+		} else if (conn->modes[i].hdisplay != WIDTH) {
+			continue;
 		}
+		found = &conn->modes[i];
+		printf("\tpicking this mode\n");
+		break;
 	}
 	/* copy the mode information into our device structure */
 	memcpy(&dev->mode, found, sizeof(dev->mode));
@@ -279,9 +895,10 @@ jump_lookup:
 		printf("no valid crtc for connector %u\n", conn->connector_id);
 		return -1;
 	}
+	dev->pipe = _crtc_pipe(res, dev->crtc);
 
 	/* create a framebuffer for this CRTC */
-	if (_create_fbs(dev)) {
+	if (_create_fbs(dev, res, depth)) {
 		printf("cannot create framebuffer for connector %u\n", conn->connector_id);
 		return -1;
 	}
@@ -304,11 +921,230 @@ static void modeset_dev_append(struct modeset_dev **list, struct modeset_dev *it
 	l->next = item;
 }
 
-struct modeset_dev *drm_modeset_with_mode(int fd, const drmModeModeInfo *mode)
+static int _device_init(int fd)
+{
+	struct drm_device *device;
+	unsigned i;
+
+	if (_device_get(fd))
+		return 0;
+
+	for (i = 0; i < DRM_DEVICES_MAX && devices[i].bufmgr; i++)
+		;
+	if (i == DRM_DEVICES_MAX) {
+		fprintf(stderr, "more than %u devices\n", DRM_DEVICES_MAX);
+		return -1;
+	}
+	device = &devices[i];
+
+	device->fd = fd;
+	device->bufmgr = bufmgr_create(fd);
+	device->fb_pool = fb_pool_create(FB_POOL_BUDGET, &pool_buffer_ops, device);
+	if (!device->bufmgr || !device->fb_pool) {
+		fprintf(stderr, "cannot create the buffer manager of fd %d\n", fd);
+		fb_pool_destroy(device->fb_pool);
+		bufmgr_destroy(device->bufmgr);
+		memset(device, 0, sizeof(*device));
+		return -1;
+	}
+
+	return 0;
+}
+
+void drm_swapchain_init_set(enum swapchain_init init)
+{
+	swapchain_init = init;
+}
+
+void drm_atomic_set(bool enable)
+{
+	atomic_enabled = enable;
+}
+
+/*
+ * One commit for every head, false if the kernel or one of the heads can't
+ * do it or refused the configuration, the legacy calls are used then.
+ */
+static bool _modeset_atomic(struct modeset_dev *list)
+{
+	struct drm_device *device = list ? _device_get(list->drm_fd) : NULL;
+	struct modeset_dev *iter;
+	bool ok = device && device->atomic;
+
+	for (iter = list; iter && ok; iter = iter->next)
+		ok = !kms_atomic_init(iter);
+	if (ok && !kms_atomic_modeset(list))
+		return true;
+
+	for (iter = list; iter; iter = iter->next)
+		kms_atomic_fini(iter);
+	return false;
+}
+
+static void _flip_pending(struct modeset_dev *dev, void *cookie)
+{
+	dev->flip_pending = true;
+	dev->flip_cookie = cookie;
+}
+
+int drm_flip(const struct drm_flip *flips, unsigned count)
+{
+	uint32_t flags = 0;
+	unsigned i;
+	int ret = 0;
+
+	for (i = 0; i < count; i++) {
+		if (flips[i].cookie)
+			flags = DRM_MODE_PAGE_FLIP_EVENT;
+	}
+
+	if (count && flips[0].dev->atomic) {
+		ret = kms_atomic_flip(flips, count, flags);
+		for (i = 0; i < count && !ret && flags; i++)
+			_flip_pending(flips[i].dev, flips[i].cookie);
+		return ret;
+	}
+
+	/* the events find their head by CRTC, as the atomic ones */
+	for (i = 0; i < count; i++) {
+		struct modeset_dev *dev = flips[i].dev;
+
+		if (drmModePageFlip(dev->drm_fd, dev->crtc, flips[i].fb, flags, NULL))
+			ret = -errno;
+		else if (flags)
+			_flip_pending(dev, flips[i].cookie);
+	}
+
+	return ret;
+}
+
+int drm_vblank_request(struct modeset_dev *dev, void *cookie)
+{
+	drmVBlank vbl = {
+		.request = {
+			.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT,
+			.sequence = 1,
+			.signal = dev->crtc,
+		},
+	};
+
+	/* the first two pipes have their own flag, the others are shifted in */
+	if (dev->pipe == 1)
+		vbl.request.type |= DRM_VBLANK_SECONDARY;
+	else if (dev->pipe > 1)
+		vbl.request.type |= (dev->pipe << DRM_VBLANK_HIGH_CRTC_SHIFT) &
+				    DRM_VBLANK_HIGH_CRTC_MASK;
+
+	if (drmWaitVBlank(dev->drm_fd, &vbl))
+		return -errno;
+
+	dev->vblank_pending = true;
+	dev->vblank_cookie = cookie;
+	return 0;
+}
+
+/* drmHandleEvent() has no data pointer of its own */
+static const struct drm_event_handlers *event_handlers;
+static struct modeset_dev *event_heads;
+
+static struct modeset_dev *_event_head(uint32_t crtc)
+{
+	struct modeset_dev *iter;
+
+	for (iter = event_heads; iter; iter = iter->next) {
+		if (iter->crtc == crtc)
+			return iter;
+	}
+
+	return NULL;
+}
+
+static void _page_flip_event(int fd, unsigned sequence, unsigned tv_sec, unsigned tv_usec,
+			     unsigned crtc_id, void *user_data)
+{
+	struct modeset_dev *dev = _event_head(crtc_id);
+	void *cookie;
+
+	(void)fd;
+	(void)user_data;
+	if (!dev || !dev->flip_pending)
+		return;
+
+	cookie = dev->flip_cookie;
+	dev->flip_pending = false;
+	dev->flip_cookie = NULL;
+	if (event_handlers->flip_done)
+		event_handlers->flip_done(dev, cookie, tv_sec * NSEC_PER_SEC + tv_usec * 1000ULL,
+					  sequence, event_handlers->data);
+}
+
+static void _vblank_event(int fd, unsigned sequence, unsigned tv_sec, unsigned tv_usec,
+			  void *user_data)
+{
+	struct modeset_dev *dev = _event_head((uintptr_t)user_data);
+	void *cookie;
+
+	(void)fd;
+	if (!dev || !dev->vblank_pending)
+		return;
+
+	cookie = dev->vblank_cookie;
+	dev->vblank_pending = false;
+	dev->vblank_cookie = NULL;
+	if (event_handlers->vblank)
+		event_handlers->vblank(dev, cookie, tv_sec * NSEC_PER_SEC + tv_usec * 1000ULL,
+				       sequence, event_handlers->data);
+}
+
+int drm_handle_events(struct modeset_dev *list, const struct drm_event_handlers *handlers)
+{
+	drmEventContext context = {
+		.version = 3,
+		.vblank_handler = _vblank_event,
+		.page_flip_handler2 = _page_flip_event,
+	};
+	int ret;
+
+	if (!list)
+		return -EINVAL;
+
+	event_handlers = handlers;
+	event_heads = list;
+	ret = drmHandleEvent(list->drm_fd, &context);
+	event_handlers = NULL;
+	event_heads = NULL;
+
+	return ret ? -errno : 0;
+}
+
+void drm_startup_stats_get(struct drm_startup_stats *stats)
+{
+	*stats = startup_stats;
+}
+
+static void _startup_stats_print(const struct drm_startup_stats *stats)
+{
+	printf("startup: %.1f ms to the first pixel, probe %.1f ms, buffers %.1f ms, "
+	       "clear %.1f ms, modeset %.1f ms in %u commits\n",
+	       (double)stats->total_ns / NSEC_PER_MSEC, (double)stats->probe_ns / NSEC_PER_MSEC,
+	       (double)stats->alloc_ns / NSEC_PER_MSEC, (double)stats->clear_ns / NSEC_PER_MSEC,
+	       (double)stats->modeset_ns / NSEC_PER_MSEC, stats->modesets);
+}
+
+struct modeset_dev *drm_modeset_with_mode(int fd, const drmModeModeInfo *mode, unsigned depth)
 {
 	drmModeRes *res;
 	int i;
 	struct modeset_dev *list = NULL, *iter;
+	struct drm_startup_stats stats = { 0 };
+	uint64_t start = _now_ns(), modeset_start;
+
+	if (_device_init(fd))
+		return NULL;
+
+	/* the primary planes and their IN_FORMATS are hidden without it */
+	drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+	_device_get(fd)->atomic = atomic_enabled && !drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1);
 
 	res = drmModeGetResources(fd);
 	if (!res) {
@@ -338,7 +1174,7 @@ struct modeset_dev *drm_modeset_with_mode(int fd, const drmModeModeInfo *mode)
 		dev->drm_fd = fd;
 		if (mode)
 			memcpy(&dev->mode, mode, sizeof(*mode));
-		if (_setup_conn(list, res, conn, dev)) {
+		if (_setup_conn(list, res, conn, dev, depth)) {
 			free(dev);
 			drmModeFreeConnector(conn);
 			continue;
@@ -351,23 +1187,48 @@ struct modeset_dev *drm_modeset_with_mode(int fd, const drmModeModeInfo *mode)
 	drmModeFreeResources(res);
 
 	for (iter = list; iter; iter = iter->next) {
-		int ret;
+		struct swapchain_stats swapchain_stats;
 
+		swapchain_stats_get(iter->swapchain, &swapchain_stats);
+		stats.alloc_ns += swapchain_stats.alloc_ns;
+		stats.clear_ns += swapchain_stats.clear_ns;
+	}
+
+	for (iter = list; iter; iter = iter->next)
 		iter->saved_crtc = drmModeGetCrtc(iter->drm_fd, iter->crtc);
-		iter->buffers[0].frontbuffer = true;
-		ret = drmModeSetCrtc(iter->drm_fd, iter->crtc, iter->buffers[0].fb, 0, 0,
-							 &iter->conn, 1, &iter->mode);
-		if (ret)
-			fprintf(stderr, "cannot set CRTC for connector %u (%d): %m\n",
-					iter->conn, errno);
-		else
+
+	modeset_start = _now_ns();
+	stats.probe_ns = modeset_start - start - stats.alloc_ns - stats.clear_ns;
+
+	if (_modeset_atomic(list)) {
+		for (iter = list; iter; iter = iter->next)
 			iter->enabled = true;
+		stats.modesets = 1;
+	} else {
+		for (iter = list; iter; iter = iter->next) {
+			int ret;
+
+			stats.modesets++;
+			ret = drmModeSetCrtc(iter->drm_fd, iter->crtc, swapchain_front(iter->swapchain)->fb, 0, 0,
+								 &iter->conn, 1, &iter->mode);
+			if (ret)
+				fprintf(stderr, "cannot set CRTC for connector %u (%d): %m\n",
+						iter->conn, errno);
+			else
+				iter->enabled = true;
+		}
 	}
 
+	stats.modeset_ns = _now_ns() - modeset_start;
+	stats.total_ns = _now_ns() - start;
+	startup_stats = stats;
+	_startup_stats_print(&stats);
+	drm_memory_stats_print();
+
 	return list;
 }
 
-struct modeset_dev *drm_modeset(int fd)
+struct modeset_dev *drm_modeset(int fd, unsigned depth)
 {
 	int ret = drmIoctl(fd, DRM_IOCTL_SET_MASTER, NULL);
 
@@ -376,12 +1237,5 @@ struct modeset_dev *drm_modeset(int fd)
 		return NULL;
 	}
 
-	bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
-	if (!bufmgr) {
-		fprintf(stderr, "Unable to initialize drm_intel_bufmgr_gem_init() | errno=%i\n", errno);
-		return NULL;
-	}
-
-	drm_intel_bufmgr_gem_enable_reuse(bufmgr);
-	return drm_modeset_with_mode(fd, NULL);
+	return drm_modeset_with_mode(fd, NULL, depth);
 }
@@ -4,16 +4,65 @@
 #include <stdint.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
-#include "intel_bufmgr.h"
+#include "damage.h"
+#include "format.h"
 
 #define UNUSED __attribute__((unused))
 
 #define DEFAULT_DRM_DEVICE "/dev/dri/card0"
 
+struct swapchain;
+struct bufmgr_bo;
+struct kms_atomic;
+
+/* When the back buffers of a swapchain are cleared, see swapchain.h */
+enum swapchain_init {
+	/* every buffer cleared by swapchain_create() */
+	SWAPCHAIN_INIT_EAGER,
+	/* a back buffer is cleared by the swapchain_acquire() handing it out first */
+	SWAPCHAIN_INIT_ACQUIRE,
+	/* back buffers cleared by a thread, swapchain_acquire() waits for it */
+	SWAPCHAIN_INIT_BACKGROUND,
+	/* back buffers left undefined, the first frame overwrites all of them */
+	SWAPCHAIN_INIT_NONE,
+};
+
+/*
+ * How the CPU sees a buffer object. GTT goes through the aperture, WC and
+ * detiled by a fence, but reads are very slow, fences are few and newer
+ * platforms have no aperture. WC maps the pages directly, a tiled buffer
+ * then shows its raw tiled layout. CPU is cached, fast to read, but the
+ * display doesn't snoop the caches, written lines must be flushed with
+ * fill_writeback() before they are scanned out.
+ */
+enum drm_map {
+	DRM_MAP_GTT,
+	DRM_MAP_WC,
+	DRM_MAP_CPU,
+};
+
+/* What a buffer of common.c is used for, see drm_memory_stats */
+enum drm_buffer_role {
+	/* swapchains of the CRTCs */
+	DRM_ROLE_SCANOUT,
+	/* scene_cache framebuffers and other drm_buffer_create() ones */
+	DRM_ROLE_SCENE,
+	DRM_ROLE_CURSOR,
+	/* released, kept by the fb_pool for a later modeset */
+	DRM_ROLE_POOL,
+	DRM_ROLE_COUNT,
+};
+
 struct modeset_buf {
 	uint32_t width;
 	uint32_t height;
+	/* pitch of the first plane */
 	uint32_t stride;
+	/* DRM fourcc, see format.h */
+	uint32_t format;
+	/* per plane, in bytes from map */
+	uint32_t pitches[FORMAT_MAX_PLANES];
+	uint32_t offsets[FORMAT_MAX_PLANES];
 	/* Size of the memory mapped buffer */
 	uint32_t size;
 	/* A DRM handle to the buffer object that we can draw into */
@@ -23,15 +72,41 @@ struct modeset_buf {
 	/* Framebuffer handle with our buffer object as scanout buffer */
 	uint32_t fb;
 
-	bool frontbuffer;
-	drm_intel_bo *bo;
+	/* Tiling layout of the buffer object */
+	uint64_t modifier;
+	/* map exposes the raw tiled layout instead of a fence detiled view */
+	bool map_tiled;
+	/* map is write-combined, long fills use non-temporal stores */
+	bool map_wc;
+	/* map is CPU cached and the display doesn't snoop, see fill_writeback() */
+	bool map_cached;
+	/* how common.c mapped the buffer object */
+	enum drm_map map_mode;
+
+	/* frames since the content was last rendered, 0 means undefined */
+	uint32_t age;
+	/* damage of the frames presented since the buffer was the back buffer */
+	struct damage damage;
+	/* drawn since the last damage_flush(), what drmModeDirtyFB() gets */
+	struct damage dirty;
+
+	struct bufmgr_bo *bo;
+	/* for the memory accounting, owner is the connector or 0 */
+	enum drm_buffer_role role;
+	uint32_t owner;
 };
 
 struct modeset_dev {
 	struct modeset_dev *next;
 
-	struct modeset_buf buffers[3];
+	/* framebuffers of the CRTC, the front one is scanned out after the modeset */
+	struct swapchain *swapchain;
+	/* only allocated by drm_cursor_create() */
 	struct modeset_buf cursor;
+	/* scene_cache framebuffer being scanned out instead of buffers, pinned */
+	struct modeset_buf *scene;
+	/* the scene it replaced, pinned until the next flip as it may still be on screen */
+	struct modeset_buf *prev_scene;
 
 	/* Display mode that we want to use */
 	drmModeModeInfo mode;
@@ -39,6 +114,10 @@ struct modeset_dev {
 	uint32_t conn;
 	/* Crtc ID that we want to use with this connector */
 	uint32_t crtc;
+	/* index of crtc in the resources, what vblank requests name it by */
+	unsigned pipe;
+	/* primary plane of the CRTC, 0 if the kernel doesn't list it */
+	uint32_t plane;
 	/* Configuration of the crtc before we changed it. We use it so we can
 	 * restore the same mode when we exit
 	 */
@@ -46,6 +125,14 @@ struct modeset_dev {
 
 	int drm_fd;
 	bool enabled;
+	/* property ids for the atomic commits, NULL with the legacy calls, see kms_atomic.h */
+	struct kms_atomic *atomic;
+
+	/* events in flight and their cookies, see drm_handle_events() */
+	bool flip_pending;
+	bool vblank_pending;
+	void *flip_cookie;
+	void *vblank_cookie;
 };
 
 struct pixel {
@@ -57,7 +144,150 @@ struct pixel {
 
 int drm_open(const char *drm_device);
 void drm_cleanup(struct modeset_dev *list);
+/* Scene caches of fd must be destroyed before, their buffers go back to its fb_pool */
 void drm_close(int fd);
 
-struct modeset_dev *drm_modeset(int fd);
-struct modeset_dev *drm_modeset_with_mode(int fd, const drmModeModeInfo *mode);
+/* depth is the number of framebuffers of each CRTC, 1 for front buffer rendering */
+struct modeset_dev *drm_modeset(int fd, unsigned depth);
+struct modeset_dev *drm_modeset_with_mode(int fd, const drmModeModeInfo *mode, unsigned depth);
+/* Mode for drm_modeset_with_mode(), each head takes the preferred mode of its connector */
+extern const drmModeModeInfo drm_mode_preferred;
+
+/* Back buffers of the next modesets, SWAPCHAIN_INIT_BACKGROUND by default */
+void drm_swapchain_init_set(enum swapchain_init init);
+
+/*
+ * Atomic commits for the next modesets when the kernel has them, the
+ * default. All heads are set up, flipped and restored in one commit each,
+ * false goes back to drmModeSetCrtc() and drmModePageFlip() per CRTC.
+ */
+void drm_atomic_set(bool enable);
+
+struct drm_flip {
+	struct modeset_dev *dev;
+	uint32_t fb;
+	/* handed back by the flip_done handler */
+	void *cookie;
+};
+
+/*
+ * Flip the heads to their framebuffer without waiting, in one commit
+ * landing in the same vblank if the heads were set up atomically. Returns
+ * -EBUSY while a previous flip of one of them is pending.
+ *
+ * If one of the flips has a cookie, every head flipped asks for a
+ * completion event and stays flip_pending until drm_handle_events() reads
+ * it. Without cookies nothing tells when the flips are done.
+ */
+int drm_flip(const struct drm_flip *flips, unsigned count);
+
+/* Event at the next vblank of dev, for pacing while there is nothing to flip */
+int drm_vblank_request(struct modeset_dev *dev, void *cookie);
+
+/*
+ * Completion handlers, time_ns is the CLOCK_MONOTONIC time of the vblank
+ * and sequence its count on the CRTC.
+ */
+struct drm_event_handlers {
+	/* the flip of dev is on screen, the buffer it replaced is not scanned out anymore */
+	void (*flip_done)(struct modeset_dev *dev, void *cookie, uint64_t time_ns,
+			  unsigned sequence, void *data);
+	void (*vblank)(struct modeset_dev *dev, void *cookie, uint64_t time_ns, unsigned sequence,
+		       void *data);
+	void *data;
+};
+
+/*
+ * Read the pending events of the list device and run their handlers, to be
+ * called when its fd is readable. Events are routed to the heads of list by
+ * CRTC, the ones of other CRTCs or without a pending request are dropped.
+ */
+int drm_handle_events(struct modeset_dev *list, const struct drm_event_handlers *handlers);
+
+/* Where the last modeset spent its time, printed by drm_modeset_with_mode() */
+struct drm_startup_stats {
+	/* resources, connectors, encoders and CRTCs */
+	uint64_t probe_ns;
+	/* buffer objects, framebuffers and mappings, or taking them from the fb_pool */
+	uint64_t alloc_ns;
+	/* synchronous clears, the front buffers and, if eager, the back buffers */
+	uint64_t clear_ns;
+	/* the atomic commit, or drmModeSetCrtc() of every head */
+	uint64_t modeset_ns;
+	/* modeset ioctls, one for all heads with atomic, one per head otherwise */
+	unsigned modesets;
+	/* from the start of the modeset to the first pixel on every head */
+	uint64_t total_ns;
+};
+void drm_startup_stats_get(struct drm_startup_stats *stats);
+
+/* 64x64 ARGB8888 cursor buffer in dev->cursor */
+int drm_cursor_create(struct modeset_dev *dev);
+
+/* Extra mapped buffer object with a framebuffer, mapped the default way */
+int drm_buffer_create(int drm_fd, struct modeset_buf *buf, uint32_t width, uint32_t height,
+		      uint32_t format, uint64_t modifier);
+void drm_buffer_destroy(int drm_fd, struct modeset_buf *buf);
+
+/*
+ * Framebuffer of a dma-buf of another device, process or a dmabuf_shm,
+ * scanned out without a copy. The producer keeps writing the pages, buf
+ * is not mapped and holds its own reference, dmabuf_fd can be closed.
+ * Released with drm_buffer_destroy().
+ */
+int drm_buffer_import(int drm_fd, struct modeset_buf *buf, int dmabuf_fd, uint32_t width,
+		      uint32_t height, uint32_t format, uint64_t modifier,
+		      const uint32_t pitches[FORMAT_MAX_PLANES],
+		      const uint32_t offsets[FORMAT_MAX_PLANES]);
+/* dma-buf of buf for a consumer, closed by the caller. The bufmgr stops recycling its object */
+int drm_buffer_export(const struct modeset_buf *buf, int *dmabuf_fd);
+
+/* Mapping of the next buffers, DRM_MAP_GTT by default */
+void drm_map_default_set(enum drm_map map);
+/* Map buf another way, the previous map pointer is not valid anymore */
+int drm_buffer_remap(struct modeset_buf *buf, enum drm_map map);
+
+/*
+ * Framebuffers for a scene_cache, taken from and given back to the device
+ * fb_pool like the swapchain ones. The ops data is a pointer to the DRM fd.
+ */
+struct scene_buffer_ops;
+extern const struct scene_buffer_ops drm_scene_buffer_ops;
+
+/* a few full screen frames, enough to keep every scene of the examples */
+#define DRM_SCENE_CACHE_BUDGET (128 * 1024 * 1024)
+
+struct scene;
+struct scene_cache;
+
+/*
+ * Flip dev to the framebuffer of scene, rendered on a cache miss. The flip
+ * lands at the next vblank, so the scene it replaces stays pinned until the
+ * next flip of dev. Flip every head first, they all land on the same vblank.
+ */
+int drm_scene_flip(struct scene_cache *cache, struct modeset_dev *dev, const struct scene *scene);
+
+/* Released framebuffers of the device, see fb_pool.h, NULL before the first modeset */
+struct fb_pool;
+struct fb_pool *drm_fb_pool(int fd);
+
+/* Buffer objects of the device, see bufmgr.h, NULL before the first modeset */
+struct bufmgr;
+struct bufmgr *drm_bufmgr(int fd);
+
+/*
+ * Buffer objects held by the process, sizes are what the kernel allocated.
+ * layout_bytes is what format_layout() needs for them, the rest is lost to
+ * page and allocator bucket rounding.
+ */
+struct drm_memory_stats {
+	uint64_t bytes;
+	uint64_t peak;
+	uint64_t layout_bytes;
+	uint64_t roles[DRM_ROLE_COUNT];
+	unsigned buffers;
+};
+void drm_memory_stats_get(struct drm_memory_stats *stats);
+/* Scanout and cursor bytes of connector conn */
+uint64_t drm_memory_connector_bytes(uint32_t conn);
+void drm_memory_stats_print(void);
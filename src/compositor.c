@@ -0,0 +1,389 @@
+#include "compositor.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fill.h"
+#include "region.h"
+
+/* layers of a size larger than any framebuffer */
+#define LAYER_SOLID_SIZE 65535
+
+struct layer {
+	/* bottom to top */
+	struct layer *prev, *next;
+	struct compositor *compositor;
+
+	enum layer_type type;
+	int z;
+	int32_t x, y;
+	uint32_t w, h;
+	uint32_t color;
+	const struct modeset_buf *image;
+	bool visible;
+
+	/* part of the repaint region this layer draws, only valid in compositor_render() */
+	struct region clip;
+};
+
+struct compositor {
+	uint32_t background;
+	/* bottom to top */
+	struct layer *bottom, *top;
+	/* layer changes since the last frame */
+	struct damage damage;
+	struct region_arena arena;
+	struct compositor_stats stats;
+};
+
+static bool _layer_opaque(const struct layer *layer)
+{
+	return layer->type != LAYER_CURSOR;
+}
+
+/* What the layer covers, x2 <= x1 or y2 <= y1 if nothing */
+static struct region_box _layer_box(const struct layer *layer)
+{
+	struct region_box box = { layer->x, layer->y, layer->x, layer->y };
+	uint32_t w = layer->w, h = layer->h;
+
+	if (!layer->visible)
+		return box;
+
+	switch (layer->type) {
+	case LAYER_SOLID:
+		return (struct region_box){ 0, 0, LAYER_SOLID_SIZE, LAYER_SOLID_SIZE };
+	case LAYER_IMAGE:
+	case LAYER_CURSOR:
+		if (!layer->image)
+			return box;
+		if (w > layer->image->width)
+			w = layer->image->width;
+		if (h > layer->image->height)
+			h = layer->image->height;
+		break;
+	case LAYER_RECT:
+		break;
+	}
+
+	box.x2 = layer->x + (int32_t)(w < LAYER_SOLID_SIZE ? w : LAYER_SOLID_SIZE);
+	box.y2 = layer->y + (int32_t)(h < LAYER_SOLID_SIZE ? h : LAYER_SOLID_SIZE);
+	return box;
+}
+
+/* Damage what the layer covers, call before and after changing it */
+static void _layer_damage(struct layer *layer)
+{
+	struct region_box box = _layer_box(layer);
+
+	if (box.x1 < 0)
+		box.x1 = 0;
+	if (box.y1 < 0)
+		box.y1 = 0;
+	if (box.x2 <= box.x1 || box.y2 <= box.y1)
+		return;
+
+	damage_add_rect(&layer->compositor->damage, box.x1, box.y1, box.x2 - box.x1,
+			box.y2 - box.y1);
+}
+
+struct compositor *compositor_create(uint32_t background)
+{
+	struct compositor *compositor = calloc(1, sizeof(*compositor));
+
+	if (!compositor)
+		return NULL;
+
+	if (region_arena_init(&compositor->arena, 0)) {
+		free(compositor);
+		return NULL;
+	}
+
+	compositor->background = background;
+	/* nothing was rendered yet, every buffer starts with age 0 anyway */
+	damage_add_rect(&compositor->damage, 0, 0, LAYER_SOLID_SIZE, LAYER_SOLID_SIZE);
+	return compositor;
+}
+
+void compositor_destroy(struct compositor *compositor)
+{
+	if (!compositor)
+		return;
+
+	while (compositor->bottom)
+		compositor_layer_remove(compositor, compositor->bottom);
+	region_arena_fini(&compositor->arena);
+	free(compositor);
+}
+
+struct layer *compositor_layer_add(struct compositor *compositor, enum layer_type type, int z)
+{
+	struct layer *layer = calloc(1, sizeof(*layer));
+	struct layer *below;
+
+	if (!layer)
+		return NULL;
+
+	layer->compositor = compositor;
+	layer->type = type;
+	layer->z = z;
+	layer->visible = true;
+
+	/* above the last layer with the same z */
+	for (below = compositor->top; below && below->z > z; below = below->prev)
+		;
+	layer->prev = below;
+	layer->next = below ? below->next : compositor->bottom;
+	if (layer->prev)
+		layer->prev->next = layer;
+	else
+		compositor->bottom = layer;
+	if (layer->next)
+		layer->next->prev = layer;
+	else
+		compositor->top = layer;
+
+	_layer_damage(layer);
+	return layer;
+}
+
+void compositor_layer_remove(struct compositor *compositor, struct layer *layer)
+{
+	if (!layer)
+		return;
+
+	_layer_damage(layer);
+
+	if (layer->prev)
+		layer->prev->next = layer->next;
+	else
+		compositor->bottom = layer->next;
+	if (layer->next)
+		layer->next->prev = layer->prev;
+	else
+		compositor->top = layer->prev;
+	free(layer);
+}
+
+void layer_set_position(struct layer *layer, int32_t x, int32_t y)
+{
+	if (layer->x == x && layer->y == y)
+		return;
+
+	_layer_damage(layer);
+	layer->x = x;
+	layer->y = y;
+	_layer_damage(layer);
+}
+
+void layer_set_size(struct layer *layer, uint32_t w, uint32_t h)
+{
+	if (layer->w == w && layer->h == h)
+		return;
+
+	_layer_damage(layer);
+	layer->w = w;
+	layer->h = h;
+	_layer_damage(layer);
+}
+
+void layer_set_color(struct layer *layer, uint32_t color)
+{
+	if (layer->color == color)
+		return;
+
+	layer->color = color;
+	_layer_damage(layer);
+}
+
+void layer_set_image(struct layer *layer, const struct modeset_buf *image)
+{
+	_layer_damage(layer);
+	layer->image = image;
+	layer->w = image ? image->width : 0;
+	layer->h = image ? image->height : 0;
+	_layer_damage(layer);
+}
+
+void layer_set_visible(struct layer *layer, bool visible)
+{
+	if (layer->visible == visible)
+		return;
+
+	_layer_damage(layer);
+	layer->visible = visible;
+	_layer_damage(layer);
+}
+
+static inline struct pixel *_pixel(const struct modeset_buf *buf, int32_t x, int32_t y)
+{
+	return (struct pixel *)&buf->map[buf->stride * y + x * 4];
+}
+
+static void _draw_image(struct modeset_buf *buf, const struct layer *layer,
+			const struct region_box *box)
+{
+	uint32_t len = (box->x2 - box->x1) * 4;
+	int32_t y;
+
+	for (y = box->y1; y < box->y2; y++)
+		memcpy(_pixel(buf, box->x1, y),
+		       _pixel(layer->image, box->x1 - layer->x, y - layer->y), len);
+}
+
+/* Straight (not premultiplied) alpha over, a / 255 rounded */
+static inline uint8_t _blend(uint8_t src, uint8_t dst, uint8_t alpha)
+{
+	uint32_t value = src * alpha + dst * (255 - alpha) + 128;
+
+	return (value + (value >> 8)) >> 8;
+}
+
+static void _draw_cursor(struct modeset_buf *buf, const struct layer *layer,
+			 const struct region_box *box)
+{
+	int32_t x, y;
+
+	for (y = box->y1; y < box->y2; y++) {
+		const struct pixel *src = _pixel(layer->image, box->x1 - layer->x, y - layer->y);
+		struct pixel *dst = _pixel(buf, box->x1, y);
+
+		for (x = box->x1; x < box->x2; x++, src++, dst++) {
+			uint8_t alpha = src->pad_or_alpha;
+
+			/* the alpha of dst is left alone, it is padding in XRGB8888 */
+			if (alpha == 255) {
+				dst->blue = src->blue;
+				dst->green = src->green;
+				dst->red = src->red;
+			} else if (alpha) {
+				dst->blue = _blend(src->blue, dst->blue, alpha);
+				dst->green = _blend(src->green, dst->green, alpha);
+				dst->red = _blend(src->red, dst->red, alpha);
+			}
+		}
+	}
+}
+
+static uint64_t _draw_layer(struct modeset_buf *buf, const struct layer *layer)
+{
+	const struct region_box *extents = region_extents(&layer->clip);
+	uint64_t pixels = 0;
+	uint32_t i;
+
+	for (i = 0; i < layer->clip.count; i++) {
+		const struct region_box *box = &layer->clip.boxes[i];
+
+		switch (layer->type) {
+		case LAYER_SOLID:
+		case LAYER_RECT:
+			fill_rect(buf, box->x1, box->y1, box->x2 - box->x1, box->y2 - box->y1,
+				  layer->color);
+			break;
+		case LAYER_IMAGE:
+			_draw_image(buf, layer, box);
+			break;
+		case LAYER_CURSOR:
+			_draw_cursor(buf, layer, box);
+			break;
+		}
+		pixels += (uint64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+	}
+
+	/* fill_rect() already recorded the boxes it wrote */
+	if (layer->clip.count && (layer->type == LAYER_IMAGE || layer->type == LAYER_CURSOR))
+		damage_add_rect(&buf->dirty, extents->x1, extents->y1, extents->x2 - extents->x1,
+				extents->y2 - extents->y1);
+
+	return pixels;
+}
+
+static int _repaint_region(struct compositor *compositor, struct modeset_buf *buf,
+			   const struct damage *repaint, struct region *region)
+{
+	struct region_box boxes[DAMAGE_MAX_RECTS];
+	struct region screen;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < repaint->count; i++)
+		boxes[i] = (struct region_box){ repaint->rects[i].x1, repaint->rects[i].y1,
+						repaint->rects[i].x2, repaint->rects[i].y2 };
+
+	ret = region_init_boxes(region, &compositor->arena, boxes, repaint->count);
+	if (ret)
+		return ret;
+	ret = region_init_rect(&screen, &compositor->arena, 0, 0, buf->width, buf->height);
+	if (ret)
+		return ret;
+
+	return region_intersect(region, region, &screen);
+}
+
+int compositor_render(struct compositor *compositor, struct modeset_buf *buf,
+		      struct damage *frame)
+{
+	struct region remaining, bounds;
+	struct damage repaint;
+	struct layer *layer;
+	uint32_t i;
+	int ret;
+
+	if (buf->map_tiled || !format_is_32bpp(buf->format)) {
+		for (layer = compositor->bottom; layer; layer = layer->next) {
+			if (layer->visible && layer->image &&
+			    (layer->type == LAYER_IMAGE || layer->type == LAYER_CURSOR))
+				return -EINVAL;
+		}
+	}
+
+	region_arena_reset(&compositor->arena);
+	damage_buffer_repaint(buf, &compositor->damage, &repaint);
+	ret = _repaint_region(compositor, buf, &repaint, &remaining);
+	if (ret)
+		return ret;
+
+	/*
+	 * Front to back: every layer gets what is left of the repaint region
+	 * under its bounds, opaque layers then remove it for the layers below.
+	 */
+	for (layer = compositor->top; layer; layer = layer->prev) {
+		struct region_box box = _layer_box(layer);
+
+		region_init(&layer->clip, &compositor->arena);
+		if (region_empty(&remaining) || box.x2 <= box.x1 || box.y2 <= box.y1)
+			continue;
+
+		ret = region_init_rect(&bounds, &compositor->arena, box.x1, box.y1,
+				       box.x2 - box.x1, box.y2 - box.y1);
+		if (!ret)
+			ret = region_intersect(&layer->clip, &bounds, &remaining);
+		if (!ret && _layer_opaque(layer))
+			ret = region_subtract(&remaining, &remaining, &layer->clip);
+		if (ret)
+			return ret;
+	}
+
+	/* back to front, so blended layers see what is below them */
+	for (i = 0; i < remaining.count; i++) {
+		const struct region_box *box = &remaining.boxes[i];
+
+		fill_rect(buf, box->x1, box->y1, box->x2 - box->x1, box->y2 - box->y1,
+			  compositor->background);
+	}
+	compositor->stats.pixels += region_area(&remaining);
+
+	for (layer = compositor->bottom; layer; layer = layer->next)
+		compositor->stats.pixels += _draw_layer(buf, layer);
+
+	*frame = compositor->damage;
+	damage_clear(&compositor->damage);
+	compositor->stats.frames++;
+	return 0;
+}
+
+void compositor_stats_get(struct compositor *compositor, struct compositor_stats *stats)
+{
+	*stats = compositor->stats;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "damage.h"
+
+/*
+ * Software compositor: an ordered list of layers composited into a
+ * modeset_buf.
+ *
+ * Only the parts of the back buffer that changed since it was last
+ * rendered are composited. Those are the layers moved, resized, recolored
+ * or added and removed since the last frame, plus the damage the buffer
+ * missed while it was not the back buffer (see damage.h). The layers are
+ * walked front to back first. Opaque layers clip everything below them,
+ * so pixels covered by opaque layers are never written. Then the visible
+ * parts are drawn back to front, so the cursor can blend over what is
+ * below it.
+ *
+ * Image and cursor layers read the pixels of a caller owned XRGB8888 or
+ * ARGB8888 buffer that must outlive the layer. They need a linear view of
+ * a 4 bytes per pixel destination buffer (map_tiled false).
+ */
+
+enum layer_type {
+	/* whole buffer of one color, x, y, w and h are ignored */
+	LAYER_SOLID,
+	/* rectangle of one color */
+	LAYER_RECT,
+	/* opaque copy of an image */
+	LAYER_IMAGE,
+	/* image blended over what is below with its alpha channel */
+	LAYER_CURSOR,
+};
+
+struct layer;
+struct compositor;
+
+struct compositor_stats {
+	uint64_t frames;
+	/* pixels written into the back buffers, blended ones included */
+	uint64_t pixels;
+};
+
+/* Pixels not covered by any layer get background */
+struct compositor *compositor_create(uint32_t background);
+void compositor_destroy(struct compositor *compositor);
+
+/* Layers with a higher z are above, same z layers stack in creation order */
+struct layer *compositor_layer_add(struct compositor *compositor, enum layer_type type, int z);
+void compositor_layer_remove(struct compositor *compositor, struct layer *layer);
+
+void layer_set_position(struct layer *layer, int32_t x, int32_t y);
+void layer_set_size(struct layer *layer, uint32_t w, uint32_t h);
+void layer_set_color(struct layer *layer, uint32_t color);
+/* For image and cursor layers, also sets the layer size to the image size */
+void layer_set_image(struct layer *layer, const struct modeset_buf *image);
+void layer_set_visible(struct layer *layer, bool visible);
+
+/*
+ * Composite the changes into buf and return in frame the damage of this
+ * frame. That is what the other buffers of the ring miss, pass it to
+ * damage_buffers_swap() once buf is presented. What was written is added
+ * to buf->dirty.
+ */
+int compositor_render(struct compositor *compositor, struct modeset_buf *buf,
+		      struct damage *frame);
+
+void compositor_stats_get(struct compositor *compositor, struct compositor_stats *stats);
@@ -0,0 +1,523 @@
+#include "convert.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONVERT_X86 1
+#endif
+
+typedef void (*convert_func)(struct modeset_buf *dst, const struct modeset_buf *src,
+			     uint32_t y_start, uint32_t y_end);
+typedef void (*convert_row_func)(uint8_t *dst, const uint8_t *src, uint32_t width);
+
+/* Ordered from the slowest to the fastest */
+enum convert_level {
+	CONVERT_SCALAR,
+	CONVERT_SSSE3,
+	CONVERT_AVX2,
+	CONVERT_LEVELS,
+};
+
+struct convert_kernel {
+	uint32_t src, dst;
+	enum convert_level level;
+	convert_func func;
+};
+
+static inline uint8_t *_plane(const struct modeset_buf *buf, unsigned plane, uint32_t y)
+{
+	uint32_t pitch = buf->pitches[plane] ? buf->pitches[plane] : buf->stride;
+
+	return buf->map + buf->offsets[plane] + pitch * y;
+}
+
+static inline uint32_t _clamp(int value)
+{
+	return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/* Pixels go through the loaders and storers as XRGB8888 values */
+static inline uint32_t _load_XRGB8888(const uint8_t *p)
+{
+	uint32_t value;
+
+	memcpy(&value, p, 4);
+	return value;
+}
+
+static inline uint32_t _load_ABGR8888(const uint8_t *p)
+{
+	uint32_t value = _load_XRGB8888(p);
+
+	return (value & 0xff00ff00) | (value >> 16 & 0xff) | (value & 0xff) << 16;
+}
+
+static inline void _store_XRGB8888(uint8_t *p, uint32_t color)
+{
+	memcpy(p, &color, 4);
+}
+
+static inline void _store_RGB565(uint8_t *p, uint32_t color)
+{
+	uint16_t value = (color >> 8 & 0xf800) | (color >> 5 & 0x07e0) | (color >> 3 & 0x001f);
+
+	memcpy(p, &value, 2);
+}
+
+/* BT.601 limited range, the same coefficients as format_pack() */
+static inline uint32_t _yuv_to_rgb(int y, int u, int v)
+{
+	int c = 298 * (y - 16) + 128, d = u - 128, e = v - 128;
+
+	return 0xff000000 | _clamp((c + 409 * e) >> 8) << 16 |
+	       _clamp((c - 100 * d - 208 * e) >> 8) << 8 | _clamp((c + 516 * d) >> 8);
+}
+
+static inline uint8_t _rgb_to_y(int r, int g, int b)
+{
+	return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t _rgb_to_u(int r, int g, int b)
+{
+	return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t _rgb_to_v(int r, int g, int b)
+{
+	return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+static inline __attribute__((always_inline))
+void _convert_rows(struct modeset_buf *dst, const struct modeset_buf *src,
+		   uint32_t y_start, uint32_t y_end, convert_row_func row)
+{
+	uint32_t y;
+
+	for (y = y_start; y < y_end; y++)
+		row(_plane(dst, 0, y), _plane(src, 0, y), dst->width);
+}
+
+/* One plane to one plane, row by row */
+#define CONVERT_PACKED(src_format, src_cpp, dst_format, dst_cpp)					\
+static void _row_##src_format##_##dst_format(uint8_t *dst, const uint8_t *src, uint32_t width)	\
+{												\
+	uint32_t x;										\
+												\
+	for (x = 0; x < width; x++)								\
+		_store_##dst_format(dst + x * dst_cpp, _load_##src_format(src + x * src_cpp));	\
+}
+
+#define CONVERT_ROWS(name, row)									\
+static void _convert_##name(struct modeset_buf *dst, const struct modeset_buf *src,		\
+			    uint32_t y_start, uint32_t y_end)					\
+{												\
+	_convert_rows(dst, src, y_start, y_end, row);						\
+}
+
+/* Every pixel gets the chroma of its 2x2 block */
+#define CONVERT_FROM_YUV420(dst_format, dst_cpp)						\
+static void _convert_YUV420_##dst_format(struct modeset_buf *dst, const struct modeset_buf *src,	\
+					 uint32_t y_start, uint32_t y_end)			\
+{												\
+	uint32_t x, y;										\
+												\
+	for (y = y_start; y < y_end; y++) {							\
+		const uint8_t *luma = _plane(src, 0, y);					\
+		const uint8_t *u = _plane(src, 1, y / 2), *v = _plane(src, 2, y / 2);		\
+		uint8_t *line = _plane(dst, 0, y);						\
+												\
+		for (x = 0; x < dst->width; x++)						\
+			_store_##dst_format(line + x * dst_cpp,					\
+					    _yuv_to_rgb(luma[x], u[x / 2], v[x / 2]));		\
+	}											\
+}
+
+/* Two rows at a time, the chroma is the average of each 2x2 block */
+#define CONVERT_TO_NV12(src_format, src_cpp)							\
+static void _convert_##src_format##_NV12(struct modeset_buf *dst, const struct modeset_buf *src,	\
+					 uint32_t y_start, uint32_t y_end)			\
+{												\
+	uint32_t x, y;										\
+												\
+	for (y = y_start; y < y_end; y += 2) {							\
+		bool second = y + 1 < y_end;							\
+		const uint8_t *s0 = _plane(src, 0, y);						\
+		const uint8_t *s1 = y + 1 < src->height ? _plane(src, 0, y + 1) : s0;		\
+		uint8_t *d0 = _plane(dst, 0, y), *d1 = second ? _plane(dst, 0, y + 1) : d0;	\
+		uint8_t *uv = _plane(dst, 1, y / 2);						\
+												\
+		for (x = 0; x < dst->width; x += 2) {						\
+			uint32_t x1 = x + 1 < dst->width ? x + 1 : x;				\
+			uint32_t c[4] = {							\
+				_load_##src_format(s0 + x * src_cpp),				\
+				_load_##src_format(s0 + x1 * src_cpp),				\
+				_load_##src_format(s1 + x * src_cpp),				\
+				_load_##src_format(s1 + x1 * src_cpp),				\
+			};									\
+			int r = 2, g = 2, b = 2, i;						\
+												\
+			for (i = 0; i < 4; i++) {						\
+				r += c[i] >> 16 & 0xff;						\
+				g += c[i] >> 8 & 0xff;						\
+				b += c[i] & 0xff;						\
+			}									\
+			r >>= 2;								\
+			g >>= 2;								\
+			b >>= 2;								\
+												\
+			d0[x] = _rgb_to_y(c[0] >> 16 & 0xff, c[0] >> 8 & 0xff, c[0] & 0xff);	\
+			d0[x1] = _rgb_to_y(c[1] >> 16 & 0xff, c[1] >> 8 & 0xff, c[1] & 0xff);	\
+			if (second) {								\
+				d1[x] = _rgb_to_y(c[2] >> 16 & 0xff, c[2] >> 8 & 0xff,		\
+						  c[2] & 0xff);					\
+				d1[x1] = _rgb_to_y(c[3] >> 16 & 0xff, c[3] >> 8 & 0xff,		\
+						   c[3] & 0xff);				\
+			}									\
+			uv[x] = _rgb_to_u(r, g, b);						\
+			uv[x + 1] = _rgb_to_v(r, g, b);						\
+		}										\
+	}											\
+}
+
+CONVERT_PACKED(ABGR8888, 4, XRGB8888, 4)
+CONVERT_PACKED(ABGR8888, 4, RGB565, 2)
+CONVERT_PACKED(XRGB8888, 4, RGB565, 2)
+CONVERT_ROWS(ABGR8888_XRGB8888, _row_ABGR8888_XRGB8888)
+CONVERT_ROWS(ABGR8888_RGB565, _row_ABGR8888_RGB565)
+CONVERT_ROWS(XRGB8888_RGB565, _row_XRGB8888_RGB565)
+CONVERT_FROM_YUV420(XRGB8888, 4)
+CONVERT_FROM_YUV420(RGB565, 2)
+CONVERT_TO_NV12(ABGR8888, 4)
+CONVERT_TO_NV12(XRGB8888, 4)
+
+/* Same Y plane, the Cb and Cr planes are interleaved */
+static void _convert_YUV420_NV12(struct modeset_buf *dst, const struct modeset_buf *src,
+				 uint32_t y_start, uint32_t y_end)
+{
+	uint32_t x, y;
+
+	for (y = y_start; y < y_end; y++) {
+		const uint8_t *u = _plane(src, 1, y / 2), *v = _plane(src, 2, y / 2);
+		uint8_t *uv = _plane(dst, 1, y / 2);
+
+		memcpy(_plane(dst, 0, y), _plane(src, 0, y), dst->width);
+		if (y & 1)
+			continue;
+
+		for (x = 0; x < (dst->width + 1) / 2; x++) {
+			uv[2 * x] = u[x];
+			uv[2 * x + 1] = v[x];
+		}
+	}
+}
+
+#ifdef CONVERT_X86
+/* R and B swap, one byte shuffle per vector */
+__attribute__((target("ssse3")))
+static void _row_ABGR8888_XRGB8888_ssse3(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	uint32_t x;
+
+	for (x = 0; x + 4 <= width; x += 4)
+		_mm_storeu_si128((__m128i *)(dst + x * 4),
+				 _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + x * 4)), mask));
+
+	_row_ABGR8888_XRGB8888(dst + x * 4, src + x * 4, width - x);
+}
+
+__attribute__((target("avx2")))
+static void _row_ABGR8888_XRGB8888_avx2(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+					      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + x * 4));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + x * 4 + 32));
+
+		_mm256_storeu_si256((__m256i *)(dst + x * 4), _mm256_shuffle_epi8(a, mask));
+		_mm256_storeu_si256((__m256i *)(dst + x * 4 + 32), _mm256_shuffle_epi8(b, mask));
+	}
+
+	_row_ABGR8888_XRGB8888_ssse3(dst + x * 4, src + x * 4, width - x);
+}
+
+/*
+ * 16 pixels per iteration: the channels are shifted and masked in 32 bits
+ * lanes, then packed to 16 bits. packus works within 128 bits lanes, the
+ * permute puts the 64 bits quarters back in order.
+ */
+#define CONVERT_RGB565_AVX2(src_format, red_shift, blue_shift)					\
+__attribute__((target("avx2")))									\
+static inline __m256i _pack565_##src_format(__m256i v)						\
+{												\
+	__m256i r = _mm256_and_si256(_mm256_srli_epi32(v, red_shift + 3), _mm256_set1_epi32(0x1f)); \
+	__m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 10), _mm256_set1_epi32(0x3f));	\
+	__m256i b = _mm256_and_si256(_mm256_srli_epi32(v, blue_shift + 3), _mm256_set1_epi32(0x1f)); \
+												\
+	return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, 11), _mm256_slli_epi32(g, 5)), b); \
+}												\
+												\
+__attribute__((target("avx2")))									\
+static void _row_##src_format##_RGB565_avx2(uint8_t *dst, const uint8_t *src, uint32_t width)	\
+{												\
+	uint32_t x;										\
+												\
+	for (x = 0; x + 16 <= width; x += 16) {							\
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + x * 4));			\
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + x * 4 + 32));		\
+		__m256i packed = _mm256_packus_epi32(_pack565_##src_format(a),			\
+						     _pack565_##src_format(b));			\
+												\
+		_mm256_storeu_si256((__m256i *)(dst + x * 2),					\
+				    _mm256_permute4x64_epi64(packed, 0xd8));			\
+	}											\
+												\
+	_row_##src_format##_RGB565(dst + x * 2, src + x * 4, width - x);			\
+}
+
+CONVERT_RGB565_AVX2(XRGB8888, 16, 0)
+CONVERT_RGB565_AVX2(ABGR8888, 0, 16)
+
+/* 8 pixels of _yuv_to_rgb() in 32 bits lanes, same integer math */
+__attribute__((target("avx2")))
+static inline __m256i _yuv_to_rgb_avx2(const uint8_t *luma, const uint8_t *u, const uint8_t *v)
+{
+	const __m256i zero = _mm256_setzero_si256(), max = _mm256_set1_epi32(255);
+	uint32_t u4, v4;
+	__m128i uu, vv;
+	__m256i c, d, e, r, g, b;
+
+	memcpy(&u4, u, 4);
+	memcpy(&v4, v, 4);
+	/* every chroma sample covers two pixels */
+	uu = _mm_cvtsi32_si128(u4);
+	vv = _mm_cvtsi32_si128(v4);
+	uu = _mm_unpacklo_epi8(uu, uu);
+	vv = _mm_unpacklo_epi8(vv, vv);
+
+	c = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)luma));
+	c = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(c, _mm256_set1_epi32(16)),
+						_mm256_set1_epi32(298)), _mm256_set1_epi32(128));
+	d = _mm256_sub_epi32(_mm256_cvtepu8_epi32(uu), _mm256_set1_epi32(128));
+	e = _mm256_sub_epi32(_mm256_cvtepu8_epi32(vv), _mm256_set1_epi32(128));
+
+	r = _mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409)));
+	g = _mm256_sub_epi32(c, _mm256_add_epi32(_mm256_mullo_epi32(d, _mm256_set1_epi32(100)),
+						 _mm256_mullo_epi32(e, _mm256_set1_epi32(208))));
+	b = _mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516)));
+
+	r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, 8), zero), max);
+	g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, 8), zero), max);
+	b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, 8), zero), max);
+
+	return _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32(0xff000000), _mm256_slli_epi32(r, 16)),
+			       _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+__attribute__((target("avx2")))
+static inline void _store8_XRGB8888(uint8_t *p, __m256i colors)
+{
+	_mm256_storeu_si256((__m256i *)p, colors);
+}
+
+__attribute__((target("avx2")))
+static inline void _store8_RGB565(uint8_t *p, __m256i colors)
+{
+	__m256i packed = _mm256_packus_epi32(_pack565_XRGB8888(colors), _mm256_setzero_si256());
+
+	_mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(_mm256_permute4x64_epi64(packed, 0xd8)));
+}
+
+#define CONVERT_FROM_YUV420_AVX2(dst_format, dst_cpp)						\
+__attribute__((target("avx2")))									\
+static void _convert_YUV420_##dst_format##_avx2(struct modeset_buf *dst,			\
+						const struct modeset_buf *src,			\
+						uint32_t y_start, uint32_t y_end)		\
+{												\
+	uint32_t x, y;										\
+												\
+	for (y = y_start; y < y_end; y++) {							\
+		const uint8_t *luma = _plane(src, 0, y);					\
+		const uint8_t *u = _plane(src, 1, y / 2), *v = _plane(src, 2, y / 2);		\
+		uint8_t *line = _plane(dst, 0, y);						\
+												\
+		for (x = 0; x + 8 <= dst->width; x += 8)					\
+			_store8_##dst_format(line + x * dst_cpp,				\
+					     _yuv_to_rgb_avx2(luma + x, u + x / 2, v + x / 2));	\
+		for (; x < dst->width; x++)							\
+			_store_##dst_format(line + x * dst_cpp,					\
+					    _yuv_to_rgb(luma[x], u[x / 2], v[x / 2]));		\
+	}											\
+}
+
+CONVERT_FROM_YUV420_AVX2(XRGB8888, 4)
+CONVERT_FROM_YUV420_AVX2(RGB565, 2)
+CONVERT_ROWS(ABGR8888_XRGB8888_ssse3, _row_ABGR8888_XRGB8888_ssse3)
+CONVERT_ROWS(ABGR8888_XRGB8888_avx2, _row_ABGR8888_XRGB8888_avx2)
+CONVERT_ROWS(ABGR8888_RGB565_avx2, _row_ABGR8888_RGB565_avx2)
+CONVERT_ROWS(XRGB8888_RGB565_avx2, _row_XRGB8888_RGB565_avx2)
+#endif
+
+static const struct convert_kernel kernels[] = {
+	{ DRM_FORMAT_ABGR8888, DRM_FORMAT_XRGB8888, CONVERT_SCALAR, _convert_ABGR8888_XRGB8888 },
+	{ DRM_FORMAT_ABGR8888, DRM_FORMAT_RGB565, CONVERT_SCALAR, _convert_ABGR8888_RGB565 },
+	{ DRM_FORMAT_ABGR8888, DRM_FORMAT_NV12, CONVERT_SCALAR, _convert_ABGR8888_NV12 },
+	{ DRM_FORMAT_XRGB8888, DRM_FORMAT_RGB565, CONVERT_SCALAR, _convert_XRGB8888_RGB565 },
+	{ DRM_FORMAT_XRGB8888, DRM_FORMAT_NV12, CONVERT_SCALAR, _convert_XRGB8888_NV12 },
+	{ DRM_FORMAT_YUV420, DRM_FORMAT_XRGB8888, CONVERT_SCALAR, _convert_YUV420_XRGB8888 },
+	{ DRM_FORMAT_YUV420, DRM_FORMAT_RGB565, CONVERT_SCALAR, _convert_YUV420_RGB565 },
+	{ DRM_FORMAT_YUV420, DRM_FORMAT_NV12, CONVERT_SCALAR, _convert_YUV420_NV12 },
+#ifdef CONVERT_X86
+	{ DRM_FORMAT_ABGR8888, DRM_FORMAT_XRGB8888, CONVERT_SSSE3, _convert_ABGR8888_XRGB8888_ssse3 },
+	{ DRM_FORMAT_ABGR8888, DRM_FORMAT_XRGB8888, CONVERT_AVX2, _convert_ABGR8888_XRGB8888_avx2 },
+	{ DRM_FORMAT_ABGR8888, DRM_FORMAT_RGB565, CONVERT_AVX2, _convert_ABGR8888_RGB565_avx2 },
+	{ DRM_FORMAT_XRGB8888, DRM_FORMAT_RGB565, CONVERT_AVX2, _convert_XRGB8888_RGB565_avx2 },
+	{ DRM_FORMAT_YUV420, DRM_FORMAT_XRGB8888, CONVERT_AVX2, _convert_YUV420_XRGB8888_avx2 },
+	{ DRM_FORMAT_YUV420, DRM_FORMAT_RGB565, CONVERT_AVX2, _convert_YUV420_RGB565_avx2 },
+#endif
+};
+
+static const char *const level_names[CONVERT_LEVELS] = { "scalar", "ssse3", "avx2" };
+
+/* highest level convert() may use, -1 until picked from CPUID */
+static int level_max = -1;
+
+static bool _level_supported(enum convert_level level)
+{
+#ifdef CONVERT_X86
+	__builtin_cpu_init();
+	switch (level) {
+	case CONVERT_SCALAR:
+		return true;
+	case CONVERT_SSSE3:
+		return __builtin_cpu_supports("ssse3");
+	case CONVERT_AVX2:
+		return __builtin_cpu_supports("avx2");
+	default:
+		return false;
+	}
+#else
+	return level == CONVERT_SCALAR;
+#endif
+}
+
+static int _level_max(void)
+{
+	int level;
+
+	if (level_max >= 0)
+		return level_max;
+
+	for (level = CONVERT_LEVELS - 1; level > CONVERT_SCALAR; level--) {
+		if (_level_supported(level))
+			break;
+	}
+	level_max = level;
+	return level_max;
+}
+
+/* ARGB8888 is XRGB8888 with the alpha kept */
+static uint32_t _alias(uint32_t format)
+{
+	return format == DRM_FORMAT_ARGB8888 ? DRM_FORMAT_XRGB8888 : format;
+}
+
+static const struct convert_kernel *_kernel_get(uint32_t src_format, uint32_t dst_format)
+{
+	const struct convert_kernel *best = NULL;
+	int max = _level_max();
+	unsigned i;
+
+	src_format = _alias(src_format);
+	dst_format = _alias(dst_format);
+
+	for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		const struct convert_kernel *k = &kernels[i];
+
+		if (k->src != src_format || k->dst != dst_format || (int)k->level > max)
+			continue;
+		if (!best || k->level > best->level)
+			best = k;
+	}
+
+	return best;
+}
+
+bool convert_supported(uint32_t src_format, uint32_t dst_format)
+{
+	return _kernel_get(src_format, dst_format);
+}
+
+const char *convert_kernel_name(uint32_t src_format, uint32_t dst_format)
+{
+	const struct convert_kernel *k = _kernel_get(src_format, dst_format);
+
+	return k ? level_names[k->level] : NULL;
+}
+
+int convert_kernel_set(const char *name)
+{
+	unsigned i;
+
+	if (!name) {
+		level_max = -1;
+		return 0;
+	}
+
+	for (i = 0; i < CONVERT_LEVELS; i++) {
+		if (strcmp(level_names[i], name))
+			continue;
+		if (!_level_supported(i))
+			return -1;
+
+		level_max = i;
+		return 0;
+	}
+
+	return -1;
+}
+
+static bool _subsampled(uint32_t format)
+{
+	const struct format_info *info = format_info_get(format);
+
+	return info && info->vsub > 1;
+}
+
+int convert_rows(struct modeset_buf *dst, const struct modeset_buf *src,
+		 uint32_t y_start, uint32_t y_end)
+{
+	const struct convert_kernel *k = _kernel_get(src->format, dst->format);
+
+	if (!k || dst->width != src->width || dst->height != src->height ||
+	    dst->map_tiled || src->map_tiled)
+		return -EINVAL;
+	/* an odd start splits the 2x2 chroma blocks with the band above */
+	if ((y_start & 1) && (_subsampled(src->format) || _subsampled(dst->format)))
+		return -EINVAL;
+
+	if (y_end > dst->height)
+		y_end = dst->height;
+	if (y_start < y_end)
+		k->func(dst, src, y_start, y_end);
+
+	return 0;
+}
+
+int convert(struct modeset_buf *dst, const struct modeset_buf *src)
+{
+	int ret = convert_rows(dst, src, 0, dst->height);
+
+	if (!ret)
+		damage_add_rect(&dst->dirty, 0, 0, dst->width, dst->height);
+
+	return ret;
+}
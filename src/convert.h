@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Pixel format conversion between two linear buffers of the same size.
+ *
+ * Sources are ABGR8888 (R, G, B, A in memory, the struct color_32_bits
+ * layout most producers hand out as "RGBA"), XRGB8888 and YUV420 (I420).
+ * Destinations are XRGB8888, RGB565 and NV12. YUV goes through BT.601
+ * limited range like format_pack(), NV12 chroma is the average of each
+ * 2x2 block.
+ *
+ * Every (source, destination) pair has its own kernel, generated from
+ * per-format load and store helpers so the compiler specializes and
+ * vectorizes each loop. The most used pairs also have hand written
+ * SSSE3/AVX2 shuffle kernels, picked at runtime from CPUID like the fill
+ * kernels.
+ */
+
+bool convert_supported(uint32_t src_format, uint32_t dst_format);
+
+/* Returns -EINVAL if the pair is not supported or the sizes differ */
+int convert(struct modeset_buf *dst, const struct modeset_buf *src);
+/*
+ * Rows [y_start, y_end) only, for render_pool bands. y_start must be even
+ * when either format has subsampled chroma, -EINVAL otherwise.
+ */
+int convert_rows(struct modeset_buf *dst, const struct modeset_buf *src,
+		 uint32_t y_start, uint32_t y_end);
+
+/* Kernel convert() uses for a pair: "scalar", "ssse3" or "avx2", NULL if unsupported */
+const char *convert_kernel_name(uint32_t src_format, uint32_t dst_format);
+/*
+ * Highest kernel level to use, NULL goes back to the CPUID pick. Returns -1
+ * if the level is unknown or not supported by the CPU.
+ */
+int convert_kernel_set(const char *name);
@@ -2,6 +2,11 @@
 #include <stdio.h>
 
 #include "common.h"
+#include "fill.h"
+#include "swapchain.h"
+
+#define CURSOR_X 100
+#define CURSOR_Y 100
 
 int main()
 {
@@ -13,26 +18,15 @@ int main()
 		return -1;
 	}
 
-	list = drm_modeset(fd);
+	list = drm_modeset(fd, 1);
 
 	// half screen blue half screen green
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 0;
-				p->green = x >= (buf->width / 2) ? 255 : 0;
-				p->blue = x < (buf->width / 2) ? 255 : 0;
-			}
-		}
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
+		uint32_t half = buf->width / 2;
+
+		fill_rect(buf, 0, 0, half, buf->height, fill_color(0, 0, 255, 0));
+		fill_rect(buf, half, 0, buf->width - half, buf->height, fill_color(0, 255, 0, 0));
 	}
 
 	// get properties
@@ -54,25 +48,15 @@ int main()
 	// white cursor
 	for (iter = list; iter; iter = iter->next) {
 		struct modeset_buf *cursor = &iter->cursor;
-		uint32_t y;
-
-		for (y = 0; y < cursor->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = cursor->stride * y;
-
-			for (x = 0; x < cursor->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(cursor->map[pixel_offset]);
-				p->red = 255;
-				p->green = 255;
-				p->blue = 255;
-				p->pad_or_alpha = 255;
-			}
+
+		if (drm_cursor_create(iter)) {
+			fprintf(stderr, "cannot create cursor for connector %u\n", iter->conn);
+			continue;
 		}
+		fill_buffer(cursor, fill_color(255, 255, 255, 255));
 
 		drmModeSetCursor(iter->drm_fd, iter->crtc, cursor->handle, cursor->width, cursor->height);
-		drmModeMoveCursor(iter->drm_fd, iter->crtc, 100, 100);
+		drmModeMoveCursor(iter->drm_fd, iter->crtc, CURSOR_X, CURSOR_Y);
 	}
 	printf("Full red screens with a white cursor\n");
 	printf("Press enter to continue...\n");
@@ -80,24 +64,12 @@ int main()
 
 	for (iter = list; iter; iter = iter->next) {
 		struct modeset_buf *cursor = &iter->cursor;
-		uint32_t y;
-
-		for (y = 0; y < cursor->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = cursor->stride * y;
-
-			for (x = 0; x < cursor->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(cursor->map[pixel_offset]);
-				p->red = 0;
-				p->green = 255;
-				p->blue = 0;
-				p->pad_or_alpha = 255;
-			}
-		}
 
-		r = drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		fill_buffer(cursor, fill_color(0, 255, 0, 255));
+
+		/* the primary is untouched, only flag what is under the cursor */
+		damage_add_rect(&swapchain_front(iter->swapchain)->dirty, CURSOR_X, CURSOR_Y, cursor->width, cursor->height);
+		r = damage_flush(iter->drm_fd, swapchain_front(iter->swapchain));
 		printf("drmModeDirtyFB() r=%i\n", r);
 	}
 	printf("Green cursor\n");
@@ -106,24 +78,14 @@ int main()
 
 	for (iter = list; iter; iter = iter->next) {
 		struct modeset_buf *cursor = &iter->cursor;
-		uint32_t y;
-
-		for (y = 0; y < cursor->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = cursor->stride * y;
-
-			for (x = 0; x < cursor->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(cursor->map[pixel_offset]);
-				p->red = x >= (cursor->width / 2) ? 255 : 0;
-				p->green = 0;
-				p->blue = 0;
-				p->pad_or_alpha = 255;
-			}
-		}
+		uint32_t half = cursor->width / 2;
+
+		fill_rect(cursor, 0, 0, half, cursor->height, fill_color(0, 0, 0, 255));
+		fill_rect(cursor, half, 0, cursor->width - half, cursor->height, fill_color(255, 0, 0, 255));
 
-		r = drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		/* the primary is untouched, only flag what is under the cursor */
+		damage_add_rect(&swapchain_front(iter->swapchain)->dirty, CURSOR_X, CURSOR_Y, cursor->width, cursor->height);
+		r = damage_flush(iter->drm_fd, swapchain_front(iter->swapchain));
 		printf("drmModeDirtyFB() r=%i\n", r);
 	}
 	printf("Half red half black cursor\n");
@@ -132,21 +94,15 @@ int main()
 
 	for (iter = list; iter; iter = iter->next) {
 		struct modeset_buf *cursor = &iter->cursor;
-		uint32_t y;
-
-		for (y = 0; y < cursor->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = cursor->stride * y;
-
-			for (x = 0; x < cursor->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(cursor->map[pixel_offset]);
-				p->pad_or_alpha = 125;
-			}
-		}
+		uint32_t half = cursor->width / 2;
+
+		/* same colors as before, only the alpha changes */
+		fill_rect(cursor, 0, 0, half, cursor->height, fill_color(0, 0, 0, 125));
+		fill_rect(cursor, half, 0, cursor->width - half, cursor->height, fill_color(255, 0, 0, 125));
 
-		r = drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		/* the primary is untouched, only flag what is under the cursor */
+		damage_add_rect(&swapchain_front(iter->swapchain)->dirty, CURSOR_X, CURSOR_Y, cursor->width, cursor->height);
+		r = damage_flush(iter->drm_fd, swapchain_front(iter->swapchain));
 		printf("drmModeDirtyFB() r=%i\n", r);
 	}
 	printf("Half blue half green with 50%% of transparency\n");
@@ -154,7 +110,7 @@ int main()
 	getchar();
 
 	for (iter = list; iter; iter = iter->next) {
-		drmModeMoveCursor(iter->drm_fd, iter->crtc, iter->buffers[0].width / 2 + 100, 100);
+		drmModeMoveCursor(iter->drm_fd, iter->crtc, iter->mode.hdisplay / 2 + CURSOR_X, CURSOR_Y);
 	}
 	printf("Cursor moved to other half of screen\n");
 	printf("Press enter to continue...\n");
@@ -0,0 +1,228 @@
+#include "damage.h"
+
+#include "common.h"
+#include "fill.h"
+
+static struct {
+	unsigned max_clips;
+	uint64_t slack;
+	damage_dirty_fb_func dirty_fb;
+} flush = {
+	.max_clips = DAMAGE_FLUSH_MAX_CLIPS,
+	.slack = DAMAGE_FLUSH_SLACK,
+	.dirty_fb = drmModeDirtyFB,
+};
+
+static inline uint32_t _min(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline uint32_t _max(uint32_t a, uint32_t b)
+{
+	return a > b ? a : b;
+}
+
+static uint64_t _rect_area(const struct drm_clip_rect *r)
+{
+	return (uint64_t)(r->x2 - r->x1) * (r->y2 - r->y1);
+}
+
+static uint64_t _rect_intersection_area(const struct drm_clip_rect *a,
+				       const struct drm_clip_rect *b)
+{
+	uint32_t x1 = _max(a->x1, b->x1), y1 = _max(a->y1, b->y1);
+	uint32_t x2 = _min(a->x2, b->x2), y2 = _min(a->y2, b->y2);
+
+	if (x1 >= x2 || y1 >= y2)
+		return 0;
+
+	return (uint64_t)(x2 - x1) * (y2 - y1);
+}
+
+static void _rect_union(struct drm_clip_rect *r, const struct drm_clip_rect *other)
+{
+	r->x1 = _min(r->x1, other->x1);
+	r->y1 = _min(r->y1, other->y1);
+	r->x2 = _max(r->x2, other->x2);
+	r->y2 = _max(r->y2, other->y2);
+}
+
+static bool _rect_contains(const struct drm_clip_rect *r, const struct drm_clip_rect *other)
+{
+	return r->x1 <= other->x1 && r->y1 <= other->y1 &&
+	       r->x2 >= other->x2 && r->y2 >= other->y2;
+}
+
+static void _damage_add_clip_rect(struct damage *damage, const struct drm_clip_rect *rect)
+{
+	uint64_t best_growth = UINT64_MAX;
+	unsigned i, best = 0;
+
+	if (rect->x1 >= rect->x2 || rect->y1 >= rect->y2)
+		return;
+
+	for (i = 0; i < damage->count; i++) {
+		struct drm_clip_rect merged = damage->rects[i];
+		uint64_t growth;
+
+		if (_rect_contains(&damage->rects[i], rect))
+			return;
+
+		_rect_union(&merged, rect);
+		growth = _rect_area(&merged) - _rect_area(&damage->rects[i]);
+		if (growth < best_growth) {
+			best_growth = growth;
+			best = i;
+		}
+	}
+
+	if (damage->count < DAMAGE_MAX_RECTS) {
+		damage->rects[damage->count++] = *rect;
+		return;
+	}
+
+	_rect_union(&damage->rects[best], rect);
+}
+
+void damage_clear(struct damage *damage)
+{
+	damage->count = 0;
+}
+
+void damage_add_rect(struct damage *damage, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+	struct drm_clip_rect rect = {
+		.x1 = _min(x, UINT16_MAX),
+		.y1 = _min(y, UINT16_MAX),
+		.x2 = _min(x + w, UINT16_MAX),
+		.y2 = _min(y + h, UINT16_MAX),
+	};
+
+	_damage_add_clip_rect(damage, &rect);
+}
+
+void damage_add(struct damage *damage, const struct damage *other)
+{
+	unsigned i;
+
+	for (i = 0; i < other->count; i++)
+		_damage_add_clip_rect(damage, &other->rects[i]);
+}
+
+uint64_t damage_area(const struct damage *damage)
+{
+	uint64_t area = 0;
+	unsigned i;
+
+	for (i = 0; i < damage->count; i++)
+		area += _rect_area(&damage->rects[i]);
+
+	return area;
+}
+
+/* Pixels the bounding box of a and b covers that neither a nor b does */
+static uint64_t _merge_cost(const struct drm_clip_rect *a, const struct drm_clip_rect *b)
+{
+	struct drm_clip_rect merged = *a;
+	uint64_t covered = _rect_area(a) + _rect_area(b) - _rect_intersection_area(a, b);
+
+	_rect_union(&merged, b);
+	return _rect_area(&merged) - covered;
+}
+
+void damage_simplify(struct damage *damage, unsigned max_rects, uint64_t slack)
+{
+	if (!max_rects)
+		max_rects = 1;
+
+	while (damage->count > 1) {
+		uint64_t best_cost = UINT64_MAX;
+		unsigned i, j, best_i = 0, best_j = 1;
+
+		for (i = 0; i < damage->count; i++) {
+			for (j = i + 1; j < damage->count; j++) {
+				uint64_t cost = _merge_cost(&damage->rects[i], &damage->rects[j]);
+
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_i = i;
+					best_j = j;
+				}
+			}
+		}
+
+		if (damage->count <= max_rects && best_cost > slack)
+			break;
+
+		_rect_union(&damage->rects[best_i], &damage->rects[best_j]);
+		damage->rects[best_j] = damage->rects[--damage->count];
+	}
+}
+
+void damage_flush_config(unsigned max_clips, uint64_t slack)
+{
+	flush.max_clips = max_clips;
+	flush.slack = slack;
+}
+
+void damage_flush_backend_set(damage_dirty_fb_func func)
+{
+	flush.dirty_fb = func ? func : drmModeDirtyFB;
+}
+
+int damage_flush(int drm_fd, struct modeset_buf *buf)
+{
+	struct damage clips;
+	unsigned i;
+
+	damage_clear(&clips);
+	for (i = 0; i < buf->dirty.count; i++) {
+		struct drm_clip_rect rect = buf->dirty.rects[i];
+
+		rect.x2 = _min(rect.x2, buf->width);
+		rect.y2 = _min(rect.y2, buf->height);
+		_damage_add_clip_rect(&clips, &rect);
+	}
+	damage_clear(&buf->dirty);
+
+	if (!clips.count)
+		return 0;
+
+	damage_simplify(&clips, flush.max_clips, flush.slack);
+	/* the clips cover everything drawn, written back before the display reads it */
+	fill_writeback(buf, &clips);
+	return flush.dirty_fb(drm_fd, buf->fb, clips.rects, clips.count);
+}
+
+void damage_buffer_repaint(struct modeset_buf *buf, const struct damage *frame,
+			   struct damage *repaint)
+{
+	damage_clear(repaint);
+
+	if (!buf->age) {
+		damage_add_rect(repaint, 0, 0, buf->width, buf->height);
+		return;
+	}
+
+	*repaint = buf->damage;
+	damage_add(repaint, frame);
+}
+
+void damage_buffers_swap(struct modeset_buf *buffers, unsigned count, struct modeset_buf *back,
+			 const struct damage *frame)
+{
+	unsigned i;
+
+	for (i = 0; i < count; i++) {
+		struct modeset_buf *buf = &buffers[i];
+
+		if (buf == back) {
+			buf->age = 1;
+			damage_clear(&buf->damage);
+		} else if (buf->age) {
+			buf->age++;
+			damage_add(&buf->damage, frame);
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+/*
+ * Damage tracking, a short list of rectangles covering everything that
+ * changed. When the list is full a new rectangle is merged into the one
+ * whose bounding box grows the least, so the list always covers at least
+ * the damaged pixels, sometimes a bit more.
+ *
+ * Every modeset_buf carries an age and the damage of the frames presented
+ * since it was last the back buffer, like EGL_EXT_buffer_age: a buffer
+ * with age 0 has undefined content and must be fully repainted, otherwise
+ * only its damage plus the damage of the new frame has to be repainted.
+ *
+ * The fill and raster functions also record what they draw in buf->dirty,
+ * damage_flush() hands it to drmModeDirtyFB() so frontbuffer rendering
+ * with PSR2 selective update or FBC only refreshes what changed.
+ */
+
+#define DAMAGE_MAX_RECTS 16
+
+struct damage {
+	unsigned count;
+	/* x2 and y2 are exclusive */
+	struct drm_clip_rect rects[DAMAGE_MAX_RECTS];
+};
+
+struct modeset_buf;
+
+void damage_clear(struct damage *damage);
+void damage_add_rect(struct damage *damage, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+void damage_add(struct damage *damage, const struct damage *other);
+/* Sum of the rectangle areas, overlaps are counted more than once */
+uint64_t damage_area(const struct damage *damage);
+
+/*
+ * Merge rectangles until there are at most max_rects of them, then keep
+ * merging the pairs whose bounding box adds at most slack pixels not
+ * covered by either of them. Fewer clips cost less to program, a lower
+ * slack refreshes fewer pixels.
+ */
+void damage_simplify(struct damage *damage, unsigned max_rects, uint64_t slack);
+
+#define DAMAGE_FLUSH_MAX_CLIPS 4
+#define DAMAGE_FLUSH_SLACK 4096
+
+/* Merge settings of damage_flush(), defaults are the DAMAGE_FLUSH_* above */
+void damage_flush_config(unsigned max_clips, uint64_t slack);
+
+typedef int (*damage_dirty_fb_func)(int fd, uint32_t fb, drmModeClipPtr clips, uint32_t num_clips);
+
+/* Replace drmModeDirtyFB(), to run without a device, NULL restores it */
+void damage_flush_backend_set(damage_dirty_fb_func func);
+
+/*
+ * Send buf->dirty, clipped to the buffer and simplified, to
+ * drmModeDirtyFB() and clear it. Nothing is sent when nothing was drawn,
+ * an empty clip list would mark the whole framebuffer dirty.
+ */
+int damage_flush(int drm_fd, struct modeset_buf *buf);
+
+/* Damage to repaint in buf, the next back buffer, for a frame with frame damage */
+void damage_buffer_repaint(struct modeset_buf *buf, const struct damage *frame,
+			   struct damage *repaint);
+
+/*
+ * back was just presented with frame damage: back is now up to date and
+ * every other buffer of the ring gets one frame older.
+ */
+void damage_buffers_swap(struct modeset_buf *buffers, unsigned count, struct modeset_buf *back,
+			 const struct damage *frame);
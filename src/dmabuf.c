@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include "dmabuf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <drm_fourcc.h>
+#include <linux/dma-buf.h>
+#include <linux/udmabuf.h>
+
+#include "tiling.h"
+
+#define UDMABUF_DEVICE "/dev/udmabuf"
+#define PAGE_SIZE 4096
+
+/* -1 if udmabuf is missing, the memfd is kept either way */
+static int _udmabuf_create(int memfd, size_t size)
+{
+	struct udmabuf_create create = {
+		.memfd = memfd,
+		.flags = UDMABUF_FLAGS_CLOEXEC,
+		.offset = 0,
+		.size = size,
+	};
+	int fd, dmabuf_fd;
+
+	fd = open(UDMABUF_DEVICE, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	dmabuf_fd = ioctl(fd, UDMABUF_CREATE, &create);
+	close(fd);
+	return dmabuf_fd;
+}
+
+int dmabuf_shm_create(struct dmabuf_shm *shm, size_t size)
+{
+	size = (size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+
+	memset(shm, 0, sizeof(*shm));
+	shm->dmabuf_fd = -1;
+	shm->size = size;
+
+	shm->memfd = memfd_create("dmabuf_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (shm->memfd < 0) {
+		fprintf(stderr, "cannot create memfd (%d): %m\n", errno);
+		return -errno;
+	}
+
+	/* udmabuf pins the pages, the memfd must not shrink under it */
+	if (ftruncate(shm->memfd, size) || fcntl(shm->memfd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+		fprintf(stderr, "cannot size memfd (%d): %m\n", errno);
+		goto err;
+	}
+
+	shm->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->memfd, 0);
+	if (shm->map == MAP_FAILED) {
+		fprintf(stderr, "cannot map memfd (%d): %m\n", errno);
+		shm->map = NULL;
+		goto err;
+	}
+
+	shm->dmabuf_fd = _udmabuf_create(shm->memfd, size);
+	return 0;
+
+err:
+	close(shm->memfd);
+	shm->memfd = -1;
+	return -errno;
+}
+
+void dmabuf_shm_destroy(struct dmabuf_shm *shm)
+{
+	if (shm->dmabuf_fd >= 0)
+		close(shm->dmabuf_fd);
+	if (shm->map)
+		munmap(shm->map, shm->size);
+	if (shm->memfd >= 0)
+		close(shm->memfd);
+	shm->dmabuf_fd = shm->memfd = -1;
+	shm->map = NULL;
+}
+
+static int _sync(int dmabuf_fd, uint64_t flags)
+{
+	struct dma_buf_sync sync = {
+		.flags = flags,
+	};
+	int ret;
+
+	do {
+		ret = ioctl(dmabuf_fd, DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret && (errno == EINTR || errno == EAGAIN));
+
+	return ret ? -errno : 0;
+}
+
+int dmabuf_sync_begin(int dmabuf_fd, uint64_t flags)
+{
+	return _sync(dmabuf_fd, DMA_BUF_SYNC_START | flags);
+}
+
+int dmabuf_sync_end(int dmabuf_fd, uint64_t flags)
+{
+	return _sync(dmabuf_fd, DMA_BUF_SYNC_END | flags);
+}
+
+uint64_t dmabuf_size(int dmabuf_fd)
+{
+	/* seeking to the end is all a dma-buf supports, to tell its size */
+	off_t size = lseek(dmabuf_fd, 0, SEEK_END);
+
+	return size > 0 ? size : 0;
+}
+
+int dmabuf_layout_check(uint64_t size, uint32_t format, uint64_t modifier, uint32_t width,
+			uint32_t height, const uint32_t pitches[FORMAT_MAX_PLANES],
+			const uint32_t offsets[FORMAT_MAX_PLANES])
+{
+	const struct format_info *info = format_info_get(format);
+	uint32_t tile_width = 1, tile_height = 1;
+	unsigned i;
+
+	if (!info || !width || !height)
+		return -EINVAL;
+	if (modifier != DRM_FORMAT_MOD_LINEAR && tiling_tile_size(modifier, &tile_width, &tile_height))
+		return -EINVAL;
+
+	for (i = 0; i < info->planes; i++) {
+		uint32_t plane_width, plane_height;
+		uint64_t rows;
+
+		format_plane_size(info, i, width, height, &plane_width, &plane_height);
+		rows = (plane_height + tile_height - 1) / tile_height * tile_height;
+
+		if ((uint64_t)pitches[i] < (uint64_t)plane_width * info->cpp[i] ||
+		    pitches[i] % tile_width || offsets[i] + rows * pitches[i] > size)
+			return -EINVAL;
+	}
+
+	return 0;
+}
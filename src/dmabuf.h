@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "format.h"
+
+/*
+ * dma-bufs handed to the display without a copy, see drm_buffer_import().
+ *
+ * A shared memory producer writes its frames in a dmabuf_shm: a sealed
+ * memfd turned into a dma-buf by /dev/udmabuf. Without udmabuf, on older
+ * kernels or in containers, dmabuf_fd is -1 and the memfd can still be
+ * shared with another process, but the display can't import it.
+ *
+ * None of this needs a GPU.
+ */
+
+struct dmabuf_shm {
+	int memfd;
+	/* -1 without /dev/udmabuf */
+	int dmabuf_fd;
+	/* the producer view of the pages, shared with the dma-buf */
+	uint8_t *map;
+	/* page rounded */
+	size_t size;
+};
+
+int dmabuf_shm_create(struct dmabuf_shm *shm, size_t size);
+void dmabuf_shm_destroy(struct dmabuf_shm *shm);
+
+/*
+ * Bracket CPU accesses through a dma-buf mapping, flags are
+ * DMA_BUF_SYNC_READ and DMA_BUF_SYNC_WRITE.
+ */
+int dmabuf_sync_begin(int dmabuf_fd, uint64_t flags);
+int dmabuf_sync_end(int dmabuf_fd, uint64_t flags);
+
+/* Size of the dma-buf, 0 if fd is not one */
+uint64_t dmabuf_size(int dmabuf_fd);
+
+/*
+ * Does a width x height buffer of format and modifier with the given plane
+ * pitches and offsets fit in size bytes, tiled planes a whole number of
+ * tiles. Returns -EINVAL if it doesn't, before the kernel refuses the
+ * framebuffer with less detail.
+ */
+int dmabuf_layout_check(uint64_t size, uint32_t format, uint64_t modifier, uint32_t width,
+			uint32_t height, const uint32_t pitches[FORMAT_MAX_PLANES],
+			const uint32_t offsets[FORMAT_MAX_PLANES]);
@@ -0,0 +1,117 @@
+#include <errno.h>
+#include <stdio.h>
+
+#include <drm_fourcc.h>
+#include <linux/dma-buf.h>
+
+#include "common.h"
+#include "dmabuf.h"
+#include "fill.h"
+
+#define HEADS_MAX 8
+
+/* A shared memory producer, its frames are scanned out without any copy */
+struct producer {
+	struct dmabuf_shm shm;
+	/* the imported framebuffer */
+	struct modeset_buf fb;
+	/* fb seen through the producer mapping */
+	struct modeset_buf frame;
+};
+
+static int producer_init(struct producer *producer, struct modeset_dev *iter)
+{
+	uint32_t pitches[FORMAT_MAX_PLANES], offsets[FORMAT_MAX_PLANES], size;
+	uint32_t width = iter->mode.hdisplay, height = iter->mode.vdisplay;
+
+	format_layout(DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, width, height, pitches, offsets,
+		      &size);
+	if (dmabuf_shm_create(&producer->shm, size))
+		return -1;
+	if (producer->shm.dmabuf_fd < 0) {
+		fprintf(stderr, "no /dev/udmabuf, the memfd can't be imported\n");
+		dmabuf_shm_destroy(&producer->shm);
+		return -1;
+	}
+
+	if (drm_buffer_import(iter->drm_fd, &producer->fb, producer->shm.dmabuf_fd, width, height,
+			      DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR, pitches, offsets)) {
+		dmabuf_shm_destroy(&producer->shm);
+		return -1;
+	}
+
+	/* the pages are cached for the producer, the display doesn't snoop */
+	producer->frame = producer->fb;
+	producer->frame.map = producer->shm.map;
+	producer->frame.map_cached = true;
+	return 0;
+}
+
+static void producer_fini(struct producer *producer, int fd)
+{
+	drm_buffer_destroy(fd, &producer->fb);
+	dmabuf_shm_destroy(&producer->shm);
+}
+
+/* Straight into the scanned out pages, damage_flush() writes the lines back */
+static void producer_draw(struct producer *producer, int fd, bool halves)
+{
+	struct modeset_buf *frame = &producer->frame;
+	uint32_t half = frame->width / 2;
+
+	dmabuf_sync_begin(producer->shm.dmabuf_fd, DMA_BUF_SYNC_WRITE);
+	if (halves) {
+		fill_rect(frame, 0, 0, half, frame->height, fill_color(0, 0, 255, 0));
+		fill_rect(frame, half, 0, frame->width - half, frame->height, fill_color(0, 255, 0, 0));
+	} else {
+		fill_buffer(frame, fill_color(255, 0, 0, 0));
+	}
+	dmabuf_sync_end(producer->shm.dmabuf_fd, DMA_BUF_SYNC_WRITE);
+
+	damage_flush(fd, frame);
+}
+
+int main()
+{
+	int fd;
+	struct modeset_dev *list, *iter;
+	struct producer producers[HEADS_MAX];
+	unsigned heads = 0, i;
+
+	fd = drm_open(DEFAULT_DRM_DEVICE);
+	if (fd < 0) {
+		return -1;
+	}
+
+	list = drm_modeset(fd, 1);
+
+	for (iter = list; iter && heads < HEADS_MAX; iter = iter->next) {
+		if (producer_init(&producers[heads], iter))
+			break;
+
+		producer_draw(&producers[heads], fd, false);
+		if (drmModeSetCrtc(fd, iter->crtc, producers[heads].fb.fb, 0, 0, &iter->conn, 1,
+				   &iter->mode))
+			fprintf(stderr, "cannot scan out the dma-buf (%d): %m\n", errno);
+		heads++;
+	}
+
+	printf("Full red screens, drawn in shared memory\n");
+	printf("Press enter to continue...\n");
+	getchar();
+
+	for (i = 0; i < heads; i++)
+		producer_draw(&producers[i], fd, true);
+
+	printf("Half blue and green screens, drawn in shared memory\n");
+	printf("Press enter to continue...\n");
+	getchar();
+
+	/* the CRTCs are restored first, the imported framebuffers are on screen */
+	drm_cleanup(list);
+	for (i = 0; i < heads; i++)
+		producer_fini(&producers[i], fd);
+	drm_close(fd);
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+#include "event_loop.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+struct event_source {
+	int fd;
+	/* a timerfd created and closed by the loop */
+	bool timer;
+	event_loop_fd_func fd_func;
+	event_loop_timer_func timer_func;
+	void *data;
+};
+
+struct event_loop {
+	struct event_source sources[EVENT_LOOP_MAX_SOURCES];
+	unsigned count;
+	bool quit;
+};
+
+struct event_loop *event_loop_create(void)
+{
+	return calloc(1, sizeof(struct event_loop));
+}
+
+void event_loop_destroy(struct event_loop *loop)
+{
+	unsigned i;
+
+	if (!loop)
+		return;
+
+	for (i = 0; i < loop->count; i++) {
+		if (loop->sources[i].timer)
+			close(loop->sources[i].fd);
+	}
+	free(loop);
+}
+
+static struct event_source *_source_add(struct event_loop *loop, int fd)
+{
+	struct event_source *source;
+
+	if (loop->count == EVENT_LOOP_MAX_SOURCES)
+		return NULL;
+
+	source = &loop->sources[loop->count++];
+	source->fd = fd;
+	return source;
+}
+
+int event_loop_fd_add(struct event_loop *loop, int fd, event_loop_fd_func func, void *data)
+{
+	struct event_source *source = _source_add(loop, fd);
+
+	if (!source)
+		return -ENOSPC;
+
+	source->fd_func = func;
+	source->data = data;
+	return 0;
+}
+
+int event_loop_timer_add(struct event_loop *loop, event_loop_timer_func func, void *data)
+{
+	struct event_source *source;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "cannot create timerfd (%d): %m\n", errno);
+		return -errno;
+	}
+
+	source = _source_add(loop, fd);
+	if (!source) {
+		close(fd);
+		return -ENOSPC;
+	}
+
+	source->timer = true;
+	source->timer_func = func;
+	source->data = data;
+	return fd;
+}
+
+static void _timespec_set(struct timespec *ts, uint64_t ns)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+int event_loop_timer_arm(struct event_loop *loop, int timer, uint64_t deadline_ns,
+			 uint64_t interval_ns)
+{
+	struct itimerspec value;
+
+	(void)loop;
+	_timespec_set(&value.it_value, deadline_ns);
+	_timespec_set(&value.it_interval, interval_ns);
+
+	/* an absolute time already past expires right away */
+	return timerfd_settime(timer, TFD_TIMER_ABSTIME, &value, NULL) ? -errno : 0;
+}
+
+static void _timer_read(struct event_source *source)
+{
+	uint64_t expirations;
+
+	/* disarmed or re-armed since poll() saw it, nothing to read */
+	if (read(source->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return;
+
+	source->timer_func(expirations, source->data);
+}
+
+int event_loop_dispatch(struct event_loop *loop, int timeout_ms)
+{
+	struct pollfd pollfds[EVENT_LOOP_MAX_SOURCES];
+	unsigned i, count = loop->count;
+	int ret, dispatched = 0;
+
+	for (i = 0; i < count; i++) {
+		pollfds[i].fd = loop->sources[i].fd;
+		pollfds[i].events = POLLIN;
+		pollfds[i].revents = 0;
+	}
+
+	ret = poll(pollfds, count, timeout_ms);
+	if (ret < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	for (i = 0; i < count; i++) {
+		struct event_source *source = &loop->sources[i];
+
+		if (!pollfds[i].revents)
+			continue;
+		if (pollfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			fprintf(stderr, "event source fd %d failed, revents=%d\n", source->fd,
+				pollfds[i].revents);
+			return -EIO;
+		}
+
+		if (source->timer)
+			_timer_read(source);
+		else
+			source->fd_func(source->fd, source->data);
+		dispatched++;
+	}
+
+	return dispatched;
+}
+
+int event_loop_run(struct event_loop *loop)
+{
+	int ret = 0;
+
+	loop->quit = false;
+	while (!loop->quit && ret >= 0)
+		ret = event_loop_dispatch(loop, -1);
+
+	return ret < 0 ? ret : 0;
+}
+
+void event_loop_quit(struct event_loop *loop)
+{
+	loop->quit = true;
+}
+
+uint64_t event_loop_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
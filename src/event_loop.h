@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * poll() over a few file descriptors, the DRM one for its flip and vblank
+ * events, and timerfd timers, all driven from one thread.
+ *
+ * Timers are armed at absolute CLOCK_MONOTONIC times, the clock of the
+ * DRM event timestamps, so they can be set relative to a vblank. Callbacks
+ * run from event_loop_dispatch() and may arm timers or quit the loop.
+ */
+
+#define EVENT_LOOP_MAX_SOURCES 8
+
+struct event_loop;
+
+/* fd is readable */
+typedef void (*event_loop_fd_func)(int fd, void *data);
+/* The timer expired, more than once if expirations > 1 */
+typedef void (*event_loop_timer_func)(uint64_t expirations, void *data);
+
+struct event_loop *event_loop_create(void);
+/* Closes the timers, the added fds stay the caller's */
+void event_loop_destroy(struct event_loop *loop);
+
+int event_loop_fd_add(struct event_loop *loop, int fd, event_loop_fd_func func, void *data);
+
+/* A new disarmed timer, its id or -errno */
+int event_loop_timer_add(struct event_loop *loop, event_loop_timer_func func, void *data);
+/* First expiry at deadline_ns, then every interval_ns unless 0. deadline_ns 0 disarms. */
+int event_loop_timer_arm(struct event_loop *loop, int timer, uint64_t deadline_ns,
+			 uint64_t interval_ns);
+
+/*
+ * Wait up to timeout_ms, -1 for ever, and run the callbacks of the ready
+ * sources. Returns how many ran or -errno, EINTR is not an error.
+ */
+int event_loop_dispatch(struct event_loop *loop, int timeout_ms);
+
+/* Dispatch until event_loop_quit() */
+int event_loop_run(struct event_loop *loop);
+void event_loop_quit(struct event_loop *loop);
+
+/* CLOCK_MONOTONIC */
+uint64_t event_loop_now_ns(void);
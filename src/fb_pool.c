@@ -0,0 +1,147 @@
+#include "fb_pool.h"
+
+#include <stdlib.h>
+
+struct fb_pool_entry {
+	struct fb_pool_entry *prev, *next;
+	struct modeset_buf buf;
+};
+
+struct fb_pool {
+	size_t budget;
+	const struct scene_buffer_ops *ops;
+	void *data;
+
+	/* most recently put first */
+	struct fb_pool_entry *head, *tail;
+	struct fb_pool_stats stats;
+};
+
+static void _list_unlink(struct fb_pool *pool, struct fb_pool_entry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		pool->head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		pool->tail = entry->prev;
+	pool->stats.bytes -= entry->buf.size;
+	pool->stats.entries--;
+}
+
+static void _list_push_front(struct fb_pool *pool, struct fb_pool_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = pool->head;
+	if (pool->head)
+		pool->head->prev = entry;
+	else
+		pool->tail = entry;
+	pool->head = entry;
+	pool->stats.bytes += entry->buf.size;
+	pool->stats.entries++;
+}
+
+struct fb_pool *fb_pool_create(size_t budget, const struct scene_buffer_ops *ops, void *data)
+{
+	struct fb_pool *pool = calloc(1, sizeof(*pool));
+
+	if (!pool)
+		return NULL;
+
+	pool->budget = budget;
+	pool->ops = ops;
+	pool->data = data;
+	return pool;
+}
+
+void fb_pool_destroy(struct fb_pool *pool)
+{
+	if (!pool)
+		return;
+
+	fb_pool_trim(pool, 0);
+	free(pool);
+}
+
+int fb_pool_get(struct fb_pool *pool, struct modeset_buf *buf, uint32_t width, uint32_t height,
+		uint32_t format, uint64_t modifier)
+{
+	struct fb_pool_entry *entry;
+	int ret;
+
+	for (entry = pool->head; entry; entry = entry->next) {
+		if (entry->buf.width != width || entry->buf.height != height ||
+		    entry->buf.format != format || entry->buf.modifier != modifier)
+			continue;
+
+		_list_unlink(pool, entry);
+		*buf = entry->buf;
+		free(entry);
+		pool->stats.hits++;
+		return 0;
+	}
+
+	pool->stats.misses++;
+	ret = pool->ops->alloc(pool->data, buf, width, height, format, modifier);
+	if (ret && pool->head) {
+		/* the kept buffers may be what the memory is short of */
+		fb_pool_trim(pool, 0);
+		ret = pool->ops->alloc(pool->data, buf, width, height, format, modifier);
+	}
+
+	return ret;
+}
+
+void fb_pool_put(struct fb_pool *pool, struct modeset_buf *buf)
+{
+	struct fb_pool_entry *entry;
+
+	if (buf->size > pool->budget || !(entry = malloc(sizeof(*entry)))) {
+		pool->ops->free(pool->data, buf);
+		return;
+	}
+
+	entry->buf = *buf;
+	entry->buf.age = 0;
+	damage_clear(&entry->buf.damage);
+	damage_clear(&entry->buf.dirty);
+
+	fb_pool_trim(pool, pool->budget - buf->size);
+	_list_push_front(pool, entry);
+}
+
+void fb_pool_trim(struct fb_pool *pool, size_t bytes)
+{
+	while (pool->tail && pool->stats.bytes > bytes) {
+		struct fb_pool_entry *entry = pool->tail;
+
+		_list_unlink(pool, entry);
+		pool->ops->free(pool->data, &entry->buf);
+		free(entry);
+		pool->stats.trims++;
+	}
+}
+
+void fb_pool_stats_get(struct fb_pool *pool, struct fb_pool_stats *stats)
+{
+	*stats = pool->stats;
+}
+
+static int _buffer_alloc(void *data, struct modeset_buf *buf, uint32_t width, uint32_t height,
+			 uint32_t format, uint64_t modifier)
+{
+	return fb_pool_get(data, buf, width, height, format, modifier);
+}
+
+static void _buffer_free(void *data, struct modeset_buf *buf)
+{
+	fb_pool_put(data, buf);
+}
+
+const struct scene_buffer_ops fb_pool_buffer_ops = {
+	.alloc = _buffer_alloc,
+	.free = _buffer_free,
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "scene_cache.h"
+
+/*
+ * Pool of released framebuffers, reused by (width, height, format,
+ * modifier).
+ *
+ * fb_pool_put() keeps a buffer with its framebuffer and mapping instead of
+ * freeing it, fb_pool_get() hands back the most recently kept buffer of
+ * the same key without any allocation or AddFB. A reused buffer keeps the
+ * pixels it had but its age is reset, its content is undefined for the
+ * damage tracking.
+ *
+ * Kept buffers are freed least recently put first when they exceed the
+ * budget, and all of them when an allocation fails. Buffers in use are not
+ * counted.
+ */
+
+struct fb_pool_stats {
+	uint64_t hits;
+	uint64_t misses;
+	/* kept buffers freed for the budget or an allocation failure */
+	uint64_t trims;
+	/* kept buffers */
+	size_t bytes;
+	unsigned entries;
+};
+
+struct fb_pool;
+
+/* Buffers are allocated and freed with ops */
+struct fb_pool *fb_pool_create(size_t budget, const struct scene_buffer_ops *ops, void *data);
+void fb_pool_destroy(struct fb_pool *pool);
+
+int fb_pool_get(struct fb_pool *pool, struct modeset_buf *buf, uint32_t width, uint32_t height,
+		uint32_t format, uint64_t modifier);
+void fb_pool_put(struct fb_pool *pool, struct modeset_buf *buf);
+
+/* Free kept buffers until at most bytes are left */
+void fb_pool_trim(struct fb_pool *pool, size_t bytes);
+
+void fb_pool_stats_get(struct fb_pool *pool, struct fb_pool_stats *stats);
+
+/* Allocation through a pool for scene_cache and swapchain, the ops data is the pool */
+extern const struct scene_buffer_ops fb_pool_buffer_ops;
@@ -0,0 +1,498 @@
+#include "fill.h"
+
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "damage.h"
+#include "format.h"
+#include "tiling.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILL_X86 1
+#endif
+
+struct fill_kernel {
+	const char *name;
+	fill_span_func func;
+	/* same as func but with non-temporal stores, needs a fence after */
+	fill_span_func stream;
+	bool (*supported)(void);
+};
+
+/* below this non-temporal stores only add partial write-combining flushes */
+#define STREAM_MIN_PIXELS 64
+
+#define CACHE_LINE_SIZE 64
+
+static void _fill_span_scalar(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		dst[i] = color;
+}
+
+static bool _supported_always(void)
+{
+	return true;
+}
+
+#ifdef FILL_X86
+/*
+ * All the SIMD kernels do the same: scalar stores until dst is aligned to
+ * the vector size, then aligned vector stores unrolled 4 times, then the
+ * remaining vectors and finally the scalar tail.
+ */
+static void _fill_span_sse2(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	__m128i v = _mm_set1_epi32(color);
+
+	while (len && ((uintptr_t)dst & 15)) {
+		*dst++ = color;
+		len--;
+	}
+
+	for (; len >= 16; len -= 16, dst += 16) {
+		_mm_store_si128((__m128i *)dst, v);
+		_mm_store_si128((__m128i *)(dst + 4), v);
+		_mm_store_si128((__m128i *)(dst + 8), v);
+		_mm_store_si128((__m128i *)(dst + 12), v);
+	}
+
+	for (; len >= 4; len -= 4, dst += 4)
+		_mm_store_si128((__m128i *)dst, v);
+
+	_fill_span_scalar(dst, len, color);
+}
+
+static void _fill_span_sse2_stream(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	__m128i v = _mm_set1_epi32(color);
+
+	while (len && ((uintptr_t)dst & 15)) {
+		*dst++ = color;
+		len--;
+	}
+
+	for (; len >= 16; len -= 16, dst += 16) {
+		_mm_stream_si128((__m128i *)dst, v);
+		_mm_stream_si128((__m128i *)(dst + 4), v);
+		_mm_stream_si128((__m128i *)(dst + 8), v);
+		_mm_stream_si128((__m128i *)(dst + 12), v);
+	}
+
+	for (; len >= 4; len -= 4, dst += 4)
+		_mm_stream_si128((__m128i *)dst, v);
+
+	_fill_span_scalar(dst, len, color);
+}
+
+__attribute__((target("avx2")))
+static void _fill_span_avx2(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	__m256i v = _mm256_set1_epi32(color);
+
+	while (len && ((uintptr_t)dst & 31)) {
+		*dst++ = color;
+		len--;
+	}
+
+	for (; len >= 32; len -= 32, dst += 32) {
+		_mm256_store_si256((__m256i *)dst, v);
+		_mm256_store_si256((__m256i *)(dst + 8), v);
+		_mm256_store_si256((__m256i *)(dst + 16), v);
+		_mm256_store_si256((__m256i *)(dst + 24), v);
+	}
+
+	for (; len >= 8; len -= 8, dst += 8)
+		_mm256_store_si256((__m256i *)dst, v);
+
+	_fill_span_scalar(dst, len, color);
+}
+
+__attribute__((target("avx2")))
+static void _fill_span_avx2_stream(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	__m256i v = _mm256_set1_epi32(color);
+
+	while (len && ((uintptr_t)dst & 31)) {
+		*dst++ = color;
+		len--;
+	}
+
+	for (; len >= 32; len -= 32, dst += 32) {
+		_mm256_stream_si256((__m256i *)dst, v);
+		_mm256_stream_si256((__m256i *)(dst + 8), v);
+		_mm256_stream_si256((__m256i *)(dst + 16), v);
+		_mm256_stream_si256((__m256i *)(dst + 24), v);
+	}
+
+	for (; len >= 8; len -= 8, dst += 8)
+		_mm256_stream_si256((__m256i *)dst, v);
+
+	_fill_span_scalar(dst, len, color);
+}
+
+__attribute__((target("avx512f")))
+static void _fill_span_avx512(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	__m512i v = _mm512_set1_epi32(color);
+
+	while (len && ((uintptr_t)dst & 63)) {
+		*dst++ = color;
+		len--;
+	}
+
+	for (; len >= 64; len -= 64, dst += 64) {
+		_mm512_store_si512((void *)dst, v);
+		_mm512_store_si512((void *)(dst + 16), v);
+		_mm512_store_si512((void *)(dst + 32), v);
+		_mm512_store_si512((void *)(dst + 48), v);
+	}
+
+	for (; len >= 16; len -= 16, dst += 16)
+		_mm512_store_si512((void *)dst, v);
+
+	_fill_span_scalar(dst, len, color);
+}
+
+__attribute__((target("avx512f")))
+static void _fill_span_avx512_stream(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	__m512i v = _mm512_set1_epi32(color);
+
+	while (len && ((uintptr_t)dst & 63)) {
+		*dst++ = color;
+		len--;
+	}
+
+	for (; len >= 64; len -= 64, dst += 64) {
+		_mm512_stream_si512((void *)dst, v);
+		_mm512_stream_si512((void *)(dst + 16), v);
+		_mm512_stream_si512((void *)(dst + 32), v);
+		_mm512_stream_si512((void *)(dst + 48), v);
+	}
+
+	for (; len >= 16; len -= 16, dst += 16)
+		_mm512_stream_si512((void *)dst, v);
+
+	_fill_span_scalar(dst, len, color);
+}
+
+static bool _supported_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+static bool _supported_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static bool _supported_avx512(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+/* Ordered from the slowest to the fastest */
+static const struct fill_kernel kernels[] = {
+	{ "scalar", _fill_span_scalar, _fill_span_scalar, _supported_always },
+#ifdef FILL_X86
+	{ "sse2", _fill_span_sse2, _fill_span_sse2_stream, _supported_sse2 },
+	{ "avx2", _fill_span_avx2, _fill_span_avx2_stream, _supported_avx2 },
+	{ "avx512", _fill_span_avx512, _fill_span_avx512_stream, _supported_avx512 },
+#endif
+};
+
+static const struct fill_kernel *kernel;
+
+static const struct fill_kernel *_kernel_get(void)
+{
+	int i;
+
+	if (kernel)
+		return kernel;
+
+	for (i = (sizeof(kernels) / sizeof(kernels[0])) - 1; i >= 0; i--) {
+		if (kernels[i].supported()) {
+			kernel = &kernels[i];
+			break;
+		}
+	}
+
+	return kernel;
+}
+
+const char *fill_kernel_name(void)
+{
+	return _kernel_get()->name;
+}
+
+int fill_kernel_set(const char *name)
+{
+	unsigned i;
+
+	if (!name) {
+		kernel = NULL;
+		return 0;
+	}
+
+	for (i = 0; i < (sizeof(kernels) / sizeof(kernels[0])); i++) {
+		if (strcmp(kernels[i].name, name))
+			continue;
+		if (!kernels[i].supported())
+			return -1;
+
+		kernel = &kernels[i];
+		return 0;
+	}
+
+	return -1;
+}
+
+void fill_span(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	_kernel_get()->func(dst, len, color);
+}
+
+void fill_span_stream(uint32_t *dst, uint32_t len, uint32_t color)
+{
+	if (len < STREAM_MIN_PIXELS)
+		_kernel_get()->func(dst, len, color);
+	else
+		_kernel_get()->stream(dst, len, color);
+}
+
+void fill_flush(void)
+{
+#ifdef FILL_X86
+	_mm_sfence();
+#endif
+}
+
+fill_span_func fill_span_func_get(struct modeset_buf *buf, uint32_t len)
+{
+	const struct fill_kernel *k = _kernel_get();
+
+	return buf->map_wc && len >= STREAM_MIN_PIXELS ? k->stream : k->func;
+}
+
+uint32_t fill_color_pack(const struct modeset_buf *buf, uint32_t color)
+{
+	uint32_t patterns[FORMAT_MAX_PLANES];
+
+	if (!buf->format || buf->format == DRM_FORMAT_XRGB8888 || buf->format == DRM_FORMAT_ARGB8888)
+		return color;
+
+	format_pack(buf->format, color, patterns);
+	return patterns[0];
+}
+
+static inline uint32_t *_pixel_ptr(struct modeset_buf *buf, uint32_t x, uint32_t y)
+{
+	// 32bpp = 4bytes
+	return (uint32_t *)&buf->map[buf->stride * y + x * 4];
+}
+
+void fill_bytes(fill_span_func func, uint8_t *dst, uint32_t len, uint32_t pattern)
+{
+	uint32_t head = -(uintptr_t)dst & 3;
+
+	if (head > len)
+		head = len;
+	memcpy(dst, &pattern, head);
+	dst += head;
+	len -= head;
+
+	if (len >= 4)
+		func((uint32_t *)dst, len / 4, pattern);
+	memcpy(dst + (len & ~3u), &pattern, len & 3);
+}
+
+/* Planes of formats with other than 4 bytes pixels, chroma samples touched by the rect are written */
+static void _fill_rect_planes(struct modeset_buf *buf, const struct format_info *info,
+			      uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color)
+{
+	uint32_t patterns[FORMAT_MAX_PLANES];
+	unsigned plane;
+
+	format_pack(buf->format, color, patterns);
+
+	for (plane = 0; plane < info->planes; plane++) {
+		uint32_t x0 = x, y0 = y, x1 = x + w, y1 = y + h, cpp = info->cpp[plane];
+		uint32_t pitch = buf->pitches[plane] ? buf->pitches[plane] : buf->stride;
+		fill_span_func func;
+
+		if (plane) {
+			x0 /= info->hsub;
+			y0 /= info->vsub;
+			x1 = (x1 + info->hsub - 1) / info->hsub;
+			y1 = (y1 + info->vsub - 1) / info->vsub;
+		}
+
+		if (buf->map_tiled) {
+			tiling_fill_plane(buf, plane, x0 * cpp, y0, (x1 - x0) * cpp, y1 - y0,
+					  patterns[plane]);
+			continue;
+		}
+
+		func = fill_span_func_get(buf, (x1 - x0) * cpp / 4);
+		for (; y0 < y1; y0++)
+			fill_bytes(func, &buf->map[buf->offsets[plane] + pitch * y0 + x0 * cpp],
+				   (x1 - x0) * cpp, patterns[plane]);
+	}
+
+	if (buf->map_wc)
+		fill_flush();
+}
+
+static bool _clip(struct modeset_buf *buf, uint32_t x, uint32_t y, uint32_t *w, uint32_t *h)
+{
+	if (y >= buf->height || x >= buf->width)
+		return false;
+	if (*w > buf->width - x)
+		*w = buf->width - x;
+	if (*h > buf->height - y)
+		*h = buf->height - y;
+
+	return *w && *h;
+}
+
+static void _fill_rect(struct modeset_buf *buf, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+		       uint32_t color)
+{
+	fill_span_func func;
+	uint32_t y_end;
+
+	if (!format_is_32bpp(buf->format)) {
+		_fill_rect_planes(buf, format_info_get(buf->format), x, y, w, h, color);
+		return;
+	}
+	color = fill_color_pack(buf, color);
+
+	if (buf->map_tiled) {
+		tiling_fill_rect(buf, x, y, w, h, color);
+		return;
+	}
+
+	func = fill_span_func_get(buf, w);
+	for (y_end = y + h; y < y_end; y++)
+		func(_pixel_ptr(buf, x, y), w, color);
+
+	if (buf->map_wc)
+		fill_flush();
+}
+
+void fill_row(struct modeset_buf *buf, uint32_t x, uint32_t y, uint32_t len, uint32_t color)
+{
+	fill_rect(buf, x, y, len, 1, color);
+}
+
+void fill_rect(struct modeset_buf *buf, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color)
+{
+	if (!_clip(buf, x, y, &w, &h))
+		return;
+
+	damage_add_rect(&buf->dirty, x, y, w, h);
+	_fill_rect(buf, x, y, w, h, color);
+}
+
+void fill_rect_rows(struct modeset_buf *buf, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+		    uint32_t color)
+{
+	if (_clip(buf, x, y, &w, &h))
+		_fill_rect(buf, x, y, w, h, color);
+}
+
+void fill_buffer(struct modeset_buf *buf, uint32_t color)
+{
+	fill_rect(buf, 0, 0, buf->width, buf->height, color);
+}
+
+void fill_clear(struct modeset_buf *buf, uint8_t value)
+{
+	uint32_t color = value * 0x01010101u;
+	uint32_t len = buf->size / 4;
+
+	if (buf->map_wc)
+		fill_span_stream((uint32_t *)buf->map, len, color);
+	else
+		fill_span((uint32_t *)buf->map, len, color);
+	memset(buf->map + len * 4, value, buf->size % 4);
+
+	if (buf->map_wc)
+		fill_flush();
+	fill_writeback(buf, NULL);
+}
+
+#ifdef FILL_X86
+static void _writeback_range(uint8_t *start, uint8_t *end)
+{
+	uintptr_t line = (uintptr_t)start & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+
+	for (; line < (uintptr_t)end; line += CACHE_LINE_SIZE)
+		_mm_clflush((void *)line);
+}
+
+static void _writeback_rect(struct modeset_buf *buf, const struct drm_clip_rect *rect)
+{
+	const struct format_info *info = format_info_get(buf->format);
+	uint32_t x2 = rect->x2 < buf->width ? rect->x2 : buf->width;
+	uint32_t y2 = rect->y2 < buf->height ? rect->y2 : buf->height;
+	uint32_t tile_width, tile_height, cpp, y;
+
+	if (rect->x1 >= x2 || rect->y1 >= y2)
+		return;
+
+	/* the other planes don't follow the rows of the first one */
+	if (info && info->planes > 1) {
+		_writeback_range(buf->map, buf->map + buf->size);
+		return;
+	}
+
+	/* a rectangle of a raw tiled map is spread over whole tile rows */
+	if (buf->map_tiled && !tiling_tile_size(buf->modifier, &tile_width, &tile_height)) {
+		uint32_t start = rect->y1 / tile_height * tile_height;
+		uint32_t end = (y2 + tile_height - 1) / tile_height * tile_height;
+
+		_writeback_range(buf->map + (size_t)start * buf->stride,
+				 buf->map + (size_t)end * buf->stride);
+		return;
+	}
+
+	cpp = info ? info->cpp[0] : 4;
+	for (y = rect->y1; y < y2; y++) {
+		uint8_t *row = buf->map + (size_t)y * buf->stride;
+
+		_writeback_range(row + rect->x1 * cpp, row + x2 * cpp);
+	}
+}
+#endif
+
+void fill_writeback(struct modeset_buf *buf, const struct damage *damage)
+{
+#ifdef FILL_X86
+	unsigned i;
+
+	if (!buf->map_cached)
+		return;
+
+	if (!damage)
+		_writeback_range(buf->map, buf->map + buf->size);
+	else
+		for (i = 0; i < damage->count; i++)
+			_writeback_rect(buf, &damage->rects[i]);
+
+	/* clflush is only ordered by fences */
+	_mm_mfence();
+#else
+	(void)buf;
+	(void)damage;
+#endif
+}
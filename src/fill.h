@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Solid color fills for the buffer formats of format.h.
+ *
+ * Colors are packed the same way struct pixel is laid out in memory, so
+ * a single 32 bits store writes blue, green, red and pad/alpha at once.
+ * Other formats get the color converted once per fill and stored as a
+ * 4 bytes pattern with the same kernels.
+ * The span kernel (scalar, SSE2, AVX2 or AVX-512) is picked at runtime
+ * from CPUID the first time something is filled.
+ */
+
+static inline uint32_t fill_color(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha)
+{
+	return (uint32_t)alpha << 24 | (uint32_t)red << 16 | (uint32_t)green << 8 | blue;
+}
+
+/* color as stored in a buffer with 4 bytes pixels, see format_is_32bpp() */
+uint32_t fill_color_pack(const struct modeset_buf *buf, uint32_t color);
+
+typedef void (*fill_span_func)(uint32_t *dst, uint32_t len, uint32_t color);
+
+/* Fill len pixels starting at dst, dst must be 4 bytes aligned */
+void fill_span(uint32_t *dst, uint32_t len, uint32_t color);
+
+/*
+ * Same as fill_span() but with non-temporal (movnt) stores, for
+ * write-combined mappings. Call fill_flush() once done with the fills.
+ */
+void fill_span_stream(uint32_t *dst, uint32_t len, uint32_t color);
+void fill_flush(void);
+
+/*
+ * Span kernel to use for spans of len pixels in buf: streaming for WC
+ * mappings when the span is long enough, regular stores otherwise.
+ */
+fill_span_func fill_span_func_get(struct modeset_buf *buf, uint32_t len);
+
+/*
+ * Fill len bytes at dst with a repeating 4 bytes pattern. dst only has to be
+ * aligned to the period of the pattern, the unaligned head and the tail
+ * are written with plain stores.
+ */
+void fill_bytes(fill_span_func func, uint8_t *dst, uint32_t len, uint32_t pattern);
+
+/*
+ * Fill len pixels of row y starting at column x, clipped to the buffer.
+ * fill_row(), fill_rect() and fill_buffer() add what they wrote to
+ * buf->dirty, don't call them for the same buffer from several threads.
+ */
+void fill_row(struct modeset_buf *buf, uint32_t x, uint32_t y, uint32_t len, uint32_t color);
+void fill_rect(struct modeset_buf *buf, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color);
+void fill_buffer(struct modeset_buf *buf, uint32_t color);
+/* fill_rect() without adding to buf->dirty, for render_pool bands */
+void fill_rect_rows(struct modeset_buf *buf, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+		    uint32_t color);
+/* memset() of the whole buffer, including the stride and tile padding */
+void fill_clear(struct modeset_buf *buf, uint8_t value);
+
+/*
+ * Flush the cache lines of the damage rectangles out to memory, NULL
+ * damage is the whole buffer. Nothing to do unless buf->map_cached, call
+ * it once a frame is drawn and before it is scanned out.
+ */
+void fill_writeback(struct modeset_buf *buf, const struct damage *damage);
+
+/* Name of the kernel in use: "scalar", "sse2", "avx2" or "avx512" */
+const char *fill_kernel_name(void);
+/*
+ * Force a kernel, NULL goes back to the CPUID pick. Returns -1 if the kernel
+ * is unknown or not supported by the CPU.
+ */
+int fill_kernel_set(const char *name);
@@ -0,0 +1,127 @@
+#include "format.h"
+
+#include <errno.h>
+
+#include <drm_fourcc.h>
+
+#include "tiling.h"
+
+#define LINEAR_PITCH_ALIGN 64
+
+static const struct format_info formats[] = {
+	{ DRM_FORMAT_XRGB8888, "XRGB8888", 1, { 4 }, 1, 1 },
+	{ DRM_FORMAT_ARGB8888, "ARGB8888", 1, { 4 }, 1, 1 },
+	{ DRM_FORMAT_XRGB2101010, "XRGB2101010", 1, { 4 }, 1, 1 },
+	{ DRM_FORMAT_RGB565, "RGB565", 1, { 2 }, 1, 1 },
+	{ DRM_FORMAT_ABGR8888, "ABGR8888", 1, { 4 }, 1, 1 },
+	{ DRM_FORMAT_NV12, "NV12", 2, { 1, 2 }, 2, 2 },
+	{ DRM_FORMAT_YUV420, "YUV420", 3, { 1, 1, 1 }, 2, 2 },
+};
+
+static inline uint32_t _align(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+const struct format_info *format_info_get(uint32_t fourcc)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		if (formats[i].fourcc == fourcc)
+			return &formats[i];
+	}
+
+	return NULL;
+}
+
+void format_plane_size(const struct format_info *info, unsigned plane, uint32_t width,
+		       uint32_t height, uint32_t *plane_width, uint32_t *plane_height)
+{
+	if (!plane) {
+		*plane_width = width;
+		*plane_height = height;
+		return;
+	}
+
+	*plane_width = (width + info->hsub - 1) / info->hsub;
+	*plane_height = (height + info->vsub - 1) / info->vsub;
+}
+
+int format_layout(uint32_t fourcc, uint64_t modifier, uint32_t width, uint32_t height,
+		  uint32_t pitches[FORMAT_MAX_PLANES], uint32_t offsets[FORMAT_MAX_PLANES],
+		  uint32_t *size)
+{
+	const struct format_info *info = format_info_get(fourcc);
+	uint32_t tile_width = LINEAR_PITCH_ALIGN, tile_height = 1;
+	uint64_t offset = 0;
+	unsigned i;
+
+	if (!info)
+		return -EINVAL;
+	if (modifier != DRM_FORMAT_MOD_LINEAR && tiling_tile_size(modifier, &tile_width, &tile_height))
+		return -EINVAL;
+
+	for (i = 0; i < FORMAT_MAX_PLANES; i++) {
+		uint32_t plane_width, plane_height;
+
+		pitches[i] = offsets[i] = 0;
+		if (i >= info->planes)
+			continue;
+
+		format_plane_size(info, i, width, height, &plane_width, &plane_height);
+		pitches[i] = _align(plane_width * info->cpp[i], tile_width);
+		offsets[i] = offset;
+		offset += (uint64_t)pitches[i] * _align(plane_height, tile_height);
+	}
+
+	if (offset > UINT32_MAX)
+		return -EINVAL;
+
+	*size = offset;
+	return 0;
+}
+
+static uint32_t _yuv(uint32_t color, int ry, int gy, int by, int offset)
+{
+	int r = color >> 16 & 0xff, g = color >> 8 & 0xff, b = color & 0xff;
+
+	return ((ry * r + gy * g + by * b + 128) >> 8) + offset;
+}
+
+void format_pack(uint32_t fourcc, uint32_t color, uint32_t patterns[FORMAT_MAX_PLANES])
+{
+	uint32_t r = color >> 16 & 0xff, g = color >> 8 & 0xff, b = color & 0xff;
+	uint32_t value;
+
+	patterns[1] = patterns[2] = patterns[3] = 0;
+
+	switch (fourcc) {
+	case DRM_FORMAT_XRGB2101010:
+		/* replicate the top bits so 0xff stays full scale */
+		patterns[0] = (color >> 24 & 0xc0) << 24 | (r << 2 | r >> 6) << 20 |
+			      (g << 2 | g >> 6) << 10 | (b << 2 | b >> 6);
+		break;
+	case DRM_FORMAT_RGB565:
+		value = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+		patterns[0] = value * 0x00010001u;
+		break;
+	case DRM_FORMAT_NV12:
+		/* BT.601 limited range, coefficients scaled by 256 */
+		patterns[0] = _yuv(color, 66, 129, 25, 16) * 0x01010101u;
+		value = _yuv(color, -38, -74, 112, 128) | _yuv(color, 112, -94, -18, 128) << 8;
+		patterns[1] = value * 0x00010001u;
+		break;
+	case DRM_FORMAT_YUV420:
+		patterns[0] = _yuv(color, 66, 129, 25, 16) * 0x01010101u;
+		patterns[1] = _yuv(color, -38, -74, 112, 128) * 0x01010101u;
+		patterns[2] = _yuv(color, 112, -94, -18, 128) * 0x01010101u;
+		break;
+	case DRM_FORMAT_ABGR8888:
+		patterns[0] = (color & 0xff00ff00) | r | b << 16;
+		break;
+	default:
+		patterns[0] = color;
+		break;
+	}
+}
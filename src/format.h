@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Pixel formats the buffers can be created with.
+ *
+ * Colors are always given packed as XRGB8888, like fill_color() does, and
+ * converted to the buffer format when written. NV12 has a full resolution
+ * Y plane followed by a half resolution interleaved CbCr plane, colors go
+ * through BT.601 limited range. YUV420 (I420) has the Cb and Cr planes
+ * separate, both at half resolution.
+ */
+
+#define FORMAT_MAX_PLANES 4
+
+struct format_info {
+	uint32_t fourcc;
+	const char *name;
+	unsigned planes;
+	/* bytes per sample of each plane */
+	uint8_t cpp[FORMAT_MAX_PLANES];
+	/* subsampling of the planes after the first one */
+	uint8_t hsub, vsub;
+};
+
+/* NULL if the format is not supported */
+const struct format_info *format_info_get(uint32_t fourcc);
+
+/*
+ * Formats with one plane of 4 bytes pixels, the fast path of every writer.
+ * Unknown formats, like 0 for buffers set up by hand, count as XRGB8888.
+ */
+static inline bool format_is_32bpp(uint32_t fourcc)
+{
+	const struct format_info *info = format_info_get(fourcc);
+
+	return !info || (info->planes == 1 && info->cpp[0] == 4);
+}
+
+/*
+ * Pitch, offset and total size of each plane of a width x height buffer.
+ * Linear pitches are 64 bytes aligned, tiled ones a whole number of tiles
+ * and the planes start on a tile row. Returns -EINVAL for an unsupported
+ * format or modifier.
+ */
+int format_layout(uint32_t fourcc, uint64_t modifier, uint32_t width, uint32_t height,
+		  uint32_t pitches[FORMAT_MAX_PLANES], uint32_t offsets[FORMAT_MAX_PLANES],
+		  uint32_t *size);
+
+/* Size in samples of plane of a width x height buffer */
+void format_plane_size(const struct format_info *info, unsigned plane, uint32_t width,
+		       uint32_t height, uint32_t *plane_width, uint32_t *plane_height);
+
+/*
+ * XRGB8888 color converted to the value of one sample of each plane,
+ * replicated over 4 bytes so it can be stored with the 32 bits fill
+ * kernels.
+ */
+void format_pack(uint32_t fourcc, uint32_t color, uint32_t patterns[FORMAT_MAX_PLANES]);
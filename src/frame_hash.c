@@ -0,0 +1,315 @@
+#include "frame_hash.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "format.h"
+#include "tiling.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC_X86 1
+#endif
+
+/* reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82f63b78
+
+/* bytes per stream in the 3 streams loops, powers of 2 for the zeros operators */
+#define CRC_LONG 2048
+#define CRC_SHORT 256
+
+struct crc32c_kernel {
+	const char *name;
+	uint32_t (*func)(uint32_t crc, const uint8_t *data, size_t len);
+	bool (*supported)(void);
+};
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+static uint32_t byte_table[256];
+/* crc of the same bytes followed by CRC_LONG or CRC_SHORT zeros */
+static uint32_t long_table[4][256];
+static uint32_t short_table[4][256];
+
+static uint32_t _gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+
+	for (; vec; vec >>= 1, mat++) {
+		if (vec & 1)
+			sum ^= *mat;
+	}
+
+	return sum;
+}
+
+static void _gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+	unsigned n;
+
+	for (n = 0; n < 32; n++)
+		square[n] = _gf2_matrix_times(mat, mat[n]);
+}
+
+/* Operator appending len zero bytes, len a power of 2 */
+static void _zeros_op(uint32_t *even, size_t len)
+{
+	uint32_t odd[32], row = 1;
+	unsigned n;
+
+	/* one zero bit */
+	odd[0] = CRC32C_POLY;
+	for (n = 1; n < 32; n++, row <<= 1)
+		odd[n] = row;
+
+	/* two, then four zero bits */
+	_gf2_matrix_square(even, odd);
+	_gf2_matrix_square(odd, even);
+
+	/* the first square gives one zero byte, each next one doubles it */
+	do {
+		_gf2_matrix_square(even, odd);
+		len >>= 1;
+		if (!len)
+			return;
+		_gf2_matrix_square(odd, even);
+		len >>= 1;
+	} while (len);
+
+	memcpy(even, odd, sizeof(odd));
+}
+
+static void _zeros_table(uint32_t table[4][256], size_t len)
+{
+	uint32_t op[32];
+	unsigned n;
+
+	_zeros_op(op, len);
+	for (n = 0; n < 256; n++) {
+		table[0][n] = _gf2_matrix_times(op, n);
+		table[1][n] = _gf2_matrix_times(op, n << 8);
+		table[2][n] = _gf2_matrix_times(op, n << 16);
+		table[3][n] = _gf2_matrix_times(op, n << 24);
+	}
+}
+
+static void _tables_init(void)
+{
+	unsigned n, k;
+
+	for (n = 0; n < 256; n++) {
+		uint32_t crc = n;
+
+		for (k = 0; k < 8; k++)
+			crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		byte_table[n] = crc;
+	}
+
+	_zeros_table(long_table, CRC_LONG);
+	_zeros_table(short_table, CRC_SHORT);
+}
+
+static inline uint32_t _shift(uint32_t table[4][256], uint32_t crc)
+{
+	return table[0][crc & 0xff] ^ table[1][crc >> 8 & 0xff] ^ table[2][crc >> 16 & 0xff] ^
+	       table[3][crc >> 24];
+}
+
+static uint32_t _crc32c_table(uint32_t crc, const uint8_t *data, size_t len)
+{
+	crc = ~crc;
+	while (len--)
+		crc = byte_table[(crc ^ *data++) & 0xff] ^ crc >> 8;
+
+	return ~crc;
+}
+
+static bool _supported_always(void)
+{
+	return true;
+}
+
+#ifdef CRC_X86
+/*
+ * The crc32 instruction has a latency of 3 cycles and a throughput of 1,
+ * so three independent streams over consecutive blocks keep it busy. The
+ * three CRCs are then combined by appending the zeros of the next blocks
+ * to the first ones.
+ */
+#define CRC_STREAMS(size, table)								\
+	while (len >= (size) * 3) {								\
+		const uint8_t *end = data + (size);						\
+		uint64_t crc1 = 0, crc2 = 0;							\
+												\
+		do {										\
+			uint64_t v0, v1, v2;							\
+												\
+			memcpy(&v0, data, 8);							\
+			memcpy(&v1, data + (size), 8);						\
+			memcpy(&v2, data + 2 * (size), 8);					\
+			crc0 = _mm_crc32_u64(crc0, v0);						\
+			crc1 = _mm_crc32_u64(crc1, v1);						\
+			crc2 = _mm_crc32_u64(crc2, v2);						\
+			data += 8;								\
+		} while (data < end);								\
+												\
+		crc0 = _shift(table, crc0) ^ crc1;						\
+		crc0 = _shift(table, crc0) ^ crc2;						\
+		data += 2 * (size);								\
+		len -= 3 * (size);								\
+	}
+
+__attribute__((target("sse4.2")))
+static uint32_t _crc32c_sse42(uint32_t crc, const uint8_t *data, size_t len)
+{
+	uint64_t crc0 = ~crc;
+
+	while (len && ((uintptr_t)data & 7)) {
+		crc0 = _mm_crc32_u8(crc0, *data++);
+		len--;
+	}
+
+	CRC_STREAMS(CRC_LONG, long_table)
+	CRC_STREAMS(CRC_SHORT, short_table)
+
+	for (; len >= 8; len -= 8, data += 8) {
+		uint64_t v;
+
+		memcpy(&v, data, 8);
+		crc0 = _mm_crc32_u64(crc0, v);
+	}
+
+	while (len--)
+		crc0 = _mm_crc32_u8(crc0, *data++);
+
+	return ~(uint32_t)crc0;
+}
+
+static bool _supported_sse42(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+/* Ordered from the slowest to the fastest */
+static const struct crc32c_kernel kernels[] = {
+	{ "table", _crc32c_table, _supported_always },
+#ifdef CRC_X86
+	{ "sse4.2", _crc32c_sse42, _supported_sse42 },
+#endif
+};
+
+static const struct crc32c_kernel *kernel;
+
+static const struct crc32c_kernel *_kernel_get(void)
+{
+	int i;
+
+	pthread_once(&tables_once, _tables_init);
+	if (kernel)
+		return kernel;
+
+	for (i = (sizeof(kernels) / sizeof(kernels[0])) - 1; i >= 0; i--) {
+		if (kernels[i].supported()) {
+			kernel = &kernels[i];
+			break;
+		}
+	}
+
+	return kernel;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+	return _kernel_get()->func(crc, data, len);
+}
+
+const char *crc32c_kernel_name(void)
+{
+	return _kernel_get()->name;
+}
+
+int crc32c_kernel_set(const char *name)
+{
+	unsigned i;
+
+	if (!name) {
+		kernel = NULL;
+		return 0;
+	}
+
+	for (i = 0; i < (sizeof(kernels) / sizeof(kernels[0])); i++) {
+		if (strcmp(kernels[i].name, name))
+			continue;
+		if (!kernels[i].supported())
+			return -1;
+
+		kernel = &kernels[i];
+		return 0;
+	}
+
+	return -1;
+}
+
+int frame_hash(const struct modeset_buf *buf, uint32_t *hash)
+{
+	const struct format_info *info = format_info_get(buf->format ? buf->format :
+							 DRM_FORMAT_XRGB8888);
+	uint32_t crc = 0, tile_width, tile_height;
+	uint8_t *strip = NULL;
+	unsigned plane;
+
+	if (!info)
+		return -EINVAL;
+	if (buf->map_tiled && tiling_tile_size(buf->modifier, &tile_width, &tile_height))
+		return -EINVAL;
+
+	if (buf->map_tiled) {
+		size_t strip_row = 0;
+
+		/* a chroma row may be wider than the luma one, odd widths round it up */
+		for (plane = 0; plane < info->planes; plane++) {
+			uint32_t width, height;
+
+			format_plane_size(info, plane, buf->width, buf->height, &width, &height);
+			if ((size_t)width * info->cpp[plane] > strip_row)
+				strip_row = (size_t)width * info->cpp[plane];
+		}
+
+		strip = malloc(strip_row * tile_height);
+		if (!strip)
+			return -ENOMEM;
+	}
+
+	for (plane = 0; plane < info->planes; plane++) {
+		uint32_t pitch = buf->pitches[plane] ? buf->pitches[plane] : buf->stride;
+		const uint8_t *map = buf->map + buf->offsets[plane];
+		uint32_t width, height, row, y;
+
+		format_plane_size(info, plane, buf->width, buf->height, &width, &height);
+		row = width * info->cpp[plane];
+
+		if (!buf->map_tiled) {
+			for (y = 0; y < height; y++)
+				crc = crc32c(crc, map + (size_t)pitch * y, row);
+			continue;
+		}
+
+		for (y = 0; y < height; y += tile_height) {
+			uint32_t rows = height - y < tile_height ? height - y : tile_height;
+
+			tiling_tiled_to_linear(buf->modifier, strip, row, map + (size_t)pitch * y,
+					       pitch, row, rows);
+			crc = crc32c(crc, strip, (size_t)row * rows);
+		}
+	}
+
+	free(strip);
+	*hash = crc;
+	return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * CRC32C (Castagnoli) checksums of frames, to verify rendering without a
+ * display.
+ *
+ * The hash of a buffer only covers its visible pixels: the width * cpp
+ * bytes of every row of every plane, in plane and row order. Pitch and
+ * tile padding are skipped and raw tiled maps are detiled one row of
+ * tiles at a time, so a frame hashes the same in any layout and equals
+ * crc32c() of the frame dumped as tightly packed planes.
+ *
+ * The SSE4.2 crc32 instruction is used when the CPU has it, with three
+ * independent streams over consecutive blocks of a row combined with
+ * zeros operator tables, a table driven version otherwise.
+ */
+
+/* Continue crc over len bytes, start with 0 */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/* Returns -EINVAL for an unsupported format or modifier, -ENOMEM */
+int frame_hash(const struct modeset_buf *buf, uint32_t *hash);
+
+/* Implementation in use: "table" or "sse4.2" */
+const char *crc32c_kernel_name(void);
+/*
+ * Force an implementation, NULL goes back to the CPUID pick. Returns -1 if
+ * it is unknown or not supported by the CPU.
+ */
+int crc32c_kernel_set(const char *name);
@@ -0,0 +1,174 @@
+#include "frame_sched.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NSEC_PER_MSEC 1000000ULL
+
+/* weights of the EWMAs, as 1 / 2^shift */
+#define COST_SHIFT 3
+#define COST_DEV_SHIFT 2
+#define PERIOD_SHIFT 4
+/* deviations in the render cost the prediction covers */
+#define COST_DEVS 4
+
+struct frame_sched {
+	uint64_t period_ns;
+	uint64_t margin_ns;
+
+	/* last vblank seen, valid once synced */
+	bool synced;
+	uint64_t vblank_ns;
+	unsigned sequence;
+
+	/* EWMAs of the render cost and of its deviation */
+	uint64_t costs;
+	uint64_t cost_ns;
+	uint64_t cost_dev_ns;
+
+	/* frame in flight: when it started and the vblank it aims at */
+	uint64_t start_ns;
+	uint64_t target_ns;
+
+	struct frame_sched_stats stats;
+};
+
+uint64_t frame_sched_mode_period(const drmModeModeInfo *mode)
+{
+	uint64_t period;
+
+	if (!mode->clock || !mode->htotal || !mode->vtotal)
+		return 0;
+
+	/* clock is in kHz */
+	period = (uint64_t)mode->htotal * mode->vtotal * 1000000 / mode->clock;
+	if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+		period /= 2;
+	if (mode->flags & DRM_MODE_FLAG_DBLSCAN)
+		period *= 2;
+	if (mode->vscan > 1)
+		period *= mode->vscan;
+
+	return period;
+}
+
+struct frame_sched *frame_sched_create(uint64_t period_ns, uint64_t margin_ns)
+{
+	struct frame_sched *sched;
+
+	if (!period_ns)
+		return NULL;
+
+	sched = calloc(1, sizeof(*sched));
+	if (!sched)
+		return NULL;
+
+	sched->period_ns = period_ns;
+	sched->margin_ns = margin_ns;
+	return sched;
+}
+
+void frame_sched_destroy(struct frame_sched *sched)
+{
+	free(sched);
+}
+
+void frame_sched_vblank(struct frame_sched *sched, uint64_t time_ns, unsigned sequence)
+{
+	if (sched->synced && sequence != sched->sequence && time_ns > sched->vblank_ns) {
+		unsigned vblanks = sequence - sched->sequence;
+		int64_t err = (int64_t)((time_ns - sched->vblank_ns) / vblanks) - (int64_t)sched->period_ns;
+
+		/* the mode period is close already, a larger error is a glitch of the events */
+		if (llabs(err) < (int64_t)sched->period_ns / 8)
+			sched->period_ns += err / (1 << PERIOD_SHIFT);
+	}
+
+	sched->synced = true;
+	sched->vblank_ns = time_ns;
+	sched->sequence = sequence;
+}
+
+uint64_t frame_sched_next_vblank(const struct frame_sched *sched, uint64_t now_ns)
+{
+	if (!sched->synced)
+		return now_ns;
+	if (now_ns < sched->vblank_ns)
+		return sched->vblank_ns;
+
+	return sched->vblank_ns + ((now_ns - sched->vblank_ns) / sched->period_ns + 1) * sched->period_ns;
+}
+
+uint64_t frame_sched_start(struct frame_sched *sched, uint64_t now_ns)
+{
+	uint64_t budget = sched->cost_ns + COST_DEVS * sched->cost_dev_ns + sched->margin_ns;
+	uint64_t target = frame_sched_next_vblank(sched, now_ns);
+	uint64_t start;
+
+	sched->target_ns = 0;
+
+	/* nothing to predict from yet, as soon as possible */
+	if (!sched->synced || !sched->costs)
+		return now_ns;
+
+	/* too late for the next vblank, the one after is as early as it gets */
+	while (target < now_ns + budget)
+		target += sched->period_ns;
+
+	start = target - budget;
+	sched->target_ns = target;
+	sched->stats.saved_ns += start - now_ns;
+	return start;
+}
+
+void frame_sched_rendered(struct frame_sched *sched, uint64_t start_ns, uint64_t end_ns)
+{
+	uint64_t cost = end_ns > start_ns ? end_ns - start_ns : 0;
+	int64_t err = (int64_t)cost - (int64_t)sched->cost_ns;
+
+	sched->start_ns = start_ns;
+
+	if (!sched->costs++) {
+		sched->cost_ns = cost;
+		sched->cost_dev_ns = cost / 2;
+		return;
+	}
+
+	sched->cost_ns += err / (1 << COST_SHIFT);
+	sched->cost_dev_ns += ((int64_t)llabs(err) - (int64_t)sched->cost_dev_ns) / (1 << COST_DEV_SHIFT);
+}
+
+void frame_sched_flip_done(struct frame_sched *sched, uint64_t time_ns, unsigned sequence)
+{
+	frame_sched_vblank(sched, time_ns, sequence);
+
+	sched->stats.frames++;
+	if (time_ns > sched->start_ns)
+		sched->stats.latency_ns += time_ns - sched->start_ns;
+	if (sched->target_ns && time_ns > sched->target_ns + sched->period_ns / 2)
+		sched->stats.misses++;
+}
+
+void frame_sched_stats_get(const struct frame_sched *sched, struct frame_sched_stats *stats)
+{
+	*stats = sched->stats;
+	stats->period_ns = sched->period_ns;
+	stats->cost_ns = sched->cost_ns + COST_DEVS * sched->cost_dev_ns;
+}
+
+void frame_sched_print_stats(const struct frame_sched *sched)
+{
+	struct frame_sched_stats stats;
+	uint64_t frames;
+
+	frame_sched_stats_get(sched, &stats);
+	frames = stats.frames ? stats.frames : 1;
+	printf("frames %" PRIu64 ": period %.3f ms, predicted cost %.2f ms, latency %.2f ms, "
+	       "saved %.2f ms per frame, %" PRIu64 " deadline misses\n",
+	       stats.frames, (double)stats.period_ns / NSEC_PER_MSEC,
+	       (double)stats.cost_ns / NSEC_PER_MSEC,
+	       (double)stats.latency_ns / frames / NSEC_PER_MSEC,
+	       (double)stats.saved_ns / frames / NSEC_PER_MSEC, stats.misses);
+}
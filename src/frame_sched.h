@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <xf86drmMode.h>
+
+/*
+ * Just in time frame scheduling: start rendering as late as the frame can
+ * still make the next vblank, instead of right after the previous flip,
+ * so what it shows is up to a frame more recent.
+ *
+ * The vblanks are predicted from the last flip or vblank event and the
+ * refresh period, computed from the mode timings and then refined by the
+ * event timestamps. The render cost is predicted as an EWMA of the
+ * measured costs plus four times the EWMA of their deviation, so a jittery
+ * renderer starts earlier than a steady one. margin_ns covers the commit
+ * reaching the kernel before the vblank.
+ *
+ * Only timestamps go in, all on the CLOCK_MONOTONIC of the DRM events, so
+ * the scheduler runs as well against a simulated vblank clock.
+ */
+
+struct frame_sched;
+
+struct frame_sched_stats {
+	uint64_t frames;
+	/* frames on screen later than the vblank they were started for */
+	uint64_t misses;
+	/* start delays, what rendering right after the previous flip would have added */
+	uint64_t saved_ns;
+	/* from the start of rendering to the frame on screen */
+	uint64_t latency_ns;
+	/* current predictions */
+	uint64_t period_ns;
+	uint64_t cost_ns;
+};
+
+/* Refresh period of mode, 0 if its timings are not set */
+uint64_t frame_sched_mode_period(const drmModeModeInfo *mode);
+
+struct frame_sched *frame_sched_create(uint64_t period_ns, uint64_t margin_ns);
+void frame_sched_destroy(struct frame_sched *sched);
+
+/* A vblank happened at time_ns, sequence is its count on the CRTC */
+void frame_sched_vblank(struct frame_sched *sched, uint64_t time_ns, unsigned sequence);
+
+/* First vblank after now_ns, now_ns itself before any vblank was seen */
+uint64_t frame_sched_next_vblank(const struct frame_sched *sched, uint64_t now_ns);
+
+/*
+ * When to start rendering the next frame, never before now_ns. The frame
+ * aims at the first vblank it can still make with the predicted cost.
+ */
+uint64_t frame_sched_start(struct frame_sched *sched, uint64_t now_ns);
+
+/* The frame started at frame_sched_start() time is rendered and flipped */
+void frame_sched_rendered(struct frame_sched *sched, uint64_t start_ns, uint64_t end_ns);
+
+/* Its flip landed, a vblank event with the accounting of the frame */
+void frame_sched_flip_done(struct frame_sched *sched, uint64_t time_ns, unsigned sequence);
+
+void frame_sched_stats_get(const struct frame_sched *sched, struct frame_sched_stats *stats);
+void frame_sched_print_stats(const struct frame_sched *sched);
@@ -2,6 +2,8 @@
 #include <stdio.h>
 
 #include "common.h"
+#include "fill.h"
+#include "swapchain.h"
 
 int main()
 {
@@ -13,28 +15,15 @@ int main()
 		return -1;
 	}
 
-	list = drm_modeset(fd);
+	list = drm_modeset(fd, 1);
 
 	// draw red in all screens
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-		uint32_t y;
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
 
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
+		fill_buffer(buf, fill_color(255, 0, 0, 0));
 
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->green = 0;
-				p->blue = 0;
-			}
-		}
-
-		drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		damage_flush(iter->drm_fd, buf);
 	}
 
 	printf("Full red screens\n");
@@ -43,24 +32,13 @@ int main()
 
 	// half screen blue half screen green
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
+		uint32_t half = buf->width / 2;
 
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 0;
-				p->green = x >= (buf->width / 2) ? 255 : 0;
-				p->blue = x < (buf->width / 2) ? 255 : 0;
-			}
-		}
+		fill_rect(buf, 0, 0, half, buf->height, fill_color(0, 0, 255, 0));
+		fill_rect(buf, half, 0, buf->width - half, buf->height, fill_color(0, 255, 0, 0));
 
-		drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		damage_flush(iter->drm_fd, buf);
 	}
 
 	printf("Half blue and green screens\n");
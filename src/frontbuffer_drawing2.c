@@ -2,6 +2,9 @@
 #include <stdio.h>
 
 #include "common.h"
+#include "fill.h"
+#include "raster.h"
+#include "swapchain.h"
 
 #define BOX_SIZE 50
 
@@ -15,28 +18,15 @@ int main()
 		return -1;
 	}
 
-	list = drm_modeset(fd);
+	list = drm_modeset(fd, 1);
 
 	// draw red in all screens
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->green = 0;
-				p->blue = 0;
-			}
-		}
-
-		drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
+
+		fill_buffer(buf, fill_color(255, 0, 0, 0));
+
+		damage_flush(iter->drm_fd, buf);
 	}
 
 	printf("Full red screens\n");
@@ -44,35 +34,23 @@ int main()
 	getchar();
 
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-		uint32_t y, box_y_start, box_y_end, box_x_start, box_x_end;
-
-		box_y_start = (buf->height - BOX_SIZE) / 2;
-		box_y_end = box_y_start + BOX_SIZE;
-		box_x_start = (buf->width - BOX_SIZE) / 2;
-		box_x_end = box_x_start + BOX_SIZE;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->green = 0;
-
-
-				if (y > box_y_start && y < box_y_end && x > box_x_start
-					&& x < box_x_end)
-					p->blue = 255;
-				else
-					p->blue = 0;
-			}
-		}
-
-		drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
+		struct raster_rect box = {
+			/* box borders are exclusive */
+			.x = (buf->width - BOX_SIZE) / 2 + 1,
+			.y = (buf->height - BOX_SIZE) / 2 + 1,
+			.w = BOX_SIZE - 1,
+			.h = BOX_SIZE - 1,
+			.color = fill_color(255, 0, 255, 0),
+		};
+		struct damage damage;
+
+		/* only the box changes over the red screen */
+		damage_clear(&damage);
+		damage_add_rect(&damage, box.x, box.y, box.w, box.h);
+		raster_draw_damage(buf, fill_color(255, 0, 0, 0), &box, 1, &damage);
+
+		damage_flush(iter->drm_fd, buf);
 	}
 
 	printf("Pink box in the middle of screen\n");
@@ -80,35 +58,23 @@ int main()
 	getchar();
 
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-		uint32_t y, box_y_start, box_y_end, box_x_start, box_x_end;
-
-		box_y_start = (buf->height - BOX_SIZE) / 2;
-		box_y_end = box_y_start + BOX_SIZE;
-		box_x_start = (buf->width - BOX_SIZE) / 2;
-		box_x_end = box_x_start + BOX_SIZE;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->blue = 0;
-
-
-				if (y > box_y_start && y < box_y_end && x > box_x_start
-					&& x < box_x_end)
-					p->green = 255;
-				else
-					p->green = 0;
-			}
-		}
-
-		drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
+		struct raster_rect box = {
+			/* box borders are exclusive */
+			.x = (buf->width - BOX_SIZE) / 2 + 1,
+			.y = (buf->height - BOX_SIZE) / 2 + 1,
+			.w = BOX_SIZE - 1,
+			.h = BOX_SIZE - 1,
+			.color = fill_color(255, 255, 0, 0),
+		};
+		struct damage damage;
+
+		/* only the box changes over the red screen */
+		damage_clear(&damage);
+		damage_add_rect(&damage, box.x, box.y, box.w, box.h);
+		raster_draw_damage(buf, fill_color(255, 0, 0, 0), &box, 1, &damage);
+
+		damage_flush(iter->drm_fd, buf);
 	}
 
 	printf("Yellow box in the middle of screen\n");
@@ -116,37 +82,24 @@ int main()
 	getchar();
 
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-		uint32_t y, box_y_start, box_y_end, box_x_start, box_x_end;
-
-		box_y_start = (buf->height - BOX_SIZE) / 2;
-		box_y_start += BOX_SIZE;
-		box_y_end = box_y_start + BOX_SIZE;
-		box_x_start = (buf->width - BOX_SIZE) / 2;
-		box_x_start += BOX_SIZE;
-		box_x_end = box_x_start + BOX_SIZE;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->blue = 0;
-
-
-				if (y > box_y_start && y < box_y_end && x > box_x_start
-					&& x < box_x_end)
-					p->green = 255;
-				else
-					p->green = 0;
-			}
-		}
-
-		drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
+		struct raster_rect box = {
+			/* box borders are exclusive */
+			.x = (buf->width - BOX_SIZE) / 2 + BOX_SIZE + 1,
+			.y = (buf->height - BOX_SIZE) / 2 + BOX_SIZE + 1,
+			.w = BOX_SIZE - 1,
+			.h = BOX_SIZE - 1,
+			.color = fill_color(255, 255, 0, 0),
+		};
+		struct damage damage;
+
+		/* the box moves from the middle to the middle+BOX_SIZE */
+		damage_clear(&damage);
+		damage_add_rect(&damage, box.x - BOX_SIZE, box.y - BOX_SIZE, box.w, box.h);
+		damage_add_rect(&damage, box.x, box.y, box.w, box.h);
+		raster_draw_damage(buf, fill_color(255, 0, 0, 0), &box, 1, &damage);
+
+		damage_flush(iter->drm_fd, buf);
 	}
 
 	printf("Yellow box in the middle+%dpx of screen\n", BOX_SIZE);
@@ -5,66 +5,82 @@
 #include <unistd.h>
 
 #include "common.h"
+#include "fill.h"
+#include "raster.h"
+#include "render_pool.h"
+#include "swapchain.h"
 
 #define BOX_SIZE 100
 #define INCREMENT (BOX_SIZE / 3)
 
 #define NSEC_PER_SEC 1000000000ULL
 
-static void move_box(struct modeset_dev *list)
+struct frame {
+	struct raster_rect box;
+	/* what the buffer misses of the scene */
+	struct damage repaint;
+};
+
+static void draw_band(struct modeset_buf *buf, uint32_t y_start, uint32_t y_end, void *data)
+{
+	const struct frame *frame = data;
+
+	raster_draw_damage_rows(buf, fill_color(0, 0, 255, 0), &frame->box, 1,
+				&frame->repaint, y_start, y_end);
+}
+
+static void move_box(struct modeset_dev *list, struct render_pool *pool)
 {
 	struct modeset_dev *iter;
 	static uint32_t box_x_begin = 0;
 	static uint32_t box_y_begin = 0;
-	uint32_t y, box_y_start, box_y_end, box_x_start, box_x_end;
+	struct frame frame = {
+		.box = {
+			.w = BOX_SIZE,
+			.h = BOX_SIZE,
+			.color = fill_color(0, 0, 0, 0),
+		},
+	};
+	struct damage damage;
 
 	printf("move box\n");
 
-	if (box_x_begin + BOX_SIZE > list->buffers->width) {
+	/* old and new position of the box */
+	damage_clear(&damage);
+	damage_add_rect(&damage, box_x_begin, box_y_begin, BOX_SIZE, BOX_SIZE);
+
+	if (box_x_begin + BOX_SIZE > list->mode.hdisplay) {
 		box_x_begin = 0;
 		box_y_begin += INCREMENT;
 
-		if (box_y_begin + BOX_SIZE > list->buffers->height) {
+		if (box_y_begin + BOX_SIZE > list->mode.vdisplay) {
 			box_y_begin = 0;
 		}
 	} else {
 		box_x_begin += INCREMENT;
 	}
 
-	box_y_start = box_y_begin;
-	box_y_end = box_y_start + BOX_SIZE;
-	box_x_start = box_x_begin;
-	box_x_end = box_x_start + BOX_SIZE;
+	frame.box.x = box_x_begin;
+	frame.box.y = box_y_begin;
+	damage_add_rect(&damage, box_x_begin, box_y_begin, BOX_SIZE, BOX_SIZE);
 
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 0;
-				p->green = 0;
-
-				if (y >= box_y_start && y < box_y_end && x >= box_x_start
-					&& x < box_x_end)
-					p->blue = 0;
-				else
-					p->blue = 255;
-			}
-		}
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
+
+		damage_buffer_repaint(buf, &damage, &frame.repaint);
+		render_pool_frame(pool, buf, draw_band, &frame);
+		/* the bands don't record what they draw */
+		damage_add(&buf->dirty, &frame.repaint);
 
-		drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		damage_flush(iter->drm_fd, buf);
+		damage_buffers_swap(buf, 1, buf, &damage);
 	}
 }
 
 int main()
 {
 	int fd, timerfd, r;
+	struct render_pool *pool;
 	struct modeset_dev *list, *iter;
 	struct itimerspec new_value;
 	struct pollfd pollfds[1];
@@ -74,28 +90,24 @@ int main()
 		return -1;
 	}
 
-	list = drm_modeset(fd);
+	list = drm_modeset(fd, 1);
+	pool = render_pool_create(0);
+	if (!pool) {
+		fprintf(stderr, "cannot create render pool\n");
+		drm_cleanup(list);
+		drm_close(fd);
+		return -1;
+	}
 
 	// draw blue in all screens
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = iter->buffers;
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 0;
-				p->green = 0;
-				p->blue = 255;
-			}
-		}
+		struct modeset_buf *buf = swapchain_front(iter->swapchain);
+
+		fill_buffer(buf, fill_color(0, 0, 255, 0));
+		/* the blue background is the scene before the box shows up */
+		buf->age = 1;
 
-		drmModeDirtyFB(iter->drm_fd, iter->buffers->fb, NULL, 0);
+		damage_flush(iter->drm_fd, buf);
 	}
 
 	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
@@ -124,7 +136,7 @@ int main()
 			if (r != sizeof(uint64_t))
 				printf("read a not expected number of bytes: %i\n", r);
 			if (exp)
-				move_box(list);
+				move_box(list, pool);
 			if (exp > 1)
 				printf("events missed: %lu\n", exp - 1);
 		} else {
@@ -132,6 +144,7 @@ int main()
 		}
 	}
 
+	render_pool_destroy(pool);
 	drm_cleanup(list);
 	drm_close(fd);
 
@@ -31,6 +31,11 @@ int gem_buffer_destroy(int drm_fd, uint32_t handle)
 }
 
 void *gem_buffer_mmap(int drm_fd, uint32_t handle, uint64_t size)
+{
+    return gem_buffer_mmap_type(drm_fd, handle, size, GEM_MMAP_GTT);
+}
+
+static void *_mmap_gtt(int drm_fd, uint32_t handle, uint64_t size)
 {
     struct drm_i915_gem_mmap_gtt mm = {
         .handle = handle,
@@ -49,6 +54,62 @@ void *gem_buffer_mmap(int drm_fd, uint32_t handle, uint64_t size)
     return ptr;
 }
 
+/* Kernels since 5.8, the only way on platforms without an aperture */
+static void *_mmap_offset(int drm_fd, uint32_t handle, uint64_t size, enum gem_mmap_type type)
+{
+#ifdef DRM_IOCTL_I915_GEM_MMAP_OFFSET
+    struct drm_i915_gem_mmap_offset mm = {
+        .handle = handle,
+        .flags = type == GEM_MMAP_WC ? I915_MMAP_OFFSET_WC : I915_MMAP_OFFSET_WB,
+    };
+    void *ptr;
+
+    if (drmIoctl(drm_fd, DRM_IOCTL_I915_GEM_MMAP_OFFSET, &mm))
+        return NULL;
+
+    ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, drm_fd, mm.offset);
+    if (ptr == (void *)-1)
+        return NULL;
+
+    return ptr;
+#else
+    (void)drm_fd;
+    (void)handle;
+    (void)size;
+    (void)type;
+    return NULL;
+#endif
+}
+
+/* Older kernels, the kernel maps the shmem pages itself */
+static void *_mmap_legacy(int drm_fd, uint32_t handle, uint64_t size, enum gem_mmap_type type)
+{
+    struct drm_i915_gem_mmap mm = {
+        .handle = handle,
+        .size = size,
+        .flags = type == GEM_MMAP_WC ? I915_MMAP_WC : 0,
+    };
+
+    if (drmIoctl(drm_fd, DRM_IOCTL_I915_GEM_MMAP, &mm))
+        return NULL;
+
+    return (void *)(uintptr_t)mm.addr_ptr;
+}
+
+void *gem_buffer_mmap_type(int drm_fd, uint32_t handle, uint64_t size, enum gem_mmap_type type)
+{
+    void *ptr;
+
+    if (type == GEM_MMAP_GTT)
+        return _mmap_gtt(drm_fd, handle, size);
+
+    ptr = _mmap_offset(drm_fd, handle, size, type);
+    if (!ptr)
+        ptr = _mmap_legacy(drm_fd, handle, size, type);
+
+    return ptr;
+}
+
 void gem_buffer_unmap(int UNUSED drm_fd, void *mmapped_gem_buffer, uint64_t size)
 {
     munmap(mmapped_gem_buffer, size);
@@ -69,6 +130,17 @@ int gem_get_caching(int fd, uint32_t handle, uint32_t *caching)
     return 0;
 }
 
+int gem_set_tiling(int fd, uint32_t handle, uint32_t tiling, uint32_t stride)
+{
+    struct drm_i915_gem_set_tiling arg = {
+        .handle = handle,
+        .tiling_mode = tiling,
+        .stride = stride,
+    };
+
+    return drmIoctl(fd, DRM_IOCTL_I915_GEM_SET_TILING, &arg);
+}
+
 int gem_set_domain(int fd, uint32_t handle, uint32_t read, uint32_t write)
 {
 	struct drm_i915_gem_set_domain set_domain = {
@@ -80,6 +152,37 @@ int gem_set_domain(int fd, uint32_t handle, uint32_t read, uint32_t write)
     return drmIoctl(fd, DRM_IOCTL_I915_GEM_SET_DOMAIN, &set_domain);
 }
 
+int gem_madvise(int fd, uint32_t handle, uint32_t madv, uint32_t *retained)
+{
+    struct drm_i915_gem_madvise arg = {
+        .handle = handle,
+        .madv = madv,
+    };
+    int ret;
+
+    ret = drmIoctl(fd, DRM_IOCTL_I915_GEM_MADVISE, &arg);
+    if (ret)
+        return ret;
+
+    *retained = arg.retained;
+    return 0;
+}
+
+int gem_busy(int fd, uint32_t handle, uint32_t *busy)
+{
+    struct drm_i915_gem_busy arg = {
+        .handle = handle,
+    };
+    int ret;
+
+    ret = drmIoctl(fd, DRM_IOCTL_I915_GEM_BUSY, &arg);
+    if (ret)
+        return ret;
+
+    *busy = arg.busy;
+    return 0;
+}
+
 int gem_context_get_param(int fd, struct drm_i915_gem_context_param *p)
 {
     return drmIoctl(fd, DRM_IOCTL_I915_GEM_CONTEXT_GETPARAM, p);
@@ -37,6 +37,10 @@ struct gem_buffer {
     };
 };
 
+/*
+ * R, G, B, A in memory, DRM_FORMAT_ABGR8888: the opposite channel order of
+ * struct pixel, convert.h turns it into XRGB8888.
+ */
 struct  color_32_bits {
     union {
         struct PACKED {
@@ -52,12 +56,30 @@ struct  color_32_bits {
 int gem_buffer_create(int drm_fd, uint64_t size, uint32_t *handler);
 int gem_buffer_destroy(int drm_fd, uint32_t handle);
 
+/*
+ * GTT maps through the aperture, write-combined and detiled by a fence.
+ * WC maps the pages write-combined and CPU maps them cached, both show
+ * the raw tiled layout and also work without an aperture.
+ */
+enum gem_mmap_type {
+    GEM_MMAP_GTT = 0,
+    GEM_MMAP_WC,
+    GEM_MMAP_CPU
+};
+
+/* GTT mapping */
 void *gem_buffer_mmap(int drm_fd, uint32_t handle, uint64_t size);
+void *gem_buffer_mmap_type(int drm_fd, uint32_t handle, uint64_t size, enum gem_mmap_type type);
 void gem_buffer_unmap(int UNUSED drm_fd, void *mmapped_gem_buffer, uint64_t size);
 
 int gem_get_caching(int fd, uint32_t handle, uint32_t *caching);
+int gem_set_tiling(int fd, uint32_t handle, uint32_t tiling, uint32_t stride);
 
 int gem_set_domain(int fd, uint32_t handle, uint32_t read, uint32_t write);
 
+/* I915_MADV_*, retained is 0 when the kernel already purged the pages */
+int gem_madvise(int fd, uint32_t handle, uint32_t madv, uint32_t *retained);
+int gem_busy(int fd, uint32_t handle, uint32_t *busy);
+
 int gem_context_get_param(int fd, struct drm_i915_gem_context_param *p);
 int gem_get_param(int fd, struct drm_i915_getparam *p);
\ No newline at end of file
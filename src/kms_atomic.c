@@ -0,0 +1,253 @@
+#include "kms_atomic.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "swapchain.h"
+
+enum kms_prop {
+	PROP_CONN_CRTC_ID,
+	PROP_CRTC_ACTIVE,
+	PROP_CRTC_MODE_ID,
+	PROP_PLANE_FB_ID,
+	PROP_PLANE_CRTC_ID,
+	PROP_PLANE_SRC_X,
+	PROP_PLANE_SRC_Y,
+	PROP_PLANE_SRC_W,
+	PROP_PLANE_SRC_H,
+	PROP_PLANE_CRTC_X,
+	PROP_PLANE_CRTC_Y,
+	PROP_PLANE_CRTC_W,
+	PROP_PLANE_CRTC_H,
+	PROP_COUNT,
+};
+
+static const struct {
+	uint32_t type;
+	const char *name;
+} props[PROP_COUNT] = {
+	[PROP_CONN_CRTC_ID] = { DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID" },
+	[PROP_CRTC_ACTIVE] = { DRM_MODE_OBJECT_CRTC, "ACTIVE" },
+	[PROP_CRTC_MODE_ID] = { DRM_MODE_OBJECT_CRTC, "MODE_ID" },
+	[PROP_PLANE_FB_ID] = { DRM_MODE_OBJECT_PLANE, "FB_ID" },
+	[PROP_PLANE_CRTC_ID] = { DRM_MODE_OBJECT_PLANE, "CRTC_ID" },
+	[PROP_PLANE_SRC_X] = { DRM_MODE_OBJECT_PLANE, "SRC_X" },
+	[PROP_PLANE_SRC_Y] = { DRM_MODE_OBJECT_PLANE, "SRC_Y" },
+	[PROP_PLANE_SRC_W] = { DRM_MODE_OBJECT_PLANE, "SRC_W" },
+	[PROP_PLANE_SRC_H] = { DRM_MODE_OBJECT_PLANE, "SRC_H" },
+	[PROP_PLANE_CRTC_X] = { DRM_MODE_OBJECT_PLANE, "CRTC_X" },
+	[PROP_PLANE_CRTC_Y] = { DRM_MODE_OBJECT_PLANE, "CRTC_Y" },
+	[PROP_PLANE_CRTC_W] = { DRM_MODE_OBJECT_PLANE, "CRTC_W" },
+	[PROP_PLANE_CRTC_H] = { DRM_MODE_OBJECT_PLANE, "CRTC_H" },
+};
+
+struct kms_atomic {
+	uint32_t plane;
+	uint32_t ids[PROP_COUNT];
+};
+
+/* Property ids of props of type for object id */
+static int _props_get(int fd, uint32_t id, uint32_t type, uint32_t ids[PROP_COUNT])
+{
+	drmModeObjectPropertiesPtr object;
+	unsigned i, j;
+	int ret = 0;
+
+	object = drmModeObjectGetProperties(fd, id, type);
+	if (!object)
+		return -errno;
+
+	for (j = 0; j < object->count_props; j++) {
+		drmModePropertyPtr prop = drmModeGetProperty(fd, object->props[j]);
+
+		if (!prop)
+			continue;
+		for (i = 0; i < PROP_COUNT; i++) {
+			if (props[i].type == type && !strcmp(props[i].name, prop->name))
+				ids[i] = prop->prop_id;
+		}
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(object);
+
+	for (i = 0; i < PROP_COUNT; i++) {
+		if (props[i].type == type && !ids[i]) {
+			fprintf(stderr, "object %u has no %s property\n", id, props[i].name);
+			ret = -ENOENT;
+		}
+	}
+
+	return ret;
+}
+
+int kms_atomic_init(struct modeset_dev *dev)
+{
+	struct kms_atomic *atomic;
+	uint32_t plane = dev->plane;
+
+	if (!plane)
+		return -ENOENT;
+
+	atomic = calloc(1, sizeof(*atomic));
+	if (!atomic)
+		return -ENOMEM;
+
+	atomic->plane = plane;
+	if (_props_get(dev->drm_fd, dev->conn, DRM_MODE_OBJECT_CONNECTOR, atomic->ids) ||
+	    _props_get(dev->drm_fd, dev->crtc, DRM_MODE_OBJECT_CRTC, atomic->ids) ||
+	    _props_get(dev->drm_fd, plane, DRM_MODE_OBJECT_PLANE, atomic->ids)) {
+		free(atomic);
+		return -ENOENT;
+	}
+
+	dev->atomic = atomic;
+	return 0;
+}
+
+void kms_atomic_fini(struct modeset_dev *dev)
+{
+	free(dev->atomic);
+	dev->atomic = NULL;
+}
+
+/* The primary plane scans out fb, all of it over the whole width x height CRTC */
+static void _plane_add(drmModeAtomicReqPtr req, struct modeset_dev *dev, uint32_t fb,
+		       uint32_t width, uint32_t height)
+{
+	const struct kms_atomic *atomic = dev->atomic;
+	const uint32_t *ids = atomic->ids;
+
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_FB_ID], fb);
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_CRTC_ID], fb ? dev->crtc : 0);
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_SRC_X], 0);
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_SRC_Y], 0);
+	/* 16.16 fixed point */
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_SRC_W], (uint64_t)width << 16);
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_SRC_H], (uint64_t)height << 16);
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_CRTC_X], 0);
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_CRTC_Y], 0);
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_CRTC_W], width);
+	drmModeAtomicAddProperty(req, atomic->plane, ids[PROP_PLANE_CRTC_H], height);
+}
+
+/* dev scanning out fb with mode, or off without one */
+static int _head_add(drmModeAtomicReqPtr req, struct modeset_dev *dev, const drmModeModeInfo *mode,
+		     uint32_t fb, uint32_t *blob)
+{
+	const uint32_t *ids = dev->atomic->ids;
+
+	*blob = 0;
+	if (mode && drmModeCreatePropertyBlob(dev->drm_fd, mode, sizeof(*mode), blob))
+		return -errno;
+
+	drmModeAtomicAddProperty(req, dev->conn, ids[PROP_CONN_CRTC_ID], mode ? dev->crtc : 0);
+	drmModeAtomicAddProperty(req, dev->crtc, ids[PROP_CRTC_MODE_ID], *blob);
+	drmModeAtomicAddProperty(req, dev->crtc, ids[PROP_CRTC_ACTIVE], !!mode);
+	if (mode)
+		_plane_add(req, dev, fb, mode->hdisplay, mode->vdisplay);
+	else
+		_plane_add(req, dev, 0, 0, 0);
+	return 0;
+}
+
+static unsigned _heads_count(struct modeset_dev *list)
+{
+	unsigned count = 0;
+
+	for (; list; list = list->next)
+		count++;
+
+	return count;
+}
+
+/* One modeset of every head, to its mode and front buffer or back to its saved_crtc */
+static int _heads_modeset(struct modeset_dev *list, bool restore)
+{
+	unsigned count = _heads_count(list), i = 0;
+	drmModeAtomicReqPtr req;
+	struct modeset_dev *iter;
+	uint32_t *blobs;
+	int ret = 0;
+
+	if (!list)
+		return 0;
+
+	blobs = calloc(count, sizeof(*blobs));
+	req = drmModeAtomicAlloc();
+	if (!blobs || !req) {
+		free(blobs);
+		drmModeAtomicFree(req);
+		return -ENOMEM;
+	}
+
+	for (iter = list; iter && !ret; iter = iter->next, i++) {
+		const drmModeCrtc *saved = iter->saved_crtc;
+
+		if (restore)
+			ret = _head_add(req, iter, saved && saved->mode_valid ? &saved->mode : NULL,
+					saved ? saved->buffer_id : 0, &blobs[i]);
+		else
+			ret = _head_add(req, iter, &iter->mode, swapchain_front(iter->swapchain)->fb,
+					&blobs[i]);
+	}
+
+	/* tested first, a refused configuration leaves the display as it is */
+	if (!ret && drmModeAtomicCommit(list->drm_fd, req, DRM_MODE_ATOMIC_TEST_ONLY |
+					DRM_MODE_ATOMIC_ALLOW_MODESET, NULL)) {
+		fprintf(stderr, "atomic configuration refused (%d): %m\n", errno);
+		ret = -errno;
+	}
+	if (!ret && drmModeAtomicCommit(list->drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL)) {
+		fprintf(stderr, "atomic modeset failed (%d): %m\n", errno);
+		ret = -errno;
+	}
+
+	/* the CRTCs hold their own references to the modes */
+	for (i = 0; i < count; i++) {
+		if (blobs[i])
+			drmModeDestroyPropertyBlob(list->drm_fd, blobs[i]);
+	}
+	drmModeAtomicFree(req);
+	free(blobs);
+	return ret;
+}
+
+int kms_atomic_modeset(struct modeset_dev *list)
+{
+	return _heads_modeset(list, false);
+}
+
+int kms_atomic_restore(struct modeset_dev *list)
+{
+	return _heads_modeset(list, true);
+}
+
+int kms_atomic_flip(const struct drm_flip *flips, unsigned count, uint32_t flags)
+{
+	drmModeAtomicReqPtr req;
+	unsigned i;
+	int ret;
+
+	if (!count)
+		return 0;
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	/* only the framebuffers change, the rest of the plane state stays */
+	for (i = 0; i < count; i++) {
+		const struct kms_atomic *atomic = flips[i].dev->atomic;
+
+		drmModeAtomicAddProperty(req, atomic->plane, atomic->ids[PROP_PLANE_FB_ID], flips[i].fb);
+	}
+
+	/* one event per CRTC of the commit */
+	ret = drmModeAtomicCommit(flips[0].dev->drm_fd, req, DRM_MODE_ATOMIC_NONBLOCK | flags, NULL) ?
+		-errno : 0;
+	drmModeAtomicFree(req);
+	return ret;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Atomic KMS for the heads of a modeset_dev list, used by common.c when
+ * the device has DRM_CLIENT_CAP_ATOMIC.
+ *
+ * Each head drives one connector, CRTC and primary plane, the plane
+ * covering the whole mode. A configuration is checked with a TEST_ONLY
+ * commit first, so a refused one leaves the display untouched and the
+ * caller can fall back to the legacy calls. Every head of a list goes in
+ * the same commit, their flips land in the same vblank.
+ */
+
+/* Looks up the properties of dev->conn, dev->crtc and dev->plane into dev->atomic */
+int kms_atomic_init(struct modeset_dev *dev);
+void kms_atomic_fini(struct modeset_dev *dev);
+
+/* Modeset of every head to its mode and front buffer */
+int kms_atomic_modeset(struct modeset_dev *list);
+/* Back to the saved_crtc of every head */
+int kms_atomic_restore(struct modeset_dev *list);
+
+/* One non-blocking commit of the flips, all of the same device, flags is DRM_MODE_PAGE_FLIP_EVENT or 0 */
+int kms_atomic_flip(const struct drm_flip *flips, unsigned count, uint32_t flags);
@@ -1,42 +1,41 @@
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 
+#include <drm_fourcc.h>
+
 #include "common.h"
+#include "fill.h"
+#include "scene_cache.h"
+#include "swapchain.h"
 
 int main()
 {
 	int fd;
 	struct modeset_dev *list, *iter;
+	struct scene_cache *cache;
+	struct scene_cache_stats stats;
 
 	fd = drm_open(DEFAULT_DRM_DEVICE);
 	if (fd < 0) {
 		return -1;
 	}
 
-	list = drm_modeset(fd);
+	list = drm_modeset(fd, 1);
+	cache = scene_cache_create(DRM_SCENE_CACHE_BUDGET, &drm_scene_buffer_ops, &fd);
+	if (!cache) {
+		drm_cleanup(list);
+		drm_close(fd);
+		return -1;
+	}
 
-	// draw red in all screens
+	// draw red in all screens, heads with the same size share the framebuffer
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[1];
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->green = 0;
-				p->blue = 0;
-			}
-		}
+		struct scene scene;
 
-		drmModePageFlip(fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[0].frontbuffer = false;
+		scene_init(&scene, iter->mode.hdisplay, iter->mode.vdisplay, DRM_FORMAT_XRGB8888,
+			   swapchain_front(iter->swapchain)->modifier, fill_color(255, 0, 0, 0));
+		drm_scene_flip(cache, iter, &scene);
 	}
 
 	printf("Full red screens\n");
@@ -45,33 +44,26 @@ int main()
 
 	// half screen blue half screen green
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[0];
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 0;
-				p->green = x >= (buf->width / 2) ? 255 : 0;
-				p->blue = x < (buf->width / 2) ? 255 : 0;
-			}
-		}
-
-		drmModePageFlip(fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[1].frontbuffer = false;
+		uint32_t half = iter->mode.hdisplay / 2;
+		struct scene scene;
+
+		scene_init(&scene, iter->mode.hdisplay, iter->mode.vdisplay, DRM_FORMAT_XRGB8888,
+			   swapchain_front(iter->swapchain)->modifier, fill_color(0, 0, 255, 0));
+		scene_add_rect(&scene, half, 0, iter->mode.hdisplay - half, iter->mode.vdisplay,
+			       fill_color(0, 255, 0, 0));
+		drm_scene_flip(cache, iter, &scene);
 	}
 
 	printf("Half blue and green screens\n");
 	printf("Press enter to continue...\n");
 	getchar();
 
+	scene_cache_stats_get(cache, &stats);
+	printf("scene cache: %" PRIu64 " rendered, %" PRIu64 " reused\n", stats.misses, stats.hits);
+
+	/* the CRTCs are restored first, the cached framebuffers are on screen */
 	drm_cleanup(list);
+	scene_cache_destroy(cache);
 	drm_close(fd);
 
 	return 0;
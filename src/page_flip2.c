@@ -1,168 +1,91 @@
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 
+#include <drm_fourcc.h>
+
 #include "common.h"
+#include "fill.h"
+#include "scene_cache.h"
+#include "swapchain.h"
 
 #define BOX_SIZE 50
 
+/* Red screen with a box offset pixels right and down of the middle */
+static void show_box(struct scene_cache *cache, struct modeset_dev *iter, uint32_t offset,
+		     uint32_t color)
+{
+	struct scene scene;
+
+	scene_init(&scene, iter->mode.hdisplay, iter->mode.vdisplay, DRM_FORMAT_XRGB8888,
+		   swapchain_front(iter->swapchain)->modifier, fill_color(255, 0, 0, 0));
+	/* box borders are exclusive */
+	scene_add_rect(&scene, (iter->mode.hdisplay - BOX_SIZE) / 2 + offset + 1,
+		       (iter->mode.vdisplay - BOX_SIZE) / 2 + offset + 1,
+		       BOX_SIZE - 1, BOX_SIZE - 1, color);
+	drm_scene_flip(cache, iter, &scene);
+}
+
 int main()
 {
 	int fd;
 	struct modeset_dev *list, *iter;
+	struct scene_cache *cache;
+	struct scene_cache_stats stats;
 
 	fd = drm_open(DEFAULT_DRM_DEVICE);
 	if (fd < 0) {
 		return -1;
 	}
 
-	list = drm_modeset(fd);
+	list = drm_modeset(fd, 1);
+	cache = scene_cache_create(DRM_SCENE_CACHE_BUDGET, &drm_scene_buffer_ops, &fd);
+	if (!cache) {
+		drm_cleanup(list);
+		drm_close(fd);
+		return -1;
+	}
 
 	// draw red in all screens
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[1];
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->green = 0;
-				p->blue = 0;
-			}
-		}
-
-		drmModePageFlip(fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[0].frontbuffer = false;
+		struct scene scene;
+
+		scene_init(&scene, iter->mode.hdisplay, iter->mode.vdisplay, DRM_FORMAT_XRGB8888,
+			   swapchain_front(iter->swapchain)->modifier, fill_color(255, 0, 0, 0));
+		drm_scene_flip(cache, iter, &scene);
 	}
 
 	printf("Full red screens\n");
 	printf("Press enter to continue...\n");
 	getchar();
 
-	// half screen blue half screen green
-	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[0];
-		uint32_t y, box_y_start, box_y_end, box_x_start, box_x_end;
-
-		box_y_start = (buf->height - BOX_SIZE) / 2;
-		box_y_end = box_y_start + BOX_SIZE;
-		box_x_start = (buf->width - BOX_SIZE) / 2;
-		box_x_end = box_x_start + BOX_SIZE;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->green = 0;
-
-
-				if (y > box_y_start && y < box_y_end && x > box_x_start
-					&& x < box_x_end)
-					p->blue = 255;
-				else
-					p->blue = 0;
-			}
-		}
-
-		drmModePageFlip(fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[1].frontbuffer = false;
-	}
+	for (iter = list; iter; iter = iter->next)
+		show_box(cache, iter, 0, fill_color(255, 0, 255, 0));
 
 	printf("Pink box in the middle of screen\n");
 	printf("Press enter to continue...\n");
 	getchar();
 
-	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[1];
-		uint32_t y, box_y_start, box_y_end, box_x_start, box_x_end;
-
-		box_y_start = (buf->height - BOX_SIZE) / 2;
-		box_y_end = box_y_start + BOX_SIZE;
-		box_x_start = (buf->width - BOX_SIZE) / 2;
-		box_x_end = box_x_start + BOX_SIZE;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->blue = 0;
-
-
-				if (y > box_y_start && y < box_y_end && x > box_x_start
-					&& x < box_x_end)
-					p->green = 255;
-				else
-					p->green = 0;
-			}
-		}
-
-		drmModePageFlip(fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[0].frontbuffer = false;
-	}
+	for (iter = list; iter; iter = iter->next)
+		show_box(cache, iter, 0, fill_color(255, 255, 0, 0));
 
 	printf("Yellow box in the middle of screen\n");
 	printf("Press enter to continue...\n");
 	getchar();
 
-	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[0];
-		uint32_t y, box_y_start, box_y_end, box_x_start, box_x_end;
-
-		box_y_start = (buf->height - BOX_SIZE) / 2;
-		box_y_start += BOX_SIZE;
-		box_y_end = box_y_start + BOX_SIZE;
-		box_x_start = (buf->width - BOX_SIZE) / 2;
-		box_x_start += BOX_SIZE;
-		box_x_end = box_x_start + BOX_SIZE;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->blue = 0;
-
-
-				if (y > box_y_start && y < box_y_end && x > box_x_start
-					&& x < box_x_end)
-					p->green = 255;
-				else
-					p->green = 0;
-			}
-		}
-
-		drmModePageFlip(fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[1].frontbuffer = false;
-	}
+	for (iter = list; iter; iter = iter->next)
+		show_box(cache, iter, BOX_SIZE, fill_color(255, 255, 0, 0));
 
 	printf("Yellow box in the middle+%dpx of screen\n", BOX_SIZE);
 	printf("Press enter to continue...\n");
 	getchar();
 
+	scene_cache_stats_get(cache, &stats);
+	printf("scene cache: %" PRIu64 " rendered, %" PRIu64 " reused\n", stats.misses, stats.hits);
+
+	/* the CRTCs are restored first, the cached framebuffers are on screen */
 	drm_cleanup(list);
+	scene_cache_destroy(cache);
 	drm_close(fd);
 
 	return 0;
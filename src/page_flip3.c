@@ -1,140 +1,313 @@
 #include <errno.h>
 #include <stdio.h>
-#include <sys/timerfd.h>
-#include <poll.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include "common.h"
+#include "event_loop.h"
+#include "fill.h"
+#include "frame_sched.h"
+#include "raster.h"
+#include "pipeline.h"
+#include "render_pool.h"
+#include "swapchain.h"
 
 #define BOX_SIZE 100
 #define INCREMENT (BOX_SIZE / 3)
 
-#define NSEC_PER_SEC 1000000000ULL
+/* heads flipped together, a commit takes all of them */
+#define HEADS_MAX 8
 
-static uint8_t get_index_buffer_in_use(struct modeset_dev *iter)
+/* time for the commit to reach the kernel ahead of the vblank */
+#define SCHED_MARGIN_NS 1000000ULL
+#define SCHED_STATS_FRAMES 600
+
+/* box is shared by all heads and only changes between frames */
+static struct scene {
+	struct raster_rect box;
+	/* old and new position of the box */
+	struct damage damage;
+} scene = {
+	.box = {
+		.w = BOX_SIZE,
+		.h = BOX_SIZE,
+	},
+};
+
+struct frame {
+	const struct scene *scene;
+	/* what the back buffer misses of the scene */
+	struct damage repaint;
+};
+
+struct head {
+	struct render_pool *pool;
+	/* rendered by the head thread, flipped with the other heads by the main thread */
+	struct modeset_buf *buf;
+	/* front buffer replaced by the pending flip, released once it is done */
+	struct modeset_buf *retire;
+};
+
+/* flip and vblank events still to come, the next frame is scheduled once they are in */
+static unsigned events_pending;
+/* the render timer is armed */
+static bool frame_scheduled;
+/* paced by the vblanks of the first head */
+static struct frame_sched *sched;
+
+static void draw_band(struct modeset_buf *buf, uint32_t y_start, uint32_t y_end, void *data)
 {
-	uint8_t i;
+	const struct frame *frame = data;
+
+	raster_draw_damage_rows(buf, fill_color(0, 0, 255, 0), &frame->scene->box, 1,
+				&frame->repaint, y_start, y_end);
+}
+
+/* Runs in the head own thread, every head has its own render pool */
+static void head_frame(struct pipeline_head *head, void *data)
+{
+	struct modeset_dev *iter = head->dev;
+	struct head *state = head->priv;
+	struct modeset_buf *buf = swapchain_acquire(iter->swapchain);
+	struct frame frame = {
+		.scene = data,
+	};
+
+	/* every buffer is presented, drop this frame */
+	if (!buf)
+		return;
+
+	damage_buffer_repaint(buf, &frame.scene->damage, &frame.repaint);
+	render_pool_frame(state->pool, buf, draw_band, &frame);
+	fill_writeback(buf, &frame.repaint);
+	state->buf = buf;
+}
+
+/* Every head rendered its frame, they are flipped in the same vblank */
+static void flip_heads(struct pipeline *pipeline)
+{
+	struct drm_flip flips[HEADS_MAX];
+	unsigned i, count = 0;
+
+	for (i = 0; i < pipeline_heads_count(pipeline); i++) {
+		struct pipeline_head *head = pipeline_head_get(pipeline, i);
+		struct head *state = head->priv;
 
-	for (i = 0; i < (sizeof(iter->buffers) / sizeof(iter->buffers[0])); i++) {
-		if (iter->buffers[i].frontbuffer)
-			return i;
+		if (!state->buf)
+			continue;
+		flips[count].dev = head->dev;
+		flips[count].fb = state->buf->fb;
+		flips[count++].cookie = state;
 	}
 
-	return 0;
+	if (drm_flip(flips, count))
+		fprintf(stderr, "cannot flip (%d): %m\n", errno);
+
+	for (i = 0; i < pipeline_heads_count(pipeline); i++) {
+		struct pipeline_head *head = pipeline_head_get(pipeline, i);
+		struct head *state = head->priv;
+		struct swapchain *swapchain = head->dev->swapchain;
+
+		if (!state->buf)
+			continue;
+
+		/* the flip didn't make it, the frame is dropped */
+		if (!head->dev->flip_pending) {
+			swapchain_release(swapchain, state->buf);
+			state->buf = NULL;
+			continue;
+		}
+
+		state->retire = swapchain_present(swapchain, state->buf, &scene.damage);
+		state->buf = NULL;
+		events_pending++;
+	}
+
+	/* nothing flipped, the next frame is still paced by the display */
+	if (!events_pending && !drm_vblank_request(pipeline_head_get(pipeline, 0)->dev, NULL))
+		events_pending++;
+}
+
+/* The display scans out the new buffer, the one it replaced can be drawn into again */
+static void flip_done(struct modeset_dev *dev, void *cookie, uint64_t time_ns, unsigned sequence,
+		      void *data)
+{
+	struct head *state = cookie;
+	struct frame_sched_stats stats;
+
+	swapchain_release(dev->swapchain, state->retire);
+	state->retire = NULL;
+	events_pending--;
+
+	if (dev != data)
+		return;
+
+	frame_sched_flip_done(sched, time_ns, sequence);
+	frame_sched_stats_get(sched, &stats);
+	if (stats.frames % SCHED_STATS_FRAMES == 0)
+		frame_sched_print_stats(sched);
+}
+
+static void vblank(struct modeset_dev *dev, void *cookie, uint64_t time_ns, unsigned sequence,
+		   void *data)
+{
+	(void)cookie;
+	if (dev == data)
+		frame_sched_vblank(sched, time_ns, sequence);
+	events_pending--;
 }
 
-static uint8_t get_index_next_buffer(struct modeset_dev *iter, uint8_t buffer_in_use)
+/* data is the modeset list, its first head paces the frames */
+static void drm_events(int fd, void *data)
 {
-	uint8_t max = sizeof(iter->buffers) / sizeof(iter->buffers[0]);
+	const struct drm_event_handlers handlers = {
+		.flip_done = flip_done,
+		.vblank = vblank,
+		.data = data,
+	};
 
-	buffer_in_use++;
-	if (buffer_in_use == max)
-		return 0;
-	else
-		return buffer_in_use;
+	(void)fd;
+	if (drm_handle_events(data, &handlers))
+		fprintf(stderr, "cannot read DRM events (%d): %m\n", errno);
 }
 
-static void move_box(struct modeset_dev *list)
+static void move_box(struct modeset_dev *list, struct pipeline *pipeline)
 {
-	struct modeset_dev *iter;
 	static uint32_t box_x_begin = 0;
 	static uint32_t box_y_begin = 0;
-	uint32_t y, box_y_start, box_y_end, box_x_start, box_x_end;
 
-	if (box_x_begin + BOX_SIZE > list->buffers->width) {
+	damage_clear(&scene.damage);
+	damage_add_rect(&scene.damage, box_x_begin, box_y_begin, BOX_SIZE, BOX_SIZE);
+
+	if (box_x_begin + BOX_SIZE > list->mode.hdisplay) {
 		box_x_begin = 0;
 		box_y_begin += INCREMENT;
 
-		if (box_y_begin + BOX_SIZE > list->buffers->height) {
+		if (box_y_begin + BOX_SIZE > list->mode.vdisplay) {
 			box_y_begin = 0;
 		}
 	} else {
 		box_x_begin += INCREMENT;
 	}
 
-	box_y_start = box_y_begin;
-	box_y_end = box_y_start + BOX_SIZE;
-	box_x_start = box_x_begin;
-	box_x_end = box_x_start + BOX_SIZE;
-
-	for (iter = list; iter; iter = iter->next) {
-		uint8_t index_bufer_in_use = get_index_buffer_in_use(iter);
-		uint8_t index_next_buffer = get_index_next_buffer(iter, index_bufer_in_use);
-		struct modeset_buf *buf = &iter->buffers[index_next_buffer];
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 0;
-				p->green = 0;
-
-				if (y >= box_y_start && y < box_y_end && x >= box_x_start
-					&& x < box_x_end)
-					p->blue = 0;
-				else
-					p->blue = 255;
-			}
-		}
+	scene.box.x = box_x_begin;
+	scene.box.y = box_y_begin;
+	scene.box.color = fill_color(0, 0, 0, 0);
+	damage_add_rect(&scene.damage, box_x_begin, box_y_begin, BOX_SIZE, BOX_SIZE);
+
+	pipeline_frame(pipeline);
+	flip_heads(pipeline);
+}
+
+/* The scheduled start of the next frame */
+static void render_timer(uint64_t expirations, void *data)
+{
+	struct pipeline *pipeline = data;
+	uint64_t start = event_loop_now_ns();
+
+	(void)expirations;
+	frame_scheduled = false;
+	move_box(pipeline_head_get(pipeline, 0)->dev, pipeline);
+	frame_sched_rendered(sched, start, event_loop_now_ns());
+}
+
+static void pipeline_pools_destroy(struct pipeline *pipeline)
+{
+	unsigned i;
+
+	for (i = 0; i < pipeline_heads_count(pipeline); i++) {
+		struct head *state = pipeline_head_get(pipeline, i)->priv;
+
+		if (state)
+			render_pool_destroy(state->pool);
+		free(state);
+	}
+}
+
+static int pipeline_pools_create(struct pipeline *pipeline)
+{
+	unsigned i, heads = pipeline_heads_count(pipeline);
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned threads = cpus > heads ? cpus / heads : 1;
+
+	if (heads > HEADS_MAX)
+		return -1;
+
+	for (i = 0; i < heads; i++) {
+		struct pipeline_head *head = pipeline_head_get(pipeline, i);
+		struct head *state = calloc(1, sizeof(*state));
 
-		drmModePageFlip(iter->drm_fd, iter->crtc, buf->fb, 0, NULL);
-		iter->buffers[index_bufer_in_use].frontbuffer = false;
-		buf->frontbuffer = true;
+		head->priv = state;
+		if (!state || !(state->pool = render_pool_create(threads))) {
+			pipeline_pools_destroy(pipeline);
+			return -1;
+		}
 	}
+
+	return 0;
 }
 
 int main()
 {
-	int fd, timerfd, r;
+	int fd, timer = -1, r = 0;
+	struct pipeline *pipeline;
 	struct modeset_dev *list;
-	struct itimerspec new_value;
-	struct pollfd pollfds[1];
+	struct event_loop *loop;
 
 	fd = drm_open(DEFAULT_DRM_DEVICE);
 	if (fd < 0) {
 		return -1;
 	}
 
-	list = drm_modeset(fd);
-
-	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-	new_value.it_value.tv_nsec = NSEC_PER_SEC / 45;
-	new_value.it_value.tv_sec = 0;
-	new_value.it_interval.tv_nsec = new_value.it_value.tv_nsec;
-	new_value.it_interval.tv_sec = new_value.it_value.tv_sec;
-	r = timerfd_settime(timerfd, 0, &new_value, NULL);
-
-	pollfds[0].fd = timerfd;
-	pollfds[0].events = POLLIN | POLLPRI | POLLOUT | POLLERR | POLLHUP | POLLNVAL;
-	pollfds[0].revents = 0;
+	/* every back buffer is age 0 when first acquired, the first frame repaints all of it */
+	drm_swapchain_init_set(SWAPCHAIN_INIT_NONE);
+	list = drm_modeset(fd, 3);
+	pipeline = pipeline_create(list, head_frame, &scene);
+	if (!pipeline || pipeline_pools_create(pipeline)) {
+		fprintf(stderr, "cannot create render pipelines\n");
+		pipeline_destroy(pipeline);
+		drm_cleanup(list);
+		drm_close(fd);
+		return -1;
+	}
 
-	while (1) {
-		uint64_t exp;
+	sched = frame_sched_create(frame_sched_mode_period(&list->mode), SCHED_MARGIN_NS);
+	loop = event_loop_create();
+	if (loop)
+		timer = event_loop_timer_add(loop, render_timer, pipeline);
+	if (!sched || timer < 0 || event_loop_fd_add(loop, fd, drm_events, list)) {
+		fprintf(stderr, "cannot create the event loop\n");
+		r = -1;
+		goto end;
+	}
 
-		r = poll(pollfds, 1, -1);
-		if (r <= 0) {
-			printf("poll returned r=%i, breaking\n", r);
-			break;
-		}
+	/*
+	 * A frame is scheduled once the previous one is on screen, one per
+	 * vblank at most. It starts as late as it can still make the next
+	 * vblank, see frame_sched.h. The buffer a flip replaces is only
+	 * released by its completion event, never while it may still be
+	 * scanned out.
+	 */
+	while (r >= 0) {
+		if (!events_pending && !frame_scheduled) {
+			uint64_t start = frame_sched_start(sched, event_loop_now_ns());
 
-		if (pollfds[0].revents & POLLIN) {
-			r = read(pollfds[0].fd, &exp, sizeof(exp));
-
-			if (r != sizeof(uint64_t))
-				printf("read a not expected number of bytes: %i\n", r);
-			if (exp)
-				move_box(list);
-			if (exp > 1)
-				printf("events missed: %lu\n", exp - 1);
-		} else {
-			printf("pollfds[0].revents=%d\n", pollfds[0].revents);
+			frame_scheduled = !event_loop_timer_arm(loop, timer, start, 0);
+			if (!frame_scheduled)
+				render_timer(1, pipeline);
 		}
+		r = event_loop_dispatch(loop, -1);
 	}
+	printf("event loop failed (%d)\n", r);
 
+end:
+	if (sched)
+		frame_sched_print_stats(sched);
+	frame_sched_destroy(sched);
+	event_loop_destroy(loop);
+	pipeline_print_stats(pipeline);
+	pipeline_pools_destroy(pipeline);
+	pipeline_destroy(pipeline);
 	drm_cleanup(list);
 	drm_close(fd);
 
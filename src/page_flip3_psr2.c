@@ -1,61 +1,45 @@
 #include <errno.h>
 #include <stdio.h>
-#include <sys/timerfd.h>
-#include <poll.h>
 #include <unistd.h>
 
 #include "common.h"
+#include "event_loop.h"
+#include "fill.h"
+#include "raster.h"
 #include "debugfs.h"
+#include "swapchain.h"
 
 #define BOX_SIZE 100
 #define INCREMENT (BOX_SIZE / 3)
 
 #define NSEC_PER_SEC 1000000000ULL
 
+/* heads flipped together, a commit takes all of them */
+#define HEADS_MAX 8
+
 static int psr_debugfs;
 
 static void draw_frames(struct modeset_dev *list)
 {
-	const uint8_t buffers_count = sizeof(list->buffers) / sizeof(list->buffers[0]);
 	struct modeset_dev *iter;
 
 	for (iter = list; iter; iter = iter->next) {
+		const uint8_t buffers_count = swapchain_depth(iter->swapchain);
 		uint8_t i;
 
 		for (i = 0; i < buffers_count; i++) {
-			struct modeset_buf *buf = &iter->buffers[i];
-			uint32_t y;
-			uint32_t box_y_begin = (buf->height - BOX_SIZE) / 2;
-			uint32_t box_y_end = box_y_begin + BOX_SIZE;
-
-			for (y = 0; y < buf->height; y++) {
-				uint32_t x;
-				uint8_t draw_box_in_y;
-				uint32_t line_offset = buf->stride * y;
-				uint32_t box_x_begin, box_x_end;
-
-				if (y > box_y_begin && y < box_y_end) {
-					draw_box_in_y = 1;
-					box_x_begin = (buf->width / buffers_count) * i;
-					box_x_end = box_x_begin + BOX_SIZE;
-				} else {
-					draw_box_in_y = box_x_begin = box_x_end = 0;
-				}
-
-				for (x = 0; x < buf->width; x++) {
-					// 32bpp = 4bytes
-					uint32_t pixel_offset = line_offset + (x * 4);
-					struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-
-					p->red = 0;
-					p->green = 0;
-
-					if (draw_box_in_y && x > box_x_begin && x < box_x_end)
-						p->blue = 0;
-					else
-						p->blue = 255;
-				}
-			}
+			struct modeset_buf *buf = swapchain_buffer(iter->swapchain, i);
+			struct raster_rect box = {
+				/* box borders are exclusive */
+				.x = (buf->width / buffers_count) * i + 1,
+				.y = (buf->height - BOX_SIZE) / 2 + 1,
+				.w = BOX_SIZE - 1,
+				.h = BOX_SIZE - 1,
+				.color = fill_color(0, 0, 0, 0),
+			};
+
+			raster_draw(buf, fill_color(0, 0, 255, 0), &box, 1);
+			fill_writeback(buf, NULL);
 		}
 	}
 }
@@ -120,83 +104,117 @@ static void psr_debugfs_parse()
 		printf("\tcount=%d | status=%d\n", count, status);
 }
 
-static void flip_frame(struct modeset_dev *list, uint8_t *active_frame)
+/*
+ * The buffers already hold their frame, they are only cycled through, all
+ * heads in one commit. The cookie of a flip is the front buffer it
+ * replaces, released by its completion event.
+ */
+static void flip_frame(struct modeset_dev *list)
 {
-	const uint8_t buffers_count = sizeof(list->buffers) / sizeof(list->buffers[0]);
 	struct modeset_dev *iter;
-	uint8_t next_frame = (*active_frame) + 1;
+	struct drm_flip flips[HEADS_MAX];
+	struct modeset_buf *bufs[HEADS_MAX];
+	unsigned i, count = 0;
 
-	if (next_frame == buffers_count)
-		next_frame = 0;
+	for (iter = list; iter && count < HEADS_MAX; iter = iter->next) {
+		struct modeset_buf *buf;
 
-	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[next_frame];
+		/* the previous flip is still pending, this head skips a frame */
+		if (iter->flip_pending) {
+			printf("flip of connector %u still pending\n", iter->conn);
+			continue;
+		}
+
+		buf = swapchain_acquire(iter->swapchain);
+		if (!buf)
+			continue;
+
+		bufs[count] = buf;
+		flips[count].dev = iter;
+		flips[count].fb = buf->fb;
+		flips[count++].cookie = swapchain_front(iter->swapchain);
+	}
+
+	/* every head skipped, the PSR state is still logged */
+	if (count && drm_flip(flips, count))
+		fprintf(stderr, "cannot flip (%d): %m\n", errno);
+	for (i = 0; i < count; i++) {
+		struct swapchain *swapchain = flips[i].dev->swapchain;
 
-		drmModePageFlip(iter->drm_fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[*active_frame].frontbuffer = false;
+		if (flips[i].dev->flip_pending)
+			swapchain_present(swapchain, bufs[i], NULL);
+		else
+			swapchain_release(swapchain, bufs[i]);
 	}
-	*active_frame = next_frame;
 
 	printf("flip_frame\n");
 	psr_debugfs_parse();
 }
 
+static void flip_done(struct modeset_dev *dev, void *cookie, uint64_t time_ns, unsigned sequence,
+		      void *data)
+{
+	(void)time_ns;
+	(void)sequence;
+	(void)data;
+	swapchain_release(dev->swapchain, cookie);
+}
+
+static const struct drm_event_handlers handlers = {
+	.flip_done = flip_done,
+};
+
+/* data is the modeset list */
+static void drm_events(int fd, void *data)
+{
+	(void)fd;
+	if (drm_handle_events(data, &handlers))
+		fprintf(stderr, "cannot read DRM events (%d): %m\n", errno);
+}
+
+static void flip_timer(uint64_t expirations, void *data)
+{
+	flip_frame(data);
+	if (expirations > 1)
+		printf("events missed: %lu\n", expirations - 1);
+}
+
 int main()
 {
-	int fd, timerfd, r;
+	int fd, timer;
 	struct modeset_dev *list;
-	struct itimerspec new_value;
-	struct pollfd pollfds[1];
-	uint8_t active_frame = 0;
+	struct event_loop *loop = NULL;
+	/* slow enough for PSR2 to kick in between the flips */
+	const uint64_t period_ns = NSEC_PER_SEC / 10;
 
 	fd = drm_open(DEFAULT_DRM_DEVICE);
 	if (fd < 0) {
 		return -1;
 	}
 
-	list = drm_modeset(fd);
+	/* draw_frames() draws all of every buffer before the first flip */
+	drm_swapchain_init_set(SWAPCHAIN_INIT_NONE);
+	list = drm_modeset(fd, 3);
 	psr_debugfs = i915_psr_debugfs_read_init();
 	if (psr_debugfs < 0)
 		goto end;
 
 	draw_frames(list);
 
-	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-	//new_value.it_value.tv_nsec = NSEC_PER_SEC / 15;
-	new_value.it_value.tv_nsec = NSEC_PER_SEC / 10;
-	new_value.it_value.tv_sec = 0;
-	new_value.it_interval.tv_nsec = new_value.it_value.tv_nsec;
-	new_value.it_interval.tv_sec = new_value.it_value.tv_sec;
-	r = timerfd_settime(timerfd, 0, &new_value, NULL);
-
-	pollfds[0].fd = timerfd;
-	pollfds[0].events = POLLIN | POLLPRI | POLLOUT | POLLERR | POLLHUP | POLLNVAL;
-	pollfds[0].revents = 0;
-
-	while (1) {
-		uint64_t exp;
-
-		r = poll(pollfds, 1, -1);
-		if (r <= 0) {
-			printf("poll returned r=%i, breaking\n", r);
-			break;
-		}
-
-		if (pollfds[0].revents & POLLIN) {
-			r = read(pollfds[0].fd, &exp, sizeof(exp));
-
-			if (r != sizeof(uint64_t))
-				printf("read a not expected number of bytes: %i\n", r);
-			if (exp)
-				flip_frame(list, &active_frame);
-			if (exp > 1)
-				printf("events missed: %lu\n", exp - 1);
-		} else {
-			printf("pollfds[0].revents=%d\n", pollfds[0].revents);
-		}
+	loop = event_loop_create();
+	if (!loop || event_loop_fd_add(loop, fd, drm_events, list)) {
+		fprintf(stderr, "cannot create the event loop\n");
+		goto shutdown;
 	}
+	timer = event_loop_timer_add(loop, flip_timer, list);
+	if (timer < 0 ||
+	    event_loop_timer_arm(loop, timer, event_loop_now_ns() + period_ns, period_ns))
+		goto shutdown;
+
+	printf("event loop failed (%d)\n", event_loop_run(loop));
 
+shutdown:
+	event_loop_destroy(loop);
 	i915_psr_debugfs_shutdown(psr_debugfs);
 end:
 	drm_cleanup(list);
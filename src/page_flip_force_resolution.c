@@ -1,12 +1,74 @@
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 
+#include <drm_fourcc.h>
+
+#include "bufmgr.h"
 #include "common.h"
+#include "fill.h"
+#include "fb_pool.h"
+#include "scene_cache.h"
+#include "swapchain.h"
+
+static void show_scenes(struct scene_cache *cache, struct modeset_dev *list)
+{
+	struct modeset_dev *iter;
+
+	// draw red in all screens, heads with the same size share the framebuffer
+	for (iter = list; iter; iter = iter->next) {
+		struct scene scene;
+
+		scene_init(&scene, iter->mode.hdisplay, iter->mode.vdisplay, DRM_FORMAT_XRGB8888,
+			   swapchain_front(iter->swapchain)->modifier, fill_color(255, 0, 0, 0));
+		drm_scene_flip(cache, iter, &scene);
+	}
+
+	printf("Full red screens\n");
+	printf("Press enter to continue...\n");
+	getchar();
+
+	// half screen blue half screen green
+	for (iter = list; iter; iter = iter->next) {
+		uint32_t half = iter->mode.hdisplay / 2;
+		struct scene scene;
+
+		scene_init(&scene, iter->mode.hdisplay, iter->mode.vdisplay, DRM_FORMAT_XRGB8888,
+			   swapchain_front(iter->swapchain)->modifier, fill_color(0, 0, 255, 0));
+		scene_add_rect(&scene, half, 0, iter->mode.hdisplay - half, iter->mode.vdisplay,
+			       fill_color(0, 255, 0, 0));
+		drm_scene_flip(cache, iter, &scene);
+	}
+
+	printf("Half blue and green screens\n");
+	printf("Press enter to continue...\n");
+	getchar();
+}
+
+/* Tear down list and modeset again, the framebuffers come back from the pool */
+static struct modeset_dev *switch_mode(int fd, struct modeset_dev *list, struct scene_cache *cache,
+				       const drmModeModeInfo *mode)
+{
+	struct modeset_dev *iter;
+
+	/* only unpinned, nothing is evicted before the CRTCs are restored */
+	for (iter = list; iter; iter = iter->next) {
+		scene_cache_put(cache, iter->scene);
+		scene_cache_put(cache, iter->prev_scene);
+	}
+	drm_cleanup(list);
+
+	return drm_modeset_with_mode(fd, mode, 1);
+}
 
 int main()
 {
 	int fd;
 	struct modeset_dev *list, *iter;
+	struct scene_cache *cache;
+	struct scene_cache_stats stats;
+	struct fb_pool_stats pool_stats;
+	struct bufmgr_stats bufmgr_stats;
 	const drmModeModeInfo std_1024_mode = {
 		.clock = 65000,
 		.hdisplay = 1024,
@@ -30,65 +92,45 @@ int main()
 		return -1;
 	}
 
-	list = drm_modeset_with_mode(fd, &std_1024_mode);
-
-	// draw red in all screens
-	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[1];
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 255;
-				p->green = 0;
-				p->blue = 0;
-			}
-		}
-
-		drmModePageFlip(fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[0].frontbuffer = false;
+	list = drm_modeset_with_mode(fd, &std_1024_mode, 1);
+	cache = scene_cache_create(DRM_SCENE_CACHE_BUDGET, &drm_scene_buffer_ops, &fd);
+	if (!cache) {
+		drm_cleanup(list);
+		drm_close(fd);
+		return -1;
 	}
 
-	printf("Full red screens\n");
-	printf("Press enter to continue...\n");
-	getchar();
+	show_scenes(cache, list);
 
-	// half screen blue half screen green
+	/* the preferred mode and back, the second 1024x768 modeset allocates nothing */
+	printf("Switching to the preferred modes\n");
+	list = switch_mode(fd, list, cache, &drm_mode_preferred);
 	for (iter = list; iter; iter = iter->next) {
-		struct modeset_buf *buf = &iter->buffers[0];
-		uint32_t y;
-
-		for (y = 0; y < buf->height; y++) {
-			uint32_t x;
-			uint32_t line_offset = buf->stride * y;
-
-			for (x = 0; x < buf->width; x++) {
-				// 32bpp = 4bytes
-				uint32_t pixel_offset = line_offset + (x * 4);
-				struct pixel *p = (struct pixel *)&(buf->map[pixel_offset]);
-				p->red = 0;
-				p->green = x >= (buf->width / 2) ? 255 : 0;
-				p->blue = x < (buf->width / 2) ? 255 : 0;
-			}
-		}
-
-		drmModePageFlip(fd, iter->crtc, buf->fb, 0, NULL);
-		buf->frontbuffer = true;
-		iter->buffers[1].frontbuffer = false;
+		if (iter->mode.hdisplay == std_1024_mode.hdisplay &&
+		    iter->mode.vdisplay == std_1024_mode.vdisplay)
+			printf("connector %u prefers 1024x768 too, its pool counts show no switch\n",
+			       iter->conn);
 	}
-
-	printf("Half blue and green screens\n");
-	printf("Press enter to continue...\n");
-	getchar();
-
+	show_scenes(cache, list);
+
+	printf("Switching back to 1024x768\n");
+	list = switch_mode(fd, list, cache, &std_1024_mode);
+	show_scenes(cache, list);
+
+	scene_cache_stats_get(cache, &stats);
+	printf("scene cache: %" PRIu64 " rendered, %" PRIu64 " reused\n", stats.misses, stats.hits);
+	fb_pool_stats_get(drm_fb_pool(fd), &pool_stats);
+	printf("framebuffer pool: %" PRIu64 " allocated, %" PRIu64 " reused, %" PRIu64 " trimmed\n",
+	       pool_stats.misses, pool_stats.hits, pool_stats.trims);
+	bufmgr_stats_get(drm_bufmgr(fd), &bufmgr_stats);
+	printf("buffer objects: %" PRIu64 " created, %" PRIu64 " reused, %" PRIu64 " purged, "
+	       "%" PRIu64 " expired\n", bufmgr_stats.creates, bufmgr_stats.hits,
+	       bufmgr_stats.purged, bufmgr_stats.expired);
+	drm_memory_stats_print();
+
+	/* the CRTCs are restored first, the cached framebuffers are on screen */
 	drm_cleanup(list);
+	scene_cache_destroy(cache);
 	drm_close(fd);
 
 	return 0;
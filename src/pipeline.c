@@ -0,0 +1,201 @@
+#include "pipeline.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_USEC 1000
+
+struct pipeline_thread {
+	struct pipeline *pipeline;
+	pthread_t thread;
+	struct pipeline_head head;
+};
+
+struct pipeline {
+	pthread_mutex_t lock;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+	uint64_t generation;
+	uint64_t start_ns;
+	unsigned pending;
+	bool quit;
+
+	pipeline_frame_func func;
+	void *data;
+
+	unsigned count;
+	struct pipeline_thread *threads;
+};
+
+static uint64_t _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void *_head_main(void *data)
+{
+	struct pipeline_thread *thread = data;
+	struct pipeline *pipeline = thread->pipeline;
+	struct pipeline_head *head = &thread->head;
+	uint64_t generation = 0;
+
+	for (;;) {
+		uint64_t latency;
+
+		pthread_mutex_lock(&pipeline->lock);
+		while (!pipeline->quit && pipeline->generation == generation)
+			pthread_cond_wait(&pipeline->start_cond, &pipeline->lock);
+		generation = pipeline->generation;
+		if (pipeline->quit) {
+			pthread_mutex_unlock(&pipeline->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pipeline->lock);
+
+		pipeline->func(head, pipeline->data);
+
+		latency = _now_ns() - pipeline->start_ns;
+		head->frames++;
+		head->last_latency_ns = latency;
+		if (latency > head->max_latency_ns)
+			head->max_latency_ns = latency;
+
+		pthread_mutex_lock(&pipeline->lock);
+		if (--pipeline->pending == 0)
+			pthread_cond_signal(&pipeline->done_cond);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+
+	return NULL;
+}
+
+struct pipeline *pipeline_create(struct modeset_dev *list, pipeline_frame_func func, void *data)
+{
+	struct modeset_dev *iter;
+	struct pipeline *pipeline;
+	unsigned count = 0, i;
+
+	for (iter = list; iter; iter = iter->next)
+		count++;
+
+	pipeline = calloc(1, sizeof(*pipeline));
+	if (!pipeline)
+		return NULL;
+
+	pipeline->threads = calloc(count ? count : 1, sizeof(*pipeline->threads));
+	if (!pipeline->threads) {
+		free(pipeline);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->start_cond, NULL);
+	pthread_cond_init(&pipeline->done_cond, NULL);
+	pipeline->func = func;
+	pipeline->data = data;
+
+	for (iter = list, i = 0; iter; iter = iter->next, i++) {
+		struct pipeline_thread *thread = &pipeline->threads[i];
+
+		thread->pipeline = pipeline;
+		thread->head.dev = iter;
+		thread->head.index = i;
+
+		if (pthread_create(&thread->thread, NULL, _head_main, thread)) {
+			fprintf(stderr, "cannot create pipeline thread for connector %u (%d): %m\n",
+				iter->conn, errno);
+			pipeline_destroy(pipeline);
+			return NULL;
+		}
+		pipeline->count++;
+	}
+
+	return pipeline;
+}
+
+void pipeline_destroy(struct pipeline *pipeline)
+{
+	unsigned i;
+
+	if (!pipeline)
+		return;
+
+	pipeline_frame_wait(pipeline);
+
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->quit = true;
+	pthread_cond_broadcast(&pipeline->start_cond);
+	pthread_mutex_unlock(&pipeline->lock);
+
+	for (i = 0; i < pipeline->count; i++)
+		pthread_join(pipeline->threads[i].thread, NULL);
+
+	pthread_cond_destroy(&pipeline->done_cond);
+	pthread_cond_destroy(&pipeline->start_cond);
+	pthread_mutex_destroy(&pipeline->lock);
+	free(pipeline->threads);
+	free(pipeline);
+}
+
+unsigned pipeline_heads_count(struct pipeline *pipeline)
+{
+	return pipeline->count;
+}
+
+struct pipeline_head *pipeline_head_get(struct pipeline *pipeline, unsigned index)
+{
+	if (index >= pipeline->count)
+		return NULL;
+
+	return &pipeline->threads[index].head;
+}
+
+void pipeline_frame_start(struct pipeline *pipeline)
+{
+	pipeline_frame_wait(pipeline);
+
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->pending = pipeline->count;
+	pipeline->start_ns = _now_ns();
+	pipeline->generation++;
+	pthread_cond_broadcast(&pipeline->start_cond);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+void pipeline_frame_wait(struct pipeline *pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	while (pipeline->pending)
+		pthread_cond_wait(&pipeline->done_cond, &pipeline->lock);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+void pipeline_frame(struct pipeline *pipeline)
+{
+	pipeline_frame_start(pipeline);
+	pipeline_frame_wait(pipeline);
+}
+
+void pipeline_print_stats(struct pipeline *pipeline)
+{
+	unsigned i;
+
+	pipeline_frame_wait(pipeline);
+
+	for (i = 0; i < pipeline->count; i++) {
+		struct pipeline_head *head = &pipeline->threads[i].head;
+
+		printf("head %u connector %u: frames=%" PRIu64 " last latency=%" PRIu64
+		       "us max latency=%" PRIu64 "us\n", i, head->dev->conn, head->frames,
+		       head->last_latency_ns / NSEC_PER_USEC,
+		       head->max_latency_ns / NSEC_PER_USEC);
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * One render/flip thread per modeset_dev.
+ *
+ * pipeline_frame_start() releases every head at the same time and
+ * pipeline_frame_wait() collects the completions, so a head no longer waits
+ * for the heads before it in the list to render and flip.
+ */
+
+struct pipeline;
+
+struct pipeline_head {
+	struct modeset_dev *dev;
+	unsigned index;
+	/* frames rendered and flipped by this head */
+	uint64_t frames;
+	/* time from pipeline_frame_start() to the head finishing its frame */
+	uint64_t last_latency_ns;
+	uint64_t max_latency_ns;
+	/* per head state, owned by the caller */
+	void *priv;
+};
+
+/* Render and flip the next frame of head, runs in the head thread */
+typedef void (*pipeline_frame_func)(struct pipeline_head *head, void *data);
+
+struct pipeline *pipeline_create(struct modeset_dev *list, pipeline_frame_func func, void *data);
+void pipeline_destroy(struct pipeline *pipeline);
+
+unsigned pipeline_heads_count(struct pipeline *pipeline);
+struct pipeline_head *pipeline_head_get(struct pipeline *pipeline, unsigned index);
+
+void pipeline_frame_start(struct pipeline *pipeline);
+void pipeline_frame_wait(struct pipeline *pipeline);
+void pipeline_frame(struct pipeline *pipeline);
+
+void pipeline_print_stats(struct pipeline *pipeline);
@@ -0,0 +1,185 @@
+#include "raster.h"
+
+#include <stdlib.h>
+
+#include "fill.h"
+
+struct raster_span {
+	uint32_t x, len;
+	uint32_t color;
+	fill_span_func func;
+};
+
+/* every rectangle can split one span in 3 */
+#define RASTER_MAX_SPANS (RASTER_MAX_RECTS * 2 + 1)
+
+static int _cmp_uint32(const void *a, const void *b)
+{
+	uint32_t va = *(const uint32_t *)a, vb = *(const uint32_t *)b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+/* Paint [x0, x1) with color over spans, returns the new number of spans */
+static unsigned _spans_paint(struct raster_span *spans, unsigned count,
+			     uint32_t x0, uint32_t x1, uint32_t color)
+{
+	struct raster_span out[RASTER_MAX_SPANS];
+	unsigned i, n = 0;
+	bool painted = false;
+
+	for (i = 0; i < count; i++) {
+		struct raster_span *s = &spans[i];
+		uint32_t s_end = s->x + s->len;
+
+		if (s_end <= x0 || s->x >= x1) {
+			out[n++] = *s;
+			continue;
+		}
+
+		if (s->x < x0)
+			out[n++] = (struct raster_span){ s->x, x0 - s->x, s->color, NULL };
+
+		if (!painted) {
+			out[n++] = (struct raster_span){ x0, x1 - x0, color, NULL };
+			painted = true;
+		}
+
+		if (s_end > x1)
+			out[n++] = (struct raster_span){ x1, s_end - x1, s->color, NULL };
+	}
+
+	/* merge neighbours with the same color so stores stay long */
+	count = 0;
+	for (i = 0; i < n; i++) {
+		if (count && spans[count - 1].color == out[i].color)
+			spans[count - 1].len += out[i].len;
+		else
+			spans[count++] = out[i];
+	}
+
+	return count;
+}
+
+static int _draw(struct modeset_buf *buf, uint32_t background,
+		 const struct raster_rect *rects, unsigned count,
+		 uint32_t x_start, uint32_t x_end, uint32_t y_start, uint32_t y_end)
+{
+	uint32_t edges[RASTER_MAX_RECTS * 2 + 2];
+	unsigned i, j, edges_count = 0;
+
+	if (count > RASTER_MAX_RECTS)
+		return -1;
+
+	if (x_end > buf->width)
+		x_end = buf->width;
+	if (y_end > buf->height)
+		y_end = buf->height;
+	if (x_start >= x_end || y_start >= y_end)
+		return 0;
+
+	edges[edges_count++] = y_start;
+	edges[edges_count++] = y_end;
+	for (i = 0; i < count; i++) {
+		uint32_t r_end = rects[i].y + rects[i].h;
+
+		if (rects[i].y >= y_end || r_end <= y_start)
+			continue;
+		edges[edges_count++] = rects[i].y > y_start ? rects[i].y : y_start;
+		edges[edges_count++] = r_end < y_end ? r_end : y_end;
+	}
+	qsort(edges, edges_count, sizeof(edges[0]), _cmp_uint32);
+
+	for (i = 0; i + 1 < edges_count; i++) {
+		struct raster_span spans[RASTER_MAX_SPANS];
+		uint32_t y, y0 = edges[i], y1 = edges[i + 1];
+		unsigned spans_count;
+
+		if (y0 == y1)
+			continue;
+
+		spans[0] = (struct raster_span){ x_start, x_end - x_start, background, NULL };
+		spans_count = 1;
+
+		for (j = 0; j < count; j++) {
+			const struct raster_rect *r = &rects[j];
+			uint32_t x0, x1;
+
+			if (r->y > y0 || r->y + r->h <= y0)
+				continue;
+
+			x0 = r->x > x_start ? r->x : x_start;
+			x1 = r->x + r->w < x_end ? r->x + r->w : x_end;
+			if (x0 >= x1)
+				continue;
+			spans_count = _spans_paint(spans, spans_count, x0, x1, r->color);
+		}
+
+		/* tiled maps and the other formats are written one span rectangle at a time */
+		if (buf->map_tiled || !format_is_32bpp(buf->format)) {
+			for (j = 0; j < spans_count; j++)
+				fill_rect_rows(buf, spans[j].x, y0, spans[j].len, y1 - y0,
+					       spans[j].color);
+			continue;
+		}
+
+		for (j = 0; j < spans_count; j++) {
+			spans[j].func = fill_span_func_get(buf, spans[j].len);
+			spans[j].color = fill_color_pack(buf, spans[j].color);
+		}
+
+		for (y = y0; y < y1; y++) {
+			uint32_t *line = (uint32_t *)&buf->map[buf->stride * y];
+
+			for (j = 0; j < spans_count; j++)
+				spans[j].func(line + spans[j].x, spans[j].len, spans[j].color);
+		}
+	}
+
+	if (buf->map_wc)
+		fill_flush();
+
+	return 0;
+}
+
+int raster_draw_rows(struct modeset_buf *buf, uint32_t background,
+		     const struct raster_rect *rects, unsigned count,
+		     uint32_t y_start, uint32_t y_end)
+{
+	return _draw(buf, background, rects, count, 0, buf->width, y_start, y_end);
+}
+
+int raster_draw(struct modeset_buf *buf, uint32_t background,
+		const struct raster_rect *rects, unsigned count)
+{
+	damage_add_rect(&buf->dirty, 0, 0, buf->width, buf->height);
+	return raster_draw_rows(buf, background, rects, count, 0, buf->height);
+}
+
+int raster_draw_damage_rows(struct modeset_buf *buf, uint32_t background,
+			    const struct raster_rect *rects, unsigned count,
+			    const struct damage *damage, uint32_t y_start, uint32_t y_end)
+{
+	unsigned i;
+
+	for (i = 0; i < damage->count; i++) {
+		const struct drm_clip_rect *clip = &damage->rects[i];
+		int ret;
+
+		ret = _draw(buf, background, rects, count, clip->x1, clip->x2,
+			    clip->y1 > y_start ? clip->y1 : y_start,
+			    clip->y2 < y_end ? clip->y2 : y_end);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int raster_draw_damage(struct modeset_buf *buf, uint32_t background,
+		       const struct raster_rect *rects, unsigned count,
+		       const struct damage *damage)
+{
+	damage_add(&buf->dirty, damage);
+	return raster_draw_damage_rows(buf, background, rects, count, damage, 0, buf->height);
+}
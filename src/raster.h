@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+#include "damage.h"
+
+#define RASTER_MAX_RECTS 32
+
+/* Axis-aligned rectangle, x and y are inclusive and w and h in pixels */
+struct raster_rect {
+	uint32_t x, y;
+	uint32_t w, h;
+	uint32_t color;
+};
+
+/*
+ * Draw a background color plus count rectangles, the later rectangles are
+ * drawn over the earlier ones. The scene is split in horizontal bands
+ * where no rectangle begins or ends, each band is resolved once into a
+ * list of uniform spans and every row of the band is then written as long
+ * span fills, so every pixel is written exactly once.
+ *
+ * The whole buffer is added to buf->dirty.
+ *
+ * Returns -1 if count is bigger than RASTER_MAX_RECTS.
+ */
+int raster_draw(struct modeset_buf *buf, uint32_t background,
+		const struct raster_rect *rects, unsigned count);
+
+/*
+ * Same as raster_draw() but only rows [y_start, y_end) are written. Meant
+ * to be called from render_pool bands, so nothing is added to buf->dirty.
+ */
+int raster_draw_rows(struct modeset_buf *buf, uint32_t background,
+		     const struct raster_rect *rects, unsigned count,
+		     uint32_t y_start, uint32_t y_end);
+
+/*
+ * Same as raster_draw() but only the pixels covered by damage are written,
+ * overlapping damage rectangles are simply written twice. damage is
+ * added to buf->dirty.
+ */
+int raster_draw_damage(struct modeset_buf *buf, uint32_t background,
+		       const struct raster_rect *rects, unsigned count,
+		       const struct damage *damage);
+
+/* raster_draw_damage() limited to rows [y_start, y_end), for render_pool bands */
+int raster_draw_damage_rows(struct modeset_buf *buf, uint32_t background,
+			    const struct raster_rect *rects, unsigned count,
+			    const struct damage *damage, uint32_t y_start, uint32_t y_end);
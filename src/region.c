@@ -0,0 +1,640 @@
+#include "region.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+#define MIN_CAPACITY 8
+
+struct region_arena_chunk {
+	struct region_arena_chunk *next;
+	size_t size;
+	size_t used;
+	uint8_t data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+enum region_op {
+	REGION_UNION,
+	REGION_INTERSECT,
+	REGION_SUBTRACT,
+};
+
+static inline int32_t _min(int32_t a, int32_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline int32_t _max(int32_t a, int32_t b)
+{
+	return a > b ? a : b;
+}
+
+static struct region_arena_chunk *_chunk_new(size_t size)
+{
+	struct region_arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+
+	if (!chunk)
+		return NULL;
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+int region_arena_init(struct region_arena *arena, size_t size)
+{
+	memset(arena, 0, sizeof(*arena));
+
+	arena->chunks = _chunk_new(size ? size : ARENA_DEFAULT_SIZE);
+	if (!arena->chunks)
+		return -ENOMEM;
+
+	arena->size = arena->chunks->size;
+	return 0;
+}
+
+void region_arena_fini(struct region_arena *arena)
+{
+	while (arena->chunks) {
+		struct region_arena_chunk *chunk = arena->chunks;
+
+		arena->chunks = chunk->next;
+		free(chunk);
+	}
+
+	arena->size = arena->used = 0;
+}
+
+void region_arena_reset(struct region_arena *arena)
+{
+	struct region_arena_chunk *chunk;
+
+	/* the frame needed more than one chunk, next frames get a single big one */
+	if (arena->chunks && arena->chunks->next) {
+		chunk = _chunk_new(arena->size);
+		if (chunk) {
+			region_arena_fini(arena);
+			arena->chunks = chunk;
+			arena->size = chunk->size;
+		}
+	}
+
+	for (chunk = arena->chunks; chunk; chunk = chunk->next)
+		chunk->used = 0;
+	arena->used = 0;
+}
+
+static void *_arena_alloc(struct region_arena *arena, size_t size)
+{
+	struct region_arena_chunk *chunk = arena->chunks;
+	void *ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		size_t chunk_size = chunk ? chunk->size * 2 : ARENA_DEFAULT_SIZE;
+
+		if (chunk_size < size)
+			chunk_size = size;
+
+		chunk = _chunk_new(chunk_size);
+		if (!chunk)
+			return NULL;
+
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		arena->size += chunk_size;
+	}
+
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->used += size;
+	if (arena->used > arena->peak)
+		arena->peak = arena->used;
+
+	return ptr;
+}
+
+static int _reserve(struct region *region, uint32_t count)
+{
+	struct region_box *boxes;
+	uint32_t capacity;
+
+	if (count <= region->capacity)
+		return 0;
+
+	capacity = region->capacity * 2;
+	if (capacity < count)
+		capacity = count;
+	if (capacity < MIN_CAPACITY)
+		capacity = MIN_CAPACITY;
+
+	boxes = _arena_alloc(region->arena, capacity * sizeof(*boxes));
+	if (!boxes)
+		return -ENOMEM;
+
+	if (region->count)
+		memcpy(boxes, region->boxes, region->count * sizeof(*boxes));
+	region->boxes = boxes;
+	region->capacity = capacity;
+	return 0;
+}
+
+static void _extents_update(struct region *region)
+{
+	uint32_t i;
+
+	if (!region->count) {
+		memset(&region->extents, 0, sizeof(region->extents));
+		return;
+	}
+
+	region->extents = region->boxes[0];
+	region->extents.y2 = region->boxes[region->count - 1].y2;
+	for (i = 1; i < region->count; i++) {
+		region->extents.x1 = _min(region->extents.x1, region->boxes[i].x1);
+		region->extents.x2 = _max(region->extents.x2, region->boxes[i].x2);
+	}
+}
+
+void region_init(struct region *region, struct region_arena *arena)
+{
+	memset(region, 0, sizeof(*region));
+	region->arena = arena;
+}
+
+int region_init_rect(struct region *region, struct region_arena *arena,
+		     int32_t x, int32_t y, uint32_t w, uint32_t h)
+{
+	region_init(region, arena);
+
+	if (!w || !h)
+		return 0;
+	if (_reserve(region, 1))
+		return -ENOMEM;
+
+	region->boxes[0] = (struct region_box){ x, y, x + (int32_t)w, y + (int32_t)h };
+	region->count = 1;
+	region->extents = region->boxes[0];
+	return 0;
+}
+
+int region_copy(struct region *dst, const struct region *src)
+{
+	struct region out;
+
+	if (dst == src)
+		return 0;
+
+	region_init(&out, dst->arena);
+	if (_reserve(&out, src->count))
+		return -ENOMEM;
+
+	if (src->count)
+		memcpy(out.boxes, src->boxes, src->count * sizeof(*src->boxes));
+	out.count = src->count;
+	out.extents = src->extents;
+	*dst = out;
+	return 0;
+}
+
+/* Number of boxes of the band starting at box i */
+static uint32_t _band_size(const struct region *region, uint32_t i)
+{
+	uint32_t end = i + 1;
+
+	while (end < region->count && region->boxes[end].y1 == region->boxes[i].y1)
+		end++;
+
+	return end - i;
+}
+
+static bool _bands_same_spans(const struct region_box *a, const struct region_box *b, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		if (a[i].x1 != b[i].x1 || a[i].x2 != b[i].x2)
+			return false;
+	}
+
+	return true;
+}
+
+/* Append [x1, x2) to the band being built, merging with the box it touches */
+static int _span_emit(struct region *out, uint32_t band_start, int32_t x1, int32_t x2,
+		      int32_t y1, int32_t y2)
+{
+	if (out->count > band_start) {
+		struct region_box *last = &out->boxes[out->count - 1];
+
+		if (x1 <= last->x2) {
+			last->x2 = _max(last->x2, x2);
+			return 0;
+		}
+	}
+
+	if (_reserve(out, out->count + 1))
+		return -ENOMEM;
+
+	out->boxes[out->count++] = (struct region_box){ x1, y1, x2, y2 };
+	return 0;
+}
+
+/* Combine the x spans of two bands, either can be empty, into out */
+static int _spans_op(struct region *out, enum region_op op,
+		     const struct region_box *a, uint32_t a_count,
+		     const struct region_box *b, uint32_t b_count, int32_t y1, int32_t y2)
+{
+	uint32_t band_start = out->count, i = 0, j = 0;
+	int ret = 0;
+
+	switch (op) {
+	case REGION_UNION:
+		while (!ret && (i < a_count || j < b_count)) {
+			const struct region_box *box;
+
+			if (j == b_count || (i < a_count && a[i].x1 <= b[j].x1))
+				box = &a[i++];
+			else
+				box = &b[j++];
+			ret = _span_emit(out, band_start, box->x1, box->x2, y1, y2);
+		}
+		break;
+	case REGION_INTERSECT:
+		while (!ret && i < a_count && j < b_count) {
+			int32_t x1 = _max(a[i].x1, b[j].x1), x2 = _min(a[i].x2, b[j].x2);
+
+			if (x1 < x2)
+				ret = _span_emit(out, band_start, x1, x2, y1, y2);
+			if (a[i].x2 < b[j].x2)
+				i++;
+			else
+				j++;
+		}
+		break;
+	case REGION_SUBTRACT:
+		for (i = 0; !ret && i < a_count; i++) {
+			int32_t x = a[i].x1;
+
+			while (j < b_count && b[j].x2 <= x)
+				j++;
+
+			for (; !ret && j < b_count && b[j].x1 < a[i].x2; j++) {
+				if (b[j].x1 > x)
+					ret = _span_emit(out, band_start, x, b[j].x1, y1, y2);
+				x = _max(x, b[j].x2);
+				/* b[j] may cover the next span of a too */
+				if (b[j].x2 >= a[i].x2)
+					break;
+			}
+
+			if (!ret && x < a[i].x2)
+				ret = _span_emit(out, band_start, x, a[i].x2, y1, y2);
+		}
+		break;
+	}
+
+	return ret;
+}
+
+/*
+ * Walk both regions top to bottom in slices where the bands of a and b
+ * don't change, combine the spans of each slice and coalesce the result
+ * with the slice above when both have the same spans.
+ */
+static int _region_op(struct region *dst, const struct region *a, const struct region *b,
+		      enum region_op op)
+{
+	uint32_t ia = 0, ib = 0, prev_band = 0;
+	bool has_prev = false;
+	struct region out;
+	int32_t y = INT32_MIN;
+
+	region_init(&out, dst->arena);
+	/* usually enough, saves growing the box array a few times */
+	if (_reserve(&out, a->count + b->count))
+		return -ENOMEM;
+
+	while (ia < a->count || ib < b->count) {
+		uint32_t a_size = 0, b_size = 0, band_start;
+		bool a_on = false, b_on = false;
+		int32_t top = INT32_MAX, bottom = INT32_MAX;
+
+		if (ia < a->count) {
+			a_size = _band_size(a, ia);
+			top = _max(y, a->boxes[ia].y1);
+		}
+		if (ib < b->count) {
+			b_size = _band_size(b, ib);
+			top = _min(top, _max(y, b->boxes[ib].y1));
+		}
+
+		if (ia < a->count) {
+			a_on = a->boxes[ia].y1 <= top;
+			bottom = a_on ? a->boxes[ia].y2 : a->boxes[ia].y1;
+		}
+		if (ib < b->count) {
+			b_on = b->boxes[ib].y1 <= top;
+			bottom = _min(bottom, b_on ? b->boxes[ib].y2 : b->boxes[ib].y1);
+		}
+
+		band_start = out.count;
+		if (_spans_op(&out, op, a_on ? &a->boxes[ia] : NULL, a_on ? a_size : 0,
+			      b_on ? &b->boxes[ib] : NULL, b_on ? b_size : 0, top, bottom))
+			return -ENOMEM;
+
+		if (out.count > band_start) {
+			uint32_t size = out.count - band_start;
+
+			if (has_prev && out.boxes[prev_band].y2 == top &&
+			    band_start - prev_band == size &&
+			    _bands_same_spans(&out.boxes[prev_band], &out.boxes[band_start], size)) {
+				uint32_t i;
+
+				for (i = prev_band; i < band_start; i++)
+					out.boxes[i].y2 = bottom;
+				out.count = band_start;
+			} else {
+				prev_band = band_start;
+				has_prev = true;
+			}
+		}
+
+		y = bottom;
+		if (ia < a->count && a->boxes[ia].y2 <= y)
+			ia += a_size;
+		if (ib < b->count && b->boxes[ib].y2 <= y)
+			ib += b_size;
+
+		/* nothing left that could produce boxes */
+		if ((op == REGION_INTERSECT && (ia == a->count || ib == b->count)) ||
+		    (op == REGION_SUBTRACT && ia == a->count))
+			break;
+	}
+
+	_extents_update(&out);
+	*dst = out;
+	return 0;
+}
+
+static bool _extents_overlap(const struct region_box *a, const struct region_box *b)
+{
+	return a->x1 < b->x2 && b->x1 < a->x2 && a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+int region_union(struct region *dst, const struct region *a, const struct region *b)
+{
+	if (!b->count)
+		return region_copy(dst, a);
+	if (!a->count)
+		return region_copy(dst, b);
+
+	return _region_op(dst, a, b, REGION_UNION);
+}
+
+int region_union_rect(struct region *dst, const struct region *src,
+		      int32_t x, int32_t y, uint32_t w, uint32_t h)
+{
+	struct region rect;
+	struct region_box box = { x, y, x + (int32_t)w, y + (int32_t)h };
+
+	if (!w || !h)
+		return region_copy(dst, src);
+
+	/* single box, no need for a region op */
+	rect.arena = dst->arena;
+	rect.extents = box;
+	rect.count = rect.capacity = 1;
+	rect.boxes = &box;
+
+	return region_union(dst, src, &rect);
+}
+
+int region_init_boxes(struct region *region, struct region_arena *arena,
+		      const struct region_box *boxes, uint32_t count)
+{
+	struct region a, b;
+	uint32_t half = count / 2;
+
+	if (count <= 1) {
+		if (!count || boxes->x1 >= boxes->x2 || boxes->y1 >= boxes->y2) {
+			region_init(region, arena);
+			return 0;
+		}
+
+		return region_init_rect(region, arena, boxes->x1, boxes->y1,
+					boxes->x2 - boxes->x1, boxes->y2 - boxes->y1);
+	}
+
+	/* union the two halves, log(count) passes over the boxes */
+	if (region_init_boxes(&a, arena, boxes, half) ||
+	    region_init_boxes(&b, arena, boxes + half, count - half))
+		return -ENOMEM;
+
+	region_init(region, arena);
+	return region_union(region, &a, &b);
+}
+
+int region_intersect(struct region *dst, const struct region *a, const struct region *b)
+{
+	if (!a->count || !b->count || !_extents_overlap(&a->extents, &b->extents)) {
+		region_init(dst, dst->arena);
+		return 0;
+	}
+
+	return _region_op(dst, a, b, REGION_INTERSECT);
+}
+
+int region_subtract(struct region *dst, const struct region *a, const struct region *b)
+{
+	if (!a->count || !b->count || !_extents_overlap(&a->extents, &b->extents))
+		return region_copy(dst, a);
+
+	return _region_op(dst, a, b, REGION_SUBTRACT);
+}
+
+void region_translate(struct region *region, int32_t dx, int32_t dy)
+{
+	uint32_t i;
+
+	for (i = 0; i < region->count; i++) {
+		region->boxes[i].x1 += dx;
+		region->boxes[i].x2 += dx;
+		region->boxes[i].y1 += dy;
+		region->boxes[i].y2 += dy;
+	}
+
+	if (region->count) {
+		region->extents.x1 += dx;
+		region->extents.x2 += dx;
+		region->extents.y1 += dy;
+		region->extents.y2 += dy;
+	}
+}
+
+/* Merge touching bands with the same spans, in place */
+static void _coalesce(struct region *region)
+{
+	uint32_t i = 0, count = 0, prev = 0;
+	bool has_prev = false;
+
+	while (i < region->count) {
+		uint32_t size = _band_size(region, i);
+
+		if (has_prev && region->boxes[prev].y2 == region->boxes[i].y1 &&
+		    count - prev == size &&
+		    _bands_same_spans(&region->boxes[prev], &region->boxes[i], size)) {
+			uint32_t j;
+
+			for (j = prev; j < count; j++)
+				region->boxes[j].y2 = region->boxes[i].y2;
+		} else {
+			memmove(&region->boxes[count], &region->boxes[i], size * sizeof(*region->boxes));
+			prev = count;
+			count += size;
+			has_prev = true;
+		}
+		i += size;
+	}
+
+	region->count = count;
+}
+
+struct _gap {
+	uint64_t cost;
+	uint32_t box;
+};
+
+static int _cmp_gap(const void *a, const void *b)
+{
+	const struct _gap *ga = a, *gb = b;
+
+	return ga->cost < gb->cost ? -1 : ga->cost > gb->cost;
+}
+
+static uint64_t _box_area(const struct region_box *box)
+{
+	return (uint64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+int region_simplify(struct region *region, uint32_t max_rects)
+{
+	struct _gap *gaps;
+	uint8_t *close;
+	uint32_t i, gaps_count = 0, merges, count;
+
+	if (!max_rects)
+		max_rects = 1;
+	if (region->count <= max_rects)
+		return 0;
+
+	/* fill the cheapest gaps between the boxes of a band */
+	gaps = _arena_alloc(region->arena, region->count * sizeof(*gaps));
+	close = _arena_alloc(region->arena, region->count);
+	if (!gaps || !close)
+		return -ENOMEM;
+
+	for (i = 0; i + 1 < region->count; i++) {
+		const struct region_box *box = &region->boxes[i], *next = box + 1;
+
+		close[i] = 0;
+		if (next->y1 != box->y1)
+			continue;
+		gaps[gaps_count++] = (struct _gap){
+			(uint64_t)(next->x1 - box->x2) * (box->y2 - box->y1), i
+		};
+	}
+	close[region->count - 1] = 0;
+
+	merges = region->count - max_rects;
+	if (merges > gaps_count)
+		merges = gaps_count;
+	qsort(gaps, gaps_count, sizeof(*gaps), _cmp_gap);
+	for (i = 0; i < merges; i++)
+		close[gaps[i].box] = 1;
+
+	count = 0;
+	for (i = 0; i < region->count; i++) {
+		if (count && close[i - 1])
+			region->boxes[count - 1].x2 = region->boxes[i].x2;
+		else
+			region->boxes[count++] = region->boxes[i];
+	}
+	region->count = count;
+	_coalesce(region);
+
+	/* every band is a single box now, merge the cheapest neighbour bands */
+	while (region->count > max_rects) {
+		uint64_t best_cost = UINT64_MAX;
+		uint32_t best = 0;
+
+		for (i = 0; i + 1 < region->count; i++) {
+			const struct region_box *box = &region->boxes[i], *next = box + 1;
+			struct region_box merged = {
+				_min(box->x1, next->x1), box->y1, _max(box->x2, next->x2), next->y2
+			};
+			uint64_t cost = _box_area(&merged) - _box_area(box) - _box_area(next);
+
+			if (cost < best_cost) {
+				best_cost = cost;
+				best = i;
+			}
+		}
+
+		region->boxes[best].x1 = _min(region->boxes[best].x1, region->boxes[best + 1].x1);
+		region->boxes[best].x2 = _max(region->boxes[best].x2, region->boxes[best + 1].x2);
+		region->boxes[best].y2 = region->boxes[best + 1].y2;
+		memmove(&region->boxes[best + 1], &region->boxes[best + 2],
+			(region->count - best - 2) * sizeof(*region->boxes));
+		region->count--;
+		_coalesce(region);
+	}
+
+	_extents_update(region);
+	return 0;
+}
+
+uint64_t region_area(const struct region *region)
+{
+	uint64_t area = 0;
+	uint32_t i;
+
+	for (i = 0; i < region->count; i++)
+		area += _box_area(&region->boxes[i]);
+
+	return area;
+}
+
+bool region_contains_point(const struct region *region, int32_t x, int32_t y)
+{
+	uint32_t i;
+
+	if (!region->count || x < region->extents.x1 || x >= region->extents.x2 ||
+	    y < region->extents.y1 || y >= region->extents.y2)
+		return false;
+
+	for (i = 0; i < region->count; i++) {
+		const struct region_box *box = &region->boxes[i];
+
+		if (box->y1 > y)
+			break;
+		if (y < box->y2 && x >= box->x1 && x < box->x2)
+			return true;
+	}
+
+	return false;
+}
+
+bool region_equal(const struct region *a, const struct region *b)
+{
+	if (a->count != b->count)
+		return false;
+	if (!a->count)
+		return true;
+
+	return !memcmp(a->boxes, b->boxes, a->count * sizeof(*a->boxes));
+}
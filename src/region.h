@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Pixel regions stored the way pixman does it: non overlapping boxes in
+ * y-x bands. The boxes of a band share the same y1 and y2, are sorted by
+ * x and never touch, and two bands that touch vertically always have
+ * different x spans, otherwise they are coalesced into one. Every region
+ * has a single representation, so equal regions have equal box lists.
+ *
+ * Boxes are allocated from a region_arena. A frame builds and combines
+ * its regions and then drops all of them at once with
+ * region_arena_reset(). After the first few frames the arena is big
+ * enough and no more malloc() is done.
+ *
+ * The functions returning int return -ENOMEM if the arena can't grow,
+ * dst is then left untouched.
+ */
+
+struct region_box {
+	int32_t x1, y1;
+	/* x2 and y2 are exclusive */
+	int32_t x2, y2;
+};
+
+struct region_arena_chunk;
+
+struct region_arena {
+	struct region_arena_chunk *chunks;
+	/* bytes of all chunks */
+	size_t size;
+	/* bytes handed out since the last reset */
+	size_t used;
+	/* most bytes handed out between two resets */
+	size_t peak;
+};
+
+struct region {
+	struct region_arena *arena;
+	struct region_box extents;
+	uint32_t count;
+	uint32_t capacity;
+	struct region_box *boxes;
+};
+
+/* size is the initial arena size in bytes, 0 picks a default */
+int region_arena_init(struct region_arena *arena, size_t size);
+void region_arena_fini(struct region_arena *arena);
+/* Drop every region allocated from arena, they must be initialized again */
+void region_arena_reset(struct region_arena *arena);
+
+void region_init(struct region *region, struct region_arena *arena);
+int region_init_rect(struct region *region, struct region_arena *arena,
+		     int32_t x, int32_t y, uint32_t w, uint32_t h);
+/* Union of count boxes in any order, they can overlap */
+int region_init_boxes(struct region *region, struct region_arena *arena,
+		      const struct region_box *boxes, uint32_t count);
+int region_copy(struct region *dst, const struct region *src);
+
+/*
+ * dst must be initialized, it can be the same region as a or b. Adding
+ * many rectangles one by one with region_union_rect() uses arena memory
+ * quadratic in the number of boxes, use region_init_boxes() instead.
+ */
+int region_union(struct region *dst, const struct region *a, const struct region *b);
+int region_union_rect(struct region *dst, const struct region *src,
+		      int32_t x, int32_t y, uint32_t w, uint32_t h);
+int region_intersect(struct region *dst, const struct region *a, const struct region *b);
+/* dst = a - b */
+int region_subtract(struct region *dst, const struct region *a, const struct region *b);
+
+void region_translate(struct region *region, int32_t dx, int32_t dy);
+
+/*
+ * Replace region by at most max_rects boxes covering it: first the
+ * cheapest gaps inside bands are filled, then the cheapest neighbour
+ * bands are merged. The result covers region and some more pixels.
+ */
+int region_simplify(struct region *region, uint32_t max_rects);
+
+static inline bool region_empty(const struct region *region)
+{
+	return !region->count;
+}
+
+/* Bounding box, all zeros for an empty region */
+static inline const struct region_box *region_extents(const struct region *region)
+{
+	return &region->extents;
+}
+
+uint64_t region_area(const struct region *region);
+bool region_contains_point(const struct region *region, int32_t x, int32_t y);
+bool region_equal(const struct region *a, const struct region *b);
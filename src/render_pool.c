@@ -0,0 +1,294 @@
+#include "render_pool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tiling.h"
+
+/* bands per thread, more bands balance better but cost more locking */
+#define BANDS_PER_THREAD 8
+#define MIN_BAND_HEIGHT 8
+
+struct render_queue {
+	pthread_mutex_t lock;
+	/* bands [head, tail) are still to be rendered */
+	uint32_t head, tail;
+};
+
+struct render_worker {
+	struct render_pool *pool;
+	pthread_t thread;
+	unsigned index;
+	struct render_queue queue;
+};
+
+struct render_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+	uint64_t generation;
+	bool busy;
+	bool quit;
+
+	unsigned threads;
+	struct render_worker *workers;
+
+	/* frame being rendered */
+	struct modeset_buf *buf;
+	render_band_func func;
+	void *data;
+	uint32_t band_height;
+	uint32_t bands_left;
+};
+
+static bool _queue_pop(struct render_queue *queue, bool front, uint32_t *band)
+{
+	bool ret = false;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) {
+		*band = front ? queue->head++ : --queue->tail;
+		ret = true;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return ret;
+}
+
+static bool _band_get(struct render_worker *worker, uint32_t *band)
+{
+	struct render_pool *pool = worker->pool;
+
+	if (_queue_pop(&worker->queue, true, band))
+		return true;
+
+	for (;;) {
+		struct render_queue *victim = NULL;
+		uint32_t most = 0;
+		unsigned i;
+
+		/* unlocked peek, only used to pick who to steal from */
+		for (i = 0; i < pool->threads; i++) {
+			struct render_queue *queue = &pool->workers[i].queue;
+			uint32_t left = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED) -
+					__atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+
+			if (i != worker->index && (int32_t)left > (int32_t)most) {
+				most = left;
+				victim = queue;
+			}
+		}
+
+		if (!victim)
+			return false;
+		if (_queue_pop(victim, false, band))
+			return true;
+	}
+}
+
+static void *_worker_main(void *data)
+{
+	struct render_worker *worker = data;
+	struct render_pool *pool = worker->pool;
+	uint64_t generation = 0;
+
+	for (;;) {
+		uint32_t band;
+
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->quit && pool->generation == generation)
+			pthread_cond_wait(&pool->start_cond, &pool->lock);
+		generation = pool->generation;
+		if (pool->quit) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		while (_band_get(worker, &band)) {
+			struct modeset_buf *buf = pool->buf;
+			uint32_t y_start = band * pool->band_height;
+			uint32_t y_end = y_start + pool->band_height;
+
+			if (y_end > buf->height)
+				y_end = buf->height;
+			pool->func(buf, y_start, y_end, pool->data);
+
+			if (__atomic_sub_fetch(&pool->bands_left, 1, __ATOMIC_ACQ_REL) == 0) {
+				pthread_mutex_lock(&pool->lock);
+				pool->busy = false;
+				pthread_cond_broadcast(&pool->done_cond);
+				pthread_mutex_unlock(&pool->lock);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+struct render_pool *render_pool_create(unsigned threads)
+{
+	struct render_pool *pool;
+	unsigned i;
+
+	if (!threads) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		threads = cpus > 0 ? cpus : 1;
+	}
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->workers = calloc(threads, sizeof(*pool->workers));
+	if (!pool->workers) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	for (i = 0; i < threads; i++) {
+		struct render_worker *worker = &pool->workers[i];
+
+		worker->pool = pool;
+		worker->index = i;
+		pthread_mutex_init(&worker->queue.lock, NULL);
+
+		if (pthread_create(&worker->thread, NULL, _worker_main, worker)) {
+			fprintf(stderr, "cannot create render thread %u (%d): %m\n", i, errno);
+			break;
+		}
+		pool->threads++;
+	}
+
+	if (!pool->threads) {
+		render_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void render_pool_destroy(struct render_pool *pool)
+{
+	unsigned i;
+
+	if (!pool)
+		return;
+
+	render_pool_wait(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->threads; i++) {
+		pthread_join(pool->workers[i].thread, NULL);
+		pthread_mutex_destroy(&pool->workers[i].queue.lock);
+	}
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->start_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+unsigned render_pool_threads(struct render_pool *pool)
+{
+	return pool->threads;
+}
+
+static uint32_t _band_height(struct render_pool *pool, struct modeset_buf *buf)
+{
+	uint32_t tile_width, tile_height, height;
+
+	height = buf->height / (pool->threads * BANDS_PER_THREAD);
+	if (height < MIN_BAND_HEIGHT)
+		height = MIN_BAND_HEIGHT;
+
+	/* don't let two threads write the same tile row */
+	if (!tiling_tile_size(buf->modifier, &tile_width, &tile_height))
+		height = (height + tile_height - 1) / tile_height * tile_height;
+
+	return height;
+}
+
+void render_pool_frame_async(struct render_pool *pool, struct modeset_buf *buf,
+			     render_band_func func, void *data)
+{
+	uint32_t bands, per_worker, remainder;
+	unsigned i;
+
+	render_pool_wait(pool);
+
+	if (!buf->height)
+		return;
+
+	/*
+	 * Busy before the queues are filled, a worker still looking for work
+	 * from the last frame may pick up and finish the new bands right away.
+	 */
+	pthread_mutex_lock(&pool->lock);
+	pool->busy = true;
+	pthread_mutex_unlock(&pool->lock);
+
+	pool->buf = buf;
+	pool->func = func;
+	pool->data = data;
+	pool->band_height = _band_height(pool, buf);
+	bands = (buf->height + pool->band_height - 1) / pool->band_height;
+	__atomic_store_n(&pool->bands_left, bands, __ATOMIC_RELEASE);
+
+	/* contiguous bands per worker, the remainder goes to the first ones */
+	per_worker = bands / pool->threads;
+	remainder = bands % pool->threads;
+	for (i = 0; i < pool->threads; i++) {
+		struct render_queue *queue = &pool->workers[i].queue;
+		uint32_t head = i * per_worker + (i < remainder ? i : remainder);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->head = head;
+		queue->tail = head + per_worker + (i < remainder);
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void render_pool_wait(struct render_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+bool render_pool_busy(struct render_pool *pool)
+{
+	bool busy;
+
+	pthread_mutex_lock(&pool->lock);
+	busy = pool->busy;
+	pthread_mutex_unlock(&pool->lock);
+
+	return busy;
+}
+
+void render_pool_frame(struct render_pool *pool, struct modeset_buf *buf,
+		       render_band_func func, void *data)
+{
+	render_pool_frame_async(pool, buf, func, data);
+	render_pool_wait(pool);
+}
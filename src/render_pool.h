@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Persistent pool of threads rendering a frame in row bands.
+ *
+ * The frame is cut in bands of rows, aligned to the tile height when the
+ * buffer is tiled, and the bands are dealt out to per-worker queues. A
+ * worker takes bands from the front of its own queue and, once it is
+ * empty, steals from the back of the busiest other queue, so frames with
+ * uneven content still keep every thread busy.
+ */
+
+struct render_pool;
+
+/* Render rows [y_start, y_end) of buf, called from the worker threads */
+typedef void (*render_band_func)(struct modeset_buf *buf, uint32_t y_start, uint32_t y_end,
+				 void *data);
+
+/* threads = 0 uses one thread per online CPU */
+struct render_pool *render_pool_create(unsigned threads);
+void render_pool_destroy(struct render_pool *pool);
+unsigned render_pool_threads(struct render_pool *pool);
+
+/* Render a frame and return once every band is done */
+void render_pool_frame(struct render_pool *pool, struct modeset_buf *buf,
+		       render_band_func func, void *data);
+
+/*
+ * Start rendering a frame and return right away, waits for the previous
+ * frame if it is still rendering. render_pool_wait() blocks until it is
+ * done and render_pool_busy() polls.
+ */
+void render_pool_frame_async(struct render_pool *pool, struct modeset_buf *buf,
+			     render_band_func func, void *data);
+void render_pool_wait(struct render_pool *pool);
+bool render_pool_busy(struct render_pool *pool);
@@ -0,0 +1,304 @@
+#include "scene_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "fill.h"
+#include "tiling.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/* scanout framebuffer from the ops, or system memory copy source */
+enum scene_entry_kind {
+	SCENE_ENTRY_FB,
+	SCENE_ENTRY_SHADOW,
+};
+
+struct scene_entry {
+	struct scene_entry *prev, *next;
+	struct scene scene;
+	enum scene_entry_kind kind;
+	uint64_t hash;
+	unsigned pins;
+	struct modeset_buf buf;
+};
+
+struct scene_cache {
+	size_t budget;
+	const struct scene_buffer_ops *ops;
+	void *data;
+
+	/* most recently used first */
+	struct scene_entry *head, *tail;
+	struct scene_cache_stats stats;
+};
+
+void scene_init(struct scene *scene, uint32_t width, uint32_t height, uint32_t format,
+		uint64_t modifier, uint32_t background)
+{
+	memset(scene, 0, sizeof(*scene));
+	scene->width = width;
+	scene->height = height;
+	scene->format = format;
+	scene->modifier = modifier;
+	scene->background = background;
+}
+
+int scene_add_rect(struct scene *scene, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+		   uint32_t color)
+{
+	if (scene->count == SCENE_MAX_RECTS)
+		return -1;
+
+	scene->rects[scene->count++] = (struct raster_rect){ x, y, w, h, color };
+	return 0;
+}
+
+static uint64_t _hash(const struct scene *scene, enum scene_entry_kind kind)
+{
+	const uint8_t *bytes = (const uint8_t *)scene;
+	uint64_t hash = FNV_OFFSET ^ kind;
+	size_t i;
+
+	for (i = 0; i < sizeof(*scene); i++)
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+
+	return hash;
+}
+
+static void _list_unlink(struct scene_cache *cache, struct scene_entry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache->head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+	entry->prev = entry->next = NULL;
+}
+
+static void _list_push_front(struct scene_cache *cache, struct scene_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if (cache->head)
+		cache->head->prev = entry;
+	else
+		cache->tail = entry;
+	cache->head = entry;
+}
+
+static void _entry_free(struct scene_cache *cache, struct scene_entry *entry)
+{
+	_list_unlink(cache, entry);
+	cache->stats.bytes -= entry->buf.size;
+	cache->stats.entries--;
+
+	if (entry->kind == SCENE_ENTRY_FB)
+		cache->ops->free(cache->data, &entry->buf);
+	else
+		free(entry->buf.map);
+	free(entry);
+}
+
+/* Make room for size more bytes, the least recently used unpinned entries go first */
+static void _evict(struct scene_cache *cache, size_t size)
+{
+	struct scene_entry *entry = cache->tail;
+
+	while (entry && cache->stats.bytes + size > cache->budget) {
+		struct scene_entry *prev = entry->prev;
+
+		if (!entry->pins) {
+			_entry_free(cache, entry);
+			cache->stats.evictions++;
+		}
+		entry = prev;
+	}
+}
+
+static struct scene_entry *_lookup(struct scene_cache *cache, const struct scene *scene,
+				   enum scene_entry_kind kind)
+{
+	uint64_t hash = _hash(scene, kind);
+	struct scene_entry *entry;
+
+	for (entry = cache->head; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->kind == kind &&
+		    !memcmp(&entry->scene, scene, sizeof(*scene))) {
+			_list_unlink(cache, entry);
+			_list_push_front(cache, entry);
+			cache->stats.hits++;
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static int _shadow_alloc(struct modeset_buf *buf, uint32_t width, uint32_t height)
+{
+	memset(buf, 0, sizeof(*buf));
+	buf->width = width;
+	buf->height = height;
+	/* 64 bytes aligned rows for the span kernels */
+	buf->stride = (width * 4 + 63) & ~63u;
+	buf->size = buf->stride * height;
+	buf->format = DRM_FORMAT_XRGB8888;
+	buf->modifier = DRM_FORMAT_MOD_LINEAR;
+	buf->map = aligned_alloc(64, buf->size);
+
+	return buf->map ? 0 : -ENOMEM;
+}
+
+static struct scene_entry *_insert(struct scene_cache *cache, const struct scene *scene,
+				   enum scene_entry_kind kind)
+{
+	struct scene_entry *entry;
+	int ret;
+
+	if (scene->format != DRM_FORMAT_XRGB8888 && scene->format != DRM_FORMAT_ARGB8888) {
+		fprintf(stderr, "scene cache: format %.4s not supported\n",
+			(const char *)&scene->format);
+		return NULL;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	entry->scene = *scene;
+	entry->kind = kind;
+	entry->hash = _hash(scene, kind);
+
+	/* 4 bytes per pixel is close enough for the tile padding */
+	_evict(cache, (size_t)scene->width * scene->height * 4);
+
+	if (kind == SCENE_ENTRY_FB)
+		ret = cache->ops->alloc(cache->data, &entry->buf, scene->width, scene->height,
+					scene->format, scene->modifier);
+	else
+		ret = _shadow_alloc(&entry->buf, scene->width, scene->height);
+	if (ret) {
+		free(entry);
+		return NULL;
+	}
+
+	raster_draw(&entry->buf, scene->background, scene->rects, scene->count);
+	damage_clear(&entry->buf.dirty);
+	fill_writeback(&entry->buf, NULL);
+
+	_list_push_front(cache, entry);
+	cache->stats.bytes += entry->buf.size;
+	cache->stats.entries++;
+	cache->stats.misses++;
+
+	return entry;
+}
+
+struct scene_cache *scene_cache_create(size_t budget, const struct scene_buffer_ops *ops,
+				       void *data)
+{
+	struct scene_cache *cache = calloc(1, sizeof(*cache));
+
+	if (!cache)
+		return NULL;
+
+	cache->budget = budget;
+	cache->ops = ops;
+	cache->data = data;
+	return cache;
+}
+
+void scene_cache_destroy(struct scene_cache *cache)
+{
+	if (!cache)
+		return;
+
+	while (cache->head)
+		_entry_free(cache, cache->head);
+	free(cache);
+}
+
+struct modeset_buf *scene_cache_get(struct scene_cache *cache, const struct scene *scene)
+{
+	struct scene_entry *entry = _lookup(cache, scene, SCENE_ENTRY_FB);
+
+	if (!entry)
+		entry = _insert(cache, scene, SCENE_ENTRY_FB);
+	if (!entry)
+		return NULL;
+
+	entry->pins++;
+	return &entry->buf;
+}
+
+void scene_cache_put(struct scene_cache *cache UNUSED, struct modeset_buf *buf)
+{
+	struct scene_entry *entry;
+
+	if (!buf)
+		return;
+
+	entry = (struct scene_entry *)((uint8_t *)buf - offsetof(struct scene_entry, buf));
+	if (entry->pins)
+		entry->pins--;
+}
+
+/* The shadow is XRGB8888, an ARGB8888 scene only differs in the unused byte */
+static bool _same_layout(uint32_t format, uint32_t scene_format)
+{
+	if (format == DRM_FORMAT_ARGB8888)
+		format = DRM_FORMAT_XRGB8888;
+	if (scene_format == DRM_FORMAT_ARGB8888)
+		scene_format = DRM_FORMAT_XRGB8888;
+
+	return format == scene_format;
+}
+
+int scene_cache_copy(struct scene_cache *cache, const struct scene *scene,
+		     struct modeset_buf *dst)
+{
+	struct scene_entry *entry;
+	struct modeset_buf *src;
+	uint32_t y;
+
+	if (dst->width != scene->width || dst->height != scene->height ||
+	    !_same_layout(dst->format, scene->format))
+		return -EINVAL;
+
+	entry = _lookup(cache, scene, SCENE_ENTRY_SHADOW);
+	if (!entry)
+		entry = _insert(cache, scene, SCENE_ENTRY_SHADOW);
+	if (!entry)
+		return -ENOMEM;
+	src = &entry->buf;
+
+	if (dst->map_tiled) {
+		if (tiling_linear_to_tiled(dst->modifier, dst->map, dst->stride, src->map,
+					   src->stride, src->width * 4, src->height))
+			return -EINVAL;
+	} else if (dst->stride == src->stride) {
+		memcpy(dst->map, src->map, (size_t)src->stride * src->height);
+	} else {
+		for (y = 0; y < src->height; y++)
+			memcpy(&dst->map[dst->stride * y], &src->map[src->stride * y],
+			       src->width * 4);
+	}
+
+	fill_writeback(dst, NULL);
+	damage_add_rect(&dst->dirty, 0, 0, dst->width, dst->height);
+	return 0;
+}
+
+void scene_cache_stats_get(struct scene_cache *cache, struct scene_cache_stats *stats)
+{
+	*stats = cache->stats;
+}
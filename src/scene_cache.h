@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "raster.h"
+
+/*
+ * Cache of rendered static frames.
+ *
+ * A scene is a background color plus up to SCENE_MAX_RECTS rectangles
+ * drawn in order, for a given size, format and modifier. The scene struct
+ * itself is the cache key. The first request for a scene renders it, the
+ * next ones cost either nothing (scene_cache_get(), the framebuffer is
+ * reused as is and only needs to be flipped to) or one bulk copy
+ * (scene_cache_copy()).
+ *
+ * The least recently used scenes are freed when the budget is exceeded,
+ * pinned scenes are never freed and may push the cache over its budget.
+ */
+
+#define SCENE_MAX_RECTS 8
+
+struct scene {
+	uint32_t width, height;
+	uint32_t format;
+	uint64_t modifier;
+	uint32_t background;
+	uint32_t count;
+	struct raster_rect rects[SCENE_MAX_RECTS];
+};
+
+/* Scenes must be set up with scene_init(), unused bytes are part of the key */
+void scene_init(struct scene *scene, uint32_t width, uint32_t height, uint32_t format,
+		uint64_t modifier, uint32_t background);
+/* Returns -1 when the scene is full */
+int scene_add_rect(struct scene *scene, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+		   uint32_t color);
+
+/* Allocation of the framebuffers scene_cache_get() hands out */
+struct scene_buffer_ops {
+	int (*alloc)(void *data, struct modeset_buf *buf, uint32_t width, uint32_t height,
+		     uint32_t format, uint64_t modifier);
+	void (*free)(void *data, struct modeset_buf *buf);
+};
+
+struct scene_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t bytes;
+	unsigned entries;
+};
+
+struct scene_cache;
+
+struct scene_cache *scene_cache_create(size_t budget, const struct scene_buffer_ops *ops,
+				       void *data);
+void scene_cache_destroy(struct scene_cache *cache);
+
+/*
+ * Framebuffer with scene rendered in it, pinned until scene_cache_put().
+ * Keep it pinned while it is on screen. Returns NULL if the buffer can't
+ * be allocated.
+ */
+struct modeset_buf *scene_cache_get(struct scene_cache *cache, const struct scene *scene);
+void scene_cache_put(struct scene_cache *cache, struct modeset_buf *buf);
+
+/*
+ * Write scene into dst, which must have the size and format of the scene,
+ * XRGB8888 and ARGB8888 count as the same. Returns -EINVAL otherwise. The
+ * scene is kept rendered in system memory, so a hit is one bulk copy
+ * instead of uncached reads from a framebuffer.
+ */
+int scene_cache_copy(struct scene_cache *cache, const struct scene *scene,
+		     struct modeset_buf *dst);
+
+void scene_cache_stats_get(struct scene_cache *cache, struct scene_cache_stats *stats);
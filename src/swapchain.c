@@ -0,0 +1,264 @@
+#include "swapchain.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fill.h"
+#include "scene_cache.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+struct swapchain {
+	unsigned depth;
+	struct modeset_buf buffers[SWAPCHAIN_MAX_DEPTH];
+	enum swapchain_state states[SWAPCHAIN_MAX_DEPTH];
+	unsigned front;
+	/* where swapchain_acquire() starts looking */
+	unsigned next;
+
+	enum swapchain_init init;
+	/* never acquired yet, swapchain_acquire() has to clear or wait */
+	bool pending[SWAPCHAIN_MAX_DEPTH];
+
+	/* SWAPCHAIN_INIT_BACKGROUND, lock protects cleared and stats */
+	bool cleared[SWAPCHAIN_MAX_DEPTH];
+	pthread_t thread;
+	bool thread_running;
+	bool quit;
+	pthread_mutex_t lock;
+	pthread_cond_t cleared_cond;
+
+	struct swapchain_stats stats;
+
+	const struct scene_buffer_ops *ops;
+	void *data;
+};
+
+static uint64_t _now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static unsigned _index(const struct swapchain *swapchain, const struct modeset_buf *buf)
+{
+	return buf - swapchain->buffers;
+}
+
+/* Returns the time it took */
+static uint64_t _clear(struct swapchain *swapchain, unsigned index)
+{
+	uint64_t start = _now_ns();
+
+	fill_clear(&swapchain->buffers[index], SWAPCHAIN_CLEAR);
+	return _now_ns() - start;
+}
+
+/* Back buffers in ring order, the order swapchain_acquire() wants them */
+static void *_clear_main(void *data)
+{
+	struct swapchain *swapchain = data;
+	unsigned i;
+
+	for (i = 1; i < swapchain->depth; i++) {
+		uint64_t elapsed;
+		bool quit;
+
+		pthread_mutex_lock(&swapchain->lock);
+		quit = swapchain->quit;
+		pthread_mutex_unlock(&swapchain->lock);
+		if (quit)
+			break;
+
+		/* swapchain_acquire() waits for it, nothing else touches the buffer */
+		elapsed = _clear(swapchain, i);
+
+		pthread_mutex_lock(&swapchain->lock);
+		swapchain->cleared[i] = true;
+		swapchain->stats.background_ns += elapsed;
+		swapchain->stats.cleared++;
+		pthread_cond_broadcast(&swapchain->cleared_cond);
+		pthread_mutex_unlock(&swapchain->lock);
+	}
+
+	return NULL;
+}
+
+struct swapchain *swapchain_create(unsigned depth, uint32_t width, uint32_t height,
+				   uint32_t format, uint64_t modifier, enum swapchain_init init,
+				   const struct scene_buffer_ops *ops, void *data)
+{
+	struct swapchain *swapchain;
+	uint64_t start;
+	unsigned i;
+
+	if (!depth || depth > SWAPCHAIN_MAX_DEPTH)
+		return NULL;
+
+	swapchain = calloc(1, sizeof(*swapchain));
+	if (!swapchain)
+		return NULL;
+
+	pthread_mutex_init(&swapchain->lock, NULL);
+	pthread_cond_init(&swapchain->cleared_cond, NULL);
+	swapchain->init = init;
+	swapchain->ops = ops;
+	swapchain->data = data;
+
+	start = _now_ns();
+	for (; swapchain->depth < depth; swapchain->depth++) {
+		if (ops->alloc(data, &swapchain->buffers[swapchain->depth], width, height, format,
+			       modifier)) {
+			swapchain_destroy(swapchain);
+			return NULL;
+		}
+	}
+	swapchain->stats.alloc_ns = _now_ns() - start;
+
+	/* the front buffer is scanned out right away */
+	for (i = 0; i < depth; i++) {
+		if (i && init != SWAPCHAIN_INIT_EAGER) {
+			swapchain->pending[i] = init == SWAPCHAIN_INIT_ACQUIRE ||
+						init == SWAPCHAIN_INIT_BACKGROUND;
+			continue;
+		}
+
+		swapchain->stats.clear_ns += _clear(swapchain, i);
+		swapchain->stats.cleared++;
+	}
+
+	if (init == SWAPCHAIN_INIT_BACKGROUND && depth > 1) {
+		if (pthread_create(&swapchain->thread, NULL, _clear_main, swapchain))
+			/* swapchain_acquire() clears them itself */
+			swapchain->init = SWAPCHAIN_INIT_ACQUIRE;
+		else
+			swapchain->thread_running = true;
+	}
+
+	swapchain->states[0] = SWAPCHAIN_PRESENTED;
+	swapchain->next = 1 % depth;
+	return swapchain;
+}
+
+void swapchain_destroy(struct swapchain *swapchain)
+{
+	unsigned i;
+
+	if (!swapchain)
+		return;
+
+	if (swapchain->thread_running) {
+		pthread_mutex_lock(&swapchain->lock);
+		swapchain->quit = true;
+		pthread_mutex_unlock(&swapchain->lock);
+		pthread_join(swapchain->thread, NULL);
+	}
+
+	for (i = 0; i < swapchain->depth; i++)
+		swapchain->ops->free(swapchain->data, &swapchain->buffers[i]);
+	pthread_cond_destroy(&swapchain->cleared_cond);
+	pthread_mutex_destroy(&swapchain->lock);
+	free(swapchain);
+}
+
+void swapchain_stats_get(struct swapchain *swapchain, struct swapchain_stats *stats)
+{
+	pthread_mutex_lock(&swapchain->lock);
+	*stats = swapchain->stats;
+	pthread_mutex_unlock(&swapchain->lock);
+}
+
+/* index is acquired, make sure its first content is there */
+static void _first_acquire(struct swapchain *swapchain, unsigned index)
+{
+	uint64_t start = _now_ns();
+
+	swapchain->pending[index] = false;
+	if (swapchain->init == SWAPCHAIN_INIT_ACQUIRE) {
+		_clear(swapchain, index);
+		pthread_mutex_lock(&swapchain->lock);
+		swapchain->stats.cleared++;
+		swapchain->stats.acquire_ns += _now_ns() - start;
+		pthread_mutex_unlock(&swapchain->lock);
+		return;
+	}
+
+	pthread_mutex_lock(&swapchain->lock);
+	while (!swapchain->cleared[index])
+		pthread_cond_wait(&swapchain->cleared_cond, &swapchain->lock);
+	swapchain->stats.acquire_ns += _now_ns() - start;
+	pthread_mutex_unlock(&swapchain->lock);
+}
+
+unsigned swapchain_depth(const struct swapchain *swapchain)
+{
+	return swapchain->depth;
+}
+
+struct modeset_buf *swapchain_buffer(struct swapchain *swapchain, unsigned index)
+{
+	return index < swapchain->depth ? &swapchain->buffers[index] : NULL;
+}
+
+enum swapchain_state swapchain_state_get(const struct swapchain *swapchain,
+					 const struct modeset_buf *buf)
+{
+	return swapchain->states[_index(swapchain, buf)];
+}
+
+struct modeset_buf *swapchain_front(struct swapchain *swapchain)
+{
+	return &swapchain->buffers[swapchain->front];
+}
+
+struct modeset_buf *swapchain_acquire(struct swapchain *swapchain)
+{
+	unsigned i;
+
+	for (i = 0; i < swapchain->depth; i++) {
+		unsigned index = (swapchain->next + i) % swapchain->depth;
+
+		if (swapchain->states[index] != SWAPCHAIN_FREE)
+			continue;
+
+		swapchain->states[index] = SWAPCHAIN_ACQUIRED;
+		swapchain->next = (index + 1) % swapchain->depth;
+		if (swapchain->pending[index])
+			_first_acquire(swapchain, index);
+		return &swapchain->buffers[index];
+	}
+
+	return NULL;
+}
+
+struct modeset_buf *swapchain_present(struct swapchain *swapchain, struct modeset_buf *buf,
+				      const struct damage *frame)
+{
+	unsigned index = _index(swapchain, buf), front = swapchain->front;
+
+	if (swapchain->states[index] != SWAPCHAIN_ACQUIRED)
+		return NULL;
+
+	swapchain->states[index] = SWAPCHAIN_PRESENTED;
+	swapchain->front = index;
+	if (frame)
+		damage_buffers_swap(swapchain->buffers, swapchain->depth, buf, frame);
+
+	return &swapchain->buffers[front];
+}
+
+int swapchain_release(struct swapchain *swapchain, struct modeset_buf *buf)
+{
+	unsigned index = _index(swapchain, buf);
+
+	if (index == swapchain->front || swapchain->states[index] == SWAPCHAIN_FREE)
+		return -EINVAL;
+
+	swapchain->states[index] = SWAPCHAIN_FREE;
+	return 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+#include "damage.h"
+
+/*
+ * Ring of 1 to SWAPCHAIN_MAX_DEPTH framebuffers of one size and format.
+ *
+ * Every buffer is in one of three states: free, acquired by the renderer
+ * or presented. swapchain_acquire() hands out the free buffers in ring
+ * order, so the least recently presented one is drawn into first.
+ * swapchain_present() makes an acquired buffer the front buffer and
+ * returns the one it replaces. That one stays presented, it may still be
+ * scanned out, until swapchain_release() once its replacement is on
+ * screen.
+ *
+ * The first buffer starts as the front buffer. A depth 1 swapchain is for
+ * front buffer rendering, nothing can be acquired and swapchain_front() is
+ * drawn into directly.
+ *
+ * Only the front buffer is cleared to SWAPCHAIN_CLEAR by
+ * swapchain_create(), it is what the modeset scans out. When the back
+ * buffers are cleared depends on the swapchain_init policy, see common.h.
+ */
+
+#define SWAPCHAIN_MAX_DEPTH 4
+#define SWAPCHAIN_CLEAR 0x77
+
+struct swapchain_stats {
+	/* swapchain_create() allocating the buffers and clearing them */
+	uint64_t alloc_ns;
+	uint64_t clear_ns;
+	/* swapchain_acquire() clearing a buffer or waiting for the thread */
+	uint64_t acquire_ns;
+	/* the background thread clearing */
+	uint64_t background_ns;
+	unsigned cleared;
+};
+
+enum swapchain_state {
+	SWAPCHAIN_FREE,
+	SWAPCHAIN_ACQUIRED,
+	SWAPCHAIN_PRESENTED,
+};
+
+struct swapchain;
+struct scene_buffer_ops;
+
+/* Buffers come from ops, the same allocator interface scene_cache uses */
+struct swapchain *swapchain_create(unsigned depth, uint32_t width, uint32_t height,
+				   uint32_t format, uint64_t modifier, enum swapchain_init init,
+				   const struct scene_buffer_ops *ops, void *data);
+void swapchain_destroy(struct swapchain *swapchain);
+
+/* The background thread may still be clearing, the counts can grow */
+void swapchain_stats_get(struct swapchain *swapchain, struct swapchain_stats *stats);
+
+unsigned swapchain_depth(const struct swapchain *swapchain);
+/* Direct access, with SWAPCHAIN_INIT_BACKGROUND the thread may still be clearing it */
+struct modeset_buf *swapchain_buffer(struct swapchain *swapchain, unsigned index);
+enum swapchain_state swapchain_state_get(const struct swapchain *swapchain,
+					 const struct modeset_buf *buf);
+
+/* Last presented buffer */
+struct modeset_buf *swapchain_front(struct swapchain *swapchain);
+
+/*
+ * Next free buffer to render into, NULL when none is free. The first time
+ * a buffer is handed out it may be cleared or waited for, see
+ * swapchain_init.
+ */
+struct modeset_buf *swapchain_acquire(struct swapchain *swapchain);
+
+/*
+ * buf, which must be acquired, becomes the front buffer. frame is the
+ * damage of this frame for the buffer ages (see damage.h), NULL when the
+ * buffers are not rendered from damage. Returns the previous front buffer,
+ * still presented until released.
+ */
+struct modeset_buf *swapchain_present(struct swapchain *swapchain, struct modeset_buf *buf,
+				      const struct damage *frame);
+
+/*
+ * The display is done with buf, a presented buffer that is not the front
+ * one anymore, or the renderer gives back an acquired buffer without
+ * presenting it. Returns -EINVAL for the front buffer or a free one.
+ */
+int swapchain_release(struct swapchain *swapchain, struct modeset_buf *buf);
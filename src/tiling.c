@@ -0,0 +1,204 @@
+#include "tiling.h"
+
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "fill.h"
+
+/*
+ * Both tile formats are a set of columns of chunk bytes x height rows, the
+ * rows of a column are consecutive in memory and the columns follow each
+ * other. X tiles have a single 512 bytes wide column, Y tiles have 8
+ * columns of 16 bytes.
+ */
+#define TILE_COLUMN_OFFSET(height, chunk, c, r) ((c) * (height) * (chunk) + (r) * (chunk))
+
+static inline uint32_t _min(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline uint32_t _max(uint32_t a, uint32_t b)
+{
+	return a > b ? a : b;
+}
+
+int tiling_tile_size(uint64_t modifier, uint32_t *width, uint32_t *height)
+{
+	switch (modifier) {
+	case I915_FORMAT_MOD_X_TILED:
+		*width = X_TILE_WIDTH;
+		*height = X_TILE_HEIGHT;
+		return 0;
+	case I915_FORMAT_MOD_Y_TILED:
+		*width = Y_TILE_WIDTH;
+		*height = Y_TILE_HEIGHT;
+		return 0;
+	default:
+		*width = *height = 0;
+		return -1;
+	}
+}
+
+uint32_t tiling_offset(uint64_t modifier, uint32_t stride, uint32_t x_bytes, uint32_t y)
+{
+	switch (modifier) {
+	case I915_FORMAT_MOD_X_TILED:
+		return (y / X_TILE_HEIGHT) * stride * X_TILE_HEIGHT +
+		       (x_bytes / X_TILE_WIDTH) * TILE_SIZE +
+		       (y % X_TILE_HEIGHT) * X_TILE_WIDTH +
+		       x_bytes % X_TILE_WIDTH;
+	case I915_FORMAT_MOD_Y_TILED:
+		return (y / Y_TILE_HEIGHT) * stride * Y_TILE_HEIGHT +
+		       (x_bytes / Y_TILE_WIDTH) * TILE_SIZE +
+		       ((x_bytes % Y_TILE_WIDTH) / Y_TILE_COLUMN_WIDTH) * Y_TILE_COLUMN_WIDTH * Y_TILE_HEIGHT +
+		       (y % Y_TILE_HEIGHT) * Y_TILE_COLUMN_WIDTH +
+		       x_bytes % Y_TILE_COLUMN_WIDTH;
+	default:
+		return y * stride + x_bytes;
+	}
+}
+
+/*
+ * Always inlined with constant tile sizes so the chunk copies become
+ * plain vector loads and stores.
+ */
+static inline __attribute__((always_inline))
+void _convert(uint8_t *tiled, uint32_t tiled_stride, uint8_t *linear, uint32_t linear_stride,
+	      uint32_t width_bytes, uint32_t height, bool to_tiled,
+	      const uint32_t tile_width, const uint32_t tile_height, const uint32_t chunk)
+{
+	uint32_t tx, ty, c, r;
+
+	for (ty = 0; ty * tile_height < height; ty++) {
+		uint32_t rows = _min(tile_height, height - ty * tile_height);
+
+		for (tx = 0; tx * tile_width < width_bytes; tx++) {
+			uint8_t *tile = tiled + ty * tile_height * tiled_stride + tx * TILE_SIZE;
+
+			for (c = 0; c < tile_width / chunk; c++) {
+				uint32_t x = tx * tile_width + c * chunk;
+				uint8_t *l = linear + ty * tile_height * linear_stride + x;
+				uint8_t *t = tile + TILE_COLUMN_OFFSET(tile_height, chunk, c, 0);
+
+				if (x >= width_bytes)
+					break;
+
+				if (width_bytes - x >= chunk) {
+					for (r = 0; r < rows; r++, l += linear_stride, t += chunk) {
+						if (to_tiled)
+							memcpy(t, l, chunk);
+						else
+							memcpy(l, t, chunk);
+					}
+				} else {
+					uint32_t len = width_bytes - x;
+
+					for (r = 0; r < rows; r++, l += linear_stride, t += chunk) {
+						if (to_tiled)
+							memcpy(t, l, len);
+						else
+							memcpy(l, t, len);
+					}
+				}
+			}
+		}
+	}
+}
+
+static int _convert_modifier(uint64_t modifier, uint8_t *tiled, uint32_t tiled_stride,
+			     uint8_t *linear, uint32_t linear_stride,
+			     uint32_t width_bytes, uint32_t height, bool to_tiled)
+{
+	switch (modifier) {
+	case I915_FORMAT_MOD_X_TILED:
+		if (tiled_stride % X_TILE_WIDTH)
+			return -1;
+		_convert(tiled, tiled_stride, linear, linear_stride, width_bytes, height, to_tiled,
+			 X_TILE_WIDTH, X_TILE_HEIGHT, X_TILE_WIDTH);
+		return 0;
+	case I915_FORMAT_MOD_Y_TILED:
+		if (tiled_stride % Y_TILE_WIDTH)
+			return -1;
+		_convert(tiled, tiled_stride, linear, linear_stride, width_bytes, height, to_tiled,
+			 Y_TILE_WIDTH, Y_TILE_HEIGHT, Y_TILE_COLUMN_WIDTH);
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+int tiling_linear_to_tiled(uint64_t modifier, uint8_t *dst, uint32_t dst_stride,
+			   const uint8_t *src, uint32_t src_stride,
+			   uint32_t width_bytes, uint32_t height)
+{
+	return _convert_modifier(modifier, dst, dst_stride, (uint8_t *)src, src_stride,
+				 width_bytes, height, true);
+}
+
+int tiling_tiled_to_linear(uint64_t modifier, uint8_t *dst, uint32_t dst_stride,
+			   const uint8_t *src, uint32_t src_stride,
+			   uint32_t width_bytes, uint32_t height)
+{
+	return _convert_modifier(modifier, (uint8_t *)src, src_stride, dst, dst_stride,
+				 width_bytes, height, false);
+}
+
+void tiling_fill_plane(struct modeset_buf *buf, unsigned plane, uint32_t x_bytes, uint32_t y,
+		       uint32_t w_bytes, uint32_t h, uint32_t pattern)
+{
+	uint32_t tile_width, tile_height, chunk, tx, ty, c, r;
+	uint32_t x0 = x_bytes, x1 = x_bytes + w_bytes, y1 = y + h;
+	uint32_t stride = buf->pitches[plane] ? buf->pitches[plane] : buf->stride;
+	uint8_t *map = buf->map + buf->offsets[plane];
+	fill_span_func tile_fill, column_fill;
+
+	if (tiling_tile_size(buf->modifier, &tile_width, &tile_height) || !w_bytes || !h)
+		return;
+	chunk = buf->modifier == I915_FORMAT_MOD_Y_TILED ? Y_TILE_COLUMN_WIDTH : X_TILE_WIDTH;
+	tile_fill = fill_span_func_get(buf, TILE_SIZE / 4);
+	column_fill = fill_span_func_get(buf, tile_height * chunk / 4);
+
+	for (ty = y / tile_height; ty * tile_height < y1; ty++) {
+		uint32_t r0 = _max(y, ty * tile_height) - ty * tile_height;
+		uint32_t r1 = _min(y1, (ty + 1) * tile_height) - ty * tile_height;
+
+		for (tx = x0 / tile_width; tx * tile_width < x1; tx++) {
+			uint8_t *tile = map + ty * tile_height * stride + tx * TILE_SIZE;
+			uint32_t b0 = _max(x0, tx * tile_width) - tx * tile_width;
+			uint32_t b1 = _min(x1, (tx + 1) * tile_width) - tx * tile_width;
+
+			/* whole tile, one 4KiB span */
+			if (b0 == 0 && b1 == tile_width && r0 == 0 && r1 == tile_height) {
+				tile_fill((uint32_t *)tile, TILE_SIZE / 4, pattern);
+				continue;
+			}
+
+			for (c = b0 / chunk; c * chunk < b1; c++) {
+				uint32_t c0 = _max(b0, c * chunk), c1 = _min(b1, (c + 1) * chunk);
+				uint8_t *column = tile + TILE_COLUMN_OFFSET(tile_height, chunk, c, 0);
+
+				/* full column width, the rows are consecutive */
+				if (c0 == c * chunk && c1 == (c + 1) * chunk) {
+					column_fill((uint32_t *)(column + r0 * chunk),
+						    (r1 - r0) * chunk / 4, pattern);
+					continue;
+				}
+
+				for (r = r0; r < r1; r++)
+					fill_bytes(fill_span, column + r * chunk + c0 - c * chunk,
+						   c1 - c0, pattern);
+			}
+		}
+	}
+
+	if (buf->map_wc)
+		fill_flush();
+}
+
+void tiling_fill_rect(struct modeset_buf *buf, uint32_t x, uint32_t y,
+		      uint32_t w, uint32_t h, uint32_t color)
+{
+	tiling_fill_plane(buf, 0, x * 4, y, w * 4, h, color);
+}
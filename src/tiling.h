@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * CPU side tiling for Intel X and Y tiled surfaces, no bit 6 swizzling.
+ *
+ * Both tiles are 4KiB: X tiles are 512 bytes x 8 rows stored row by row,
+ * Y tiles are 128 bytes x 32 rows stored as 8 columns of 16 bytes x 32
+ * rows. Tiles are laid out row major, so stride must be a multiple of the
+ * tile width.
+ */
+
+#define TILE_SIZE 4096
+
+#define X_TILE_WIDTH 512
+#define X_TILE_HEIGHT 8
+#define Y_TILE_WIDTH 128
+#define Y_TILE_HEIGHT 32
+#define Y_TILE_COLUMN_WIDTH 16
+
+/*
+ * Tile width in bytes and height in rows of a modifier. Returns 0, or -1
+ * with both set to 0 if the modifier is not supported.
+ */
+int tiling_tile_size(uint64_t modifier, uint32_t *width, uint32_t *height);
+
+/*
+ * Reference address swizzle: offset of byte x_bytes of row y in a tiled
+ * surface. Slow, meant to validate the converters.
+ */
+uint32_t tiling_offset(uint64_t modifier, uint32_t stride, uint32_t x_bytes, uint32_t y);
+
+/*
+ * Convert width_bytes x height from a linear to a tiled surface and back.
+ * Linear to tiled writes each destination tile completely before moving
+ * to the next one, so writes into a WC mapping are sequential. Tiled to
+ * linear reads the source a tile at a time.
+ */
+int tiling_linear_to_tiled(uint64_t modifier, uint8_t *dst, uint32_t dst_stride,
+			   const uint8_t *src, uint32_t src_stride,
+			   uint32_t width_bytes, uint32_t height);
+int tiling_tiled_to_linear(uint64_t modifier, uint8_t *dst, uint32_t dst_stride,
+			   const uint8_t *src, uint32_t src_stride,
+			   uint32_t width_bytes, uint32_t height);
+
+/*
+ * fill_rect() for buffers mapped with their raw tiled layout, rect must
+ * already be clipped to the buffer.
+ */
+void tiling_fill_rect(struct modeset_buf *buf, uint32_t x, uint32_t y,
+		      uint32_t w, uint32_t h, uint32_t color);
+
+/*
+ * tiling_fill_rect() of one plane of any format, x and w in bytes. pattern
+ * is repeated every 4 bytes, x must be aligned to its period.
+ */
+void tiling_fill_plane(struct modeset_buf *buf, unsigned plane, uint32_t x_bytes, uint32_t y,
+		       uint32_t w_bytes, uint32_t h, uint32_t pattern);